@@ -0,0 +1,87 @@
+/**
+ *  Benchmark of text logging, compared with formatting the same records with
+ *  stdio like earlier releases did.
+ *
+ *  Usage: hb-log-bench [heartbeats]
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "heartbeat-acc-pow.h"
+#include "heartbeat-time.h"
+
+#define WINDOW_SIZE 100
+
+static int null_fd;
+
+// Formats a window the way earlier releases did
+static void stdio_window_complete(const heartbeat_acc_pow_context* hb) {
+  const heartbeat_acc_pow_record* rec;
+  FILE* log = fdopen(dup(null_fd), "w");
+  uint64_t i;
+  if (log == NULL) {
+    return;
+  }
+  for (i = 0; i < WINDOW_SIZE; i++) {
+    rec = &hb->window_buffer[i];
+    fprintf(log,
+            "%-6"PRIu64" %-6"PRIu64
+            " %-11"PRIu64" %-11"PRIu64" %-11"PRIu64
+            " %-15"PRIu64" %-15"PRIu64" %-20"PRIu64" %-20"PRIu64
+            " %-15.6f %-15.6f %-15.6f"
+            " %-11"PRIu64" %-11"PRIu64" %-11"PRIu64
+            " %-16.6f %-16.6f %-16.6f"
+            " %-15"PRIu64" %-15"PRIu64" %-15"PRIu64" %-15"PRIu64
+            " %-15.6f %-15.6f %-15.6f"
+            "\n",
+            rec->id, rec->user_tag,
+            rec->wd.global, rec->wd.window, rec->work,
+            rec->td.global, rec->td.window, rec->start_time, rec->end_time,
+            rec->perf.global, rec->perf.window, rec->perf.instant,
+            rec->ad.global, rec->ad.window, rec->accuracy,
+            rec->acc.global, rec->acc.window, rec->acc.instant,
+            rec->ed.global, rec->ed.window, rec->start_energy, rec->end_energy,
+            rec->pwr.global, rec->pwr.window, rec->pwr.instant);
+  }
+  fclose(log);
+}
+
+// Returns the mean time per heartbeat in nanoseconds
+static double run(uint64_t heartbeats, int log_fd, heartbeat_acc_pow_window_complete* hwc_callback) {
+  heartbeat_acc_pow_record window_buffer[WINDOW_SIZE];
+  heartbeat_acc_pow_context hb;
+  uint64_t time = 1000000000;
+  uint64_t energy = 1000000;
+  uint64_t start;
+  uint64_t i;
+  heartbeat_acc_pow_init(&hb, WINDOW_SIZE, window_buffer, log_fd, hwc_callback);
+  start = hb_time_now();
+  for (i = 0; i < heartbeats; i++) {
+    // vary the values so the rates have fractional parts
+    heartbeat_acc_pow(&hb, i, 1 + i % 3, time, time + 1000 + i % 7, i % 5, energy, energy + 13 + i % 11);
+    time += 1000 + i % 7;
+    energy += 13 + i % 11;
+  }
+  return (double) (hb_time_now() - start) / (double) heartbeats;
+}
+
+int main(int argc, char** argv) {
+  uint64_t heartbeats = argc > 1 ? strtoull(argv[1], NULL, 0) : 2000000;
+  double none, text, stdio;
+  if (heartbeats == 0 || (null_fd = open("/dev/null", O_WRONLY)) < 0) {
+    fprintf(stderr, "Usage: %s [heartbeats]\n", argv[0]);
+    return 1;
+  }
+  none = run(heartbeats, -1, NULL);
+  text = run(heartbeats, null_fd, NULL);
+  stdio = run(heartbeats, -1, &stdio_window_complete);
+  printf("heartbeats: %"PRIu64", window size: %d\n", heartbeats, WINDOW_SIZE);
+  printf("no logging:    %10.1f ns/heartbeat\n", none);
+  printf("text logging:  %10.1f ns/heartbeat\n", text);
+  printf("stdio logging: %10.1f ns/heartbeat\n", stdio);
+  close(null_fd);
+  return 0;
+}
@@ -19,33 +19,7 @@ static void window_complete(const heartbeat_pow_context* hb) {
   UNUSED(hb);
 }
 
-// A real implementation might use one of the following time functions:
-/*
-#ifdef __MACH__
-#include <mach/clock.h>
-#include <mach/mach.h>
-#include <time.h>
-#include <sys/time.h>
-static uint64_t get_time(void) {
-  // OS X does not have clock_gettime, use clock_get_time
-  clock_serv_t cclock;
-  mach_timespec_t mts;
-  host_get_clock_service(mach_host_self(), CALENDAR_CLOCK, &cclock);
-  clock_get_time(cclock, &mts);
-  mach_port_deallocate(mach_task_self(), cclock);
-  return mts.tv_sec * 1000000000 + mts.tv_nsec;
-}
-#else
-#include <time.h>
-#include <sys/time.h>
-static uint64_t get_time(void) {
-  // may require dependency on librt, depending on system
-  struct timespec ts;
-  clock_gettime(CLOCK_REALTIME, &ts);
-  return ts.tv_sec * 1000000000 + ts.tv_nsec;
-}
-#endif
-*/
+// A real implementation might use hb_time_now() from heartbeat-time.h
 
 /*
  * Simulate time/energy readings.
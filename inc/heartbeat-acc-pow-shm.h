@@ -0,0 +1,88 @@
+/**
+ * Heartbeats in a named shared-memory region, so external processes can read
+ * the latest record without any system calls, using heartbeat-shm-reader.h.
+ * The region holds a header, the heartbeat context, and its window buffer.
+ *
+ * If the name begins with '/' and contains no other '/', the region is a
+ * POSIX shared-memory object, e.g., in /dev/shm on Linux. Otherwise, the name
+ * is the path of a memory-mapped file.
+ *
+ * This version is for heartbeat-acc-pow.h.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HEARTBEAT_ACC_POW_SHM_H
+#define _HEARTBEAT_ACC_POW_SHM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include "heartbeat-acc-pow.h"
+
+typedef struct heartbeat_acc_pow_shm_context {
+  // the heartbeat context in the region, to be used with the heartbeat functions
+  heartbeat_acc_pow_context* hb;
+  heartbeat_shm_region region;
+} heartbeat_acc_pow_shm_context;
+
+/**
+ * Create the region and initialize the heartbeat context in it.
+ * An existing region with the same name is only replaced if its writer
+ * process no longer exists, so readers that still have it mapped are not
+ * affected.
+ * Fails if hs or name is NULL, window_size is 0, or flags are not valid
+ * (errno is set to EINVAL), if name is too long (errno is set to
+ * ENAMETOOLONG), if another region or file exists with the name (errno is
+ * set to EEXIST), or if the region cannot be created and mapped.
+ * Not supported on Windows (errno is set to ENOSYS).
+ *
+ * @param hs
+ * @param name
+ * @param window_size
+ * @param log_fd
+ * @param hwc_callback
+ * @param flags
+ * @return 0 on success, another value otherwise
+ */
+int heartbeat_acc_pow_shm_init(heartbeat_acc_pow_shm_context* hs,
+                               const char* name,
+                               uint64_t window_size,
+                               int log_fd,
+                               heartbeat_acc_pow_window_complete* hwc_callback,
+                               uint32_t flags);
+
+/**
+ * Create a region with a generated name, so it can be discovered by monitors
+ * like hb-top: HEARTBEAT_SHM_REGISTRY_PREFIX, the process ID, and a counter,
+ * e.g., "/heartbeats-1234-0". The name is available in hs->region.name.
+ * Fails for the same reasons as heartbeat_acc_pow_shm_init().
+ *
+ * @param hs
+ * @param window_size
+ * @param log_fd
+ * @param hwc_callback
+ * @param flags
+ * @return 0 on success, another value otherwise
+ */
+int heartbeat_acc_pow_shm_register(heartbeat_acc_pow_shm_context* hs,
+                                   uint64_t window_size,
+                                   int log_fd,
+                                   heartbeat_acc_pow_window_complete* hwc_callback,
+                                   uint32_t flags);
+
+/**
+ * Unmap and unlink the region.
+ * The heartbeat context must not be used afterward, so finish asynchronous
+ * logging first, if it was started.
+ *
+ * @param hs
+ */
+void heartbeat_acc_pow_shm_finish(heartbeat_acc_pow_shm_context* hs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,73 @@
+/**
+ * Scoped heartbeats, where the library reads the start and end time of each
+ * heartbeat itself, using hb_time_now().
+ * The end readings of a heartbeat are reused as the start readings of the
+ * next one, so back-to-back heartbeats only need one set of readings each.
+ *
+ * A scope must only be used by one thread at a time, but multiple scopes may
+ * share a heartbeat context.
+ *
+ * This version is for heartbeat-acc.h.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HEARTBEAT_ACC_SCOPE_H
+#define _HEARTBEAT_ACC_SCOPE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include "heartbeat-acc.h"
+#include "heartbeat-time.h"
+
+typedef struct heartbeat_acc_scope {
+  heartbeat_acc_context* hb;
+  uint64_t start_time;
+} heartbeat_acc_scope;
+
+/**
+ * Initialize a scope for a heartbeat context and begin the first heartbeat.
+ * Fails if hs or hb is NULL, in which case errno is set to EINVAL.
+ *
+ * @param hs
+ * @param hb
+ * @return 0 on success, another value otherwise
+ */
+int heartbeat_acc_scope_init(heartbeat_acc_scope* hs,
+                             heartbeat_acc_context* hb);
+
+/**
+ * Begin a heartbeat by taking new start readings.
+ * Only needed to exclude the time since the last heartbeat ended, e.g., when
+ * the application was idle.
+ * Fails if hs is NULL, in which case errno is set to EINVAL.
+ *
+ * @param hs
+ * @return 0 on success, another value otherwise
+ */
+int hb_acc_begin(heartbeat_acc_scope* hs);
+
+/**
+ * End a heartbeat by taking end readings and registering the heartbeat.
+ * The next heartbeat begins with the same readings.
+ * Fails if hs is NULL, in which case errno is set to EINVAL. The heartbeat is
+ * not registered on failure.
+ *
+ * @param hs
+ * @param user_tag
+ * @param work
+ * @param accuracy
+ * @return 0 on success, another value otherwise
+ */
+int hb_acc_end(heartbeat_acc_scope* hs,
+               uint64_t user_tag,
+               uint64_t work,
+               uint64_t accuracy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -12,6 +12,98 @@ extern "C" {
 
 #include <inttypes.h>
 
+/**
+ * Context flags, combined with bitwise OR when initializing a heartbeat.
+ *
+ * HEARTBEAT_FLAG_LOCK_FREE: Producers reserve a window buffer slot with an
+ * atomic increment of the heartbeat counter and publish without taking the
+ * context lock. Cumulative data is maintained with atomic additions.
+ * Producers only wait at window boundaries, while the completed window is
+ * logged and the window complete callback runs.
+ * Records and snapshots are exact, but the context's own window data (e.g.,
+ * from hb_get_window_work()) is approximate while producers run, since it's
+ * set by whichever producer published last, which may not have the latest
+ * heartbeat.
+ */
+#define HEARTBEAT_FLAG_LOCK_FREE 0x1
+
+/**
+ * HEARTBEAT_FLAG_SINGLE_WRITER: The context is only ever updated by one
+ * thread, so heartbeats are issued without taking the context lock.
+ * Cannot be combined with HEARTBEAT_FLAG_LOCK_FREE.
+ */
+#define HEARTBEAT_FLAG_SINGLE_WRITER 0x2
+
+/**
+ * HEARTBEAT_FLAG_LAZY_RATES: Heartbeats only record raw data, and rates are
+ * computed when they are read - by getters, snapshots, and logging - or for
+ * the whole window buffer just before the window complete callback.
+ * Otherwise, rates fields in window buffer records are not populated.
+ */
+#define HEARTBEAT_FLAG_LAZY_RATES 0x4
+
+/**
+ * HEARTBEAT_FLAG_LOG_BINARY: Completed windows are logged in the binary log
+ * format instead of as text. The log should begin with a binary header.
+ */
+#define HEARTBEAT_FLAG_LOG_BINARY 0x8
+
+/**
+ * HEARTBEAT_FLAG_LOG_COMPRESSED: Binary logs contain compressed blocks of
+ * records instead of raw records (see hb_log_decode_block()).
+ * Requires HEARTBEAT_FLAG_LOG_BINARY.
+ */
+#define HEARTBEAT_FLAG_LOG_COMPRESSED 0x10
+
+/**
+ * HEARTBEAT_FLAG_HISTOGRAM_WINDOW: The context's histogram (see
+ * hb_set_histogram()) is reset when each window completes, after the window
+ * complete callback, so it only holds the current window's durations.
+ */
+#define HEARTBEAT_FLAG_HISTOGRAM_WINDOW 0x20
+
+/* Log formats for text logging (see hb_set_log_format()) */
+#define HEARTBEAT_LOG_FORMAT_TEXT 0
+#define HEARTBEAT_LOG_FORMAT_CSV 1
+#define HEARTBEAT_LOG_FORMAT_JSONL 2
+
+/**
+ * Log columns, combined with bitwise OR to select the columns that are logged.
+ * Columns that the heartbeat variant doesn't have are ignored.
+ */
+#define HEARTBEAT_LOG_COL_ID 0x1
+#define HEARTBEAT_LOG_COL_TAG 0x2
+#define HEARTBEAT_LOG_COL_GLOBAL_WORK 0x4
+#define HEARTBEAT_LOG_COL_WINDOW_WORK 0x8
+#define HEARTBEAT_LOG_COL_WORK 0x10
+#define HEARTBEAT_LOG_COL_GLOBAL_TIME 0x20
+#define HEARTBEAT_LOG_COL_WINDOW_TIME 0x40
+#define HEARTBEAT_LOG_COL_START_TIME 0x80
+#define HEARTBEAT_LOG_COL_END_TIME 0x100
+#define HEARTBEAT_LOG_COL_GLOBAL_PERF 0x200
+#define HEARTBEAT_LOG_COL_WINDOW_PERF 0x400
+#define HEARTBEAT_LOG_COL_INSTANT_PERF 0x800
+#define HEARTBEAT_LOG_COL_GLOBAL_ACC 0x1000
+#define HEARTBEAT_LOG_COL_WINDOW_ACC 0x2000
+#define HEARTBEAT_LOG_COL_ACC 0x4000
+#define HEARTBEAT_LOG_COL_GLOBAL_ACC_RATE 0x8000
+#define HEARTBEAT_LOG_COL_WINDOW_ACC_RATE 0x10000
+#define HEARTBEAT_LOG_COL_INSTANT_ACC_RATE 0x20000
+#define HEARTBEAT_LOG_COL_GLOBAL_ENERGY 0x40000
+#define HEARTBEAT_LOG_COL_WINDOW_ENERGY 0x80000
+#define HEARTBEAT_LOG_COL_START_ENERGY 0x100000
+#define HEARTBEAT_LOG_COL_END_ENERGY 0x200000
+#define HEARTBEAT_LOG_COL_GLOBAL_PWR 0x400000
+#define HEARTBEAT_LOG_COL_WINDOW_PWR 0x800000
+#define HEARTBEAT_LOG_COL_INSTANT_PWR 0x1000000
+#define HEARTBEAT_LOG_COL_ALL 0x1ffffff
+
+#define HEARTBEAT_CACHE_LINE_SIZE 64
+
+/* Size of a padded shard, which leaves at least one cache line between shards */
+#define HEARTBEAT_SHARD_SIZE(type) \
+  (((sizeof(type) + HEARTBEAT_CACHE_LINE_SIZE - 1) / HEARTBEAT_CACHE_LINE_SIZE + 1) * HEARTBEAT_CACHE_LINE_SIZE)
+
 typedef struct heartbeat_udata {
   uint64_t global;
   uint64_t window;
@@ -23,11 +115,141 @@ typedef struct heartbeat_rates {
   double instant;
 } heartbeat_rates;
 
+/* Statistics for a rate over the records in a window */
+typedef struct heartbeat_window_stats {
+  // records with a finite rate, which the other values are computed from
+  uint64_t count;
+  double min;
+  double max;
+  double mean;
+  // population variance
+  double variance;
+  // nearest-rank percentiles
+  double p50;
+  double p90;
+  double p99;
+} heartbeat_window_stats;
+
+/* Binary log format identification */
+#define HEARTBEAT_BIN_MAGIC "HBLG"
+#define HEARTBEAT_BIN_VERSION 1
+#define HEARTBEAT_BIN_BYTE_ORDER 0x01020304
+
+/* Heartbeat variants in the binary log header */
+#define HEARTBEAT_BIN_MODE_HB 0
+#define HEARTBEAT_BIN_MODE_ACC 1
+#define HEARTBEAT_BIN_MODE_POW 2
+#define HEARTBEAT_BIN_MODE_ACC_POW 3
+
+/**
+ * A binary log is this header followed by raw records in the writer's byte
+ * order. Records only contain 64-bit fields.
+ * If flags contains HEARTBEAT_FLAG_LAZY_RATES, record rates are not populated.
+ * If flags contains HEARTBEAT_FLAG_LOG_COMPRESSED, the header is followed by
+ * compressed blocks instead, which don't depend on byte order, and decoded
+ * records always have rates populated.
+ */
+typedef struct heartbeat_bin_header {
+  char magic[4];
+  // HEARTBEAT_BIN_BYTE_ORDER in the writer's byte order
+  uint32_t byte_order;
+  uint16_t version;
+  uint16_t mode;
+  uint32_t flags;
+  uint32_t record_size;
+  uint32_t reserved;
+  uint64_t window_size;
+} heartbeat_bin_header;
+
+/* Maximum size of a compressed block of count records of a given size */
+#define HEARTBEAT_LOG_BLOCK_MAX(count, record_size) (20 + (count) * ((record_size) / 8) * 10)
+
+/* Shared-memory region identification */
+#define HEARTBEAT_SHM_MAGIC "HBSM"
+#define HEARTBEAT_SHM_VERSION 1
+
+/* Name prefix of registered regions, which monitors look for in /dev/shm */
+#define HEARTBEAT_SHM_REGISTRY_PREFIX "/heartbeats-"
+
+/* Maximum length of a shared-memory region name, including the terminator */
+#define HEARTBEAT_SHM_NAME_MAX 256
+
+/**
+ * A shared-memory region begins with this header, followed by a heartbeat
+ * context and its window buffer at the given offsets.
+ * The mode is a HEARTBEAT_BIN_MODE_* value.
+ * The magic value is written last, once the context is initialized.
+ */
+typedef struct heartbeat_shm_header {
+  char magic[4];
+  uint32_t version;
+  uint32_t mode;
+  uint32_t record_size;
+  uint32_t context_size;
+  uint32_t reserved;
+  uint64_t window_size;
+  uint64_t context_offset;
+  uint64_t buffer_offset;
+  uint64_t size;
+  // process ID of the writer
+  int64_t pid;
+} heartbeat_shm_header;
+
+/* A shared-memory region mapped by its writer */
+typedef struct heartbeat_shm_region {
+  void* addr;
+  uint64_t size;
+  char name[HEARTBEAT_SHM_NAME_MAX];
+} heartbeat_shm_region;
+
+/* A shared-memory region mapped read-only by a reader */
+typedef struct heartbeat_shm_reader {
+  const heartbeat_shm_header* header;
+  uint64_t size;
+} heartbeat_shm_reader;
+
+/* Statistics for asynchronous window logging */
+typedef struct heartbeat_async_log_stats {
+  // windows copied into the queue, and windows written by the writer thread
+  uint64_t windows_queued;
+  uint64_t windows_written;
+  uint64_t write_errors;
+  // times a heartbeat waited for space in the queue, and the total wait (ns)
+  uint64_t full_waits;
+  uint64_t full_wait_time;
+  // current and maximum number of windows in the queue, and its capacity
+  uint32_t depth;
+  uint32_t max_depth;
+  uint32_t queue_len;
+} heartbeat_async_log_stats;
+
+struct hb_log_queue;
+struct hb_log_sink;
+struct hb_histogram;
+struct hb_ewma;
+struct hb_rollup;
+
 typedef struct heartbeat_window_state {
   uint64_t buffer_index;
   uint64_t read_index;
   uint64_t window_size;
   int log_fd;
+  uint32_t flags;
+  // HEARTBEAT_LOG_FORMAT_* and HEARTBEAT_LOG_COL_* mask, where 0 is all columns
+  uint32_t log_format;
+  uint32_t log_columns;
+  volatile uint64_t window_count;
+  struct hb_log_queue* async_log;
+  struct hb_log_sink* log_sink;
+  struct hb_histogram* histogram;
+  struct hb_ewma* ewma;
+  struct hb_rollup* rollup;
+  // time-based windows (see hb_set_window_duration()) hold window_len records from first_index
+  uint64_t window_duration;
+  uint64_t first_index;
+  uint64_t window_len;
+  // end time at which the window complete callback is next issued
+  uint64_t deadline;
 } heartbeat_window_state;
 
 #ifdef __cplusplus
@@ -0,0 +1,104 @@
+/**
+ * Energy providers for heartbeat energy readings.
+ * A provider reports the energy (uJ) consumed since it was initialized, so
+ * readings can be used directly as heartbeat start and end energy values.
+ *
+ * Providers are not thread-safe; use one provider per thread, or serialize
+ * reads.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HEARTBEAT_ENERGY_H_
+#define _HEARTBEAT_ENERGY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+
+struct hb_energy_provider;
+
+/* Read the energy (uJ) consumed since the provider was initialized */
+typedef int (hb_energy_provider_read) (struct hb_energy_provider* ep, uint64_t* energy);
+
+/* Release the provider's resources */
+typedef int (hb_energy_provider_finish) (struct hb_energy_provider* ep);
+
+/**
+ * Custom providers set their own functions and state.
+ */
+typedef struct hb_energy_provider {
+  hb_energy_provider_read* read;
+  hb_energy_provider_finish* finish;
+  void* state;
+} hb_energy_provider;
+
+/**
+ * Initialize a provider for the Linux powercap framework.
+ * Reads all top-level Intel RAPL zones (e.g., intel-rapl:0) under root, with
+ * counter overflow handled using each zone's max_energy_range_uj.
+ * Subzones are not read since they are included in their parent zones.
+ * If root is NULL, "/sys/class/powercap" is used.
+ * Fails if ep is NULL (errno is set to EINVAL), if no zones are found (errno
+ * is set to ENOENT), or if files cannot be opened.
+ *
+ * @param ep
+ * @param root
+ * @return 0 on success, another value otherwise
+ */
+int hb_energy_powercap_init(hb_energy_provider* ep, const char* root);
+
+/**
+ * Initialize a provider for Linux hwmon energy sensors.
+ * Reads all energy*_input files (uJ) in hwmon* directories under root.
+ * If root is NULL, "/sys/class/hwmon" is used.
+ * Fails if ep is NULL (errno is set to EINVAL), if no sensors are found
+ * (errno is set to ENOENT), or if files cannot be opened.
+ *
+ * @param ep
+ * @param root
+ * @return 0 on success, another value otherwise
+ */
+int hb_energy_hwmon_init(hb_energy_provider* ep, const char* root);
+
+/**
+ * Initialize a provider for Linux power supplies, e.g., batteries.
+ * Reads energy_now files (uWh) for all supplies under root. Energy is only
+ * consumed while the remaining energy decreases, so charging is ignored.
+ * Readings only change when the supply updates energy_now, which is much less
+ * frequent than for other providers.
+ * If root is NULL, "/sys/class/power_supply" is used.
+ * Fails if ep is NULL (errno is set to EINVAL), if no supplies are found
+ * (errno is set to ENOENT), or if files cannot be opened.
+ *
+ * @param ep
+ * @param root
+ * @return 0 on success, another value otherwise
+ */
+int hb_energy_power_supply_init(hb_energy_provider* ep, const char* root);
+
+/**
+ * Read the energy (uJ) consumed since the provider was initialized.
+ * If ep or energy is NULL, errno is set to EINVAL.
+ *
+ * @param ep
+ * @param energy
+ * @return 0 on success, another value otherwise
+ */
+int hb_energy_read(hb_energy_provider* ep, uint64_t* energy);
+
+/**
+ * Release the provider's resources.
+ * If ep is NULL, errno is set to EINVAL.
+ *
+ * @param ep
+ * @return 0 on success, another value otherwise
+ */
+int hb_energy_finish(hb_energy_provider* ep);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
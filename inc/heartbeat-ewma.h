@@ -0,0 +1,53 @@
+/**
+ * Exponentially weighted moving averages of heartbeat rates, load-average
+ * style: each heartbeat's work, accuracy, energy, and duration are added to
+ * running totals that decay with the time since the previous heartbeat, for
+ * one or more time constants. A rate is the ratio of its decayed totals, so
+ * it needs no window buffer.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HEARTBEAT_EWMA_H_
+#define _HEARTBEAT_EWMA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+
+#define HB_EWMA_MAX 4
+
+typedef struct hb_ewma {
+  // time constants (ns)
+  uint64_t time_constant[HB_EWMA_MAX];
+  uint32_t count;
+  volatile int lock;
+  // end time of the latest heartbeat, or 0 before the first one
+  uint64_t last_time;
+  // decayed totals for each time constant
+  double work[HB_EWMA_MAX];
+  double time[HB_EWMA_MAX];
+  double accuracy[HB_EWMA_MAX];
+  double energy[HB_EWMA_MAX];
+} hb_ewma;
+
+/**
+ * Initialize moving averages for count time constants, e.g., 1, 10, and 60
+ * seconds (in ns). Getters select a moving average by its index here.
+ * Fails if ewma or time_constants is NULL, count is 0 or greater than
+ * HB_EWMA_MAX, or a time constant is 0, in which cases errno is set to
+ * EINVAL.
+ *
+ * @param ewma
+ * @param time_constants
+ * @param count
+ * @return 0 on success, another value otherwise
+ */
+int hb_ewma_init(hb_ewma* ewma, const uint64_t* time_constants, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
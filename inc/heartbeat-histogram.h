@@ -0,0 +1,101 @@
+/**
+ * Log-linear (HDR-style) histograms of heartbeat durations.
+ * Values below 2^precision each have their own bucket. Larger values are
+ * grouped by their most significant bit, and each group is split into
+ * 2^precision linear buckets, so a value's bucket is within a relative error
+ * of 2^-precision of it. Memory is fixed by the precision, and recording is
+ * O(1).
+ *
+ * @author Connor Imes
+ */
+#ifndef _HEARTBEAT_HISTOGRAM_H_
+#define _HEARTBEAT_HISTOGRAM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define HB_HISTOGRAM_PRECISION_MAX 16
+
+/* The number of counts a histogram with the given precision needs */
+#define HB_HISTOGRAM_LEN(precision) (((size_t) 65 - (precision)) << (precision))
+
+typedef struct hb_histogram {
+  // HB_HISTOGRAM_LEN(precision) counts
+  uint64_t* counts;
+  uint32_t precision;
+  uint32_t reserved;
+  // the number of values, and the exact minimum and maximum values
+  uint64_t count;
+  uint64_t min;
+  uint64_t max;
+} hb_histogram;
+
+/**
+ * Initialize an empty histogram that counts values in the given array.
+ * Fails if h or counts is NULL, precision is greater than
+ * HB_HISTOGRAM_PRECISION_MAX, or len is less than HB_HISTOGRAM_LEN(precision),
+ * in which cases errno is set to EINVAL.
+ *
+ * @param h
+ * @param precision the number of bits of precision in each bucket
+ * @param counts
+ * @param len the number of elements in counts
+ * @return 0 on success, another value otherwise
+ */
+int hb_histogram_init(hb_histogram* h, uint32_t precision, uint64_t* counts, size_t len);
+
+/**
+ * Record a value. Not thread-safe.
+ * If h is NULL, errno is set to EINVAL.
+ *
+ * @param h
+ * @param value
+ * @return 0 on success, another value otherwise
+ */
+int hb_histogram_record(hb_histogram* h, uint64_t value);
+
+/**
+ * Remove all values.
+ * If h is NULL, errno is set to EINVAL.
+ *
+ * @param h
+ * @return 0 on success, another value otherwise
+ */
+int hb_histogram_reset(hb_histogram* h);
+
+/**
+ * Add the values in src to dst, e.g., to aggregate histograms from several
+ * contexts. If the histograms' precisions differ, src's values are
+ * approximated by their buckets' lowest values.
+ * If dst or src is NULL, errno is set to EINVAL.
+ *
+ * @param dst
+ * @param src
+ * @return 0 on success, another value otherwise
+ */
+int hb_histogram_merge(hb_histogram* dst, const hb_histogram* src);
+
+/**
+ * Get the value at a percentile, e.g., 50, 99, or 99.9: the highest value
+ * in the bucket that holds it, limited to the maximum value. The first and
+ * last values, e.g., the 0th and 100th percentiles, are the exact minimum and
+ * maximum values.
+ * Returns 0 if the histogram is empty.
+ * If h is NULL or percentile isn't in [0, 100], 0 is returned and errno is
+ * set to EINVAL.
+ *
+ * @param h
+ * @param percentile
+ * @return the value at the percentile
+ */
+uint64_t hb_histogram_get_percentile(const hb_histogram* h, double percentile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,212 @@
+/**
+ * Log sinks, which receive a heartbeat context's log data in place of its log
+ * file descriptor (see hb_set_log_sink()).
+ * Sinks are used for the lifetime of a context, and format windows into their
+ * own reusable buffer, so logging windows doesn't allocate memory once the
+ * buffer is large enough.
+ *
+ * A sink receives formatted data (text or binary, depending on the context's
+ * flags) if it has a write function, and raw window buffer records if it has
+ * a records function. Records don't have rates populated if the context uses
+ * HEARTBEAT_FLAG_LAZY_RATES.
+ *
+ * Sinks are called while heartbeats wait for the window to be logged, or from
+ * the writer thread with asynchronous logging. A sink must not be shared by
+ * contexts that may log concurrently.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HEARTBEAT_LOG_SINK_H_
+#define _HEARTBEAT_LOG_SINK_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include <stddef.h>
+
+struct hb_log_sink;
+
+/* Receive formatted log data, e.g., a header or a whole window */
+typedef int (hb_log_sink_write) (struct hb_log_sink* sink, const void* data, size_t len);
+
+/* Receive a window's records */
+typedef int (hb_log_sink_records) (struct hb_log_sink* sink, const void* records, uint64_t count,
+                                   size_t record_size);
+
+/* Release the sink's resources */
+typedef int (hb_log_sink_release) (struct hb_log_sink* sink);
+
+/* User function for callback sinks */
+typedef int (hb_log_sink_callback) (const void* records, uint64_t count, size_t record_size, void* arg);
+
+/**
+ * Custom sinks zero the struct, then set their own functions and state. The
+ * buffer fields are managed by the library.
+ * Headers are passed to the header function if it's set, e.g., so a sink can
+ * repeat them, and otherwise to the write function.
+ * Functions return 0 on success, or another value and set errno.
+ */
+typedef struct hb_log_sink {
+  hb_log_sink_write* write;
+  hb_log_sink_write* header;
+  hb_log_sink_records* records;
+  hb_log_sink_release* release;
+  void* state;
+  // reusable buffer for formatting windows
+  char* buf;
+  size_t buf_size;
+} hb_log_sink;
+
+/**
+ * Initialize a sink that writes formatted data to a file descriptor, with a
+ * single write per window unless it's interrupted.
+ * The file descriptor is not closed by hb_log_sink_finish().
+ * Fails if sink is NULL or fd is negative (errno is set to EINVAL), or if
+ * memory cannot be allocated.
+ *
+ * @param sink
+ * @param fd
+ * @return 0 on success, another value otherwise
+ */
+int hb_log_sink_fd_init(hb_log_sink* sink, int fd);
+
+/**
+ * Initialize a sink that writes formatted data to a series of files, which
+ * are named by replacing the single "%u" in pattern's file name with a
+ * segment number. Numbering continues after the highest existing segment that
+ * matches the pattern, e.g., from an earlier run, or starts at 0. A new segment is started at
+ * a window boundary when the next write would make the current segment larger
+ * than max_size bytes, and begins with a copy of the last header.
+ * Only the last max_files segments are kept, including earlier ones, or all of
+ * them if max_files is 0.
+ * On Linux, each segment's space is preallocated with fallocate(), without
+ * changing its size, so files aren't extended while heartbeats wait.
+ * If a segment can't be created, data is written to the current segment and
+ * rotation is retried on the next write, so no data is lost.
+ * Fails if sink or pattern is NULL, pattern doesn't contain exactly one "%u"
+ * and no other '%', "%u" is followed by a '/', or max_size is 0 (errno is set
+ * to EINVAL), if the first segment can't be created, or if memory cannot be
+ * allocated.
+ * Not supported on Windows (errno is set to ENOSYS).
+ *
+ * @param sink
+ * @param pattern
+ * @param max_size
+ * @param max_files
+ * @return 0 on success, another value otherwise
+ */
+int hb_log_sink_rotate_init(hb_log_sink* sink, const char* pattern, uint64_t max_size, uint32_t max_files);
+
+/**
+ * Initialize a sink that passes each window's records to a user function,
+ * without formatting them. The context's log header is not passed.
+ * Fails if sink or cb is NULL (errno is set to EINVAL), or if memory cannot
+ * be allocated.
+ *
+ * @param sink
+ * @param cb
+ * @param arg passed to cb
+ * @return 0 on success, another value otherwise
+ */
+int hb_log_sink_callback_init(hb_log_sink* sink, hb_log_sink_callback* cb, void* arg);
+
+/**
+ * Initialize a sink that appends formatted data to a growable memory buffer.
+ * Fails if sink is NULL (errno is set to EINVAL), or if memory cannot be
+ * allocated.
+ *
+ * @param sink
+ * @return 0 on success, another value otherwise
+ */
+int hb_log_sink_memory_init(hb_log_sink* sink);
+
+/**
+ * Get the data appended to a memory sink. The data is not terminated, and is
+ * only valid until more data is appended or the sink is reset or finished.
+ * Fails if any parameter is NULL or sink is not a memory sink, in which case
+ * errno is set to EINVAL.
+ *
+ * @param sink
+ * @param data
+ * @param len
+ * @return 0 on success, another value otherwise
+ */
+int hb_log_sink_memory_get(const hb_log_sink* sink, const void** data, size_t* len);
+
+/**
+ * Discard the data in a memory sink, but keep its memory for reuse.
+ * Fails if sink is NULL or is not a memory sink, in which case errno is set
+ * to EINVAL.
+ *
+ * @param sink
+ * @return 0 on success, another value otherwise
+ */
+int hb_log_sink_memory_reset(hb_log_sink* sink);
+
+/**
+ * Initialize a sink that forwards data to several sinks, each of which gets
+ * the data its functions accept. Data is only formatted once for all sinks.
+ * All sinks are called even if one fails, and the first error is returned.
+ * The array is copied, but the sinks are not finished by hb_log_sink_finish().
+ * Fails if sink or sinks is NULL, count is 0, or any of the sinks is NULL
+ * (errno is set to EINVAL), or if memory cannot be allocated.
+ *
+ * @param sink
+ * @param sinks
+ * @param count
+ * @return 0 on success, another value otherwise
+ */
+int hb_log_sink_fanout_init(hb_log_sink* sink, hb_log_sink* const* sinks, uint32_t count);
+
+/**
+ * Initialize a sink that writes formatted data to a file descriptor through
+ * io_uring on Linux, so logging a window only costs a copy into one of depth
+ * buffers of buf_size bytes and a submission. Completions are reaped by later
+ * writes, and a write's error is reported by a later write or by
+ * hb_log_sink_finish(), which waits for all writes to complete.
+ * The fd must be a seekable file that's not opened with O_APPEND, since data
+ * is written at offsets that start from its current position. The position
+ * is only updated when the sink is finished, and the fd must not be written
+ * to otherwise in the meantime.
+ * The sink writes with write() if io_uring is unavailable or the fd is not
+ * supported, and writes synchronously any data that doesn't fit a buffer.
+ * If depth or buf_size is 0, a default is used.
+ * Fails if sink is NULL, fd is negative, or depth buffers of buf_size bytes
+ * can't be addressed (errno is set to EINVAL), or if memory cannot be
+ * allocated.
+ *
+ * @param sink
+ * @param fd
+ * @param depth
+ * @param buf_size
+ * @return 0 on success, another value otherwise
+ */
+int hb_log_sink_uring_init(hb_log_sink* sink, int fd, uint32_t depth, size_t buf_size);
+
+/**
+ * Check whether an io_uring sink submits writes through io_uring, or has
+ * fallen back to write().
+ * Fails if sink is NULL or is not an io_uring sink, in which case errno is
+ * set to EINVAL.
+ *
+ * @param sink
+ * @return 1 if io_uring is used, 0 if not, or -1 on failure
+ */
+int hb_log_sink_uring_active(const hb_log_sink* sink);
+
+/**
+ * Release the sink's resources and its buffer.
+ * If sink is NULL, errno is set to EINVAL.
+ *
+ * @param sink
+ * @return 0 on success, another value otherwise
+ */
+int hb_log_sink_finish(hb_log_sink* sink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
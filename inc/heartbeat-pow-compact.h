@@ -0,0 +1,152 @@
+/**
+ * Compact heartbeats for large windows. Each record only holds a heartbeat's
+ * own values as 32-bit deltas; absolute times and energies and global and
+ * window data are reconstructed from the window's base, which is kept in full
+ * in the context.
+ * Windows are tumbling: window data covers the heartbeats since the current
+ * window began.
+ *
+ * This version is for heartbeat-pow.h.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HEARTBEAT_POW_COMPACT_H
+#define _HEARTBEAT_POW_COMPACT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include "heartbeat-pow.h"
+
+typedef struct heartbeat_pow_compact_record {
+  uint32_t user_tag;
+  uint32_t work;
+  // end_time - start_time, and start_time - the previous heartbeat's end_time
+  uint32_t duration;
+  uint32_t gap;
+  // end_energy - start_energy, and start_energy - the previous heartbeat's end_energy
+  uint32_t energy;
+  uint32_t energy_gap;
+} heartbeat_pow_compact_record;
+
+struct heartbeat_pow_compact_context;
+
+typedef void (heartbeat_pow_compact_window_complete) (const struct heartbeat_pow_compact_context* cc);
+
+typedef struct heartbeat_pow_compact_context {
+  heartbeat_pow_compact_record* window_buffer;
+  uint64_t window_size;
+  // records in the current window
+  uint64_t buffer_index;
+  int log_fd;
+  volatile int lock;
+  heartbeat_pow_compact_window_complete* hwc_callback;
+  uint64_t counter;
+  // heartbeats with values that didn't fit in a compact record, and weren't stored
+  uint64_t rejected;
+  // the current window's first id and start values, with global data before it
+  heartbeat_pow_record base;
+  // the last heartbeat, with its window data since the base
+  heartbeat_pow_record last;
+} heartbeat_pow_compact_context;
+
+/**
+ * Initialize a compact heartbeats instance.
+ * Completed windows are logged to log_fd as text, like
+ * hb_pow_log_window_buffer().
+ * Only fails if cc is NULL, window_size is 0, or window_buffer is NULL, in
+ * which cases errno is set to EINVAL.
+ *
+ * @param cc
+ * @param window_size
+ * @param window_buffer
+ * @param log_fd
+ * @param hwc_callback
+ * @return 0 on success, another value otherwise
+ */
+int heartbeat_pow_compact_init(heartbeat_pow_compact_context* cc,
+                               uint64_t window_size,
+                               heartbeat_pow_compact_record* window_buffer,
+                               int log_fd,
+                               heartbeat_pow_compact_window_complete* hwc_callback);
+
+/**
+ * Registers a heartbeat.
+ * The user tag, work, duration, and energy must each fit in 32 bits in a
+ * compact record. A heartbeat whose values don't fit isn't stored, and errno is
+ * set to ERANGE, but its data is still counted in the global data: it completes
+ * the current window and the next window begins after it. If the time or energy
+ * since the previous heartbeat doesn't fit, or goes backward, the window
+ * completes early and this heartbeat begins the next one.
+ * If cc is NULL, errno is set to EINVAL.
+ *
+ * @param cc
+ * @param user_tag
+ * @param work
+ * @param start_time (ns)
+ * @param end_time (ns)
+ * @param start_energy (uJ)
+ * @param end_energy (uJ)
+ */
+void heartbeat_pow_compact(heartbeat_pow_compact_context* cc,
+                           uint64_t user_tag,
+                           uint64_t work,
+                           uint64_t start_time,
+                           uint64_t end_time,
+                           uint64_t start_energy,
+                           uint64_t end_energy);
+
+/**
+ * Get the number of records in the current window.
+ * If cc is NULL, 0 is returned and errno is set to EINVAL.
+ *
+ * @param cc
+ * @return the number of records
+ */
+uint64_t hb_pow_compact_get_window_records(const heartbeat_pow_compact_context* cc);
+
+/**
+ * Get the number of heartbeats that weren't stored because their values didn't
+ * fit in a compact record. Their data is still counted in the global data.
+ * If cc is NULL, 0 is returned and errno is set to EINVAL.
+ *
+ * @param cc
+ * @return the number of heartbeats that weren't stored
+ */
+uint64_t hb_pow_compact_get_rejected(const heartbeat_pow_compact_context* cc);
+
+/**
+ * Reconstruct full records for count records in the current window, starting at
+ * index first, e.g., from the window complete callback.
+ * Not thread-safe with concurrent heartbeats.
+ * Fails if cc or records is NULL, or the range isn't in the current window, in
+ * which cases errno is set to EINVAL.
+ *
+ * @param cc
+ * @param first
+ * @param records
+ * @param count
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_compact_get_records(const heartbeat_pow_compact_context* cc, uint64_t first,
+                               heartbeat_pow_record* records, uint64_t count);
+
+/**
+ * Get the full record for the last heartbeat, with global, window, and instant
+ * values.
+ * Takes the context lock.
+ * If cc or snapshot is NULL, errno is set to EINVAL.
+ *
+ * @param cc
+ * @param snapshot
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_compact_get_snapshot(heartbeat_pow_compact_context* cc, heartbeat_pow_record* snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -19,6 +19,7 @@ extern "C" {
 typedef struct heartbeat_pow_container {
   heartbeat_pow_context hb;
   heartbeat_pow_record* window_buffer;
+  heartbeat_pow_columns columns;
 } heartbeat_pow_container;
 
 /**
@@ -50,7 +51,24 @@ int heartbeat_pow_container_init_context(heartbeat_pow_container* hc,
                                          heartbeat_pow_window_complete* hwc_callback);
 
 /**
- * Free the window buffer.
+ * Like heartbeat_pow_container_init_context(), but also allocate columns for the
+ * window and record window data in them (see hb_pow_set_columns()).
+ * Only fails if hc is NULL, window_size is 0, or the window buffer or columns
+ * cannot be allocated, in which cases errno is set.
+ *
+ * @param hc
+ * @param window_size
+ * @param log_fd
+ * @param hwc_callback
+ * @return 0 on success, another value otherwise
+ */
+int heartbeat_pow_container_init_columns(heartbeat_pow_container* hc,
+                                         uint64_t window_size,
+                                         int log_fd,
+                                         heartbeat_pow_window_complete* hwc_callback);
+
+/**
+ * Free the window buffer and columns, if any.
  *
  * @param hc
  */
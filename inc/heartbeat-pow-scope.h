@@ -0,0 +1,78 @@
+/**
+ * Scoped heartbeats, where the library reads the start and end time and energy
+ * of each heartbeat itself, using hb_time_now() and an energy provider.
+ * The end readings of a heartbeat are reused as the start readings of the
+ * next one, so back-to-back heartbeats only need one set of readings each.
+ *
+ * A scope must only be used by one thread at a time, but multiple scopes may
+ * share a heartbeat context.
+ *
+ * This version is for heartbeat-pow.h.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HEARTBEAT_POW_SCOPE_H
+#define _HEARTBEAT_POW_SCOPE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include "heartbeat-pow.h"
+#include "heartbeat-energy.h"
+#include "heartbeat-time.h"
+
+typedef struct heartbeat_pow_scope {
+  heartbeat_pow_context* hb;
+  hb_energy_provider* ep;
+  uint64_t start_time;
+  uint64_t start_energy;
+} heartbeat_pow_scope;
+
+/**
+ * Initialize a scope for a heartbeat context and begin the first heartbeat.
+ * Fails if hs, hb, or ep is NULL, in which case errno is set to EINVAL, or if
+ * energy cannot be read.
+ *
+ * @param hs
+ * @param hb
+ * @param ep
+ * @return 0 on success, another value otherwise
+ */
+int heartbeat_pow_scope_init(heartbeat_pow_scope* hs,
+                             heartbeat_pow_context* hb,
+                             hb_energy_provider* ep);
+
+/**
+ * Begin a heartbeat by taking new start readings.
+ * Only needed to exclude the time since the last heartbeat ended, e.g., when
+ * the application was idle.
+ * Fails if hs is NULL, in which case errno is set to EINVAL, or if energy
+ * cannot be read.
+ *
+ * @param hs
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_begin(heartbeat_pow_scope* hs);
+
+/**
+ * End a heartbeat by taking end readings and registering the heartbeat.
+ * The next heartbeat begins with the same readings.
+ * Fails if hs is NULL, in which case errno is set to EINVAL, or if energy
+ * cannot be read. The heartbeat is not registered on failure.
+ *
+ * @param hs
+ * @param user_tag
+ * @param work
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_end(heartbeat_pow_scope* hs,
+               uint64_t user_tag,
+               uint64_t work);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
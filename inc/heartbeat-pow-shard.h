@@ -0,0 +1,97 @@
+/**
+ * Sharded heartbeats, where each thread owns a private heartbeat context and
+ * window buffer, so heartbeats are issued without any lock. Readers merge the
+ * shards on demand.
+ *
+ * This version is for heartbeat-pow.h.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HEARTBEAT_POW_SHARD_H
+#define _HEARTBEAT_POW_SHARD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include "heartbeat-pow.h"
+
+/* Pads each shard so that shards never share a cache line */
+typedef union heartbeat_pow_shard {
+  heartbeat_pow_context hb;
+  char pad[HEARTBEAT_SHARD_SIZE(heartbeat_pow_context)];
+} heartbeat_pow_shard;
+
+typedef struct heartbeat_pow_shard_context {
+  uint32_t num_shards;
+  heartbeat_pow_shard* shards;
+  // all shards' window buffers, padded so they never share a cache line
+  heartbeat_pow_record* window_buffers;
+} heartbeat_pow_shard_context;
+
+/**
+ * Allocate and initialize the shards, each with its own window buffer.
+ * Shards are initialized with HEARTBEAT_FLAG_SINGLE_WRITER in addition to the
+ * provided flags, so each shard must only be used by one thread at a time.
+ * Each shard logs its own windows to log_fd and issues its own callbacks.
+ * Only fails if hs is NULL, num_shards or window_size is 0, flags are not
+ * valid, or memory cannot be allocated, in which cases errno is set.
+ *
+ * @param hs
+ * @param num_shards
+ * @param window_size
+ * @param log_fd
+ * @param hwc_callback
+ * @param flags
+ * @return 0 on success, another value otherwise
+ */
+int heartbeat_pow_shard_init(heartbeat_pow_shard_context* hs,
+                             uint32_t num_shards,
+                             uint64_t window_size,
+                             int log_fd,
+                             heartbeat_pow_window_complete* hwc_callback,
+                             uint32_t flags);
+
+/**
+ * Free the shards and their window buffers.
+ *
+ * @param hs
+ */
+void heartbeat_pow_shard_finish(heartbeat_pow_shard_context* hs);
+
+/**
+ * Get a shard's heartbeat context, to be used with the heartbeat functions.
+ * If hs is NULL or shard is out of range, NULL is returned and errno is set to
+ * EINVAL.
+ *
+ * @param hs
+ * @param shard
+ * @return the shard's heartbeat context
+ */
+heartbeat_pow_context* hb_pow_shard_get_context(heartbeat_pow_shard_context* hs, uint32_t shard);
+
+/**
+ * Merge the latest data from all shards into a single record.
+ * Shards run concurrently, so work data and performance are summed across
+ * shards. Time data is summed, so global and window power are time-weighted
+ * averages across shards, which is appropriate when shards observe the same
+ * energy counter. The id is the total number of heartbeats,
+ * the user tag is from the most recent heartbeat, and start and end values are
+ * the extremes over the shards' last heartbeats.
+ * Shards that have not issued a heartbeat are ignored.
+ * Each shard is read with hb_pow_get_snapshot(), so merging never blocks
+ * heartbeats, but fails if a consistent copy can't be made.
+ * If hs or merged is NULL, errno is set to EINVAL.
+ *
+ * @param hs
+ * @param merged
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_shard_merge(const heartbeat_pow_shard_context* hs, heartbeat_pow_record* merged);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -13,9 +13,23 @@ extern "C" {
 
 #include <inttypes.h>
 #include "heartbeat-common-types.h"
+#include "heartbeat-ewma.h"
+#include "heartbeat-histogram.h"
+#include "heartbeat-log-sink.h"
+#include "heartbeat-rollup.h"
 
 struct heartbeat_pow_context;
 
+/* The arguments for a single heartbeat, e.g., for batch submission */
+typedef struct heartbeat_pow_input {
+  uint64_t user_tag;
+  uint64_t work;
+  uint64_t start_time;
+  uint64_t end_time;
+  uint64_t start_energy;
+  uint64_t end_energy;
+} heartbeat_pow_input;
+
 typedef struct heartbeat_pow_record {
   uint64_t id;
   uint64_t user_tag;
@@ -33,13 +47,33 @@ typedef struct heartbeat_pow_record {
   heartbeat_rates pwr;
 } heartbeat_pow_record;
 
+/**
+ * Window data in a struct-of-arrays layout, where each field has its own
+ * array of window_size values, indexed like the window buffer.
+ */
+typedef struct heartbeat_pow_columns {
+  uint64_t* id;
+  uint64_t* user_tag;
+  uint64_t* work;
+  uint64_t* start_time;
+  uint64_t* end_time;
+  double* perf_instant;
+  uint64_t* start_energy;
+  uint64_t* end_energy;
+  double* pwr_instant;
+} heartbeat_pow_columns;
+
 typedef void (heartbeat_pow_window_complete) (const struct heartbeat_pow_context* hb);
 
 typedef struct heartbeat_pow_context {
   heartbeat_window_state ws;
   heartbeat_pow_record* window_buffer;
+  heartbeat_pow_columns* columns;
   uint64_t counter;
   volatile int lock;
+  // writes begun and ended, so readers can detect concurrent updates
+  volatile uint64_t seq_begin;
+  volatile uint64_t seq_end;
   heartbeat_pow_window_complete* hwc_callback;
 
   // data
@@ -50,8 +84,12 @@ typedef struct heartbeat_pow_context {
 
 /**
  * Initialize a heartbeats instance.
- * Only fails if hb is NULL, window_size is 0, or window_buffer is NULL, in
- * which cases errno is set to EINVAL.
+ * Only fails if hb is NULL, or only one of window_size is 0 and window_buffer
+ * is NULL, in which cases errno is set to EINVAL.
+ * Without a window (window_size is 0 and window_buffer is NULL), heartbeats
+ * only update global data, a histogram, and moving averages. There are no
+ * records, logs, or window complete callbacks, and getters for the last
+ * heartbeat or the window return 0.
  *
  * @param hb
  * @param window_size
@@ -66,9 +104,31 @@ int heartbeat_pow_init(heartbeat_pow_context* hb,
                        int log_fd,
                        heartbeat_pow_window_complete* hwc_callback);
 
+/**
+ * Initialize a heartbeats instance with context flags (HEARTBEAT_FLAG_*).
+ * Only fails if hb is NULL, only one of window_size is 0 and window_buffer is
+ * NULL, or flags contains unknown values, in which cases errno is set to
+ * EINVAL. See heartbeat_pow_init() for contexts without a window.
+ *
+ * @param hb
+ * @param window_size
+ * @param window_buffer
+ * @param log_fd
+ * @param hwc_callback
+ * @param flags
+ * @return 0 on success, another value otherwise
+ */
+int heartbeat_pow_init_flags(heartbeat_pow_context* hb,
+                             uint64_t window_size,
+                             heartbeat_pow_record* window_buffer,
+                             int log_fd,
+                             heartbeat_pow_window_complete* hwc_callback,
+                             uint32_t flags);
+
 /**
  * Registers a heartbeat.
- * If hb is NULL or its window_buffer is NULL, errno is set to EINVAL.
+ * If hb is NULL, errno is set to EINVAL.
+ * Contexts without a window are valid, see heartbeat_pow_init().
  *
  * @param hb
  * @param user_tag
@@ -87,7 +147,24 @@ void heartbeat_pow(heartbeat_pow_context* hb,
                    uint64_t end_energy);
 
 /**
- * Write the header text to a log file.
+ * Registers a batch of heartbeats in order, as if each were registered
+ * separately, but only taking the context lock once.
+ * Windows that complete during the batch are logged and their callbacks
+ * issued before the batch continues.
+ * If hb is NULL, or inputs is NULL and count is not 0, errno is set to EINVAL.
+ * Contexts without a window are valid, see heartbeat_pow_init().
+ *
+ * @param hb
+ * @param inputs
+ * @param count
+ */
+void heartbeat_pow_batch(heartbeat_pow_context* hb,
+                         const heartbeat_pow_input* inputs,
+                         uint64_t count);
+
+/**
+ * Write the header text to a log file, as padded text with all columns
+ * regardless of hb_pow_set_log_format() (see hb_pow_log_header_format()).
  * Sets errno on failure.
  *
  * @param fd
@@ -96,7 +173,22 @@ void heartbeat_pow(heartbeat_pow_context* hb,
 int hb_pow_log_header(int fd);
 
 /**
- * Write the header text to a log file.
+ * Write the header for a log in the given format and columns (see
+ * hb_pow_set_log_format()) to a log file, e.g., to begin a file written with
+ * hb_pow_log_window_buffer(). Nothing is written for JSON Lines logs.
+ * Fails if format is unknown or columns has none of this heartbeat's columns
+ * (errno is set to EINVAL), and sets errno on other failures.
+ *
+ * @param fd
+ * @param format
+ * @param columns
+ * @return 0 on success, error code otherwise
+ */
+int hb_pow_log_header_format(int fd, uint32_t format, uint32_t columns);
+
+/**
+ * Write the header text to a log file, in the format set by
+ * hb_pow_set_log_format().
  * The file descriptor provided during heartbeat init is used.
  * Sets errno on failure.
  *
@@ -106,7 +198,8 @@ int hb_pow_log_header(int fd);
 int hb_pow_ctx_log_header(const heartbeat_pow_context* hb);
 
 /**
- * Logs the circular window buffer up to the current read index.
+ * Logs the circular window buffer up to the current read index, in the format
+ * set by hb_pow_set_log_format().
  * Sets errno on failure.
  *
  * @param hb
@@ -116,7 +209,8 @@ int hb_pow_ctx_log_header(const heartbeat_pow_context* hb);
 int hb_pow_log_window_buffer(const heartbeat_pow_context* hb, int fd);
 
 /**
- * Logs the circular window buffer up to the current read index.
+ * Logs the circular window buffer up to the current read index, in the format
+ * set by hb_pow_set_log_format().
  * The file descriptor provided during heartbeat init is used.
  * Sets errno on failure.
  *
@@ -125,6 +219,219 @@ int hb_pow_log_window_buffer(const heartbeat_pow_context* hb, int fd);
  */
 int hb_pow_ctx_log_window_buffer(const heartbeat_pow_context* hb);
 
+/**
+ * Write the binary log header for a heartbeat to a log file.
+ * Sets errno on failure.
+ *
+ * @param hb
+ * @param fd
+ * @return 0 on success, error code otherwise
+ */
+int hb_pow_log_bin_header(const heartbeat_pow_context* hb, int fd);
+
+/**
+ * Logs the circular window buffer up to the current read index in the binary
+ * log format, with a single write.
+ * Sets errno on failure.
+ *
+ * @param hb
+ * @param fd
+ * @return 0 on success, error code otherwise
+ */
+int hb_pow_log_bin_window_buffer(const heartbeat_pow_context* hb, int fd);
+
+/**
+ * Encode records as a compressed binary log block (see
+ * HEARTBEAT_FLAG_LOG_COMPRESSED). Rates are not stored.
+ * Fails if records, buf, or block_len is NULL, or if len is less than
+ * HEARTBEAT_LOG_BLOCK_MAX(count, sizeof(heartbeat_pow_record)), in which cases errno is set
+ * to EINVAL.
+ *
+ * @param records
+ * @param count
+ * @param buf
+ * @param len
+ * @param block_len the size of the encoded block
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_log_encode_block(const heartbeat_pow_record* records, uint64_t count, void* buf, size_t len, size_t* block_len);
+
+/**
+ * Decode the compressed binary log block at the start of data. Records are
+ * reconstructed exactly, with rates computed from their data.
+ * Fails with errno set to EAGAIN if data doesn't contain the whole block,
+ * ENOBUFS if the block has more than max_records records, EPROTO if the block
+ * is invalid, or EINVAL if any pointer is NULL.
+ *
+ * @param data
+ * @param len
+ * @param records
+ * @param max_records
+ * @param count the number of decoded records
+ * @param block_len the size of the block in data
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_log_decode_block(const void* data, size_t len, heartbeat_pow_record* records, uint64_t max_records,
+                            uint64_t* count, size_t* block_len);
+
+/**
+ * Log to a sink instead of the log file descriptor, for completed windows and
+ * the hb_pow_ctx_log_* functions. The sink must remain valid while it's used, and
+ * is not finished by the context. If sink is NULL, the log file descriptor is
+ * used again.
+ * Call before issuing heartbeats and before starting asynchronous logging.
+ * Fails if hb is NULL, sink has neither a write nor a records function, or
+ * the context logs asynchronously, in which cases errno is set to EINVAL.
+ *
+ * @param hb
+ * @param sink
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_set_log_sink(heartbeat_pow_context* hb, hb_log_sink* sink);
+
+/**
+ * Also record each heartbeat's duration (end_time - start_time) in a
+ * histogram, e.g., for tail latencies over a whole run. With
+ * HEARTBEAT_FLAG_HISTOGRAM_WINDOW, it's reset when each window completes
+ * instead. The histogram must remain valid while it's used. If histogram is
+ * NULL, durations are no longer recorded.
+ * Call before issuing heartbeats.
+ * Fails if hb is NULL or histogram isn't initialized, in which cases errno is
+ * set to EINVAL.
+ *
+ * @param hb
+ * @param histogram
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_set_histogram(heartbeat_pow_context* hb, hb_histogram* histogram);
+
+/**
+ * Also maintain moving averages of rates (see hb_ewma_init()), which are read
+ * with the hb_pow_get_ewma_* functions. The moving averages must remain valid
+ * while they're used. If ewma is NULL, they're no longer updated.
+ * Call before issuing heartbeats.
+ * Fails if hb is NULL or ewma isn't initialized, in which cases errno is set
+ * to EINVAL.
+ *
+ * @param hb
+ * @param ewma
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_set_ewma(heartbeat_pow_context* hb, hb_ewma* ewma);
+
+/**
+ * Also add heartbeats to multi-resolution rollups (see hb_rollup_init()),
+ * which are read with hb_rollup_get_intervals(). The rollups must remain
+ * valid while they're used. If rollup is NULL, they're no longer updated.
+ * Call before issuing heartbeats.
+ * Fails if hb is NULL or rollup isn't initialized, in which cases errno is set
+ * to EINVAL.
+ *
+ * @param hb
+ * @param rollup
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_set_rollup(heartbeat_pow_context* hb, hb_rollup* rollup);
+
+/**
+ * Use a time-based window: window data and rates cover the heartbeats that
+ * ended in the last duration ns, up to window_size of them. Expired records
+ * are evicted from the front of the window as heartbeats arrive, and the
+ * window complete callback is issued when a heartbeat ends at least duration
+ * after the previous callback (or the first heartbeat), instead of when the
+ * window buffer is full. The window buffer is still logged each time it's full.
+ * If duration is 0, windows are count-based again.
+ * Not thread-safe with concurrent heartbeats.
+ * Fails if hb is NULL, hb has no window buffer, or hb uses
+ * HEARTBEAT_FLAG_LOCK_FREE, in which cases errno is set to EINVAL.
+ *
+ * @param hb
+ * @param duration (ns)
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_set_window_duration(heartbeat_pow_context* hb, uint64_t duration);
+
+/**
+ * Set the format of text logs written by hb_pow_log_window_buffer(), the
+ * hb_pow_ctx_log_* functions, completed windows, and sinks: padded text columns (HEARTBEAT_LOG_FORMAT_TEXT, the
+ * default), CSV with a header line (HEARTBEAT_LOG_FORMAT_CSV), or one JSON
+ * object per record without a header (HEARTBEAT_LOG_FORMAT_JSONL).
+ * Only the columns in the HEARTBEAT_LOG_COL_* mask are logged, in their usual
+ * order, or all columns if columns is 0.
+ * Binary logs (HEARTBEAT_FLAG_LOG_BINARY) always contain whole records.
+ * hb_pow_log_header() always writes the padded text header with all columns;
+ * use hb_pow_log_header_format() to begin a file written in another format.
+ * Call before logging the header and before starting asynchronous logging.
+ * Fails if hb is NULL, format is unknown, columns has none of this heartbeat's
+ * columns, or the context logs asynchronously, in which cases errno is set to
+ * EINVAL.
+ *
+ * @param hb
+ * @param format
+ * @param columns
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_set_log_format(heartbeat_pow_context* hb, uint32_t format, uint32_t columns);
+
+/**
+ * Also record window data in columns (see heartbeat_pow_columns), e.g., so
+ * analytics can scan a single field. Columns are written by heartbeats along
+ * with the window buffer. Instant rates are computed as records' rates are,
+ * so with HEARTBEAT_FLAG_LAZY_RATES they're computed when the window
+ * completes, for its logs and window complete callback. Without lazy rates,
+ * the instant rate getters and window statistics read the columns. Columns
+ * are not cleared. If columns is NULL, columns are no longer written or read.
+ * Call before issuing heartbeats.
+ * Fails if hb is NULL or any of the column arrays is NULL, in which cases
+ * errno is set to EINVAL.
+ *
+ * @param hb
+ * @param columns
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_set_columns(heartbeat_pow_context* hb, heartbeat_pow_columns* columns);
+
+/**
+ * Log completed windows asynchronously, instead of in the heartbeat that
+ * completes a window.
+ * Completed windows are copied into a queue of queue_len preallocated window
+ * buffers, and a writer thread writes them to the context's log file
+ * descriptor. If the queue is full, the heartbeat that completes a window
+ * waits for the writer.
+ * Call before issuing heartbeats. Not supported on Windows.
+ * Fails if hb is NULL, queue_len is 0, or the context already logs
+ * asynchronously (errno is set to EINVAL), or if resources cannot be
+ * allocated.
+ *
+ * @param hb
+ * @param queue_len
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_async_log_init(heartbeat_pow_context* hb, uint32_t queue_len);
+
+/**
+ * Write all queued windows and stop asynchronous logging.
+ * Call after the last heartbeat, and before logging any remaining window
+ * buffer data, so that records are logged in order.
+ * If hb is NULL or the context doesn't log asynchronously, errno is set to
+ * EINVAL.
+ *
+ * @param hb
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_async_log_finish(heartbeat_pow_context* hb);
+
+/**
+ * Get asynchronous logging statistics, e.g., to see if the writer keeps up.
+ * If hb or stats is NULL, or the context doesn't log asynchronously, errno is
+ * set to EINVAL.
+ *
+ * @param hb
+ * @param stats
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_async_log_get_stats(const heartbeat_pow_context* hb, heartbeat_async_log_stats* stats);
+
 /**
  * Get the size of the window buffer.
  * If hb is NULL, 0 is returned and errno is set to EINVAL.
@@ -215,6 +522,38 @@ double hb_pow_get_window_perf(const heartbeat_pow_context* hb);
  */
 double hb_pow_get_instant_perf(const heartbeat_pow_context* hb);
 
+/**
+ * Get the moving average of the performance (heart rate) for the time constant at index
+ * (see hb_ewma_init()), or 0 before any time has elapsed.
+ * If hb is NULL, the context has no moving averages, or index isn't valid,
+ * 0 is returned and errno is set to EINVAL.
+ *
+ * @param hb
+ * @param index
+ * @return the moving average of the performance (heart rate)
+ */
+double hb_pow_get_ewma_perf(const heartbeat_pow_context* hb, uint32_t index);
+
+/**
+ * Get statistics for the instant performance (heart rate) of each heartbeat in the window
+ * buffer: the last window_size heartbeats, or fewer before the first window
+ * completes, or those in a time-based window. Heartbeats with rates that aren't finite, e.g., over no time,
+ * are skipped. Values are read without blocking heartbeats, so call from the
+ * window complete callback, or when heartbeats aren't issued concurrently,
+ * for a consistent result.
+ * With columns (see hb_pow_set_columns()) and without lazy rates, values are
+ * read from the columns.
+ * Percentiles are selected in scratch, which holds window_size values, or are
+ * 0 if scratch is NULL. No memory is allocated.
+ * Fails if hb or stats is NULL, in which cases errno is set to EINVAL.
+ *
+ * @param hb
+ * @param stats
+ * @param scratch
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_get_window_perf_stats(const heartbeat_pow_context* hb, heartbeat_window_stats* stats, double* scratch);
+
 /**
  * Get the total energy (uJ) for the life of this heartbeat.
  * If hb is NULL, 0 is returned and errno is set to EINVAL.
@@ -260,6 +599,53 @@ double hb_pow_get_window_power(const heartbeat_pow_context* hb);
  */
 double hb_pow_get_instant_power(const heartbeat_pow_context* hb);
 
+/**
+ * Get the moving average of the power (Watts) for the time constant at index
+ * (see hb_ewma_init()), or 0 before any time has elapsed.
+ * If hb is NULL, the context has no moving averages, or index isn't valid,
+ * 0 is returned and errno is set to EINVAL.
+ *
+ * @param hb
+ * @param index
+ * @return the moving average of the power (Watts)
+ */
+double hb_pow_get_ewma_power(const heartbeat_pow_context* hb, uint32_t index);
+
+/**
+ * Get statistics for the instant power (Watts) of each heartbeat in the window
+ * buffer: the last window_size heartbeats, or fewer before the first window
+ * completes, or those in a time-based window. Heartbeats with rates that aren't finite, e.g., over no time,
+ * are skipped. Values are read without blocking heartbeats, so call from the
+ * window complete callback, or when heartbeats aren't issued concurrently,
+ * for a consistent result.
+ * With columns (see hb_pow_set_columns()) and without lazy rates, values are
+ * read from the columns.
+ * Percentiles are selected in scratch, which holds window_size values, or are
+ * 0 if scratch is NULL. No memory is allocated.
+ * Fails if hb or stats is NULL, in which cases errno is set to EINVAL.
+ *
+ * @param hb
+ * @param stats
+ * @param scratch
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_get_window_power_stats(const heartbeat_pow_context* hb, heartbeat_window_stats* stats, double* scratch);
+
+/**
+ * Get a consistent copy of the record for the last heartbeat, which holds all
+ * current global, window, and instant values.
+ * Readers never block heartbeats; instead, the copy is retried if a heartbeat
+ * is issued concurrently. If a consistent copy can't be made after a bounded
+ * number of retries, errno is set to EAGAIN.
+ * If hb or snapshot is NULL, or the context has no window, errno is set to
+ * EINVAL.
+ *
+ * @param hb
+ * @param snapshot
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_get_snapshot(const heartbeat_pow_context* hb, heartbeat_pow_record* snapshot);
+
 #ifdef __cplusplus
 }
 #endif
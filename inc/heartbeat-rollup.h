@@ -0,0 +1,131 @@
+/**
+ * Multi-resolution rollups of heartbeats, e.g., at 1 second, 10 second,
+ * 1 minute, and 1 hour resolutions, for long-running monitoring without
+ * keeping raw records.
+ * Each level keeps a ring of its latest completed intervals. Heartbeats are
+ * added to the finest level's interval that contains their end time, and an
+ * interval completes when a heartbeat ends in a later interval. Completed
+ * intervals are then added to the next coarser level in the same way, so
+ * each heartbeat costs amortized O(1) regardless of the number of levels.
+ * Intervals without heartbeats are skipped.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HEARTBEAT_ROLLUP_H_
+#define _HEARTBEAT_ROLLUP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define HB_ROLLUP_LEVELS_MAX 8
+
+typedef struct hb_rollup_interval {
+  // start time (ns), a multiple of the level's resolution
+  uint64_t start_time;
+  // the number of heartbeats, and the totals of their data
+  uint64_t count;
+  uint64_t work;
+  uint64_t time;
+  uint64_t accuracy;
+  uint64_t energy;
+  // minimum and maximum instant perf and power, of heartbeats over some time
+  double min_perf;
+  double max_perf;
+  double min_pwr;
+  double max_pwr;
+} hb_rollup_interval;
+
+typedef struct hb_rollup_level {
+  // interval length (ns)
+  uint64_t resolution;
+  // ring of len completed intervals, where count are used and next is written next
+  hb_rollup_interval* intervals;
+  uint64_t len;
+  uint64_t count;
+  uint64_t next;
+  // the interval in progress, which is empty if its count is 0
+  hb_rollup_interval current;
+} hb_rollup_level;
+
+typedef struct hb_rollup {
+  hb_rollup_level levels[HB_ROLLUP_LEVELS_MAX];
+  uint32_t count;
+  volatile int lock;
+  int log_fd;
+} hb_rollup;
+
+/**
+ * Initialize count levels of rollups, from finest to coarsest. Each
+ * resolution (ns) must be a multiple of the previous one, and each level keeps
+ * its latest lens[i] completed intervals in consecutive elements of the
+ * intervals array. E.g., resolutions of 1, 10, 60, and 3600 seconds, each
+ * with a length of 60, cover the last hour at 1 second resolution and more
+ * than two days at 1 hour resolution in 240 intervals.
+ * If log_fd > 0, intervals are logged as text when they complete (see
+ * hb_rollup_log_header()), after the heartbeat that completes them releases
+ * the rollup's lock, so intervals completed by concurrent heartbeats may be
+ * logged out of order.
+ * Fails if r, resolutions, lens, or intervals is NULL, count is 0 or greater
+ * than HB_ROLLUP_LEVELS_MAX, a resolution or length is 0, a resolution isn't
+ * a greater multiple of the previous one, or len is less than the sum of
+ * lens, in which cases errno is set to EINVAL.
+ *
+ * @param r
+ * @param resolutions
+ * @param lens
+ * @param count
+ * @param intervals
+ * @param len the number of elements in intervals
+ * @param log_fd
+ * @return 0 on success, another value otherwise
+ */
+int hb_rollup_init(hb_rollup* r, const uint64_t* resolutions, const uint64_t* lens, uint32_t count,
+                   hb_rollup_interval* intervals, size_t len, int log_fd);
+
+/**
+ * Write the header for logged intervals.
+ * Returns 0 on success, or an error number (errno is also set).
+ *
+ * @param fd
+ * @return 0 on success, another value otherwise
+ */
+int hb_rollup_log_header(int fd);
+
+/**
+ * Copy the latest completed intervals at a level, up to len of them, from
+ * oldest to newest.
+ * Takes the rollup's lock.
+ * If r or intervals is NULL, or level isn't valid, 0 is returned and errno is
+ * set to EINVAL.
+ *
+ * @param r
+ * @param level
+ * @param intervals
+ * @param len
+ * @return the number of intervals copied
+ */
+uint64_t hb_rollup_get_intervals(hb_rollup* r, uint32_t level, hb_rollup_interval* intervals, uint64_t len);
+
+/**
+ * Copy the interval in progress at a level, which has a count of 0 if it's
+ * empty. Coarser levels don't include the finer levels' intervals in progress.
+ * Takes the rollup's lock.
+ * Fails if r or interval is NULL, or level isn't valid, in which cases errno
+ * is set to EINVAL.
+ *
+ * @param r
+ * @param level
+ * @param interval
+ * @return 0 on success, another value otherwise
+ */
+int hb_rollup_get_current(hb_rollup* r, uint32_t level, hb_rollup_interval* interval);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
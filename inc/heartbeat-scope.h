@@ -0,0 +1,71 @@
+/**
+ * Scoped heartbeats, where the library reads the start and end time of each
+ * heartbeat itself, using hb_time_now().
+ * The end readings of a heartbeat are reused as the start readings of the
+ * next one, so back-to-back heartbeats only need one set of readings each.
+ *
+ * A scope must only be used by one thread at a time, but multiple scopes may
+ * share a heartbeat context.
+ *
+ * This version is for heartbeat.h.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HEARTBEAT_SCOPE_H
+#define _HEARTBEAT_SCOPE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include "heartbeat.h"
+#include "heartbeat-time.h"
+
+typedef struct heartbeat_scope {
+  heartbeat_context* hb;
+  uint64_t start_time;
+} heartbeat_scope;
+
+/**
+ * Initialize a scope for a heartbeat context and begin the first heartbeat.
+ * Fails if hs or hb is NULL, in which case errno is set to EINVAL.
+ *
+ * @param hs
+ * @param hb
+ * @return 0 on success, another value otherwise
+ */
+int heartbeat_scope_init(heartbeat_scope* hs,
+                         heartbeat_context* hb);
+
+/**
+ * Begin a heartbeat by taking new start readings.
+ * Only needed to exclude the time since the last heartbeat ended, e.g., when
+ * the application was idle.
+ * Fails if hs is NULL, in which case errno is set to EINVAL.
+ *
+ * @param hs
+ * @return 0 on success, another value otherwise
+ */
+int hb_begin(heartbeat_scope* hs);
+
+/**
+ * End a heartbeat by taking end readings and registering the heartbeat.
+ * The next heartbeat begins with the same readings.
+ * Fails if hs is NULL, in which case errno is set to EINVAL. The heartbeat is
+ * not registered on failure.
+ *
+ * @param hs
+ * @param user_tag
+ * @param work
+ * @return 0 on success, another value otherwise
+ */
+int hb_end(heartbeat_scope* hs,
+           uint64_t user_tag,
+           uint64_t work);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
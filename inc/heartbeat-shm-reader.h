@@ -0,0 +1,97 @@
+/**
+ * Read heartbeats from shared-memory regions created by other processes (see
+ * heartbeat-shm.h), without system calls or blocking the writer.
+ * Regions are mapped read-only. Each read is consistent, using the context's
+ * sequence counters, and is retried if a heartbeat was issued while copying.
+ *
+ * Readers must be built with the same library version as the writer; the
+ * region version and sizes are verified when attaching.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HEARTBEAT_SHM_READER_H
+#define _HEARTBEAT_SHM_READER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include "heartbeat.h"
+#include "heartbeat-acc.h"
+#include "heartbeat-pow.h"
+#include "heartbeat-acc-pow.h"
+
+/**
+ * Attach to a region by name, using the same naming rules as the writer.
+ * The region's header, e.g., its mode and writer pid, is then available from
+ * reader->header.
+ * Fails if reader or name is NULL (errno is set to EINVAL), if the region is
+ * not yet initialized (errno is set to EAGAIN), if it isn't a valid region for
+ * this library version (errno is set to EPROTO), or if it cannot be opened and
+ * mapped.
+ * Not supported on Windows (errno is set to ENOSYS).
+ *
+ * @param reader
+ * @param name
+ * @return 0 on success, another value otherwise
+ */
+int hb_shm_reader_open(heartbeat_shm_reader* reader, const char* name);
+
+/**
+ * Unmap the region.
+ * If reader is NULL, errno is set to EINVAL.
+ *
+ * @param reader
+ * @return 0 on success, another value otherwise
+ */
+int hb_shm_reader_close(heartbeat_shm_reader* reader);
+
+/**
+ * Get a consistent copy of the latest record in the region, like
+ * hb_get_snapshot().
+ * Fails if reader or snapshot is NULL, or if the region's mode doesn't match
+ * (errno is set to EINVAL), or if a consistent copy couldn't be made (errno
+ * is set to EAGAIN).
+ *
+ * @param reader
+ * @param snapshot
+ * @return 0 on success, another value otherwise
+ */
+int hb_shm_read(const heartbeat_shm_reader* reader, heartbeat_record* snapshot);
+
+/**
+ * Get a consistent copy of the latest record in the region.
+ * See hb_shm_read().
+ *
+ * @param reader
+ * @param snapshot
+ * @return 0 on success, another value otherwise
+ */
+int hb_acc_shm_read(const heartbeat_shm_reader* reader, heartbeat_acc_record* snapshot);
+
+/**
+ * Get a consistent copy of the latest record in the region.
+ * See hb_shm_read().
+ *
+ * @param reader
+ * @param snapshot
+ * @return 0 on success, another value otherwise
+ */
+int hb_pow_shm_read(const heartbeat_shm_reader* reader, heartbeat_pow_record* snapshot);
+
+/**
+ * Get a consistent copy of the latest record in the region.
+ * See hb_shm_read().
+ *
+ * @param reader
+ * @param snapshot
+ * @return 0 on success, another value otherwise
+ */
+int hb_acc_pow_shm_read(const heartbeat_shm_reader* reader, heartbeat_acc_pow_record* snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * Low-overhead time source for heartbeat timestamps.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HEARTBEAT_TIME_H_
+#define _HEARTBEAT_TIME_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+
+typedef enum hb_clock_source {
+  // POSIX monotonic clock (QueryPerformanceCounter on Windows)
+  HB_CLOCK_MONOTONIC = 0,
+  // Monotonic clock that is not subject to NTP frequency adjustments
+  HB_CLOCK_MONOTONIC_RAW,
+  // x86 time stamp counter, calibrated against HB_CLOCK_MONOTONIC_RAW
+  HB_CLOCK_TSC
+} hb_clock_source;
+
+/**
+ * Select the clock used by hb_time_now().
+ * HB_CLOCK_TSC requires an invariant TSC, which is calibrated once here (this
+ * takes a few milliseconds). If the TSC is not invariant, or a source is
+ * otherwise not supported, a fallback is selected - check the result with
+ * hb_time_get_source().
+ * Not thread-safe: call during initialization, before heartbeats are issued.
+ * If source is unknown, errno is set to EINVAL.
+ *
+ * @param source
+ * @return 0 on success, another value otherwise
+ */
+int hb_time_init(hb_clock_source source);
+
+/**
+ * Get the clock used by hb_time_now().
+ * HB_CLOCK_MONOTONIC is used until hb_time_init() is called.
+ *
+ * @return the clock source
+ */
+hb_clock_source hb_time_get_source(void);
+
+/**
+ * Get the current time (ns) from the selected clock source.
+ * Times are only meaningful relative to each other, e.g., as heartbeat start
+ * and end times, and only between calls to hb_time_init().
+ *
+ * @return the current time (ns)
+ */
+uint64_t hb_time_now(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -20,6 +20,33 @@ extern "C" {
 #include "heartbeat-pow-container.h"
 #include "heartbeat-acc-pow-container.h"
 
+#include "heartbeat-shard.h"
+#include "heartbeat-acc-shard.h"
+#include "heartbeat-pow-shard.h"
+#include "heartbeat-acc-pow-shard.h"
+
+#include "heartbeat-scope.h"
+#include "heartbeat-acc-scope.h"
+#include "heartbeat-pow-scope.h"
+#include "heartbeat-acc-pow-scope.h"
+
+#include "heartbeat-shm.h"
+#include "heartbeat-acc-shm.h"
+#include "heartbeat-pow-shm.h"
+#include "heartbeat-acc-pow-shm.h"
+#include "heartbeat-shm-reader.h"
+#include "heartbeat-compact.h"
+#include "heartbeat-acc-compact.h"
+#include "heartbeat-pow-compact.h"
+#include "heartbeat-acc-pow-compact.h"
+
+#include "heartbeat-time.h"
+#include "heartbeat-energy.h"
+#include "heartbeat-log-sink.h"
+#include "heartbeat-histogram.h"
+#include "heartbeat-ewma.h"
+#include "heartbeat-rollup.h"
+
 #ifdef __cplusplus
 }
 #endif
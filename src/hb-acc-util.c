@@ -13,6 +13,9 @@
 #else
 #include "heartbeat-acc.h"
 #endif
+#include "hb-ewma.h"
+#include "hb-rates.h"
+#include "hb-stats.h"
 
 #if defined(HEARTBEAT_MODE_ACC_POW)
 uint64_t hb_acc_pow_get_global_accuracy(const heartbeat_acc_pow_context* hb) {
@@ -43,11 +46,16 @@ double hb_acc_pow_get_global_accuracy_rate(const heartbeat_acc_pow_context* hb)
 #else
 double hb_acc_get_global_accuracy_rate(const heartbeat_acc_context* hb) {
 #endif
+  const hb_mode_record* rec;
   if (hb == NULL) {
     errno = EINVAL;
     return 0.0;
   }
-  return hb->window_buffer[hb->ws.read_index].acc.global;
+  if (hb->window_buffer == NULL) {
+    return hb_rate(hb->ad.global, hb->td.global);
+  }
+  rec = &hb->window_buffer[hb->ws.read_index];
+  return hb_lazy_rates(hb) ? hb_rate(rec->ad.global, rec->td.global) : rec->acc.global;
 }
 
 #if defined(HEARTBEAT_MODE_ACC_POW)
@@ -55,11 +63,16 @@ double hb_acc_pow_get_window_accuracy_rate(const heartbeat_acc_pow_context* hb)
 #else
 double hb_acc_get_window_accuracy_rate(const heartbeat_acc_context* hb) {
 #endif
+  const hb_mode_record* rec;
   if (hb == NULL) {
     errno = EINVAL;
     return 0.0;
   }
-  return hb->window_buffer[hb->ws.read_index].acc.window;
+  if (hb->window_buffer == NULL) {
+    return 0.0;
+  }
+  rec = &hb->window_buffer[hb->ws.read_index];
+  return hb_lazy_rates(hb) ? hb_rate(rec->ad.window, rec->td.window) : rec->acc.window;
 }
 
 #if defined(HEARTBEAT_MODE_ACC_POW)
@@ -67,9 +80,58 @@ double hb_acc_pow_get_instant_accuracy_rate(const heartbeat_acc_pow_context* hb)
 #else
 double hb_acc_get_instant_accuracy_rate(const heartbeat_acc_context* hb) {
 #endif
+  const hb_mode_record* rec;
   if (hb == NULL) {
     errno = EINVAL;
     return 0.0;
   }
-  return hb->window_buffer[hb->ws.read_index].acc.instant;
+  if (hb->window_buffer == NULL) {
+    return 0.0;
+  }
+  if (hb->columns != NULL && !hb_lazy_rates(hb)) {
+    return hb->columns->acc_instant[hb->ws.read_index];
+  }
+  rec = &hb->window_buffer[hb->ws.read_index];
+  return hb_lazy_rates(hb) ? hb_rate(rec->accuracy, rec->end_time - rec->start_time) : rec->acc.instant;
+}
+
+/* Computed from the record's data, since its rates may be lazy */
+static double instant_accuracy_rate(const void* rec) {
+  const hb_mode_record* r = rec;
+  return hb_rate(r->accuracy, r->end_time - r->start_time);
+}
+
+#if defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_get_window_accuracy_rate_stats(const heartbeat_acc_pow_context* hb,
+                                              heartbeat_window_stats* stats,
+                                              double* scratch) {
+#else
+int hb_acc_get_window_accuracy_rate_stats(const heartbeat_acc_context* hb,
+                                          heartbeat_window_stats* stats,
+                                          double* scratch) {
+#endif
+  if (hb == NULL || stats == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (hb->columns != NULL && !hb_lazy_rates(hb)) {
+    hb_stats_values(hb->columns->acc_instant, hb->ws.window_size, hb_window_first(hb), hb_window_records(hb), scratch,
+                    stats);
+  } else {
+    hb_stats_records(hb->window_buffer, sizeof(hb_mode_record), hb->ws.window_size, hb_window_first(hb),
+                     hb_window_records(hb), &instant_accuracy_rate, scratch, stats);
+  }
+  return 0;
+}
+
+#if defined(HEARTBEAT_MODE_ACC_POW)
+double hb_acc_pow_get_ewma_accuracy_rate(const heartbeat_acc_pow_context* hb, uint32_t index) {
+#else
+double hb_acc_get_ewma_accuracy_rate(const heartbeat_acc_context* hb, uint32_t index) {
+#endif
+  if (hb == NULL || hb->ws.ewma == NULL) {
+    errno = EINVAL;
+    return 0.0;
+  }
+  return hb_ewma_rate(hb->ws.ewma, hb->ws.ewma->accuracy, index);
 }
@@ -0,0 +1,113 @@
+/**
+ * Private locking and atomic helpers shared by the heartbeat implementations.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HB_ATOMIC_H_
+#define _HB_ATOMIC_H_
+
+#include <inttypes.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+/* Busy-wait iterations before yielding the processor to other threads */
+#define HB_SPIN_LIMIT 128
+
+static inline void hb_cpu_relax(void) {
+#if defined(_WIN32)
+  YieldProcessor();
+#elif defined(__i386__) || defined(__x86_64__)
+  __asm__ __volatile__("pause");
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+/*
+ * Back off in a wait loop; yield once we have spun for a while, since the
+ * thread we're waiting on may not be running.
+ */
+static inline void hb_spin_wait(unsigned int* spins) {
+  if (*spins < HB_SPIN_LIMIT) {
+    (*spins)++;
+    hb_cpu_relax();
+  } else {
+#if defined(_WIN32)
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+  }
+}
+
+static inline void hb_spin_lock(volatile int* lock) {
+  unsigned int spins = 0;
+#if defined(_WIN32)
+  // long guaranteed to be 32 bits on Windows
+  while (InterlockedExchange((long*) lock, 1)) {
+#else
+  while (__sync_lock_test_and_set(lock, 1)) {
+#endif
+    while (*lock) {
+      hb_spin_wait(&spins);
+    }
+  }
+}
+
+static inline void hb_spin_unlock(volatile int* lock) {
+#if defined(_WIN32)
+  InterlockedExchange((long*) lock, 0);
+#else
+  __sync_lock_release(lock);
+#endif
+}
+
+/* Returns the value before the addition; implies a full barrier */
+static inline uint64_t hb_fetch_add_u64(volatile uint64_t* ptr, uint64_t val) {
+#if defined(_WIN32)
+  return (uint64_t) InterlockedExchangeAdd64((volatile LONG64*) ptr, (LONG64) val);
+#else
+  return __sync_fetch_and_add(ptr, val);
+#endif
+}
+
+/* Returns the value after the addition; implies a full barrier */
+static inline uint64_t hb_add_fetch_u64(volatile uint64_t* ptr, uint64_t val) {
+  return hb_fetch_add_u64(ptr, val) + val;
+}
+
+/* Returns the value before the exchange, which only happened if it was expected; implies a full barrier */
+static inline uint64_t hb_cas_u64(volatile uint64_t* ptr, uint64_t expected, uint64_t val) {
+#if defined(_WIN32)
+  return (uint64_t) InterlockedCompareExchange64((volatile LONG64*) ptr, (LONG64) val, (LONG64) expected);
+#else
+  return __sync_val_compare_and_swap(ptr, expected, val);
+#endif
+}
+
+/* Order prior loads before subsequent loads and stores */
+static inline void hb_fence_acquire(void) {
+#if defined(_WIN32)
+  MemoryBarrier();
+#elif defined(__ATOMIC_ACQUIRE)
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+#else
+  __sync_synchronize();
+#endif
+}
+
+/* Order prior loads and stores before subsequent stores */
+static inline void hb_fence_release(void) {
+#if defined(_WIN32)
+  MemoryBarrier();
+#elif defined(__ATOMIC_RELEASE)
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+#else
+  __sync_synchronize();
+#endif
+}
+
+#endif
@@ -0,0 +1,383 @@
+/**
+ * Compact heartbeats, with 32-bit delta records reconstructed from a
+ * per-window base.
+ *
+ * @author Connor Imes
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Determine which heartbeat implementation to use */
+#if defined(HEARTBEAT_MODE_ACC)
+#include "heartbeat-acc-compact.h"
+typedef heartbeat_acc_compact_context hb_compact_context;
+typedef heartbeat_acc_compact_record hb_compact_record;
+#elif defined(HEARTBEAT_MODE_POW)
+#include "heartbeat-pow-compact.h"
+typedef heartbeat_pow_compact_context hb_compact_context;
+typedef heartbeat_pow_compact_record hb_compact_record;
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+#include "heartbeat-acc-pow-compact.h"
+typedef heartbeat_acc_pow_compact_context hb_compact_context;
+typedef heartbeat_acc_pow_compact_record hb_compact_record;
+#else
+#include "heartbeat-compact.h"
+typedef heartbeat_compact_context hb_compact_context;
+typedef heartbeat_compact_record hb_compact_record;
+#endif
+#include "hb-atomic.h"
+#include "hb-mode.h"
+#include "hb-rates.h"
+
+/* Records reconstructed at a time for logging */
+#define HB_COMPACT_LOG_CHUNK 32
+
+#if defined(HEARTBEAT_MODE_ACC)
+int heartbeat_acc_compact_init(heartbeat_acc_compact_context* cc,
+                               uint64_t window_size,
+                               heartbeat_acc_compact_record* window_buffer,
+                               int log_fd,
+                               heartbeat_acc_compact_window_complete* hwc_callback) {
+#elif defined(HEARTBEAT_MODE_POW)
+int heartbeat_pow_compact_init(heartbeat_pow_compact_context* cc,
+                               uint64_t window_size,
+                               heartbeat_pow_compact_record* window_buffer,
+                               int log_fd,
+                               heartbeat_pow_compact_window_complete* hwc_callback) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int heartbeat_acc_pow_compact_init(heartbeat_acc_pow_compact_context* cc,
+                                   uint64_t window_size,
+                                   heartbeat_acc_pow_compact_record* window_buffer,
+                                   int log_fd,
+                                   heartbeat_acc_pow_compact_window_complete* hwc_callback) {
+#else
+int heartbeat_compact_init(heartbeat_compact_context* cc,
+                           uint64_t window_size,
+                           heartbeat_compact_record* window_buffer,
+                           int log_fd,
+                           heartbeat_compact_window_complete* hwc_callback) {
+#endif
+  if (cc == NULL || window_size == 0 || window_buffer == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  memset(cc, 0, sizeof(*cc));
+  cc->window_buffer = window_buffer;
+  cc->window_size = window_size;
+  cc->log_fd = log_fd;
+  cc->hwc_callback = hwc_callback;
+  return 0;
+}
+
+/*
+ * Reconstruct the record at index i from the previous record, or from the base
+ * for the first record.
+ */
+static void expand(const hb_compact_context* cc, uint64_t i, const hb_mode_record* prev, hb_mode_record* rec) {
+  const hb_compact_record* c = &cc->window_buffer[i];
+  const hb_mode_record* base = &cc->base;
+  memset(rec, 0, sizeof(*rec));
+  rec->id = base->id + i;
+  rec->user_tag = c->user_tag;
+  rec->work = c->work;
+  rec->start_time = (prev == NULL ? base->start_time : prev->end_time) + c->gap;
+  rec->end_time = rec->start_time + c->duration;
+  rec->wd.global = (prev == NULL ? base->wd.global : prev->wd.global) + c->work;
+  rec->wd.window = rec->wd.global - base->wd.global;
+  rec->td.global = (prev == NULL ? base->td.global : prev->td.global) + c->duration;
+  rec->td.window = rec->td.global - base->td.global;
+#if defined(HEARTBEAT_USE_ACC)
+  rec->accuracy = c->accuracy;
+  rec->ad.global = (prev == NULL ? base->ad.global : prev->ad.global) + c->accuracy;
+  rec->ad.window = rec->ad.global - base->ad.global;
+#endif
+#if defined(HEARTBEAT_USE_POW)
+  rec->start_energy = (prev == NULL ? base->start_energy : prev->end_energy) + c->energy_gap;
+  rec->end_energy = rec->start_energy + c->energy;
+  rec->ed.global = (prev == NULL ? base->ed.global : prev->ed.global) + c->energy;
+  rec->ed.window = rec->ed.global - base->ed.global;
+#endif
+  hb_compute_rates(rec);
+}
+
+/*
+ * Reconstruct the window in chunks and log them with a view of a regular context.
+ */
+static int log_window(const hb_compact_context* cc) {
+  hb_mode_record chunk[HB_COMPACT_LOG_CHUNK];
+  hb_mode_context view;
+  hb_mode_record prev;
+  uint64_t i;
+  uint64_t n;
+  int err = 0;
+  memset(&view, 0, sizeof(view));
+  view.window_buffer = chunk;
+  for (i = 0; i < cc->buffer_index && !err; i += n) {
+    for (n = 0; n < HB_COMPACT_LOG_CHUNK && i + n < cc->buffer_index; n++) {
+      expand(cc, i + n, i + n == 0 ? NULL : &prev, &chunk[n]);
+      memcpy(&prev, &chunk[n], sizeof(prev));
+    }
+    view.ws.buffer_index = n;
+#if defined(HEARTBEAT_MODE_ACC)
+    err = hb_acc_log_window_buffer(&view, cc->log_fd);
+#elif defined(HEARTBEAT_MODE_POW)
+    err = hb_pow_log_window_buffer(&view, cc->log_fd);
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+    err = hb_acc_pow_log_window_buffer(&view, cc->log_fd);
+#else
+    err = hb_log_window_buffer(&view, cc->log_fd);
+#endif
+  }
+  return err;
+}
+
+static void complete_window(hb_compact_context* cc) {
+  if (cc->log_fd > 0 && log_window(cc)) {
+    perror("Failed to log heartbeat record data");
+  }
+  if (cc->hwc_callback != NULL) {
+    (*cc->hwc_callback)(cc);
+  }
+  cc->buffer_index = 0;
+}
+
+static int fits(uint64_t val) {
+  return val <= UINT32_MAX;
+}
+
+/*
+ * Whether the heartbeat's own values fit in a compact record.
+ */
+static int values_fit(const hb_mode_input* in) {
+  return fits(in->user_tag) && fits(in->work) && in->end_time >= in->start_time &&
+         fits(in->end_time - in->start_time)
+#if defined(HEARTBEAT_USE_ACC)
+         && fits(in->accuracy)
+#endif
+#if defined(HEARTBEAT_USE_POW)
+         && in->end_energy >= in->start_energy && fits(in->end_energy - in->start_energy)
+#endif
+         ;
+}
+
+/*
+ * Whether the heartbeat can be stored relative to the last one.
+ */
+static int gaps_fit(const hb_compact_context* cc, const hb_mode_input* in) {
+  return in->start_time >= cc->last.end_time && fits(in->start_time - cc->last.end_time)
+#if defined(HEARTBEAT_USE_POW)
+         && in->start_energy >= cc->last.end_energy && fits(in->start_energy - cc->last.end_energy)
+#endif
+         ;
+}
+
+/*
+ * Account for a heartbeat in the last record, with its global data and the
+ * window data since the base.
+ */
+static void update_last(hb_compact_context* cc, const hb_mode_input* in) {
+  hb_mode_record* last = &cc->last;
+  last->id = cc->counter;
+  last->user_tag = in->user_tag;
+  last->work = in->work;
+  last->start_time = in->start_time;
+  last->end_time = in->end_time;
+  last->wd.global += in->work;
+  last->wd.window = last->wd.global - cc->base.wd.global;
+  last->td.global += in->end_time - in->start_time;
+  last->td.window = last->td.global - cc->base.td.global;
+#if defined(HEARTBEAT_USE_ACC)
+  last->accuracy = in->accuracy;
+  last->ad.global += in->accuracy;
+  last->ad.window = last->ad.global - cc->base.ad.global;
+#endif
+#if defined(HEARTBEAT_USE_POW)
+  last->start_energy = in->start_energy;
+  last->end_energy = in->end_energy;
+  last->ed.global += in->end_energy - in->start_energy;
+  last->ed.window = last->ed.global - cc->base.ed.global;
+#endif
+}
+
+static void issue(hb_compact_context* cc, const hb_mode_input* in) {
+  hb_compact_record* c;
+  hb_mode_record* last;
+  if (cc == NULL) {
+    errno = EINVAL;
+    return;
+  }
+  last = &cc->last;
+  hb_spin_lock(&cc->lock);
+  if (!values_fit(in)) {
+    // the record can't be stored, but it's still counted in the global data as a window of its own,
+    // so the next window's base begins after it
+    if (cc->buffer_index > 0) {
+      complete_window(cc);
+    }
+    memcpy(&cc->base, last, sizeof(cc->base));
+    update_last(cc, in);
+    cc->counter++;
+    cc->rejected++;
+    hb_spin_unlock(&cc->lock);
+    errno = ERANGE;
+    return;
+  }
+  if (cc->buffer_index > 0 && !gaps_fit(cc, in)) {
+    complete_window(cc);
+  }
+  if (cc->buffer_index == 0) {
+    // the new window's base starts where this heartbeat does, after the global data so far
+    memcpy(&cc->base, last, sizeof(cc->base));
+    cc->base.id = cc->counter;
+    cc->base.start_time = in->start_time;
+    cc->base.end_time = in->start_time;
+#if defined(HEARTBEAT_USE_POW)
+    cc->base.start_energy = in->start_energy;
+    cc->base.end_energy = in->start_energy;
+#endif
+  }
+  c = &cc->window_buffer[cc->buffer_index];
+  c->user_tag = (uint32_t) in->user_tag;
+  c->work = (uint32_t) in->work;
+  c->duration = (uint32_t) (in->end_time - in->start_time);
+  c->gap = (uint32_t) (cc->buffer_index == 0 ? 0 : in->start_time - last->end_time);
+#if defined(HEARTBEAT_USE_ACC)
+  c->accuracy = (uint32_t) in->accuracy;
+#endif
+#if defined(HEARTBEAT_USE_POW)
+  c->energy = (uint32_t) (in->end_energy - in->start_energy);
+  c->energy_gap = (uint32_t) (cc->buffer_index == 0 ? 0 : in->start_energy - last->end_energy);
+#endif
+
+  // the last record is kept in full, so readers don't need to reconstruct it
+  update_last(cc, in);
+  cc->counter++;
+  cc->buffer_index++;
+  if (cc->buffer_index == cc->window_size) {
+    complete_window(cc);
+  }
+  hb_spin_unlock(&cc->lock);
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+void heartbeat_acc_compact(heartbeat_acc_compact_context* cc,
+                           uint64_t user_tag,
+                           uint64_t work,
+                           uint64_t start_time,
+                           uint64_t end_time,
+                           uint64_t accuracy) {
+  hb_mode_input in = { user_tag, work, start_time, end_time, accuracy };
+#elif defined(HEARTBEAT_MODE_POW)
+void heartbeat_pow_compact(heartbeat_pow_compact_context* cc,
+                           uint64_t user_tag,
+                           uint64_t work,
+                           uint64_t start_time,
+                           uint64_t end_time,
+                           uint64_t start_energy,
+                           uint64_t end_energy) {
+  hb_mode_input in = { user_tag, work, start_time, end_time, start_energy, end_energy };
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+void heartbeat_acc_pow_compact(heartbeat_acc_pow_compact_context* cc,
+                               uint64_t user_tag,
+                               uint64_t work,
+                               uint64_t start_time,
+                               uint64_t end_time,
+                               uint64_t accuracy,
+                               uint64_t start_energy,
+                               uint64_t end_energy) {
+  hb_mode_input in = { user_tag, work, start_time, end_time, accuracy, start_energy, end_energy };
+#else
+void heartbeat_compact(heartbeat_compact_context* cc,
+                       uint64_t user_tag,
+                       uint64_t work,
+                       uint64_t start_time,
+                       uint64_t end_time) {
+  hb_mode_input in = { user_tag, work, start_time, end_time };
+#endif
+  issue(cc, &in);
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+uint64_t hb_acc_compact_get_window_records(const heartbeat_acc_compact_context* cc) {
+#elif defined(HEARTBEAT_MODE_POW)
+uint64_t hb_pow_compact_get_window_records(const heartbeat_pow_compact_context* cc) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+uint64_t hb_acc_pow_compact_get_window_records(const heartbeat_acc_pow_compact_context* cc) {
+#else
+uint64_t hb_compact_get_window_records(const heartbeat_compact_context* cc) {
+#endif
+  if (cc == NULL) {
+    errno = EINVAL;
+    return 0;
+  }
+  return cc->buffer_index;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+uint64_t hb_acc_compact_get_rejected(const heartbeat_acc_compact_context* cc) {
+#elif defined(HEARTBEAT_MODE_POW)
+uint64_t hb_pow_compact_get_rejected(const heartbeat_pow_compact_context* cc) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+uint64_t hb_acc_pow_compact_get_rejected(const heartbeat_acc_pow_compact_context* cc) {
+#else
+uint64_t hb_compact_get_rejected(const heartbeat_compact_context* cc) {
+#endif
+  if (cc == NULL) {
+    errno = EINVAL;
+    return 0;
+  }
+  return cc->rejected;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_compact_get_records(const heartbeat_acc_compact_context* cc, uint64_t first,
+                               heartbeat_acc_record* records, uint64_t count) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_compact_get_records(const heartbeat_pow_compact_context* cc, uint64_t first,
+                               heartbeat_pow_record* records, uint64_t count) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_compact_get_records(const heartbeat_acc_pow_compact_context* cc, uint64_t first,
+                                   heartbeat_acc_pow_record* records, uint64_t count) {
+#else
+int hb_compact_get_records(const heartbeat_compact_context* cc, uint64_t first,
+                           heartbeat_record* records, uint64_t count) {
+#endif
+  hb_mode_record prev;
+  hb_mode_record rec;
+  uint64_t i;
+  if (cc == NULL || records == NULL || first > cc->buffer_index || count > cc->buffer_index - first) {
+    errno = EINVAL;
+    return -1;
+  }
+  // records are relative to the previous one, so reconstruct from the start of the window
+  for (i = 0; i < first + count; i++) {
+    expand(cc, i, i == 0 ? NULL : &prev, &rec);
+    memcpy(&prev, &rec, sizeof(prev));
+    if (i >= first) {
+      memcpy(&records[i - first], &rec, sizeof(rec));
+    }
+  }
+  return 0;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_compact_get_snapshot(heartbeat_acc_compact_context* cc, heartbeat_acc_record* snapshot) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_compact_get_snapshot(heartbeat_pow_compact_context* cc, heartbeat_pow_record* snapshot) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_compact_get_snapshot(heartbeat_acc_pow_compact_context* cc, heartbeat_acc_pow_record* snapshot) {
+#else
+int hb_compact_get_snapshot(heartbeat_compact_context* cc, heartbeat_record* snapshot) {
+#endif
+  if (cc == NULL || snapshot == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  hb_spin_lock(&cc->lock);
+  memcpy(snapshot, &cc->last, sizeof(*snapshot));
+  hb_spin_unlock(&cc->lock);
+  hb_compute_rates(snapshot);
+  return 0;
+}
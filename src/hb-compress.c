@@ -0,0 +1,184 @@
+/**
+ * Compressed binary log blocks.
+ * Each block is self-contained, so blocks can be written from any thread and
+ * decoded without the rest of the log: a varint record count and payload
+ * size, followed by each record's raw inputs and cumulative data as residuals
+ * from predictions based on the previous record in the block. Rates are not
+ * stored, since they're computed from the other fields.
+ *
+ * @author Connor Imes
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "hb-mode.h"
+#include "hb-rates.h"
+#include "hb-varint.h"
+
+/* Space for the block's count and payload size */
+#define HB_BLOCK_HEADER_MAX (2 * HB_VARINT_MAX)
+
+static unsigned char* encode_record(unsigned char* pos, const hb_mode_record* rec, const hb_mode_record* prev) {
+  pos = hb_varint_put_delta(pos, rec->id, prev->id + 1);
+  pos = hb_varint_put_delta(pos, rec->user_tag, prev->user_tag);
+
+  pos = hb_varint_put_delta(pos, rec->work, prev->work);
+  pos = hb_varint_put_delta(pos, rec->start_time, prev->end_time);
+  pos = hb_varint_put_delta(pos, rec->end_time, rec->start_time + (prev->end_time - prev->start_time));
+  pos = hb_varint_put_delta(pos, rec->wd.global, prev->wd.global + rec->work);
+  pos = hb_varint_put_delta(pos, rec->wd.window, prev->wd.window);
+  pos = hb_varint_put_delta(pos, rec->td.global, prev->td.global + (rec->end_time - rec->start_time));
+  pos = hb_varint_put_delta(pos, rec->td.window, prev->td.window);
+#if defined(HEARTBEAT_USE_ACC)
+
+  pos = hb_varint_put_delta(pos, rec->accuracy, prev->accuracy);
+  pos = hb_varint_put_delta(pos, rec->ad.global, prev->ad.global + rec->accuracy);
+  pos = hb_varint_put_delta(pos, rec->ad.window, prev->ad.window);
+#endif
+#if defined(HEARTBEAT_USE_POW)
+
+  pos = hb_varint_put_delta(pos, rec->start_energy, prev->end_energy);
+  pos = hb_varint_put_delta(pos, rec->end_energy, rec->start_energy + (prev->end_energy - prev->start_energy));
+  pos = hb_varint_put_delta(pos, rec->ed.global, prev->ed.global + (rec->end_energy - rec->start_energy));
+  pos = hb_varint_put_delta(pos, rec->ed.window, prev->ed.window);
+#endif
+  return pos;
+}
+
+/*
+ * Decode fields in the same order they're encoded. Returns NULL if the data
+ * is truncated or invalid.
+ */
+static const unsigned char* decode_record(const unsigned char* pos, const unsigned char* end, hb_mode_record* rec,
+                                          const hb_mode_record* prev) {
+  memset(rec, 0, sizeof(*rec));
+  if ((pos = hb_varint_get_delta(pos, end, &rec->id, prev->id + 1)) == NULL ||
+      (pos = hb_varint_get_delta(pos, end, &rec->user_tag, prev->user_tag)) == NULL ||
+
+      (pos = hb_varint_get_delta(pos, end, &rec->work, prev->work)) == NULL ||
+      (pos = hb_varint_get_delta(pos, end, &rec->start_time, prev->end_time)) == NULL ||
+      (pos = hb_varint_get_delta(pos, end, &rec->end_time,
+                                 rec->start_time + (prev->end_time - prev->start_time))) == NULL ||
+      (pos = hb_varint_get_delta(pos, end, &rec->wd.global, prev->wd.global + rec->work)) == NULL ||
+      (pos = hb_varint_get_delta(pos, end, &rec->wd.window, prev->wd.window)) == NULL ||
+      (pos = hb_varint_get_delta(pos, end, &rec->td.global,
+                                 prev->td.global + (rec->end_time - rec->start_time))) == NULL ||
+      (pos = hb_varint_get_delta(pos, end, &rec->td.window, prev->td.window)) == NULL) {
+    return NULL;
+  }
+#if defined(HEARTBEAT_USE_ACC)
+  if ((pos = hb_varint_get_delta(pos, end, &rec->accuracy, prev->accuracy)) == NULL ||
+      (pos = hb_varint_get_delta(pos, end, &rec->ad.global, prev->ad.global + rec->accuracy)) == NULL ||
+      (pos = hb_varint_get_delta(pos, end, &rec->ad.window, prev->ad.window)) == NULL) {
+    return NULL;
+  }
+#endif
+#if defined(HEARTBEAT_USE_POW)
+  if ((pos = hb_varint_get_delta(pos, end, &rec->start_energy, prev->end_energy)) == NULL ||
+      (pos = hb_varint_get_delta(pos, end, &rec->end_energy,
+                                 rec->start_energy + (prev->end_energy - prev->start_energy))) == NULL ||
+      (pos = hb_varint_get_delta(pos, end, &rec->ed.global,
+                                 prev->ed.global + (rec->end_energy - rec->start_energy))) == NULL ||
+      (pos = hb_varint_get_delta(pos, end, &rec->ed.window, prev->ed.window)) == NULL) {
+    return NULL;
+  }
+#endif
+  hb_compute_rates(rec);
+  return pos;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_log_encode_block(const heartbeat_acc_record* records, uint64_t count, void* buf, size_t len,
+                            size_t* block_len) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_log_encode_block(const heartbeat_pow_record* records, uint64_t count, void* buf, size_t len,
+                            size_t* block_len) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_log_encode_block(const heartbeat_acc_pow_record* records, uint64_t count, void* buf, size_t len,
+                                size_t* block_len) {
+#else
+int hb_log_encode_block(const heartbeat_record* records, uint64_t count, void* buf, size_t len,
+                        size_t* block_len) {
+#endif
+  static const hb_mode_record zero;
+  unsigned char header[HB_BLOCK_HEADER_MAX];
+  unsigned char* payload;
+  unsigned char* pos;
+  unsigned char* hpos;
+  const hb_mode_record* prev = &zero;
+  uint64_t i;
+  if ((records == NULL && count > 0) || buf == NULL || block_len == NULL ||
+      len < HEARTBEAT_LOG_BLOCK_MAX(count, sizeof(hb_mode_record))) {
+    errno = EINVAL;
+    return -1;
+  }
+  // encode the payload after space for the header, then move it up behind the header
+  payload = (unsigned char*) buf + HB_BLOCK_HEADER_MAX;
+  for (i = 0, pos = payload; i < count; i++) {
+    pos = encode_record(pos, &records[i], prev);
+    prev = &records[i];
+  }
+  hpos = hb_varint_put(header, count);
+  hpos = hb_varint_put(hpos, (uint64_t) (pos - payload));
+  memcpy(buf, header, (size_t) (hpos - header));
+  memmove((unsigned char*) buf + (hpos - header), payload, (size_t) (pos - payload));
+  *block_len = (size_t) (hpos - header) + (size_t) (pos - payload);
+  return 0;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_log_decode_block(const void* data, size_t len, heartbeat_acc_record* records, uint64_t max_records,
+                            uint64_t* count, size_t* block_len) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_log_decode_block(const void* data, size_t len, heartbeat_pow_record* records, uint64_t max_records,
+                            uint64_t* count, size_t* block_len) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_log_decode_block(const void* data, size_t len, heartbeat_acc_pow_record* records,
+                                uint64_t max_records, uint64_t* count, size_t* block_len) {
+#else
+int hb_log_decode_block(const void* data, size_t len, heartbeat_record* records, uint64_t max_records,
+                        uint64_t* count, size_t* block_len) {
+#endif
+  static const hb_mode_record zero;
+  const unsigned char* pos = data;
+  const unsigned char* end = pos + len;
+  const unsigned char* payload_end;
+  const hb_mode_record* prev = &zero;
+  uint64_t n;
+  uint64_t payload_len;
+  uint64_t i;
+  if (data == NULL || records == NULL || count == NULL || block_len == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if ((pos = hb_varint_get(pos, end, &n)) == NULL || (pos = hb_varint_get(pos, end, &payload_len)) == NULL) {
+    // a truncated header, unless the header is invalid
+    errno = len >= HB_BLOCK_HEADER_MAX ? EPROTO : EAGAIN;
+    return -1;
+  }
+  if (payload_len > (uint64_t) (end - pos)) {
+    errno = EAGAIN;
+    return -1;
+  }
+  if (n > max_records) {
+    errno = ENOBUFS;
+    return -1;
+  }
+  payload_end = pos + payload_len;
+  for (i = 0; i < n; i++) {
+    if ((pos = decode_record(pos, payload_end, &records[i], prev)) == NULL) {
+      errno = EPROTO;
+      return -1;
+    }
+    prev = &records[i];
+  }
+  if (pos != payload_end) {
+    errno = EPROTO;
+    return -1;
+  }
+  *count = n;
+  *block_len = (size_t) (payload_end - (const unsigned char*) data);
+  return 0;
+}
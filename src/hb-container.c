@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* Determine which heartbeat implementation to use */
 #if defined(HEARTBEAT_MODE_ACC)
@@ -18,6 +19,59 @@
 #else
 #include "heartbeat-container.h"
 #endif
+#include "hb-mode.h"
+
+/* The number of uint64_t columns, followed by the double columns */
+#if defined(HEARTBEAT_MODE_ACC)
+#define HB_COLUMNS_U64 6
+#define HB_COLUMNS_DOUBLE 2
+#elif defined(HEARTBEAT_MODE_POW)
+#define HB_COLUMNS_U64 7
+#define HB_COLUMNS_DOUBLE 2
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+#define HB_COLUMNS_U64 8
+#define HB_COLUMNS_DOUBLE 3
+#else
+#define HB_COLUMNS_U64 5
+#define HB_COLUMNS_DOUBLE 1
+#endif
+
+/*
+ * Allocate all columns in one block, starting with id, so freeing id frees them all.
+ */
+static int alloc_columns(hb_mode_columns* cols, uint64_t window_size) {
+  uint64_t* u;
+  double* d;
+  if (window_size > SIZE_MAX / sizeof(uint64_t) / (HB_COLUMNS_U64 + HB_COLUMNS_DOUBLE)) {
+    errno = ENOMEM;
+    return -1;
+  }
+  u = calloc((size_t) window_size * (HB_COLUMNS_U64 + HB_COLUMNS_DOUBLE), sizeof(uint64_t));
+  if (u == NULL) {
+    return -1;
+  }
+  d = (double*) (u + window_size * HB_COLUMNS_U64);
+  cols->id = u;
+  cols->user_tag = u + window_size;
+  cols->work = u + 2 * window_size;
+  cols->start_time = u + 3 * window_size;
+  cols->end_time = u + 4 * window_size;
+  cols->perf_instant = d;
+#if defined(HEARTBEAT_MODE_ACC) || defined(HEARTBEAT_MODE_ACC_POW)
+  cols->accuracy = u + 5 * window_size;
+  cols->acc_instant = d + window_size;
+#endif
+#if defined(HEARTBEAT_MODE_POW)
+  cols->start_energy = u + 5 * window_size;
+  cols->end_energy = u + 6 * window_size;
+  cols->pwr_instant = d + window_size;
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+  cols->start_energy = u + 6 * window_size;
+  cols->end_energy = u + 7 * window_size;
+  cols->pwr_instant = d + 2 * window_size;
+#endif
+  return 0;
+}
 
 #if defined(HEARTBEAT_MODE_ACC)
 int heartbeat_acc_container_init(heartbeat_acc_container* hc,
@@ -40,6 +94,7 @@ int heartbeat_container_init(heartbeat_container* hc,
     errno = EINVAL;
     return -1;
   }
+  memset(&hc->columns, 0, sizeof(hc->columns));
   hc->window_buffer = malloc(window_size * record_size);
   if (hc->window_buffer == NULL) {
     return -1;
@@ -97,6 +152,50 @@ int heartbeat_container_init_context(heartbeat_container* hc,
 }
 #endif
 
+#if defined(HEARTBEAT_MODE_ACC)
+int heartbeat_acc_container_init_columns(heartbeat_acc_container* hc,
+                                         uint64_t window_size,
+                                         int log_fd,
+                                         heartbeat_acc_window_complete* hwc_callback) {
+  if (heartbeat_acc_container_init_context(hc, window_size, log_fd, hwc_callback)) {
+#elif defined(HEARTBEAT_MODE_POW)
+int heartbeat_pow_container_init_columns(heartbeat_pow_container* hc,
+                                         uint64_t window_size,
+                                         int log_fd,
+                                         heartbeat_pow_window_complete* hwc_callback) {
+  if (heartbeat_pow_container_init_context(hc, window_size, log_fd, hwc_callback)) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int heartbeat_acc_pow_container_init_columns(heartbeat_acc_pow_container* hc,
+                                             uint64_t window_size,
+                                             int log_fd,
+                                             heartbeat_acc_pow_window_complete* hwc_callback) {
+  if (heartbeat_acc_pow_container_init_context(hc, window_size, log_fd, hwc_callback)) {
+#else
+int heartbeat_container_init_columns(heartbeat_container* hc,
+                                     uint64_t window_size,
+                                     int log_fd,
+                                     heartbeat_window_complete* hwc_callback) {
+  if (heartbeat_container_init_context(hc, window_size, log_fd, hwc_callback)) {
+#endif
+    return -1;
+  }
+  if (alloc_columns(&hc->columns, window_size)) {
+    free(hc->window_buffer);
+    hc->window_buffer = NULL;
+    return -1;
+  }
+#if defined(HEARTBEAT_MODE_ACC)
+  hb_acc_set_columns(&hc->hb, &hc->columns);
+#elif defined(HEARTBEAT_MODE_POW)
+  hb_pow_set_columns(&hc->hb, &hc->columns);
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+  hb_acc_pow_set_columns(&hc->hb, &hc->columns);
+#else
+  hb_set_columns(&hc->hb, &hc->columns);
+#endif
+  return 0;
+}
+
 #if defined(HEARTBEAT_MODE_ACC)
 void heartbeat_acc_container_finish(heartbeat_acc_container* hc) {
 #elif defined(HEARTBEAT_MODE_POW)
@@ -109,5 +208,7 @@ void heartbeat_container_finish(heartbeat_container* hc) {
   if (hc != NULL) {
     free(hc->window_buffer);
     hc->window_buffer = NULL;
+    free(hc->columns.id);
+    memset(&hc->columns, 0, sizeof(hc->columns));
   }
 }
@@ -0,0 +1,325 @@
+/**
+ * Energy providers for heartbeat energy readings.
+ *
+ * @author Connor Imes
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "heartbeat-energy.h"
+
+#define HB_ENERGY_MAX_ZONES 64
+#define HB_ENERGY_PATH_MAX 4096
+
+/* uJ per uWh */
+#define UJ_PER_UWH 3600
+
+#if defined(__linux__)
+
+typedef enum hb_sysfs_kind {
+  // a counter that only increases, except when it overflows
+  HB_SYSFS_COUNTER,
+  // remaining energy, which decreases as energy is consumed
+  HB_SYSFS_REMAINING
+} hb_sysfs_kind;
+
+typedef struct hb_sysfs_zone {
+  int fd;
+  // 0 if the counter is not expected to overflow
+  uint64_t max_range;
+  uint64_t last;
+} hb_sysfs_zone;
+
+typedef struct hb_sysfs_energy {
+  hb_sysfs_kind kind;
+  uint64_t scale;
+  uint64_t total;
+  uint32_t count;
+  hb_sysfs_zone zones[HB_ENERGY_MAX_ZONES];
+} hb_sysfs_energy;
+
+static int read_u64(int fd, uint64_t* val) {
+  char buf[32];
+  char* end;
+  ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+  if (n <= 0) {
+    if (n == 0) {
+      errno = ENODATA;
+    }
+    return -1;
+  }
+  buf[n] = '\0';
+  errno = 0;
+  *val = strtoull(buf, &end, 10);
+  if (errno || end == buf) {
+    errno = errno ? errno : EINVAL;
+    return -1;
+  }
+  return 0;
+}
+
+static int read_u64_path(const char* path, uint64_t* val) {
+  int ret;
+  int err_save;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  ret = read_u64(fd, val);
+  err_save = errno;
+  close(fd);
+  errno = err_save;
+  return ret;
+}
+
+/*
+ * Open a zone's file and take its first reading.
+ */
+static int add_zone(hb_sysfs_energy* se, const char* path, uint64_t max_range) {
+  hb_sysfs_zone* zone;
+  if (se->count == HB_ENERGY_MAX_ZONES) {
+    errno = ENOMEM;
+    return -1;
+  }
+  zone = &se->zones[se->count];
+  zone->max_range = max_range;
+  zone->fd = open(path, O_RDONLY);
+  if (zone->fd < 0) {
+    return -1;
+  }
+  if (read_u64(zone->fd, &zone->last)) {
+    close(zone->fd);
+    return -1;
+  }
+  se->count++;
+  return 0;
+}
+
+static int sysfs_read(hb_energy_provider* ep, uint64_t* energy) {
+  hb_sysfs_energy* se = ep->state;
+  hb_sysfs_zone* zone;
+  uint64_t val;
+  uint32_t i;
+  for (i = 0; i < se->count; i++) {
+    zone = &se->zones[i];
+    if (read_u64(zone->fd, &val)) {
+      return -1;
+    }
+    if (se->kind == HB_SYSFS_REMAINING) {
+      if (val < zone->last) {
+        se->total += (zone->last - val) * se->scale;
+      }
+    } else if (val >= zone->last) {
+      se->total += (val - zone->last) * se->scale;
+    } else if (zone->max_range > 0) {
+      // counter overflowed
+      se->total += (zone->max_range - zone->last + val) * se->scale;
+    } else {
+      // counter was reset
+      se->total += val * se->scale;
+    }
+    zone->last = val;
+  }
+  *energy = se->total;
+  return 0;
+}
+
+static int sysfs_finish(hb_energy_provider* ep) {
+  hb_sysfs_energy* se = ep->state;
+  int ret = 0;
+  uint32_t i;
+  for (i = 0; i < se->count; i++) {
+    ret |= close(se->zones[i].fd);
+  }
+  free(se);
+  ep->state = NULL;
+  return ret;
+}
+
+/*
+ * Allocate state and install the sysfs functions.
+ */
+static hb_sysfs_energy* sysfs_init(hb_energy_provider* ep, hb_sysfs_kind kind, uint64_t scale) {
+  hb_sysfs_energy* se;
+  if (ep == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+  se = malloc(sizeof(hb_sysfs_energy));
+  if (se == NULL) {
+    return NULL;
+  }
+  se->kind = kind;
+  se->scale = scale;
+  se->total = 0;
+  se->count = 0;
+  ep->read = &sysfs_read;
+  ep->finish = &sysfs_finish;
+  ep->state = se;
+  return se;
+}
+
+/*
+ * Close any open zones on failure, preserving errno.
+ */
+static int sysfs_init_done(hb_energy_provider* ep, int failed) {
+  hb_sysfs_energy* se = ep->state;
+  int err_save;
+  if (!failed && se->count == 0) {
+    errno = ENOENT;
+    failed = 1;
+  }
+  if (failed) {
+    err_save = errno;
+    sysfs_finish(ep);
+    errno = err_save;
+    return -1;
+  }
+  return 0;
+}
+
+static int is_top_level_rapl_zone(const char* name) {
+  const char* prefix = "intel-rapl:";
+  return strncmp(name, prefix, strlen(prefix)) == 0 && strchr(name + strlen(prefix), ':') == NULL;
+}
+
+int hb_energy_powercap_init(hb_energy_provider* ep, const char* root) {
+  char path[HB_ENERGY_PATH_MAX];
+  uint64_t max_range;
+  struct dirent* entry;
+  DIR* dir;
+  int failed = 0;
+  if (sysfs_init(ep, HB_SYSFS_COUNTER, 1) == NULL) {
+    return -1;
+  }
+  root = root == NULL ? "/sys/class/powercap" : root;
+  if ((dir = opendir(root)) == NULL) {
+    return sysfs_init_done(ep, 1);
+  }
+  while (!failed && (entry = readdir(dir)) != NULL) {
+    if (!is_top_level_rapl_zone(entry->d_name)) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "%s/%s/max_energy_range_uj", root, entry->d_name);
+    if (read_u64_path(path, &max_range)) {
+      failed = 1;
+      break;
+    }
+    snprintf(path, sizeof(path), "%s/%s/energy_uj", root, entry->d_name);
+    failed = add_zone(ep->state, path, max_range) != 0;
+  }
+  closedir(dir);
+  return sysfs_init_done(ep, failed);
+}
+
+int hb_energy_hwmon_init(hb_energy_provider* ep, const char* root) {
+  char path[HB_ENERGY_PATH_MAX];
+  struct dirent* entry;
+  struct dirent* sensor;
+  DIR* dir;
+  DIR* hwmon;
+  size_t len;
+  int failed = 0;
+  if (sysfs_init(ep, HB_SYSFS_COUNTER, 1) == NULL) {
+    return -1;
+  }
+  root = root == NULL ? "/sys/class/hwmon" : root;
+  if ((dir = opendir(root)) == NULL) {
+    return sysfs_init_done(ep, 1);
+  }
+  while (!failed && (entry = readdir(dir)) != NULL) {
+    if (strncmp(entry->d_name, "hwmon", strlen("hwmon")) != 0) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
+    if ((hwmon = opendir(path)) == NULL) {
+      continue;
+    }
+    while (!failed && (sensor = readdir(hwmon)) != NULL) {
+      len = strlen(sensor->d_name);
+      if (strncmp(sensor->d_name, "energy", strlen("energy")) != 0 || len < strlen("_input") ||
+          strcmp(sensor->d_name + len - strlen("_input"), "_input") != 0) {
+        continue;
+      }
+      snprintf(path, sizeof(path), "%s/%s/%s", root, entry->d_name, sensor->d_name);
+      failed = add_zone(ep->state, path, 0) != 0;
+    }
+    closedir(hwmon);
+  }
+  closedir(dir);
+  return sysfs_init_done(ep, failed);
+}
+
+int hb_energy_power_supply_init(hb_energy_provider* ep, const char* root) {
+  char path[HB_ENERGY_PATH_MAX];
+  struct dirent* entry;
+  DIR* dir;
+  int failed = 0;
+  if (sysfs_init(ep, HB_SYSFS_REMAINING, UJ_PER_UWH) == NULL) {
+    return -1;
+  }
+  root = root == NULL ? "/sys/class/power_supply" : root;
+  if ((dir = opendir(root)) == NULL) {
+    return sysfs_init_done(ep, 1);
+  }
+  while (!failed && (entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    snprintf(path, sizeof(path), "%s/%s/energy_now", root, entry->d_name);
+    if (access(path, R_OK)) {
+      // not all supplies report energy, e.g., AC adapters
+      continue;
+    }
+    failed = add_zone(ep->state, path, 0) != 0;
+  }
+  closedir(dir);
+  return sysfs_init_done(ep, failed);
+}
+
+#else
+
+int hb_energy_powercap_init(hb_energy_provider* ep, const char* root) {
+  (void) root;
+  errno = ep == NULL ? EINVAL : ENOSYS;
+  return -1;
+}
+
+int hb_energy_hwmon_init(hb_energy_provider* ep, const char* root) {
+  (void) root;
+  errno = ep == NULL ? EINVAL : ENOSYS;
+  return -1;
+}
+
+int hb_energy_power_supply_init(hb_energy_provider* ep, const char* root) {
+  (void) root;
+  errno = ep == NULL ? EINVAL : ENOSYS;
+  return -1;
+}
+
+#endif
+
+int hb_energy_read(hb_energy_provider* ep, uint64_t* energy) {
+  if (ep == NULL || ep->read == NULL || energy == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  return ep->read(ep, energy);
+}
+
+int hb_energy_finish(hb_energy_provider* ep) {
+  if (ep == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  return ep->finish == NULL ? 0 : ep->finish(ep);
+}
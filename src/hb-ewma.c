@@ -0,0 +1,69 @@
+/**
+ * Exponentially weighted moving averages.
+ *
+ * @author Connor Imes
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "heartbeat-ewma.h"
+#include "hb-atomic.h"
+#include "hb-ewma.h"
+
+#define ONE_BILLION 1000000000.0
+
+int hb_ewma_init(hb_ewma* ewma, const uint64_t* time_constants, uint32_t count) {
+  uint32_t i;
+  if (ewma == NULL || time_constants == NULL || count == 0 || count > HB_EWMA_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (i = 0; i < count; i++) {
+    if (time_constants[i] == 0) {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+  memset(ewma, 0, sizeof(*ewma));
+  memcpy(ewma->time_constant, time_constants, count * sizeof(uint64_t));
+  ewma->count = count;
+  return 0;
+}
+
+void hb_ewma_update(hb_ewma* ewma, uint64_t start_time, uint64_t end_time, uint64_t work, uint64_t accuracy,
+                    uint64_t energy, int lock_free) {
+  uint64_t elapsed;
+  double decay;
+  uint32_t i;
+  if (lock_free) {
+    hb_spin_lock(&ewma->lock);
+  }
+  // decay over the time since the latest heartbeat, or over the first one; late heartbeats don't decay
+  if (ewma->last_time == 0) {
+    elapsed = end_time - start_time;
+  } else {
+    elapsed = end_time > ewma->last_time ? end_time - ewma->last_time : 0;
+  }
+  ewma->last_time = end_time > ewma->last_time ? end_time : ewma->last_time;
+  for (i = 0; i < ewma->count; i++) {
+    decay = exp(-((double) elapsed / (double) ewma->time_constant[i]));
+    ewma->work[i] = ewma->work[i] * decay + (double) work;
+    ewma->time[i] = ewma->time[i] * decay + (double) (end_time - start_time);
+    ewma->accuracy[i] = ewma->accuracy[i] * decay + (double) accuracy;
+    ewma->energy[i] = ewma->energy[i] * decay + (double) energy;
+  }
+  if (lock_free) {
+    hb_spin_unlock(&ewma->lock);
+  }
+}
+
+double hb_ewma_rate(const hb_ewma* ewma, const double* data, uint32_t index) {
+  if (index >= ewma->count) {
+    errno = EINVAL;
+    return 0.0;
+  }
+  return ewma->time[index] > 0 ? data[index] / (ewma->time[index] / ONE_BILLION) : 0.0;
+}
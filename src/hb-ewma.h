@@ -0,0 +1,25 @@
+/**
+ * Private moving average functions for heartbeats.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HB_EWMA_H_
+#define _HB_EWMA_H_
+
+#include <inttypes.h>
+#include "heartbeat-ewma.h"
+
+/*
+ * Add a heartbeat to the moving averages. Concurrent producers must set
+ * lock_free, since they don't hold the context lock.
+ */
+void hb_ewma_update(hb_ewma* ewma, uint64_t start_time, uint64_t end_time, uint64_t work, uint64_t accuracy,
+                    uint64_t energy, int lock_free);
+
+/*
+ * The rate of data (a decayed total) per second, like hb_rate(), or 0 before
+ * any time has elapsed. Returns 0 and sets errno if index isn't valid.
+ */
+double hb_ewma_rate(const hb_ewma* ewma, const double* data, uint32_t index);
+
+#endif
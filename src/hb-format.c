@@ -0,0 +1,98 @@
+/**
+ * Text formatting for logs.
+ *
+ * @author Connor Imes
+ */
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hb-format.h"
+
+/* Values that can be scaled to an exact integer count of millionths */
+#define HB_FORMAT_EXACT_MAX 9007199254740992.0
+#define HB_FORMAT_SCALE 1000000
+
+static const char digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static char* pad(char* pos, char* start, unsigned int width) {
+  size_t len = (size_t) (pos - start);
+  if (len < width) {
+    memset(pos, ' ', width - len);
+    pos += width - len;
+  }
+  return pos;
+}
+
+/*
+ * Write digits without padding, at least min_digits of them.
+ */
+static char* write_digits(char* pos, uint64_t val, unsigned int min_digits) {
+  char tmp[20];
+  char* end = tmp + sizeof(tmp);
+  char* p = end;
+  while (val >= 100) {
+    p -= 2;
+    memcpy(p, &digit_pairs[(val % 100) * 2], 2);
+    val /= 100;
+  }
+  if (val >= 10) {
+    p -= 2;
+    memcpy(p, &digit_pairs[val * 2], 2);
+  } else {
+    *--p = (char) ('0' + val);
+  }
+  while ((unsigned int) (end - p) < min_digits) {
+    *--p = '0';
+  }
+  memcpy(pos, p, (size_t) (end - p));
+  return pos + (end - p);
+}
+
+char* hb_format_str(char* pos, const char* str, unsigned int width) {
+  size_t len = strlen(str);
+  memcpy(pos, str, len);
+  return pad(pos + len, pos, width);
+}
+
+char* hb_format_u64(char* pos, uint64_t val, unsigned int width) {
+  return pad(write_digits(pos, val, 1), pos, width);
+}
+
+char* hb_format_double(char* pos, double val, unsigned int width) {
+  double scaled = val * HB_FORMAT_SCALE;
+  double frac;
+  double tie_dist;
+  uint64_t whole;
+  char* start = pos;
+  // negative values, NaN, infinity, and large values are rare, so use printf
+  if (signbit(val) || !(scaled < HB_FORMAT_EXACT_MAX)) {
+    return pos + snprintf(pos, HB_FORMAT_FIELD_MAX, "%-*.6f", (int) width, val);
+  }
+  whole = (uint64_t) scaled;
+  frac = scaled - (double) whole;
+  // scaling rounds by at most half an ulp, so printf's rounding of the exact
+  // value is only in doubt near a tie
+  tie_dist = frac > 0.5 ? frac - 0.5 : 0.5 - frac;
+  if (tie_dist <= scaled * 0x1p-51) {
+    return pos + snprintf(pos, HB_FORMAT_FIELD_MAX, "%-*.6f", (int) width, val);
+  }
+  if (frac > 0.5) {
+    whole++;
+  }
+  pos = write_digits(pos, whole / HB_FORMAT_SCALE, 1);
+  *pos++ = '.';
+  pos = write_digits(pos, whole % HB_FORMAT_SCALE, 6);
+  return pad(pos, start, width);
+}
@@ -0,0 +1,28 @@
+/**
+ * Private text formatting for logs, shared by the heartbeat implementations.
+ * Fields are formatted into a caller's buffer without allocation, and match
+ * printf's "%-*"PRIu64 and "%-*.6f" conversions byte for byte.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HB_FORMAT_H_
+#define _HB_FORMAT_H_
+
+#include <inttypes.h>
+
+/* Space needed for any field with a width of at most HB_FORMAT_WIDTH_MAX */
+#define HB_FORMAT_WIDTH_MAX 32
+#define HB_FORMAT_FIELD_MAX 352
+
+/*
+ * Each function formats a left-justified field at pos, padded with spaces to
+ * width, and returns the position after it. Nothing is terminated.
+ */
+char* hb_format_str(char* pos, const char* str, unsigned int width);
+
+char* hb_format_u64(char* pos, uint64_t val, unsigned int width);
+
+/* Fixed-point with 6 decimal places */
+char* hb_format_double(char* pos, double val, unsigned int width);
+
+#endif
@@ -0,0 +1,174 @@
+/**
+ * Log-linear histograms.
+ *
+ * @author Connor Imes
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "heartbeat-histogram.h"
+#include "hb-atomic.h"
+#include "hb-histogram.h"
+
+static unsigned int msb(uint64_t value) {
+#if defined(__GNUC__)
+  return 63 - (unsigned int) __builtin_clzll(value);
+#else
+  unsigned int bit = 0;
+  while (value >>= 1) {
+    bit++;
+  }
+  return bit;
+#endif
+}
+
+/*
+ * Values below 2^p are their own index. Otherwise, the group after the
+ * first 2^p indexes is given by the most significant bit, and the index in
+ * the group by the next p bits.
+ */
+static size_t bucket_index(uint64_t value, uint32_t p) {
+  unsigned int shift;
+  if (value < ((uint64_t) 1 << p)) {
+    return (size_t) value;
+  }
+  shift = msb(value) - p;
+  return ((size_t) (shift + 1) << p) + (size_t) ((value >> shift) - ((uint64_t) 1 << p));
+}
+
+static uint64_t bucket_lowest(size_t index, uint32_t p) {
+  size_t group = index >> p;
+  if (group == 0) {
+    return index;
+  }
+  return (((uint64_t) 1 << p) + (index & (((size_t) 1 << p) - 1))) << (group - 1);
+}
+
+static uint64_t bucket_highest(size_t index, uint32_t p) {
+  size_t group = index >> p;
+  if (group == 0) {
+    return index;
+  }
+  return bucket_lowest(index, p) + (((uint64_t) 1 << (group - 1)) - 1);
+}
+
+static void clear(hb_histogram* h) {
+  memset(h->counts, 0, HB_HISTOGRAM_LEN(h->precision) * sizeof(uint64_t));
+  h->count = 0;
+  h->min = UINT64_MAX;
+  h->max = 0;
+}
+
+int hb_histogram_init(hb_histogram* h, uint32_t precision, uint64_t* counts, size_t len) {
+  if (h == NULL || counts == NULL || precision > HB_HISTOGRAM_PRECISION_MAX || len < HB_HISTOGRAM_LEN(precision)) {
+    errno = EINVAL;
+    return -1;
+  }
+  h->counts = counts;
+  h->precision = precision;
+  h->reserved = 0;
+  clear(h);
+  return 0;
+}
+
+static void record_n(hb_histogram* h, uint64_t value, uint64_t n, uint64_t min, uint64_t max) {
+  h->counts[bucket_index(value, h->precision)] += n;
+  h->count += n;
+  h->min = min < h->min ? min : h->min;
+  h->max = max > h->max ? max : h->max;
+}
+
+int hb_histogram_record(hb_histogram* h, uint64_t value) {
+  if (h == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  record_n(h, value, 1, value, value);
+  return 0;
+}
+
+void hb_histogram_record_atomic(hb_histogram* h, uint64_t value) {
+  uint64_t cur;
+  uint64_t prev;
+  hb_fetch_add_u64(&h->counts[bucket_index(value, h->precision)], 1);
+  hb_fetch_add_u64(&h->count, 1);
+  for (cur = h->min; value < cur; cur = prev) {
+    if ((prev = hb_cas_u64(&h->min, cur, value)) == cur) {
+      break;
+    }
+  }
+  for (cur = h->max; value > cur; cur = prev) {
+    if ((prev = hb_cas_u64(&h->max, cur, value)) == cur) {
+      break;
+    }
+  }
+}
+
+int hb_histogram_reset(hb_histogram* h) {
+  if (h == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  clear(h);
+  return 0;
+}
+
+int hb_histogram_merge(hb_histogram* dst, const hb_histogram* src) {
+  size_t len;
+  size_t i;
+  if (dst == NULL || src == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (src->count == 0) {
+    return 0;
+  }
+  len = HB_HISTOGRAM_LEN(src->precision);
+  for (i = 0; i < len; i++) {
+    if (src->counts[i] > 0) {
+      record_n(dst, bucket_lowest(i, src->precision), src->counts[i], src->min, src->max);
+    }
+  }
+  return 0;
+}
+
+uint64_t hb_histogram_get_percentile(const hb_histogram* h, double percentile) {
+  double target;
+  uint64_t rank;
+  uint64_t seen = 0;
+  uint64_t value;
+  size_t len;
+  size_t i;
+  if (h == NULL || !(percentile >= 0 && percentile <= 100)) {
+    errno = EINVAL;
+    return 0;
+  }
+  if (h->count == 0) {
+    return 0;
+  }
+  // the nearest rank, at least the first
+  target = percentile / 100 * (double) h->count;
+  rank = (uint64_t) target;
+  if ((double) rank < target) {
+    rank++;
+  }
+  // the first and last values are known exactly
+  if (rank <= 1) {
+    return h->min;
+  }
+  if (rank >= h->count) {
+    return h->max;
+  }
+  len = HB_HISTOGRAM_LEN(h->precision);
+  for (i = 0; i < len; i++) {
+    seen += h->counts[i];
+    if (seen >= rank) {
+      break;
+    }
+  }
+  value = i < len ? bucket_highest(i, h->precision) : h->max;
+  value = value < h->min ? h->min : value;
+  return value > h->max ? h->max : value;
+}
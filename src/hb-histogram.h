@@ -0,0 +1,18 @@
+/**
+ * Private histogram functions for heartbeats.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HB_HISTOGRAM_H_
+#define _HB_HISTOGRAM_H_
+
+#include <inttypes.h>
+#include "heartbeat-histogram.h"
+
+/*
+ * Record a value with atomic updates, for producers that don't hold the
+ * context lock. Concurrent resets are not supported.
+ */
+void hb_histogram_record_atomic(hb_histogram* h, uint64_t value);
+
+#endif
@@ -0,0 +1,221 @@
+/**
+ * Private asynchronous window logging, shared by the heartbeat
+ * implementations.
+ *
+ * @author Connor Imes
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+#include "hb-log-queue.h"
+#include "heartbeat-time.h"
+
+#if defined(_WIN32)
+
+struct hb_log_queue* hb_log_queue_create(const void* hb,
+                                         hb_log_queue_format* format,
+                                         int fd,
+                                         size_t record_size,
+                                         uint64_t window_size,
+                                         uint32_t queue_len) {
+  (void) hb;
+  (void) format;
+  (void) fd;
+  (void) record_size;
+  (void) window_size;
+  (void) queue_len;
+  errno = ENOSYS;
+  return NULL;
+}
+
+void hb_log_queue_enqueue(struct hb_log_queue* lq, const void* records, uint64_t count) {
+  (void) lq;
+  (void) records;
+  (void) count;
+}
+
+int hb_log_queue_destroy(struct hb_log_queue* lq) {
+  (void) lq;
+  return 0;
+}
+
+void hb_log_queue_get_stats(struct hb_log_queue* lq, heartbeat_async_log_stats* stats) {
+  (void) lq;
+  memset(stats, 0, sizeof(heartbeat_async_log_stats));
+}
+
+#else
+
+typedef struct hb_log_queue_slot {
+  void* records;
+  uint64_t count;
+} hb_log_queue_slot;
+
+struct hb_log_queue {
+  const void* hb;
+  hb_log_queue_format* format;
+  int fd;
+  size_t record_size;
+
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  int stop;
+
+  // circular queue of preallocated window buffers
+  hb_log_queue_slot* slots;
+  uint32_t queue_len;
+  uint32_t head;
+  uint32_t depth;
+
+  heartbeat_async_log_stats stats;
+};
+
+static void* writer(void* arg) {
+  struct hb_log_queue* lq = arg;
+  hb_log_queue_slot* slot;
+  int err;
+  pthread_mutex_lock(&lq->mutex);
+  for (;;) {
+    while (lq->depth == 0 && !lq->stop) {
+      pthread_cond_wait(&lq->not_empty, &lq->mutex);
+    }
+    if (lq->depth == 0) {
+      // stopped and drained
+      break;
+    }
+    slot = &lq->slots[lq->head];
+    // the slot is ours until it's released, so don't hold the lock while writing
+    pthread_mutex_unlock(&lq->mutex);
+    err = lq->format(lq->hb, slot->records, slot->count, lq->fd);
+    if (err) {
+      errno = err;
+      perror("Failed to log heartbeat record data");
+    }
+    pthread_mutex_lock(&lq->mutex);
+    lq->head = (lq->head + 1) % lq->queue_len;
+    lq->depth--;
+    lq->stats.windows_written++;
+    if (err) {
+      lq->stats.write_errors++;
+    }
+    pthread_cond_signal(&lq->not_full);
+  }
+  pthread_mutex_unlock(&lq->mutex);
+  return NULL;
+}
+
+static void free_slots(struct hb_log_queue* lq) {
+  uint32_t i;
+  for (i = 0; i < lq->queue_len; i++) {
+    free(lq->slots[i].records);
+  }
+  free(lq->slots);
+}
+
+struct hb_log_queue* hb_log_queue_create(const void* hb,
+                                         hb_log_queue_format* format,
+                                         int fd,
+                                         size_t record_size,
+                                         uint64_t window_size,
+                                         uint32_t queue_len) {
+  struct hb_log_queue* lq;
+  uint32_t i;
+  int err;
+  if ((lq = calloc(1, sizeof(struct hb_log_queue))) == NULL) {
+    return NULL;
+  }
+  if ((lq->slots = calloc(queue_len, sizeof(hb_log_queue_slot))) == NULL) {
+    free(lq);
+    return NULL;
+  }
+  lq->queue_len = queue_len;
+  for (i = 0; i < queue_len; i++) {
+    if ((lq->slots[i].records = malloc(window_size * record_size)) == NULL) {
+      free_slots(lq);
+      free(lq);
+      return NULL;
+    }
+  }
+  lq->hb = hb;
+  lq->format = format;
+  lq->fd = fd;
+  lq->record_size = record_size;
+  lq->stats.queue_len = queue_len;
+  pthread_mutex_init(&lq->mutex, NULL);
+  pthread_cond_init(&lq->not_empty, NULL);
+  pthread_cond_init(&lq->not_full, NULL);
+  if ((err = pthread_create(&lq->thread, NULL, &writer, lq))) {
+    pthread_cond_destroy(&lq->not_full);
+    pthread_cond_destroy(&lq->not_empty);
+    pthread_mutex_destroy(&lq->mutex);
+    free_slots(lq);
+    free(lq);
+    errno = err;
+    return NULL;
+  }
+  return lq;
+}
+
+void hb_log_queue_enqueue(struct hb_log_queue* lq, const void* records, uint64_t count) {
+  hb_log_queue_slot* slot;
+  uint64_t wait_start;
+  pthread_mutex_lock(&lq->mutex);
+  if (lq->depth == lq->queue_len) {
+    // backpressure: the writer isn't keeping up
+    lq->stats.full_waits++;
+    wait_start = hb_time_now();
+    while (lq->depth == lq->queue_len) {
+      pthread_cond_wait(&lq->not_full, &lq->mutex);
+    }
+    lq->stats.full_wait_time += hb_time_now() - wait_start;
+  }
+  slot = &lq->slots[(lq->head + lq->depth) % lq->queue_len];
+  pthread_mutex_unlock(&lq->mutex);
+  // only this producer uses the free slot, so copy without the lock
+  memcpy(slot->records, records, count * lq->record_size);
+  slot->count = count;
+  pthread_mutex_lock(&lq->mutex);
+  lq->depth++;
+  lq->stats.windows_queued++;
+  if (lq->depth > lq->stats.max_depth) {
+    lq->stats.max_depth = lq->depth;
+  }
+  pthread_cond_signal(&lq->not_empty);
+  pthread_mutex_unlock(&lq->mutex);
+}
+
+int hb_log_queue_destroy(struct hb_log_queue* lq) {
+  int err;
+  pthread_mutex_lock(&lq->mutex);
+  lq->stop = 1;
+  pthread_cond_signal(&lq->not_empty);
+  pthread_mutex_unlock(&lq->mutex);
+  err = pthread_join(lq->thread, NULL);
+  pthread_cond_destroy(&lq->not_full);
+  pthread_cond_destroy(&lq->not_empty);
+  pthread_mutex_destroy(&lq->mutex);
+  free_slots(lq);
+  free(lq);
+  if (err) {
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+void hb_log_queue_get_stats(struct hb_log_queue* lq, heartbeat_async_log_stats* stats) {
+  pthread_mutex_lock(&lq->mutex);
+  memcpy(stats, &lq->stats, sizeof(heartbeat_async_log_stats));
+  stats->depth = lq->depth;
+  pthread_mutex_unlock(&lq->mutex);
+}
+
+#endif
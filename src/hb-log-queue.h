@@ -0,0 +1,41 @@
+/**
+ * Private asynchronous window logging, shared by the heartbeat
+ * implementations. Completed windows are copied into a bounded queue of
+ * preallocated buffers, and a writer thread formats and writes them.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HB_LOG_QUEUE_H_
+#define _HB_LOG_QUEUE_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "heartbeat-common-types.h"
+
+/* Write a window of records for a heartbeat context to a file descriptor */
+typedef int (hb_log_queue_format) (const void* hb, const void* records, uint64_t count, int fd);
+
+/*
+ * Start a writer thread for windows of up to window_size records.
+ * Returns NULL and sets errno on failure.
+ */
+struct hb_log_queue* hb_log_queue_create(const void* hb,
+                                         hb_log_queue_format* format,
+                                         int fd,
+                                         size_t record_size,
+                                         uint64_t window_size,
+                                         uint32_t queue_len);
+
+/*
+ * Copy a window into the queue, waiting for space if the queue is full.
+ */
+void hb_log_queue_enqueue(struct hb_log_queue* lq, const void* records, uint64_t count);
+
+/*
+ * Write all queued windows, then stop the writer thread and free resources.
+ */
+int hb_log_queue_destroy(struct hb_log_queue* lq);
+
+void hb_log_queue_get_stats(struct hb_log_queue* lq, heartbeat_async_log_stats* stats);
+
+#endif
@@ -0,0 +1,532 @@
+/**
+ * Log sinks for heartbeat log data.
+ *
+ * @author Connor Imes
+ */
+#if defined(__linux__)
+// for fallocate()
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_MSC_VER)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#if !defined(_WIN32)
+#include <dirent.h>
+#include <fcntl.h>
+#endif
+
+#include "heartbeat-log-sink.h"
+#include "hb-log-sink.h"
+
+typedef struct hb_log_sink_fd {
+  int fd;
+} hb_log_sink_fd;
+
+typedef struct hb_log_sink_cb {
+  hb_log_sink_callback* cb;
+  void* arg;
+} hb_log_sink_cb;
+
+typedef struct hb_log_sink_memory {
+  char* data;
+  size_t len;
+  size_t size;
+} hb_log_sink_memory;
+
+typedef struct hb_log_sink_rotate {
+  char* pattern;
+  size_t prefix_len;
+  char* path;
+  size_t path_size;
+  uint64_t max_size;
+  uint32_t max_files;
+  // current segment, its file, and its size including the header
+  uint64_t index;
+  int fd;
+  uint64_t size;
+  // the last header, which begins each segment
+  char* header;
+  size_t header_len;
+} hb_log_sink_rotate;
+
+typedef struct hb_log_sink_fanout {
+  uint32_t count;
+  hb_log_sink** sinks;
+} hb_log_sink_fanout;
+
+int hb_write_all(int fd, const void* buf, size_t len) {
+  const char* pos = buf;
+  ssize_t written;
+  while (len > 0) {
+    written = write(fd, pos, len);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    pos += written;
+    len -= written;
+  }
+  return 0;
+}
+
+char* hb_log_sink_reserve(hb_log_sink* sink, size_t size) {
+  char* buf;
+  size_t buf_size;
+  if (size <= sink->buf_size) {
+    return sink->buf;
+  }
+  buf_size = sink->buf_size == 0 ? size : sink->buf_size;
+  while (buf_size < size) {
+    buf_size *= 2;
+  }
+  if ((buf = realloc(sink->buf, buf_size)) == NULL) {
+    return NULL;
+  }
+  sink->buf = buf;
+  sink->buf_size = buf_size;
+  return buf;
+}
+
+/*
+ * Initialize a sink with state of the given size.
+ */
+static void* sink_init(hb_log_sink* sink, size_t state_size) {
+  if (sink == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+  memset(sink, 0, sizeof(*sink));
+  sink->state = calloc(1, state_size);
+  return sink->state;
+}
+
+static int free_state(hb_log_sink* sink) {
+  free(sink->state);
+  sink->state = NULL;
+  return 0;
+}
+
+static int fd_write(hb_log_sink* sink, const void* data, size_t len) {
+  if ((errno = hb_write_all(((hb_log_sink_fd*) sink->state)->fd, data, len))) {
+    return -1;
+  }
+  return 0;
+}
+
+int hb_log_sink_fd_init(hb_log_sink* sink, int fd) {
+  hb_log_sink_fd* state;
+  if (fd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if ((state = sink_init(sink, sizeof(hb_log_sink_fd))) == NULL) {
+    return -1;
+  }
+  state->fd = fd;
+  sink->write = &fd_write;
+  sink->release = &free_state;
+  return 0;
+}
+
+#if !defined(_WIN32)
+
+/*
+ * Build a segment's path from the parts of the pattern around "%u".
+ */
+static void rotate_path(hb_log_sink_rotate* state, uint64_t index) {
+  snprintf(state->path, state->path_size, "%.*s%"PRIu64"%s", (int) state->prefix_len, state->pattern, index,
+           state->pattern + state->prefix_len + 2);
+}
+
+static int rotate_open(hb_log_sink_rotate* state, uint64_t index) {
+  int fd;
+  rotate_path(state, index);
+  if ((fd = open(state->path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    return -1;
+  }
+#if defined(__linux__)
+  // not all filesystems support preallocation, which is just an optimization
+  fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t) state->max_size);
+#endif
+  if (state->header_len > 0 && hb_write_all(fd, state->header, state->header_len)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/*
+ * Get the segment number from a file name if it's a segment name, i.e., the
+ * pattern's file name with a segment number in place of "%u".
+ */
+static int parse_segment_name(const char* name, const char* prefix, size_t prefix_len, const char* suffix,
+                              uint64_t* index) {
+  const char* pos = name + prefix_len;
+  size_t digits = 0;
+  uint64_t val = 0;
+  if (strncmp(name, prefix, prefix_len)) {
+    return -1;
+  }
+  for (; pos[digits] >= '0' && pos[digits] <= '9'; digits++) {
+    if (val > (UINT64_MAX - (uint64_t) (pos[digits] - '0')) / 10) {
+      return -1;
+    }
+    val = val * 10 + (uint64_t) (pos[digits] - '0');
+  }
+  // segment numbers are never zero-padded
+  if (digits == 0 || (pos[0] == '0' && digits > 1) || strcmp(pos + digits, suffix)) {
+    return -1;
+  }
+  *index = val;
+  return 0;
+}
+
+/*
+ * Find the segments that already match the pattern, e.g., from an earlier run,
+ * and remove the ones numbered below keep.
+ * Returns the number after the highest segment, or 0 if there are none.
+ */
+static uint64_t rotate_scan(hb_log_sink_rotate* state, uint64_t keep) {
+  const char* slash = strrchr(state->pattern, '/');
+  const char* prefix = slash == NULL ? state->pattern : slash + 1;
+  size_t prefix_len = state->prefix_len - (size_t) (prefix - state->pattern);
+  const char* suffix = state->pattern + state->prefix_len + 2;
+  struct dirent* entry;
+  DIR* dir;
+  uint64_t next = 0;
+  uint64_t index;
+  if (slash == NULL) {
+    dir = opendir(".");
+  } else {
+    // the pattern's directory, using path as scratch space
+    snprintf(state->path, state->path_size, "%.*s", slash == state->pattern ? 1 : (int) (slash - state->pattern),
+             state->pattern);
+    dir = opendir(state->path);
+  }
+  if (dir == NULL) {
+    // the first segment can't be created either
+    return 0;
+  }
+  while ((entry = readdir(dir)) != NULL) {
+    if (parse_segment_name(entry->d_name, prefix, prefix_len, suffix, &index)) {
+      continue;
+    }
+    if (index < keep) {
+      snprintf(state->path, state->path_size, "%.*s%s", (int) (prefix - state->pattern), state->pattern,
+               entry->d_name);
+      unlink(state->path);
+    } else if (index >= next) {
+      next = index + 1;
+    }
+  }
+  closedir(dir);
+  return next;
+}
+
+/*
+ * Start the next segment, then close the current one and remove the oldest.
+ * The current segment is kept if the next can't be started.
+ */
+static int rotate(hb_log_sink_rotate* state) {
+  int fd;
+  if ((fd = rotate_open(state, state->index + 1)) < 0) {
+    return -1;
+  }
+  close(state->fd);
+  state->fd = fd;
+  state->index++;
+  state->size = state->header_len;
+  if (state->max_files > 0 && state->index >= state->max_files) {
+    rotate_path(state, state->index - state->max_files);
+    unlink(state->path);
+  }
+  return 0;
+}
+
+static int rotate_write(hb_log_sink* sink, const void* data, size_t len) {
+  hb_log_sink_rotate* state = sink->state;
+  if (state->size > state->header_len && state->size + len > state->max_size) {
+    // try again next time, rather than lose data
+    rotate(state);
+  }
+  if ((errno = hb_write_all(state->fd, data, len))) {
+    return -1;
+  }
+  state->size += len;
+  return 0;
+}
+
+static int rotate_header(hb_log_sink* sink, const void* data, size_t len) {
+  hb_log_sink_rotate* state = sink->state;
+  char* tmp;
+  if ((tmp = realloc(state->header, len)) == NULL) {
+    return -1;
+  }
+  memcpy(tmp, data, len);
+  state->header = tmp;
+  state->header_len = len;
+  if ((errno = hb_write_all(state->fd, data, len))) {
+    return -1;
+  }
+  state->size += len;
+  return 0;
+}
+
+static int rotate_release(hb_log_sink* sink) {
+  hb_log_sink_rotate* state = sink->state;
+  int ret = close(state->fd);
+  free(state->header);
+  free(state->path);
+  free(state->pattern);
+  free_state(sink);
+  return ret;
+}
+
+/*
+ * The pattern must contain a single "%u" in its file name, and no other conversions.
+ */
+static int is_rotate_pattern(const char* pattern) {
+  const char* pos = strchr(pattern, '%');
+  return pos != NULL && pos[1] == 'u' && strchr(pos + 1, '%') == NULL && strchr(pos, '/') == NULL;
+}
+
+int hb_log_sink_rotate_init(hb_log_sink* sink, const char* pattern, uint64_t max_size, uint32_t max_files) {
+  hb_log_sink_rotate* state;
+  if (pattern == NULL || !is_rotate_pattern(pattern) || max_size == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if ((state = sink_init(sink, sizeof(hb_log_sink_rotate))) == NULL) {
+    return -1;
+  }
+  sink->release = &free_state;
+  state->max_size = max_size;
+  state->max_files = max_files;
+  state->prefix_len = (size_t) (strchr(pattern, '%') - pattern);
+  // room for any segment number
+  state->path_size = strlen(pattern) + 21;
+  if ((state->pattern = strdup(pattern)) == NULL || (state->path = malloc(state->path_size)) == NULL) {
+    free(state->path);
+    free(state->pattern);
+    free_state(sink);
+    return -1;
+  }
+  // continue an earlier series rather than overwrite it
+  state->index = rotate_scan(state, 0);
+  if ((state->fd = rotate_open(state, state->index)) < 0) {
+    free(state->path);
+    free(state->pattern);
+    free_state(sink);
+    return -1;
+  }
+  if (state->max_files > 0 && state->index >= state->max_files) {
+    // only the newest segments are kept, which the series then removes one at a time
+    rotate_scan(state, state->index - state->max_files + 1);
+  }
+  sink->write = &rotate_write;
+  sink->header = &rotate_header;
+  sink->release = &rotate_release;
+  return 0;
+}
+
+#else
+
+int hb_log_sink_rotate_init(hb_log_sink* sink, const char* pattern, uint64_t max_size, uint32_t max_files) {
+  (void) sink;
+  (void) pattern;
+  (void) max_size;
+  (void) max_files;
+  errno = ENOSYS;
+  return -1;
+}
+
+#endif
+
+static int cb_records(hb_log_sink* sink, const void* records, uint64_t count, size_t record_size) {
+  hb_log_sink_cb* state = sink->state;
+  return state->cb(records, count, record_size, state->arg);
+}
+
+int hb_log_sink_callback_init(hb_log_sink* sink, hb_log_sink_callback* cb, void* arg) {
+  hb_log_sink_cb* state;
+  if (cb == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if ((state = sink_init(sink, sizeof(hb_log_sink_cb))) == NULL) {
+    return -1;
+  }
+  state->cb = cb;
+  state->arg = arg;
+  sink->records = &cb_records;
+  sink->release = &free_state;
+  return 0;
+}
+
+static int memory_write(hb_log_sink* sink, const void* data, size_t len) {
+  hb_log_sink_memory* state = sink->state;
+  char* tmp;
+  size_t size;
+  if (state->size - state->len < len) {
+    size = state->size == 0 ? len : state->size;
+    while (size - state->len < len) {
+      size *= 2;
+    }
+    if ((tmp = realloc(state->data, size)) == NULL) {
+      return -1;
+    }
+    state->data = tmp;
+    state->size = size;
+  }
+  memcpy(state->data + state->len, data, len);
+  state->len += len;
+  return 0;
+}
+
+static int memory_release(hb_log_sink* sink) {
+  free(((hb_log_sink_memory*) sink->state)->data);
+  return free_state(sink);
+}
+
+int hb_log_sink_memory_init(hb_log_sink* sink) {
+  if (sink_init(sink, sizeof(hb_log_sink_memory)) == NULL) {
+    return -1;
+  }
+  sink->write = &memory_write;
+  sink->release = &memory_release;
+  return 0;
+}
+
+int hb_log_sink_memory_get(const hb_log_sink* sink, const void** data, size_t* len) {
+  hb_log_sink_memory* state;
+  if (sink == NULL || sink->write != &memory_write || data == NULL || len == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  state = sink->state;
+  *data = state->data;
+  *len = state->len;
+  return 0;
+}
+
+int hb_log_sink_memory_reset(hb_log_sink* sink) {
+  if (sink == NULL || sink->write != &memory_write) {
+    errno = EINVAL;
+    return -1;
+  }
+  ((hb_log_sink_memory*) sink->state)->len = 0;
+  return 0;
+}
+
+static int fanout_write(hb_log_sink* sink, const void* data, size_t len) {
+  hb_log_sink_fanout* state = sink->state;
+  int ret = 0;
+  int err_save = 0;
+  uint32_t i;
+  for (i = 0; i < state->count; i++) {
+    if (state->sinks[i]->write != NULL && state->sinks[i]->write(state->sinks[i], data, len) && !ret) {
+      ret = -1;
+      err_save = errno;
+    }
+  }
+  errno = err_save;
+  return ret;
+}
+
+static int fanout_header(hb_log_sink* sink, const void* data, size_t len) {
+  hb_log_sink_fanout* state = sink->state;
+  hb_log_sink_write* write_header;
+  int ret = 0;
+  int err_save = 0;
+  uint32_t i;
+  for (i = 0; i < state->count; i++) {
+    write_header = state->sinks[i]->header != NULL ? state->sinks[i]->header : state->sinks[i]->write;
+    if (write_header != NULL && write_header(state->sinks[i], data, len) && !ret) {
+      ret = -1;
+      err_save = errno;
+    }
+  }
+  errno = err_save;
+  return ret;
+}
+
+static int fanout_records(hb_log_sink* sink, const void* records, uint64_t count, size_t record_size) {
+  hb_log_sink_fanout* state = sink->state;
+  int ret = 0;
+  int err_save = 0;
+  uint32_t i;
+  for (i = 0; i < state->count; i++) {
+    if (state->sinks[i]->records != NULL &&
+        state->sinks[i]->records(state->sinks[i], records, count, record_size) && !ret) {
+      ret = -1;
+      err_save = errno;
+    }
+  }
+  errno = err_save;
+  return ret;
+}
+
+static int fanout_release(hb_log_sink* sink) {
+  free(((hb_log_sink_fanout*) sink->state)->sinks);
+  return free_state(sink);
+}
+
+int hb_log_sink_fanout_init(hb_log_sink* sink, hb_log_sink* const* sinks, uint32_t count) {
+  hb_log_sink_fanout* state;
+  uint32_t i;
+  if (sinks == NULL || count == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (i = 0; i < count; i++) {
+    if (sinks[i] == NULL) {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+  if ((state = sink_init(sink, sizeof(hb_log_sink_fanout))) == NULL) {
+    return -1;
+  }
+  if ((state->sinks = malloc(count * sizeof(hb_log_sink*))) == NULL) {
+    free_state(sink);
+    return -1;
+  }
+  memcpy(state->sinks, sinks, count * sizeof(hb_log_sink*));
+  state->count = count;
+  sink->release = &fanout_release;
+  // only format data, or pass records, if some sink wants them
+  for (i = 0; i < count; i++) {
+    if (sinks[i]->write != NULL) {
+      sink->write = &fanout_write;
+      sink->header = &fanout_header;
+    }
+    if (sinks[i]->records != NULL) {
+      sink->records = &fanout_records;
+    }
+  }
+  return 0;
+}
+
+int hb_log_sink_finish(hb_log_sink* sink) {
+  int ret = 0;
+  if (sink == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  free(sink->buf);
+  sink->buf = NULL;
+  sink->buf_size = 0;
+  if (sink->release != NULL) {
+    ret = sink->release(sink);
+  }
+  return ret;
+}
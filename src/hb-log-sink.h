@@ -0,0 +1,24 @@
+/**
+ * Private log sink helpers, shared by the heartbeat implementations.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HB_LOG_SINK_H_
+#define _HB_LOG_SINK_H_
+
+#include <stddef.h>
+#include "heartbeat-log-sink.h"
+
+/*
+ * Write the whole buffer, unless there's an error.
+ * Returns 0 on success, or an error number.
+ */
+int hb_write_all(int fd, const void* buf, size_t len);
+
+/*
+ * Grow the sink's buffer to hold at least size bytes, keeping its contents.
+ * Returns the buffer, or NULL and sets errno on failure.
+ */
+char* hb_log_sink_reserve(hb_log_sink* sink, size_t size);
+
+#endif
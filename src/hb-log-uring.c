@@ -0,0 +1,411 @@
+/**
+ * Log sink that submits writes through io_uring on Linux, so the thread that
+ * completes a window doesn't wait for the write.
+ * Data is copied into buffers registered with the kernel and written at
+ * tracked file offsets, so writes stay in order even if they complete out of
+ * order. Completions are reaped by later writes, or when the sink finishes.
+ * The sink falls back to write() if io_uring is unavailable.
+ *
+ * @author Connor Imes
+ */
+#if defined(HB_HAVE_IO_URING)
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "heartbeat-log-sink.h"
+#include "hb-log-sink.h"
+
+#if defined(HB_HAVE_IO_URING)
+#include <sys/syscall.h>
+// the system headers may predate the system calls
+#if !defined(__NR_io_uring_setup) || !defined(__NR_io_uring_enter) || !defined(__NR_io_uring_register)
+#undef HB_HAVE_IO_URING
+#endif
+#endif
+
+#if defined(HB_HAVE_IO_URING)
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#define HB_URING_DEFAULT_DEPTH 4
+#define HB_URING_DEFAULT_BUF_SIZE (256 * 1024)
+
+#if defined(HB_HAVE_IO_URING)
+typedef struct hb_uring {
+  int ring_fd;
+  unsigned int* sq_head;
+  unsigned int* sq_tail;
+  unsigned int* sq_mask;
+  unsigned int* sq_array;
+  struct io_uring_sqe* sqes;
+  unsigned int* cq_head;
+  unsigned int* cq_tail;
+  unsigned int* cq_mask;
+  struct io_uring_cqe* cqes;
+  void* sq_ring;
+  size_t sq_ring_size;
+  void* cq_ring;
+  size_t cq_ring_size;
+  size_t sqes_size;
+} hb_uring;
+#endif
+
+typedef struct hb_log_sink_uring {
+  int fd;
+  // error from a completed write, reported by the next write or finish
+  int err;
+  int active;
+#if defined(HB_HAVE_IO_URING)
+  hb_uring ring;
+  int registered;
+  uint32_t depth;
+  uint32_t next_slot;
+  uint32_t in_flight;
+  size_t buf_size;
+  // offset of the next write
+  uint64_t offset;
+  // depth buffers, registered if possible, and the offset and length of each one's write (0 when free)
+  char* bufs;
+  uint64_t* slot_offset;
+  size_t* slot_len;
+#endif
+} hb_log_sink_uring;
+
+#if defined(HB_HAVE_IO_URING)
+
+static int uring_setup(unsigned int entries, struct io_uring_params* p) {
+  return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int ring_fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+  return (int) syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int ring_fd, unsigned int opcode, const void* arg, unsigned int nr_args) {
+  return (int) syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+static void uring_unmap(hb_uring* ring) {
+  if (ring->sqes != NULL) {
+    munmap(ring->sqes, ring->sqes_size);
+  }
+  if (ring->cq_ring != NULL) {
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  }
+  if (ring->sq_ring != NULL) {
+    munmap(ring->sq_ring, ring->sq_ring_size);
+  }
+  close(ring->ring_fd);
+}
+
+static void* uring_map(int ring_fd, size_t size, off_t offset) {
+  void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+  return addr == MAP_FAILED ? NULL : addr;
+}
+
+static int uring_init(hb_uring* ring, unsigned int entries) {
+  struct io_uring_params p;
+  char* sq;
+  char* cq;
+  memset(ring, 0, sizeof(*ring));
+  memset(&p, 0, sizeof(p));
+  if ((ring->ring_fd = uring_setup(entries, &p)) < 0) {
+    return -1;
+  }
+  // the rings are mapped separately, which also works when the kernel could share one mapping
+  ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  if ((ring->sq_ring = uring_map(ring->ring_fd, ring->sq_ring_size, IORING_OFF_SQ_RING)) == NULL ||
+      (ring->cq_ring = uring_map(ring->ring_fd, ring->cq_ring_size, IORING_OFF_CQ_RING)) == NULL ||
+      (ring->sqes = uring_map(ring->ring_fd, ring->sqes_size, IORING_OFF_SQES)) == NULL) {
+    uring_unmap(ring);
+    return -1;
+  }
+  sq = ring->sq_ring;
+  ring->sq_head = (unsigned int*) (sq + p.sq_off.head);
+  ring->sq_tail = (unsigned int*) (sq + p.sq_off.tail);
+  ring->sq_mask = (unsigned int*) (sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned int*) (sq + p.sq_off.array);
+  cq = ring->cq_ring;
+  ring->cq_head = (unsigned int*) (cq + p.cq_off.head);
+  ring->cq_tail = (unsigned int*) (cq + p.cq_off.tail);
+  ring->cq_mask = (unsigned int*) (cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+  return 0;
+}
+
+/*
+ * Write data synchronously at an offset.
+ */
+static int pwrite_all(int fd, const char* data, size_t len, uint64_t offset) {
+  ssize_t written;
+  while (len > 0) {
+    written = pwrite(fd, data, len, (off_t) offset);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    data += written;
+    len -= (size_t) written;
+    offset += (uint64_t) written;
+  }
+  return 0;
+}
+
+/*
+ * Reap available completions, waiting for at least min_complete of them.
+ * Short writes are finished synchronously.
+ */
+static int reap(hb_log_sink_uring* state, unsigned int min_complete) {
+  hb_uring* ring = &state->ring;
+  struct io_uring_cqe* cqe;
+  unsigned int head;
+  uint32_t slot;
+  size_t done;
+  int err;
+  if (min_complete > 0 && uring_enter(ring->ring_fd, 0, min_complete, IORING_ENTER_GETEVENTS) < 0 &&
+      errno != EINTR) {
+    return -1;
+  }
+  head = *ring->cq_head;
+  while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+    cqe = &ring->cqes[head & *ring->cq_mask];
+    slot = (uint32_t) cqe->user_data;
+    if (cqe->res < 0) {
+      err = -cqe->res;
+    } else {
+      done = (size_t) cqe->res;
+      err = pwrite_all(state->fd, state->bufs + slot * state->buf_size + done, state->slot_len[slot] - done,
+                       state->slot_offset[slot] + done);
+    }
+    if (err && !state->err) {
+      state->err = err;
+    }
+    state->slot_len[slot] = 0;
+    state->in_flight--;
+    head++;
+  }
+  __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/*
+ * Wait for all writes to complete.
+ */
+static int drain(hb_log_sink_uring* state) {
+  while (state->in_flight > 0) {
+    if (reap(state, 1)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Wait for a slot's write to complete.
+ */
+static int wait_slot(hb_log_sink_uring* state, uint32_t slot) {
+  while (state->slot_len[slot] != 0) {
+    if (reap(state, 1)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int submit(hb_log_sink_uring* state, uint32_t slot) {
+  hb_uring* ring = &state->ring;
+  struct io_uring_sqe* sqe;
+  unsigned int tail = *ring->sq_tail;
+  unsigned int index = tail & *ring->sq_mask;
+  sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = state->registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  sqe->fd = state->fd;
+  sqe->addr = (uint64_t) (uintptr_t) (state->bufs + slot * state->buf_size);
+  sqe->len = (uint32_t) state->slot_len[slot];
+  sqe->off = state->slot_offset[slot];
+  if (state->registered) {
+    sqe->buf_index = (uint16_t) slot;
+  }
+  sqe->user_data = slot;
+  ring->sq_array[index] = index;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  if (uring_enter(ring->ring_fd, 1, 0, 0) < 0) {
+    // not submitted, so take it back
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+    return -1;
+  }
+  state->in_flight++;
+  return 0;
+}
+
+static int uring_write(hb_log_sink* sink, const void* data, size_t len) {
+  hb_log_sink_uring* state = sink->state;
+  uint32_t slot = state->next_slot;
+  int err;
+  if (reap(state, 0) || (len > state->buf_size ? drain(state) : wait_slot(state, slot))) {
+    return -1;
+  }
+  if (state->err) {
+    errno = state->err;
+    state->err = 0;
+    return -1;
+  }
+  if (len > state->buf_size) {
+    // too large for a buffer, so written synchronously after earlier writes
+    if ((err = pwrite_all(state->fd, data, len, state->offset))) {
+      errno = err;
+      return -1;
+    }
+    state->offset += len;
+    return 0;
+  }
+  memcpy(state->bufs + slot * state->buf_size, data, len);
+  state->slot_len[slot] = len;
+  state->slot_offset[slot] = state->offset;
+  if (submit(state, slot)) {
+    state->slot_len[slot] = 0;
+    if (drain(state)) {
+      return -1;
+    }
+    if ((err = pwrite_all(state->fd, data, len, state->offset))) {
+      errno = err;
+      return -1;
+    }
+  }
+  state->offset += len;
+  state->next_slot = (slot + 1) % state->depth;
+  return 0;
+}
+
+/*
+ * Writes must be at known offsets, so only files that can seek and don't
+ * append are supported.
+ */
+static int uring_start(hb_log_sink_uring* state, uint32_t depth, size_t buf_size) {
+  struct iovec* iov;
+  off_t offset;
+  int fl;
+  uint32_t i;
+  if ((offset = lseek(state->fd, 0, SEEK_CUR)) < 0 || (fl = fcntl(state->fd, F_GETFL)) < 0 || (fl & O_APPEND)) {
+    return -1;
+  }
+  if (depth > SIZE_MAX / sizeof(struct iovec)) {
+    errno = EINVAL;
+    return -1;
+  }
+  state->depth = depth;
+  state->buf_size = buf_size;
+  state->offset = (uint64_t) offset;
+  if ((state->slot_offset = calloc(depth, sizeof(uint64_t))) == NULL ||
+      (state->slot_len = calloc(depth, sizeof(size_t))) == NULL ||
+      (state->bufs = malloc(depth * buf_size)) == NULL ||
+      (iov = malloc(depth * sizeof(struct iovec))) == NULL) {
+    return -1;
+  }
+  for (i = 0; i < depth; i++) {
+    iov[i].iov_base = state->bufs + i * buf_size;
+    iov[i].iov_len = buf_size;
+  }
+  if (uring_init(&state->ring, depth)) {
+    free(iov);
+    return -1;
+  }
+  // registration can fail, e.g., if it would exceed RLIMIT_MEMLOCK, but unregistered buffers still work
+  state->registered = uring_register(state->ring.ring_fd, IORING_REGISTER_BUFFERS, iov, depth) == 0;
+  free(iov);
+  return 0;
+}
+
+static void uring_free(hb_log_sink_uring* state) {
+  free(state->bufs);
+  free(state->slot_len);
+  free(state->slot_offset);
+  state->bufs = NULL;
+  state->slot_len = NULL;
+  state->slot_offset = NULL;
+}
+
+#endif
+
+static int fallback_write(hb_log_sink* sink, const void* data, size_t len) {
+  if ((errno = hb_write_all(((hb_log_sink_uring*) sink->state)->fd, data, len))) {
+    return -1;
+  }
+  return 0;
+}
+
+static int uring_release(hb_log_sink* sink) {
+  hb_log_sink_uring* state = sink->state;
+  int err = 0;
+#if defined(HB_HAVE_IO_URING)
+  if (state->active) {
+    err = drain(state) ? errno : state->err;
+    // closing the ring waits for any writes that are still in flight
+    uring_unmap(&state->ring);
+    // leave the file position after the data, as if it had been written with write()
+    if (lseek(state->fd, (off_t) state->offset, SEEK_SET) < 0 && !err) {
+      err = errno;
+    }
+    uring_free(state);
+  }
+#endif
+  free(state);
+  sink->state = NULL;
+  if (err) {
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+int hb_log_sink_uring_init(hb_log_sink* sink, int fd, uint32_t depth, size_t buf_size) {
+  hb_log_sink_uring* state;
+  depth = depth == 0 ? HB_URING_DEFAULT_DEPTH : depth;
+  buf_size = buf_size == 0 ? HB_URING_DEFAULT_BUF_SIZE : buf_size;
+  // the buffers are allocated in one block
+  if (sink == NULL || fd < 0 || depth > SIZE_MAX / buf_size) {
+    errno = EINVAL;
+    return -1;
+  }
+  if ((state = calloc(1, sizeof(hb_log_sink_uring))) == NULL) {
+    return -1;
+  }
+  memset(sink, 0, sizeof(*sink));
+  sink->state = state;
+  sink->write = &fallback_write;
+  sink->release = &uring_release;
+  state->fd = fd;
+#if defined(HB_HAVE_IO_URING)
+  if (uring_start(state, depth, buf_size) == 0) {
+    state->active = 1;
+    sink->write = &uring_write;
+  } else {
+    uring_free(state);
+  }
+#else
+  (void) depth;
+  (void) buf_size;
+#endif
+  return 0;
+}
+
+int hb_log_sink_uring_active(const hb_log_sink* sink) {
+  if (sink == NULL || sink->release != &uring_release) {
+    errno = EINVAL;
+    return -1;
+  }
+  return ((const hb_log_sink_uring*) sink->state)->active;
+}
@@ -0,0 +1,45 @@
+/**
+ * Private type aliases for the heartbeat implementation selected at compile
+ * time, so internal helpers can be written once for all heartbeat variants.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HB_MODE_H_
+#define _HB_MODE_H_
+
+/* Determine which heartbeat implementation to use */
+#if defined(HEARTBEAT_MODE_ACC)
+#include "heartbeat-acc.h"
+typedef heartbeat_acc_context hb_mode_context;
+typedef heartbeat_acc_record hb_mode_record;
+typedef heartbeat_acc_input hb_mode_input;
+typedef heartbeat_acc_columns hb_mode_columns;
+typedef heartbeat_acc_window_complete hb_mode_window_complete;
+#define HB_MODE_BIN HEARTBEAT_BIN_MODE_ACC
+#elif defined(HEARTBEAT_MODE_POW)
+#include "heartbeat-pow.h"
+typedef heartbeat_pow_context hb_mode_context;
+typedef heartbeat_pow_record hb_mode_record;
+typedef heartbeat_pow_input hb_mode_input;
+typedef heartbeat_pow_columns hb_mode_columns;
+typedef heartbeat_pow_window_complete hb_mode_window_complete;
+#define HB_MODE_BIN HEARTBEAT_BIN_MODE_POW
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+#include "heartbeat-acc-pow.h"
+typedef heartbeat_acc_pow_context hb_mode_context;
+typedef heartbeat_acc_pow_record hb_mode_record;
+typedef heartbeat_acc_pow_input hb_mode_input;
+typedef heartbeat_acc_pow_columns hb_mode_columns;
+typedef heartbeat_acc_pow_window_complete hb_mode_window_complete;
+#define HB_MODE_BIN HEARTBEAT_BIN_MODE_ACC_POW
+#else
+#include "heartbeat.h"
+typedef heartbeat_context hb_mode_context;
+typedef heartbeat_record hb_mode_record;
+typedef heartbeat_input hb_mode_input;
+typedef heartbeat_columns hb_mode_columns;
+typedef heartbeat_window_complete hb_mode_window_complete;
+#define HB_MODE_BIN HEARTBEAT_BIN_MODE_HB
+#endif
+
+#endif
@@ -13,6 +13,9 @@
 #else
 #include "heartbeat-pow.h"
 #endif
+#include "hb-ewma.h"
+#include "hb-rates.h"
+#include "hb-stats.h"
 
 #if defined(HEARTBEAT_MODE_ACC_POW)
 uint64_t hb_acc_pow_get_global_energy(const heartbeat_acc_pow_context* hb) {
@@ -43,11 +46,16 @@ double hb_acc_pow_get_global_power(const heartbeat_acc_pow_context* hb) {
 #else
 double hb_pow_get_global_power(const heartbeat_pow_context* hb) {
 #endif
+  const hb_mode_record* rec;
   if (hb == NULL) {
     errno = EINVAL;
     return 0.0;
   }
-  return hb->window_buffer[hb->ws.read_index].pwr.global;
+  if (hb->window_buffer == NULL) {
+    return hb_power(hb->ed.global, hb->td.global);
+  }
+  rec = &hb->window_buffer[hb->ws.read_index];
+  return hb_lazy_rates(hb) ? hb_power(rec->ed.global, rec->td.global) : rec->pwr.global;
 }
 
 #if defined(HEARTBEAT_MODE_ACC_POW)
@@ -55,11 +63,16 @@ double hb_acc_pow_get_window_power(const heartbeat_acc_pow_context* hb) {
 #else
 double hb_pow_get_window_power(const heartbeat_pow_context* hb) {
 #endif
+  const hb_mode_record* rec;
   if (hb == NULL) {
     errno = EINVAL;
     return 0.0;
   }
-  return hb->window_buffer[hb->ws.read_index].pwr.window;
+  if (hb->window_buffer == NULL) {
+    return 0.0;
+  }
+  rec = &hb->window_buffer[hb->ws.read_index];
+  return hb_lazy_rates(hb) ? hb_power(rec->ed.window, rec->td.window) : rec->pwr.window;
 }
 
 #if defined(HEARTBEAT_MODE_ACC_POW)
@@ -67,9 +80,56 @@ double hb_acc_pow_get_instant_power(const heartbeat_acc_pow_context* hb) {
 #else
 double hb_pow_get_instant_power(const heartbeat_pow_context* hb) {
 #endif
+  const hb_mode_record* rec;
   if (hb == NULL) {
     errno = EINVAL;
     return 0.0;
   }
-  return hb->window_buffer[hb->ws.read_index].pwr.instant;
+  if (hb->window_buffer == NULL) {
+    return 0.0;
+  }
+  if (hb->columns != NULL && !hb_lazy_rates(hb)) {
+    return hb->columns->pwr_instant[hb->ws.read_index];
+  }
+  rec = &hb->window_buffer[hb->ws.read_index];
+  return hb_lazy_rates(hb) ? hb_power(rec->end_energy - rec->start_energy, rec->end_time - rec->start_time) : rec->pwr.instant;
+}
+
+/* Computed from the record's data, since its rates may be lazy */
+static double instant_power(const void* rec) {
+  const hb_mode_record* r = rec;
+  return hb_power(r->end_energy - r->start_energy, r->end_time - r->start_time);
+}
+
+#if defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_get_window_power_stats(const heartbeat_acc_pow_context* hb,
+                                      heartbeat_window_stats* stats,
+                                      double* scratch) {
+#else
+int hb_pow_get_window_power_stats(const heartbeat_pow_context* hb, heartbeat_window_stats* stats, double* scratch) {
+#endif
+  if (hb == NULL || stats == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (hb->columns != NULL && !hb_lazy_rates(hb)) {
+    hb_stats_values(hb->columns->pwr_instant, hb->ws.window_size, hb_window_first(hb), hb_window_records(hb), scratch,
+                    stats);
+  } else {
+    hb_stats_records(hb->window_buffer, sizeof(hb_mode_record), hb->ws.window_size, hb_window_first(hb),
+                     hb_window_records(hb), &instant_power, scratch, stats);
+  }
+  return 0;
+}
+
+#if defined(HEARTBEAT_MODE_ACC_POW)
+double hb_acc_pow_get_ewma_power(const heartbeat_acc_pow_context* hb, uint32_t index) {
+#else
+double hb_pow_get_ewma_power(const heartbeat_pow_context* hb, uint32_t index) {
+#endif
+  if (hb == NULL || hb->ws.ewma == NULL) {
+    errno = EINVAL;
+    return 0.0;
+  }
+  return hb_ewma_rate(hb->ws.ewma, hb->ws.ewma->energy, index) / ONE_MILLION;
 }
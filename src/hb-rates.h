@@ -0,0 +1,71 @@
+/**
+ * Private helpers to compute heartbeat rates from a record's raw data, shared
+ * by eager computation in heartbeat() and lazy computation by readers.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HB_RATES_H_
+#define _HB_RATES_H_
+
+#include <inttypes.h>
+#include "hb-mode.h"
+
+#define ONE_MILLION 1000000.0
+#define ONE_BILLION 1000000000.0
+
+/* Rate of data per second over a time (ns) */
+static inline double hb_rate(uint64_t data, uint64_t time) {
+  return ((double) data) / (((double) time) / ONE_BILLION);
+}
+
+/* Power (Watts) for energy (uJ) over a time (ns) */
+static inline double hb_power(uint64_t energy, uint64_t time) {
+  return hb_rate(energy, time) / ONE_MILLION;
+}
+
+static inline int hb_lazy_rates(const hb_mode_context* hb) {
+  return (hb->ws.flags & HEARTBEAT_FLAG_LAZY_RATES) != 0;
+}
+
+/*
+ * The number of records in the window: those in a time-based window, or all
+ * of the window buffer's once the first window completes, or while it's
+ * completing.
+ */
+static inline uint64_t hb_window_records(const hb_mode_context* hb) {
+  uint64_t n = hb->ws.window_count > 0 ? hb->ws.window_size : hb->ws.buffer_index;
+  if (hb->ws.window_duration > 0) {
+    return hb->ws.window_len;
+  }
+  return n < hb->ws.window_size ? n : hb->ws.window_size;
+}
+
+/*
+ * The window buffer index of the window's first record, after which records
+ * wrap around the buffer.
+ */
+static inline uint64_t hb_window_first(const hb_mode_context* hb) {
+  return hb->ws.window_duration > 0 ? hb->ws.first_index : 0;
+}
+
+/*
+ * Populate a record's rates from its data.
+ */
+static inline void hb_compute_rates(hb_mode_record* rec) {
+  uint64_t instant_time = rec->end_time - rec->start_time;
+  rec->perf.global = hb_rate(rec->wd.global, rec->td.global);
+  rec->perf.window = hb_rate(rec->wd.window, rec->td.window);
+  rec->perf.instant = hb_rate(rec->work, instant_time);
+#if defined(HEARTBEAT_USE_ACC)
+  rec->acc.global = hb_rate(rec->ad.global, rec->td.global);
+  rec->acc.window = hb_rate(rec->ad.window, rec->td.window);
+  rec->acc.instant = hb_rate(rec->accuracy, instant_time);
+#endif
+#if defined(HEARTBEAT_USE_POW)
+  rec->pwr.global = hb_power(rec->ed.global, rec->td.global);
+  rec->pwr.window = hb_power(rec->ed.window, rec->td.window);
+  rec->pwr.instant = hb_power(rec->end_energy - rec->start_energy, instant_time);
+#endif
+}
+
+#endif
@@ -0,0 +1,258 @@
+/**
+ * Multi-resolution rollups.
+ *
+ * @author Connor Imes
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "heartbeat-rollup.h"
+#include "hb-atomic.h"
+#include "hb-format.h"
+#include "hb-log-sink.h"
+#include "hb-rollup.h"
+
+#define ONE_MILLION 1000000.0
+#define ONE_BILLION 1000000000.0
+
+#define HB_ROLLUP_FIELDS 14
+#define HB_ROLLUP_LINE_MAX (HB_ROLLUP_FIELDS * (HB_FORMAT_FIELD_MAX + 1) + 1)
+
+int hb_rollup_init(hb_rollup* r, const uint64_t* resolutions, const uint64_t* lens, uint32_t count,
+                   hb_rollup_interval* intervals, size_t len, int log_fd) {
+  uint64_t total = 0;
+  uint32_t i;
+  if (r == NULL || resolutions == NULL || lens == NULL || intervals == NULL || count == 0 ||
+      count > HB_ROLLUP_LEVELS_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (i = 0; i < count; i++) {
+    if (resolutions[i] == 0 || lens[i] == 0 || lens[i] > len - total ||
+        (i > 0 && (resolutions[i] <= resolutions[i - 1] || resolutions[i] % resolutions[i - 1] != 0))) {
+      errno = EINVAL;
+      return -1;
+    }
+    total += lens[i];
+  }
+  memset(r, 0, sizeof(*r));
+  for (i = 0; i < count; i++) {
+    r->levels[i].resolution = resolutions[i];
+    r->levels[i].intervals = intervals;
+    r->levels[i].len = lens[i];
+    intervals += lens[i];
+  }
+  r->count = count;
+  r->log_fd = log_fd;
+  return 0;
+}
+
+static double rate(uint64_t data, uint64_t time) {
+  return time > 0 ? ((double) data) / (((double) time) / ONE_BILLION) : 0.0;
+}
+
+int hb_rollup_log_header(int fd) {
+  char buf[HB_ROLLUP_LINE_MAX];
+  char* pos = buf;
+  pos = hb_format_str(pos, "Level", 6);
+  *pos++ = ' ';
+  pos = hb_format_str(pos, "Start_Time", 20);
+  *pos++ = ' ';
+  pos = hb_format_str(pos, "Count", 11);
+  *pos++ = ' ';
+  pos = hb_format_str(pos, "Work", 11);
+  *pos++ = ' ';
+  pos = hb_format_str(pos, "Time", 15);
+  *pos++ = ' ';
+  pos = hb_format_str(pos, "Acc", 11);
+  *pos++ = ' ';
+  pos = hb_format_str(pos, "Energy", 15);
+  *pos++ = ' ';
+  pos = hb_format_str(pos, "Perf", 15);
+  *pos++ = ' ';
+  pos = hb_format_str(pos, "Min_Perf", 15);
+  *pos++ = ' ';
+  pos = hb_format_str(pos, "Max_Perf", 15);
+  *pos++ = ' ';
+  pos = hb_format_str(pos, "Acc_Rate", 16);
+  *pos++ = ' ';
+  pos = hb_format_str(pos, "Pwr", 15);
+  *pos++ = ' ';
+  pos = hb_format_str(pos, "Min_Pwr", 15);
+  *pos++ = ' ';
+  pos = hb_format_str(pos, "Max_Pwr", 15);
+  *pos++ = '\n';
+  errno = hb_write_all(fd, buf, (size_t) (pos - buf));
+  return errno;
+}
+
+static int log_interval(int fd, uint32_t level, const hb_rollup_interval* in) {
+  char buf[HB_ROLLUP_LINE_MAX];
+  char* pos = buf;
+  pos = hb_format_u64(pos, level, 6);
+  *pos++ = ' ';
+  pos = hb_format_u64(pos, in->start_time, 20);
+  *pos++ = ' ';
+  pos = hb_format_u64(pos, in->count, 11);
+  *pos++ = ' ';
+  pos = hb_format_u64(pos, in->work, 11);
+  *pos++ = ' ';
+  pos = hb_format_u64(pos, in->time, 15);
+  *pos++ = ' ';
+  pos = hb_format_u64(pos, in->accuracy, 11);
+  *pos++ = ' ';
+  pos = hb_format_u64(pos, in->energy, 15);
+  *pos++ = ' ';
+  pos = hb_format_double(pos, rate(in->work, in->time), 15);
+  *pos++ = ' ';
+  pos = hb_format_double(pos, in->min_perf, 15);
+  *pos++ = ' ';
+  pos = hb_format_double(pos, in->max_perf, 15);
+  *pos++ = ' ';
+  pos = hb_format_double(pos, rate(in->accuracy, in->time), 16);
+  *pos++ = ' ';
+  pos = hb_format_double(pos, rate(in->energy, in->time) / ONE_MILLION, 15);
+  *pos++ = ' ';
+  pos = hb_format_double(pos, in->min_pwr, 15);
+  *pos++ = ' ';
+  pos = hb_format_double(pos, in->max_pwr, 15);
+  *pos++ = '\n';
+  return hb_write_all(fd, buf, (size_t) (pos - buf));
+}
+
+/*
+ * Add a heartbeat's or a finer interval's data to an interval. Minimums and
+ * maximums only come from data over some time, so they're set by the first.
+ */
+static void merge(hb_rollup_interval* dst, const hb_rollup_interval* src) {
+  if (src->time > 0) {
+    if (dst->time == 0) {
+      dst->min_perf = src->min_perf;
+      dst->max_perf = src->max_perf;
+      dst->min_pwr = src->min_pwr;
+      dst->max_pwr = src->max_pwr;
+    } else {
+      dst->min_perf = src->min_perf < dst->min_perf ? src->min_perf : dst->min_perf;
+      dst->max_perf = src->max_perf > dst->max_perf ? src->max_perf : dst->max_perf;
+      dst->min_pwr = src->min_pwr < dst->min_pwr ? src->min_pwr : dst->min_pwr;
+      dst->max_pwr = src->max_pwr > dst->max_pwr ? src->max_pwr : dst->max_pwr;
+    }
+  }
+  dst->count += src->count;
+  dst->work += src->work;
+  dst->time += src->time;
+  dst->accuracy += src->accuracy;
+  dst->energy += src->energy;
+}
+
+/*
+ * Intervals completed by an update, to be logged once the lock is released.
+ * An update completes at most one interval per level.
+ */
+typedef struct hb_rollup_completed {
+  uint32_t count;
+  uint32_t levels[HB_ROLLUP_LEVELS_MAX];
+  hb_rollup_interval intervals[HB_ROLLUP_LEVELS_MAX];
+} hb_rollup_completed;
+
+static void add(hb_rollup* r, uint32_t level, const hb_rollup_interval* data, uint64_t time,
+                hb_rollup_completed* done);
+
+/*
+ * Move a level's interval in progress to its ring, and add it to the next level.
+ */
+static void complete(hb_rollup* r, uint32_t level, hb_rollup_completed* done) {
+  hb_rollup_level* l = &r->levels[level];
+  memcpy(&l->intervals[l->next], &l->current, sizeof(l->current));
+  l->next = (l->next + 1) % l->len;
+  if (l->count < l->len) {
+    l->count++;
+  }
+  if (r->log_fd > 0) {
+    done->levels[done->count] = level;
+    memcpy(&done->intervals[done->count], &l->current, sizeof(l->current));
+    done->count++;
+  }
+  if (level + 1 < r->count) {
+    add(r, level + 1, &l->current, l->current.start_time, done);
+  }
+  memset(&l->current, 0, sizeof(l->current));
+}
+
+/*
+ * Data that belongs to an earlier interval than the one in progress, e.g., from
+ * a heartbeat that ended late, is added to the one in progress.
+ */
+static void add(hb_rollup* r, uint32_t level, const hb_rollup_interval* data, uint64_t time,
+                hb_rollup_completed* done) {
+  hb_rollup_level* l = &r->levels[level];
+  uint64_t start = time - time % l->resolution;
+  if (l->current.count > 0 && start > l->current.start_time) {
+    complete(r, level, done);
+  }
+  if (l->current.count == 0) {
+    memcpy(&l->current, data, sizeof(l->current));
+    l->current.start_time = start;
+  } else {
+    merge(&l->current, data);
+  }
+}
+
+void hb_rollup_update(hb_rollup* r, uint64_t start_time, uint64_t end_time, uint64_t work, uint64_t accuracy,
+                      uint64_t energy) {
+  hb_rollup_interval hb;
+  hb_rollup_completed done;
+  uint32_t i;
+  memset(&hb, 0, sizeof(hb));
+  hb.count = 1;
+  hb.work = work;
+  hb.time = end_time - start_time;
+  hb.accuracy = accuracy;
+  hb.energy = energy;
+  hb.min_perf = rate(work, hb.time);
+  hb.max_perf = hb.min_perf;
+  hb.min_pwr = rate(energy, hb.time) / ONE_MILLION;
+  hb.max_pwr = hb.min_pwr;
+  done.count = 0;
+  hb_spin_lock(&r->lock);
+  add(r, 0, &hb, end_time, &done);
+  hb_spin_unlock(&r->lock);
+  // other producers don't wait for the log
+  for (i = 0; i < done.count; i++) {
+    if (log_interval(r->log_fd, done.levels[i], &done.intervals[i])) {
+      perror("Failed to log heartbeat rollup data");
+    }
+  }
+}
+
+uint64_t hb_rollup_get_intervals(hb_rollup* r, uint32_t level, hb_rollup_interval* intervals, uint64_t len) {
+  const hb_rollup_level* l;
+  uint64_t n;
+  uint64_t i;
+  if (r == NULL || intervals == NULL || level >= r->count) {
+    errno = EINVAL;
+    return 0;
+  }
+  l = &r->levels[level];
+  hb_spin_lock(&r->lock);
+  n = len < l->count ? len : l->count;
+  // the newest n intervals end just before next
+  for (i = 0; i < n; i++) {
+    memcpy(&intervals[i], &l->intervals[(l->next + l->len - n + i) % l->len], sizeof(*intervals));
+  }
+  hb_spin_unlock(&r->lock);
+  return n;
+}
+
+int hb_rollup_get_current(hb_rollup* r, uint32_t level, hb_rollup_interval* interval) {
+  if (r == NULL || interval == NULL || level >= r->count) {
+    errno = EINVAL;
+    return -1;
+  }
+  hb_spin_lock(&r->lock);
+  memcpy(interval, &r->levels[level].current, sizeof(*interval));
+  hb_spin_unlock(&r->lock);
+  return 0;
+}
@@ -0,0 +1,19 @@
+/**
+ * Private rollup functions for heartbeats.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HB_ROLLUP_H_
+#define _HB_ROLLUP_H_
+
+#include <inttypes.h>
+#include "heartbeat-rollup.h"
+
+/*
+ * Add a heartbeat to the finest level, completing intervals as needed.
+ * Takes the rollup's lock, so producers don't need to hold the context lock.
+ */
+void hb_rollup_update(hb_rollup* r, uint64_t start_time, uint64_t end_time, uint64_t work, uint64_t accuracy,
+                      uint64_t energy);
+
+#endif
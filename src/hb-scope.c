@@ -0,0 +1,132 @@
+/**
+ * Scoped heartbeats, where the library takes its own start and end readings.
+ *
+ * @author Connor Imes
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+/* Determine which heartbeat implementation to use */
+#if defined(HEARTBEAT_MODE_ACC)
+#include "heartbeat-acc-scope.h"
+typedef heartbeat_acc_scope hb_mode_scope;
+#elif defined(HEARTBEAT_MODE_POW)
+#include "heartbeat-pow-scope.h"
+typedef heartbeat_pow_scope hb_mode_scope;
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+#include "heartbeat-acc-pow-scope.h"
+typedef heartbeat_acc_pow_scope hb_mode_scope;
+#else
+#include "heartbeat-scope.h"
+typedef heartbeat_scope hb_mode_scope;
+#endif
+
+/*
+ * Take start readings.
+ */
+static int begin(hb_mode_scope* hs) {
+#if defined(HEARTBEAT_USE_POW)
+  if (hb_energy_read(hs->ep, &hs->start_energy)) {
+    return -1;
+  }
+#endif
+  hs->start_time = hb_time_now();
+  return 0;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int heartbeat_acc_scope_init(heartbeat_acc_scope* hs,
+                             heartbeat_acc_context* hb) {
+#elif defined(HEARTBEAT_MODE_POW)
+int heartbeat_pow_scope_init(heartbeat_pow_scope* hs,
+                             heartbeat_pow_context* hb,
+                             hb_energy_provider* ep) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int heartbeat_acc_pow_scope_init(heartbeat_acc_pow_scope* hs,
+                                 heartbeat_acc_pow_context* hb,
+                                 hb_energy_provider* ep) {
+#else
+int heartbeat_scope_init(heartbeat_scope* hs,
+                         heartbeat_context* hb) {
+#endif
+#if defined(HEARTBEAT_USE_POW)
+  if (hs == NULL || hb == NULL || ep == NULL) {
+#else
+  if (hs == NULL || hb == NULL) {
+#endif
+    errno = EINVAL;
+    return -1;
+  }
+  hs->hb = hb;
+#if defined(HEARTBEAT_USE_POW)
+  hs->ep = ep;
+#endif
+  return begin(hs);
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_begin(heartbeat_acc_scope* hs) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_begin(heartbeat_pow_scope* hs) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_begin(heartbeat_acc_pow_scope* hs) {
+#else
+int hb_begin(heartbeat_scope* hs) {
+#endif
+  if (hs == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  return begin(hs);
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_end(heartbeat_acc_scope* hs,
+               uint64_t user_tag,
+               uint64_t work,
+               uint64_t accuracy) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_end(heartbeat_pow_scope* hs,
+               uint64_t user_tag,
+               uint64_t work) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_end(heartbeat_acc_pow_scope* hs,
+                   uint64_t user_tag,
+                   uint64_t work,
+                   uint64_t accuracy) {
+#else
+int hb_end(heartbeat_scope* hs,
+           uint64_t user_tag,
+           uint64_t work) {
+#endif
+  uint64_t end_time;
+#if defined(HEARTBEAT_USE_POW)
+  uint64_t end_energy;
+#endif
+  if (hs == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  end_time = hb_time_now();
+#if defined(HEARTBEAT_USE_POW)
+  if (hb_energy_read(hs->ep, &end_energy)) {
+    return -1;
+  }
+#endif
+#if defined(HEARTBEAT_MODE_ACC)
+  heartbeat_acc(hs->hb, user_tag, work, hs->start_time, end_time, accuracy);
+#elif defined(HEARTBEAT_MODE_POW)
+  heartbeat_pow(hs->hb, user_tag, work, hs->start_time, end_time, hs->start_energy, end_energy);
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+  heartbeat_acc_pow(hs->hb, user_tag, work, hs->start_time, end_time, accuracy, hs->start_energy, end_energy);
+#else
+  heartbeat(hs->hb, user_tag, work, hs->start_time, end_time);
+#endif
+  // the next heartbeat begins now
+  hs->start_time = end_time;
+#if defined(HEARTBEAT_USE_POW)
+  hs->start_energy = end_energy;
+#endif
+  return 0;
+}
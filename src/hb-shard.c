@@ -0,0 +1,231 @@
+/**
+ * Sharded heartbeats, with a private heartbeat context per thread and
+ * merge-on-read aggregation.
+ *
+ * @author Connor Imes
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Determine which heartbeat implementation to use */
+#if defined(HEARTBEAT_MODE_ACC)
+#include "heartbeat-acc-shard.h"
+#elif defined(HEARTBEAT_MODE_POW)
+#include "heartbeat-pow-shard.h"
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+#include "heartbeat-acc-pow-shard.h"
+#else
+#include "heartbeat-shard.h"
+#endif
+#include "hb-mode.h"
+#include "hb-rates.h"
+
+/*
+ * Bytes between the starts of shards' window buffers, which are padded like
+ * shards so that buffers never share a cache line, whatever the allocation's
+ * alignment.
+ */
+static size_t buffer_stride(uint64_t window_size) {
+  return ((window_size * sizeof(hb_mode_record) + HEARTBEAT_CACHE_LINE_SIZE - 1) / HEARTBEAT_CACHE_LINE_SIZE + 1) *
+         HEARTBEAT_CACHE_LINE_SIZE;
+}
+
+static hb_mode_record* shard_buffer(hb_mode_record* window_buffers, uint32_t shard, uint64_t window_size) {
+  return (hb_mode_record*) ((char*) window_buffers + shard * buffer_stride(window_size));
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int heartbeat_acc_shard_init(heartbeat_acc_shard_context* hs,
+                             uint32_t num_shards,
+                             uint64_t window_size,
+                             int log_fd,
+                             heartbeat_acc_window_complete* hwc_callback,
+                             uint32_t flags) {
+#elif defined(HEARTBEAT_MODE_POW)
+int heartbeat_pow_shard_init(heartbeat_pow_shard_context* hs,
+                             uint32_t num_shards,
+                             uint64_t window_size,
+                             int log_fd,
+                             heartbeat_pow_window_complete* hwc_callback,
+                             uint32_t flags) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int heartbeat_acc_pow_shard_init(heartbeat_acc_pow_shard_context* hs,
+                                 uint32_t num_shards,
+                                 uint64_t window_size,
+                                 int log_fd,
+                                 heartbeat_acc_pow_window_complete* hwc_callback,
+                                 uint32_t flags) {
+#else
+int heartbeat_shard_init(heartbeat_shard_context* hs,
+                         uint32_t num_shards,
+                         uint64_t window_size,
+                         int log_fd,
+                         heartbeat_window_complete* hwc_callback,
+                         uint32_t flags) {
+#endif
+  hb_mode_record* buffer;
+  uint32_t i;
+  if (hs == NULL || num_shards == 0 || window_size == 0 || (flags & HEARTBEAT_FLAG_LOCK_FREE)) {
+    errno = EINVAL;
+    return -1;
+  }
+  hs->num_shards = num_shards;
+  hs->shards = malloc(num_shards * sizeof(*hs->shards));
+  hs->window_buffers = malloc(num_shards * buffer_stride(window_size));
+  if (hs->shards == NULL || hs->window_buffers == NULL) {
+    goto fail;
+  }
+  for (i = 0; i < num_shards; i++) {
+    buffer = shard_buffer(hs->window_buffers, i, window_size);
+#if defined(HEARTBEAT_MODE_ACC)
+    if (heartbeat_acc_init_flags(&hs->shards[i].hb, window_size, buffer, log_fd,
+                                 hwc_callback, flags | HEARTBEAT_FLAG_SINGLE_WRITER)) {
+#elif defined(HEARTBEAT_MODE_POW)
+    if (heartbeat_pow_init_flags(&hs->shards[i].hb, window_size, buffer, log_fd,
+                                 hwc_callback, flags | HEARTBEAT_FLAG_SINGLE_WRITER)) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+    if (heartbeat_acc_pow_init_flags(&hs->shards[i].hb, window_size, buffer, log_fd,
+                                     hwc_callback, flags | HEARTBEAT_FLAG_SINGLE_WRITER)) {
+#else
+    if (heartbeat_init_flags(&hs->shards[i].hb, window_size, buffer, log_fd,
+                             hwc_callback, flags | HEARTBEAT_FLAG_SINGLE_WRITER)) {
+#endif
+      goto fail;
+    }
+  }
+  return 0;
+
+fail:
+  free(hs->window_buffers);
+  free(hs->shards);
+  hs->window_buffers = NULL;
+  hs->shards = NULL;
+  hs->num_shards = 0;
+  return -1;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+void heartbeat_acc_shard_finish(heartbeat_acc_shard_context* hs) {
+#elif defined(HEARTBEAT_MODE_POW)
+void heartbeat_pow_shard_finish(heartbeat_pow_shard_context* hs) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+void heartbeat_acc_pow_shard_finish(heartbeat_acc_pow_shard_context* hs) {
+#else
+void heartbeat_shard_finish(heartbeat_shard_context* hs) {
+#endif
+  if (hs != NULL) {
+    free(hs->window_buffers);
+    free(hs->shards);
+    hs->window_buffers = NULL;
+    hs->shards = NULL;
+    hs->num_shards = 0;
+  }
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+heartbeat_acc_context* hb_acc_shard_get_context(heartbeat_acc_shard_context* hs, uint32_t shard) {
+#elif defined(HEARTBEAT_MODE_POW)
+heartbeat_pow_context* hb_pow_shard_get_context(heartbeat_pow_shard_context* hs, uint32_t shard) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+heartbeat_acc_pow_context* hb_acc_pow_shard_get_context(heartbeat_acc_pow_shard_context* hs, uint32_t shard) {
+#else
+heartbeat_context* hb_shard_get_context(heartbeat_shard_context* hs, uint32_t shard) {
+#endif
+  if (hs == NULL || shard >= hs->num_shards) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return &hs->shards[shard].hb;
+}
+
+static void add_udata(heartbeat_udata* sum, const heartbeat_udata* data) {
+  sum->global += data->global;
+  sum->window += data->window;
+}
+
+static void add_rates(heartbeat_rates* sum, const heartbeat_rates* rates) {
+  sum->global += rates->global;
+  sum->window += rates->window;
+  sum->instant += rates->instant;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_shard_merge(const heartbeat_acc_shard_context* hs, heartbeat_acc_record* merged) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_shard_merge(const heartbeat_pow_shard_context* hs, heartbeat_pow_record* merged) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_shard_merge(const heartbeat_acc_pow_shard_context* hs, heartbeat_acc_pow_record* merged) {
+#else
+int hb_shard_merge(const heartbeat_shard_context* hs, heartbeat_record* merged) {
+#endif
+  hb_mode_record snapshot;
+  const hb_mode_record* rec = &snapshot;
+  uint64_t instant_time = 0;
+  int first = 1;
+  uint32_t i;
+  if (hs == NULL || merged == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  memset(merged, 0, sizeof(*merged));
+  for (i = 0; i < hs->num_shards; i++) {
+    if (hs->shards[i].hb.counter == 0) {
+      continue;
+    }
+#if defined(HEARTBEAT_MODE_ACC)
+    if (hb_acc_get_snapshot(&hs->shards[i].hb, &snapshot)) {
+#elif defined(HEARTBEAT_MODE_POW)
+    if (hb_pow_get_snapshot(&hs->shards[i].hb, &snapshot)) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+    if (hb_acc_pow_get_snapshot(&hs->shards[i].hb, &snapshot)) {
+#else
+    if (hb_get_snapshot(&hs->shards[i].hb, &snapshot)) {
+#endif
+      return -1;
+    }
+    if (first || rec->start_time < merged->start_time) {
+      merged->start_time = rec->start_time;
+    }
+    if (first || rec->end_time >= merged->end_time) {
+      merged->end_time = rec->end_time;
+      merged->user_tag = rec->user_tag;
+    }
+    merged->id += rec->id + 1;
+    instant_time += rec->end_time - rec->start_time;
+
+    merged->work += rec->work;
+    add_udata(&merged->wd, &rec->wd);
+    add_udata(&merged->td, &rec->td);
+    add_rates(&merged->perf, &rec->perf);
+#if defined(HEARTBEAT_USE_ACC)
+    merged->accuracy += rec->accuracy;
+    add_udata(&merged->ad, &rec->ad);
+    add_rates(&merged->acc, &rec->acc);
+#endif
+#if defined(HEARTBEAT_USE_POW)
+    if (first || rec->start_energy < merged->start_energy) {
+      merged->start_energy = rec->start_energy;
+    }
+    if (rec->end_energy > merged->end_energy) {
+      merged->end_energy = rec->end_energy;
+    }
+    add_udata(&merged->ed, &rec->ed);
+    merged->pwr.instant += (double) (rec->end_energy - rec->start_energy);
+#endif
+    first = 0;
+  }
+#if defined(HEARTBEAT_USE_POW)
+  if (first) {
+    return 0;
+  }
+  // power is energy over time, not a sum of rates
+  merged->pwr.global = hb_power(merged->ed.global, merged->td.global);
+  merged->pwr.window = hb_power(merged->ed.window, merged->td.window);
+  merged->pwr.instant = merged->pwr.instant / (((double) instant_time) / ONE_BILLION) / ONE_MILLION;
+#else
+  (void) instant_time;
+#endif
+  return 0;
+}
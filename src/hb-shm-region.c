@@ -0,0 +1,283 @@
+/**
+ * Shared-memory regions for heartbeats, and read-only access by other
+ * processes.
+ *
+ * @author Connor Imes
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "heartbeat-shm-reader.h"
+#include "hb-atomic.h"
+#include "hb-shm-region.h"
+
+/* Contexts and window buffers begin on their own cache lines */
+#define HB_SHM_ALIGN(x) \
+  (((x) + HEARTBEAT_CACHE_LINE_SIZE - 1) / HEARTBEAT_CACHE_LINE_SIZE * HEARTBEAT_CACHE_LINE_SIZE)
+
+#if !defined(_WIN32)
+
+/* Distinguishes regions registered by the same process */
+static volatile uint64_t register_count = 0;
+
+/*
+ * POSIX shared-memory object names begin with '/' and contain no other '/'.
+ */
+static int is_shm_name(const char* name) {
+  return name[0] == '/' && strchr(name + 1, '/') == NULL;
+}
+
+static int region_open(const char* name, int oflag, mode_t mode) {
+  return is_shm_name(name) ? shm_open(name, oflag, mode) : open(name, oflag, mode);
+}
+
+static int region_unlink(const char* name) {
+  return is_shm_name(name) ? shm_unlink(name) : unlink(name);
+}
+
+/*
+ * A region is stale if it was published by a process that no longer exists,
+ * e.g., one that didn't exit cleanly. Anything else at the name is left alone.
+ */
+static int is_stale_region(const char* name) {
+  const heartbeat_shm_header* header;
+  struct stat st;
+  void* addr;
+  int stale = 0;
+  int fd;
+  if ((fd = region_open(name, O_RDONLY, 0)) < 0) {
+    return 0;
+  }
+  if (!fstat(fd, &st) && (uint64_t) st.st_size >= sizeof(heartbeat_shm_header) &&
+      (addr = mmap(NULL, sizeof(heartbeat_shm_header), PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED) {
+    header = addr;
+    stale = !memcmp(header->magic, HEARTBEAT_SHM_MAGIC, sizeof(header->magic)) &&
+            header->pid > 0 && kill((pid_t) header->pid, 0) && errno == ESRCH;
+    munmap(addr, sizeof(heartbeat_shm_header));
+  }
+  close(fd);
+  return stale;
+}
+
+int hb_shm_region_create(heartbeat_shm_region* region,
+                         const char* name,
+                         uint32_t mode,
+                         uint32_t context_size,
+                         uint32_t record_size,
+                         uint64_t window_size) {
+  heartbeat_shm_header* header;
+  uint64_t context_offset = HB_SHM_ALIGN(sizeof(heartbeat_shm_header));
+  uint64_t buffer_offset = HB_SHM_ALIGN(context_offset + context_size);
+  uint64_t size;
+  int err_save;
+  int fd;
+  if (strlen(name) >= sizeof(region->name)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  if (window_size > (UINT64_MAX - buffer_offset) / record_size) {
+    errno = EINVAL;
+    return -1;
+  }
+  size = buffer_offset + window_size * record_size;
+  if ((fd = region_open(name, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0) {
+    if (errno != EEXIST || !is_stale_region(name)) {
+      return -1;
+    }
+    // replace the stale region; readers that still have it mapped are not affected
+    region_unlink(name);
+    if ((fd = region_open(name, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0) {
+      return -1;
+    }
+  }
+  if (ftruncate(fd, (off_t) size) ||
+      (region->addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    err_save = errno;
+    close(fd);
+    region_unlink(name);
+    errno = err_save;
+    return -1;
+  }
+  close(fd);
+  region->size = size;
+  strcpy(region->name, name);
+  header = region->addr;
+  header->version = HEARTBEAT_SHM_VERSION;
+  header->mode = mode;
+  header->record_size = record_size;
+  header->context_size = context_size;
+  header->window_size = window_size;
+  header->context_offset = context_offset;
+  header->buffer_offset = buffer_offset;
+  header->size = size;
+  header->pid = (int64_t) getpid();
+  return 0;
+}
+
+int hb_shm_region_register_name(char* name, size_t len) {
+  uint64_t n = hb_fetch_add_u64(&register_count, 1);
+  if ((size_t) snprintf(name, len, HEARTBEAT_SHM_REGISTRY_PREFIX"%ld-%"PRIu64, (long) getpid(), n) >= len) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  return 0;
+}
+
+void hb_shm_region_destroy(heartbeat_shm_region* region) {
+  munmap(region->addr, region->size);
+  region_unlink(region->name);
+  region->addr = NULL;
+}
+
+/*
+ * The writer may still be initializing a region with a partial magic value.
+ */
+static int is_partial_magic(const char* magic) {
+  size_t i;
+  for (i = 0; i < sizeof(HEARTBEAT_SHM_MAGIC) - 1; i++) {
+    if (magic[i] != '\0' && magic[i] != HEARTBEAT_SHM_MAGIC[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Verify that the layout is within the mapped size, since the region isn't trusted.
+ */
+static int is_valid_header(const heartbeat_shm_header* header, uint64_t size) {
+  return header->version == HEARTBEAT_SHM_VERSION &&
+         header->size <= size &&
+         header->context_offset >= sizeof(heartbeat_shm_header) &&
+         header->context_offset + header->context_size <= header->buffer_offset &&
+         header->buffer_offset <= header->size &&
+         header->record_size > 0 &&
+         header->window_size > 0 &&
+         header->window_size <= (header->size - header->buffer_offset) / header->record_size;
+}
+
+int hb_shm_reader_open(heartbeat_shm_reader* reader, const char* name) {
+  const heartbeat_shm_header* header;
+  struct stat st;
+  void* addr;
+  int err_save;
+  int fd;
+  if (reader == NULL || name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if ((fd = region_open(name, O_RDONLY, 0)) < 0) {
+    return -1;
+  }
+  if (fstat(fd, &st)) {
+    err_save = errno;
+    close(fd);
+    errno = err_save;
+    return -1;
+  }
+  if ((uint64_t) st.st_size < sizeof(heartbeat_shm_header)) {
+    close(fd);
+    // the writer may not have sized the region yet
+    errno = st.st_size == 0 ? EAGAIN : EPROTO;
+    return -1;
+  }
+  addr = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  err_save = errno;
+  close(fd);
+  if (addr == MAP_FAILED) {
+    errno = err_save;
+    return -1;
+  }
+  header = addr;
+  if (memcmp(header->magic, HEARTBEAT_SHM_MAGIC, sizeof(header->magic))) {
+    err_save = is_partial_magic(header->magic) ? EAGAIN : EPROTO;
+  } else {
+    hb_fence_acquire();
+    err_save = is_valid_header(header, (uint64_t) st.st_size) ? 0 : EPROTO;
+  }
+  if (err_save) {
+    munmap(addr, (size_t) st.st_size);
+    errno = err_save;
+    return -1;
+  }
+  reader->header = header;
+  reader->size = (uint64_t) st.st_size;
+  return 0;
+}
+
+int hb_shm_reader_close(heartbeat_shm_reader* reader) {
+  int ret;
+  if (reader == NULL || reader->header == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  ret = munmap((void*) reader->header, reader->size);
+  reader->header = NULL;
+  return ret;
+}
+
+#else
+
+int hb_shm_region_create(heartbeat_shm_region* region,
+                         const char* name,
+                         uint32_t mode,
+                         uint32_t context_size,
+                         uint32_t record_size,
+                         uint64_t window_size) {
+  (void) region;
+  (void) name;
+  (void) mode;
+  (void) context_size;
+  (void) record_size;
+  (void) window_size;
+  errno = ENOSYS;
+  return -1;
+}
+
+int hb_shm_region_register_name(char* name, size_t len) {
+  (void) name;
+  (void) len;
+  errno = ENOSYS;
+  return -1;
+}
+
+void hb_shm_region_destroy(heartbeat_shm_region* region) {
+  (void) region;
+}
+
+int hb_shm_reader_open(heartbeat_shm_reader* reader, const char* name) {
+  errno = reader == NULL || name == NULL ? EINVAL : ENOSYS;
+  return -1;
+}
+
+int hb_shm_reader_close(heartbeat_shm_reader* reader) {
+  (void) reader;
+  errno = EINVAL;
+  return -1;
+}
+
+#endif
+
+void* hb_shm_region_context(const heartbeat_shm_region* region) {
+  return (char*) region->addr + ((heartbeat_shm_header*) region->addr)->context_offset;
+}
+
+void* hb_shm_region_window_buffer(const heartbeat_shm_region* region) {
+  return (char*) region->addr + ((heartbeat_shm_header*) region->addr)->buffer_offset;
+}
+
+void hb_shm_region_publish(heartbeat_shm_region* region) {
+  heartbeat_shm_header* header = region->addr;
+  hb_fence_release();
+  memcpy(header->magic, HEARTBEAT_SHM_MAGIC, sizeof(header->magic));
+}
@@ -0,0 +1,50 @@
+/**
+ * Private shared-memory region management, shared by the heartbeat
+ * implementations.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HB_SHM_REGION_H_
+#define _HB_SHM_REGION_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "heartbeat-common-types.h"
+
+/*
+ * Create and map a zeroed region for a context and its window buffer.
+ * The header is filled, except for the magic value.
+ * An existing region is only replaced if its writer no longer exists,
+ * otherwise errno is set to EEXIST.
+ * Returns -1 and sets errno on failure.
+ */
+int hb_shm_region_create(heartbeat_shm_region* region,
+                         const char* name,
+                         uint32_t mode,
+                         uint32_t context_size,
+                         uint32_t record_size,
+                         uint64_t window_size);
+
+/*
+ * Generate a unique name for a registered region.
+ * Returns -1 and sets errno on failure.
+ */
+int hb_shm_region_register_name(char* name, size_t len);
+
+/*
+ * Get the location of the context or the window buffer in a region.
+ */
+void* hb_shm_region_context(const heartbeat_shm_region* region);
+void* hb_shm_region_window_buffer(const heartbeat_shm_region* region);
+
+/*
+ * Make the region visible to readers, once the context is initialized.
+ */
+void hb_shm_region_publish(heartbeat_shm_region* region);
+
+/*
+ * Unmap and unlink the region.
+ */
+void hb_shm_region_destroy(heartbeat_shm_region* region);
+
+#endif
@@ -0,0 +1,144 @@
+/**
+ * Heartbeats in a named shared-memory region.
+ *
+ * @author Connor Imes
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+/* Determine which heartbeat implementation to use */
+#if defined(HEARTBEAT_MODE_ACC)
+#include "heartbeat-acc-shm.h"
+#elif defined(HEARTBEAT_MODE_POW)
+#include "heartbeat-pow-shm.h"
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+#include "heartbeat-acc-pow-shm.h"
+#else
+#include "heartbeat-shm.h"
+#endif
+#include "hb-mode.h"
+#include "hb-shm-region.h"
+
+#if defined(HEARTBEAT_MODE_ACC)
+int heartbeat_acc_shm_init(heartbeat_acc_shm_context* hs,
+                           const char* name,
+                           uint64_t window_size,
+                           int log_fd,
+                           heartbeat_acc_window_complete* hwc_callback,
+                           uint32_t flags) {
+#elif defined(HEARTBEAT_MODE_POW)
+int heartbeat_pow_shm_init(heartbeat_pow_shm_context* hs,
+                           const char* name,
+                           uint64_t window_size,
+                           int log_fd,
+                           heartbeat_pow_window_complete* hwc_callback,
+                           uint32_t flags) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int heartbeat_acc_pow_shm_init(heartbeat_acc_pow_shm_context* hs,
+                               const char* name,
+                               uint64_t window_size,
+                               int log_fd,
+                               heartbeat_acc_pow_window_complete* hwc_callback,
+                               uint32_t flags) {
+#else
+int heartbeat_shm_init(heartbeat_shm_context* hs,
+                       const char* name,
+                       uint64_t window_size,
+                       int log_fd,
+                       heartbeat_window_complete* hwc_callback,
+                       uint32_t flags) {
+#endif
+  int err_save;
+  int ret;
+  if (hs == NULL || name == NULL || window_size == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (hb_shm_region_create(&hs->region, name, HB_MODE_BIN, sizeof(hb_mode_context), sizeof(hb_mode_record),
+                           window_size)) {
+    return -1;
+  }
+  hs->hb = hb_shm_region_context(&hs->region);
+#if defined(HEARTBEAT_MODE_ACC)
+  ret = heartbeat_acc_init_flags(hs->hb, window_size, hb_shm_region_window_buffer(&hs->region), log_fd,
+                                 hwc_callback, flags);
+#elif defined(HEARTBEAT_MODE_POW)
+  ret = heartbeat_pow_init_flags(hs->hb, window_size, hb_shm_region_window_buffer(&hs->region), log_fd,
+                                 hwc_callback, flags);
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+  ret = heartbeat_acc_pow_init_flags(hs->hb, window_size, hb_shm_region_window_buffer(&hs->region), log_fd,
+                                     hwc_callback, flags);
+#else
+  ret = heartbeat_init_flags(hs->hb, window_size, hb_shm_region_window_buffer(&hs->region), log_fd,
+                             hwc_callback, flags);
+#endif
+  if (ret) {
+    err_save = errno;
+    hb_shm_region_destroy(&hs->region);
+    hs->hb = NULL;
+    errno = err_save;
+    return ret;
+  }
+  hb_shm_region_publish(&hs->region);
+  return 0;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int heartbeat_acc_shm_register(heartbeat_acc_shm_context* hs,
+                               uint64_t window_size,
+                               int log_fd,
+                               heartbeat_acc_window_complete* hwc_callback,
+                               uint32_t flags) {
+#elif defined(HEARTBEAT_MODE_POW)
+int heartbeat_pow_shm_register(heartbeat_pow_shm_context* hs,
+                               uint64_t window_size,
+                               int log_fd,
+                               heartbeat_pow_window_complete* hwc_callback,
+                               uint32_t flags) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int heartbeat_acc_pow_shm_register(heartbeat_acc_pow_shm_context* hs,
+                                   uint64_t window_size,
+                                   int log_fd,
+                                   heartbeat_acc_pow_window_complete* hwc_callback,
+                                   uint32_t flags) {
+#else
+int heartbeat_shm_register(heartbeat_shm_context* hs,
+                           uint64_t window_size,
+                           int log_fd,
+                           heartbeat_window_complete* hwc_callback,
+                           uint32_t flags) {
+#endif
+  char name[HEARTBEAT_SHM_NAME_MAX];
+  if (hs == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (hb_shm_region_register_name(name, sizeof(name))) {
+    return -1;
+  }
+#if defined(HEARTBEAT_MODE_ACC)
+  return heartbeat_acc_shm_init(hs, name, window_size, log_fd, hwc_callback, flags);
+#elif defined(HEARTBEAT_MODE_POW)
+  return heartbeat_pow_shm_init(hs, name, window_size, log_fd, hwc_callback, flags);
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+  return heartbeat_acc_pow_shm_init(hs, name, window_size, log_fd, hwc_callback, flags);
+#else
+  return heartbeat_shm_init(hs, name, window_size, log_fd, hwc_callback, flags);
+#endif
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+void heartbeat_acc_shm_finish(heartbeat_acc_shm_context* hs) {
+#elif defined(HEARTBEAT_MODE_POW)
+void heartbeat_pow_shm_finish(heartbeat_pow_shm_context* hs) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+void heartbeat_acc_pow_shm_finish(heartbeat_acc_pow_shm_context* hs) {
+#else
+void heartbeat_shm_finish(heartbeat_shm_context* hs) {
+#endif
+  if (hs != NULL && hs->hb != NULL) {
+    hb_shm_region_destroy(&hs->region);
+    hs->hb = NULL;
+  }
+}
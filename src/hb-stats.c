@@ -0,0 +1,409 @@
+/**
+ * Window statistics.
+ * Values are reduced in place, e.g., in a window column, by the best kernel
+ * this CPU supports, which skips values that aren't finite. Percentiles are
+ * selected in a scratch copy of the finite values.
+ *
+ * @author Connor Imes
+ */
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+
+#include "hb-stats.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HB_STATS_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define HB_STATS_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* Count, sum, min, and max of the finite values in an array */
+typedef struct hb_stats_sums {
+  uint64_t count;
+  double sum;
+  double min;
+  double max;
+} hb_stats_sums;
+
+static void sums_init(hb_stats_sums* s) {
+  s->count = 0;
+  s->sum = 0;
+  s->min = INFINITY;
+  s->max = -INFINITY;
+}
+
+static void sums_merge(hb_stats_sums* s, const hb_stats_sums* r) {
+  s->count += r->count;
+  s->sum += r->sum;
+  s->min = r->min < s->min ? r->min : s->min;
+  s->max = r->max > s->max ? r->max : s->max;
+}
+
+static void sums_add(hb_stats_sums* s, double x) {
+  if (isfinite(x)) {
+    s->count++;
+    s->sum += x;
+    s->min = x < s->min ? x : s->min;
+    s->max = x > s->max ? x : s->max;
+  }
+}
+
+static void sums_scalar(const double* v, uint64_t n, hb_stats_sums* s) {
+  uint64_t i;
+  sums_init(s);
+  for (i = 0; i < n; i++) {
+    sums_add(s, v[i]);
+  }
+}
+
+static double sq_dev_scalar(const double* v, uint64_t n, double mean) {
+  double sum = 0;
+  uint64_t i;
+  for (i = 0; i < n; i++) {
+    if (isfinite(v[i])) {
+      sum += (v[i] - mean) * (v[i] - mean);
+    }
+  }
+  return sum;
+}
+
+/*
+ * Vector kernels mask out lanes that aren't finite, i.e., where x - x isn't 0.
+ * They reduce their lanes with the scalar kernels, which also handle the
+ * remainder.
+ */
+static void merge_lanes(const double* sum, const double* min, const double* max, uint64_t count,
+                        unsigned int lanes, const double* rest, uint64_t n_rest, hb_stats_sums* s) {
+  hb_stats_sums r;
+  unsigned int i;
+  sums_init(s);
+  s->count = count;
+  for (i = 0; i < lanes; i++) {
+    s->sum += sum[i];
+    s->min = min[i] < s->min ? min[i] : s->min;
+    s->max = max[i] > s->max ? max[i] : s->max;
+  }
+  sums_scalar(rest, n_rest, &r);
+  sums_merge(s, &r);
+}
+
+#if defined(HB_STATS_X86)
+__attribute__((target("avx2")))
+static void sums_avx2(const double* v, uint64_t n, hb_stats_sums* s) {
+  double sum[4], min[4], max[4], count[4];
+  __m256d zero = _mm256_setzero_pd();
+  __m256d one = _mm256_set1_pd(1.0);
+  __m256d vsum = zero;
+  __m256d vcount = zero;
+  __m256d vmin = _mm256_set1_pd(INFINITY);
+  __m256d vmax = _mm256_set1_pd(-INFINITY);
+  __m256d x;
+  __m256d finite;
+  uint64_t i;
+  for (i = 0; i + 4 <= n; i += 4) {
+    x = _mm256_loadu_pd(&v[i]);
+    finite = _mm256_cmp_pd(_mm256_sub_pd(x, x), zero, _CMP_EQ_OQ);
+    vcount = _mm256_add_pd(vcount, _mm256_and_pd(finite, one));
+    vsum = _mm256_add_pd(vsum, _mm256_and_pd(finite, x));
+    vmin = _mm256_blendv_pd(vmin, _mm256_min_pd(vmin, x), finite);
+    vmax = _mm256_blendv_pd(vmax, _mm256_max_pd(vmax, x), finite);
+  }
+  _mm256_storeu_pd(sum, vsum);
+  _mm256_storeu_pd(min, vmin);
+  _mm256_storeu_pd(max, vmax);
+  _mm256_storeu_pd(count, vcount);
+  merge_lanes(sum, min, max, (uint64_t) (count[0] + count[1] + count[2] + count[3]), 4, &v[i], n - i, s);
+}
+
+__attribute__((target("avx2")))
+static double sq_dev_avx2(const double* v, uint64_t n, double mean) {
+  double sum[4];
+  __m256d zero = _mm256_setzero_pd();
+  __m256d vsum = zero;
+  __m256d vmean = _mm256_set1_pd(mean);
+  __m256d x;
+  __m256d d;
+  uint64_t i;
+  for (i = 0; i + 4 <= n; i += 4) {
+    x = _mm256_loadu_pd(&v[i]);
+    d = _mm256_and_pd(_mm256_cmp_pd(_mm256_sub_pd(x, x), zero, _CMP_EQ_OQ), _mm256_sub_pd(x, vmean));
+    vsum = _mm256_add_pd(vsum, _mm256_mul_pd(d, d));
+  }
+  _mm256_storeu_pd(sum, vsum);
+  return sum[0] + sum[1] + sum[2] + sum[3] + sq_dev_scalar(&v[i], n - i, mean);
+}
+
+__attribute__((target("avx512f")))
+static void sums_avx512(const double* v, uint64_t n, hb_stats_sums* s) {
+  double sum[8], min[8], max[8];
+  __m512d zero = _mm512_setzero_pd();
+  __m512d vsum = zero;
+  __m512d vmin = _mm512_set1_pd(INFINITY);
+  __m512d vmax = _mm512_set1_pd(-INFINITY);
+  __m512d x;
+  __mmask8 finite;
+  uint64_t count = 0;
+  uint64_t i;
+  for (i = 0; i + 8 <= n; i += 8) {
+    x = _mm512_loadu_pd(&v[i]);
+    finite = _mm512_cmp_pd_mask(_mm512_sub_pd(x, x), zero, _CMP_EQ_OQ);
+    count += (uint64_t) __builtin_popcount(finite);
+    vsum = _mm512_mask_add_pd(vsum, finite, vsum, x);
+    vmin = _mm512_mask_min_pd(vmin, finite, vmin, x);
+    vmax = _mm512_mask_max_pd(vmax, finite, vmax, x);
+  }
+  _mm512_storeu_pd(sum, vsum);
+  _mm512_storeu_pd(min, vmin);
+  _mm512_storeu_pd(max, vmax);
+  merge_lanes(sum, min, max, count, 8, &v[i], n - i, s);
+}
+
+__attribute__((target("avx512f")))
+static double sq_dev_avx512(const double* v, uint64_t n, double mean) {
+  double sum[8];
+  __m512d zero = _mm512_setzero_pd();
+  __m512d vsum = zero;
+  __m512d vmean = _mm512_set1_pd(mean);
+  __m512d x;
+  __m512d d;
+  uint64_t i;
+  unsigned int j;
+  double total = 0;
+  for (i = 0; i + 8 <= n; i += 8) {
+    x = _mm512_loadu_pd(&v[i]);
+    d = _mm512_maskz_sub_pd(_mm512_cmp_pd_mask(_mm512_sub_pd(x, x), zero, _CMP_EQ_OQ), x, vmean);
+    vsum = _mm512_add_pd(vsum, _mm512_mul_pd(d, d));
+  }
+  _mm512_storeu_pd(sum, vsum);
+  for (j = 0; j < 8; j++) {
+    total += sum[j];
+  }
+  return total + sq_dev_scalar(&v[i], n - i, mean);
+}
+#endif
+
+#if defined(HB_STATS_NEON)
+static void sums_neon(const double* v, uint64_t n, hb_stats_sums* s) {
+  double sum[2], min[2], max[2];
+  uint64_t count[2];
+  float64x2_t zero = vdupq_n_f64(0);
+  float64x2_t vsum = zero;
+  float64x2_t vmin = vdupq_n_f64(INFINITY);
+  float64x2_t vmax = vdupq_n_f64(-INFINITY);
+  uint64x2_t vcount = vdupq_n_u64(0);
+  uint64x2_t finite;
+  float64x2_t x;
+  uint64_t i;
+  for (i = 0; i + 2 <= n; i += 2) {
+    x = vld1q_f64(&v[i]);
+    finite = vceqq_f64(vsubq_f64(x, x), zero);
+    // finite lanes are all ones, i.e., -1
+    vcount = vsubq_u64(vcount, finite);
+    vsum = vaddq_f64(vsum, vreinterpretq_f64_u64(vandq_u64(finite, vreinterpretq_u64_f64(x))));
+    vmin = vbslq_f64(finite, vminq_f64(vmin, x), vmin);
+    vmax = vbslq_f64(finite, vmaxq_f64(vmax, x), vmax);
+  }
+  vst1q_f64(sum, vsum);
+  vst1q_f64(min, vmin);
+  vst1q_f64(max, vmax);
+  vst1q_u64(count, vcount);
+  merge_lanes(sum, min, max, count[0] + count[1], 2, &v[i], n - i, s);
+}
+
+static double sq_dev_neon(const double* v, uint64_t n, double mean) {
+  double sum[2];
+  float64x2_t zero = vdupq_n_f64(0);
+  float64x2_t vsum = zero;
+  float64x2_t vmean = vdupq_n_f64(mean);
+  float64x2_t x;
+  float64x2_t d;
+  uint64_t i;
+  for (i = 0; i + 2 <= n; i += 2) {
+    x = vld1q_f64(&v[i]);
+    d = vreinterpretq_f64_u64(vandq_u64(vceqq_f64(vsubq_f64(x, x), zero),
+                                        vreinterpretq_u64_f64(vsubq_f64(x, vmean))));
+    vsum = vfmaq_f64(vsum, d, d);
+  }
+  vst1q_f64(sum, vsum);
+  return sum[0] + sum[1] + sq_dev_scalar(&v[i], n - i, mean);
+}
+#endif
+
+/* NEON is part of the AArch64 baseline, so only x86 needs runtime checks */
+static void sums(const double* v, uint64_t n, hb_stats_sums* s) {
+#if defined(HB_STATS_X86)
+  if (__builtin_cpu_supports("avx512f")) {
+    sums_avx512(v, n, s);
+  } else if (__builtin_cpu_supports("avx2")) {
+    sums_avx2(v, n, s);
+  } else {
+    sums_scalar(v, n, s);
+  }
+#elif defined(HB_STATS_NEON)
+  sums_neon(v, n, s);
+#else
+  sums_scalar(v, n, s);
+#endif
+}
+
+static double sq_dev(const double* v, uint64_t n, double mean) {
+#if defined(HB_STATS_X86)
+  if (__builtin_cpu_supports("avx512f")) {
+    return sq_dev_avx512(v, n, mean);
+  } else if (__builtin_cpu_supports("avx2")) {
+    return sq_dev_avx2(v, n, mean);
+  }
+  return sq_dev_scalar(v, n, mean);
+#elif defined(HB_STATS_NEON)
+  return sq_dev_neon(v, n, mean);
+#else
+  return sq_dev_scalar(v, n, mean);
+#endif
+}
+
+static void swap(double* v, uint64_t i, uint64_t j) {
+  double tmp = v[i];
+  v[i] = v[j];
+  v[j] = tmp;
+}
+
+/*
+ * Select the value of rank k (from 0) in v[lo, hi), like C++'s nth_element:
+ * afterward, values from k on are the largest in the range. Partitions are
+ * three-way, so runs of equal values, which are common, end early.
+ */
+static double select_nth(double* v, uint64_t lo, uint64_t hi, uint64_t k) {
+  double a, b, c, pivot;
+  uint64_t lt, gt, i;
+  while (hi - lo > 1) {
+    // median of three
+    a = v[lo];
+    b = v[lo + (hi - lo) / 2];
+    c = v[hi - 1];
+    pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+    lt = lo;
+    gt = hi;
+    i = lo;
+    while (i < gt) {
+      if (v[i] < pivot) {
+        swap(v, lt++, i++);
+      } else if (v[i] > pivot) {
+        swap(v, i, --gt);
+      } else {
+        i++;
+      }
+    }
+    if (k < lt) {
+      hi = lt;
+    } else if (k >= gt) {
+      lo = gt;
+    } else {
+      return pivot;
+    }
+  }
+  return v[k];
+}
+
+/* Nearest-rank index of a percentile, without overflow for any n */
+static uint64_t percentile_index(uint64_t n, unsigned int pct) {
+  uint64_t rank = (n / 100) * pct + ((n % 100) * pct + 99) / 100;
+  return rank > 0 ? rank - 1 : 0;
+}
+
+/*
+ * Select percentiles from the finite values, each from the values at or above
+ * the last one's rank.
+ */
+static void percentiles(const double* values, uint64_t size, uint64_t first, uint64_t count, double* scratch,
+                        heartbeat_window_stats* stats) {
+  uint64_t p50 = percentile_index(stats->count, 50);
+  uint64_t p90 = percentile_index(stats->count, 90);
+  uint64_t p99 = percentile_index(stats->count, 99);
+  uint64_t n = 0;
+  uint64_t i;
+  double x;
+  for (i = 0; i < count; i++) {
+    x = values[(first + i) % size];
+    if (isfinite(x)) {
+      scratch[n++] = x;
+    }
+  }
+  stats->p50 = select_nth(scratch, 0, n, p50);
+  stats->p90 = select_nth(scratch, p50, n, p90);
+  stats->p99 = select_nth(scratch, p90, n, p99);
+}
+
+void hb_stats_values(const double* values, uint64_t size, uint64_t first, uint64_t count, double* scratch,
+                     heartbeat_window_stats* stats) {
+  // the values wrap around the ring at most once
+  uint64_t n_head = count < size - first ? count : size - first;
+  uint64_t n_tail = count - n_head;
+  hb_stats_sums s;
+  hb_stats_sums tail;
+  memset(stats, 0, sizeof(*stats));
+  if (count == 0) {
+    return;
+  }
+  sums(&values[first], n_head, &s);
+  if (n_tail > 0) {
+    sums(values, n_tail, &tail);
+    sums_merge(&s, &tail);
+  }
+  if (s.count == 0) {
+    return;
+  }
+  stats->count = s.count;
+  stats->min = s.min;
+  stats->max = s.max;
+  stats->mean = s.sum / (double) s.count;
+  stats->variance = (sq_dev(&values[first], n_head, stats->mean) +
+                     (n_tail > 0 ? sq_dev(values, n_tail, stats->mean) : 0)) / (double) s.count;
+  if (scratch != NULL) {
+    percentiles(values, size, first, count, scratch, stats);
+  }
+}
+
+/* The value of the record at index i of a ring */
+static double ring_value(const void* records, size_t record_size, uint64_t size, uint64_t first, uint64_t i,
+                         hb_stats_value* value) {
+  return value((const char*) records + ((first + i) % size) * record_size);
+}
+
+void hb_stats_records(const void* records, size_t record_size, uint64_t size, uint64_t first, uint64_t count,
+                      hb_stats_value* value, double* scratch, heartbeat_window_stats* stats) {
+  hb_stats_sums s;
+  double sq = 0;
+  double x;
+  uint64_t i;
+  if (scratch != NULL && count > 0) {
+    // gather the values, then reduce and select in place
+    for (i = 0; i < count; i++) {
+      scratch[i] = ring_value(records, record_size, size, first, i, value);
+    }
+    hb_stats_values(scratch, count, 0, count, scratch, stats);
+    return;
+  }
+  // otherwise, reduce values as they're read, without percentiles
+  memset(stats, 0, sizeof(*stats));
+  sums_init(&s);
+  for (i = 0; i < count; i++) {
+    sums_add(&s, ring_value(records, record_size, size, first, i, value));
+  }
+  if (s.count == 0) {
+    return;
+  }
+  stats->count = s.count;
+  stats->min = s.min;
+  stats->max = s.max;
+  stats->mean = s.sum / (double) s.count;
+  for (i = 0; i < count; i++) {
+    x = ring_value(records, record_size, size, first, i, value);
+    if (isfinite(x)) {
+      sq += (x - stats->mean) * (x - stats->mean);
+    }
+  }
+  stats->variance = sq / (double) s.count;
+}
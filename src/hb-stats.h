@@ -0,0 +1,35 @@
+/**
+ * Private window statistics, shared by the heartbeat implementations.
+ * Min, max, mean, and variance are computed with SIMD kernels chosen for the
+ * CPU at runtime, with a portable scalar fallback.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HB_STATS_H_
+#define _HB_STATS_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "heartbeat-common-types.h"
+
+/* Get the value of interest from a record */
+typedef double (hb_stats_value)(const void* rec);
+
+/*
+ * Compute statistics for count values in a ring of size values, e.g., a window
+ * column, starting at index first. The values are reduced in place. Values
+ * that aren't finite, e.g., rates over no time, are skipped.
+ * If scratch isn't NULL, it holds count values and is used to select
+ * percentiles, which are otherwise 0.
+ */
+void hb_stats_values(const double* values, uint64_t size, uint64_t first, uint64_t count, double* scratch,
+                     heartbeat_window_stats* stats);
+
+/*
+ * Like hb_stats_values(), for records of record_size bytes in a ring. Values
+ * are gathered into scratch if it isn't NULL.
+ */
+void hb_stats_records(const void* records, size_t record_size, uint64_t size, uint64_t first, uint64_t count,
+                      hb_stats_value* value, double* scratch, heartbeat_window_stats* stats);
+
+#endif
@@ -0,0 +1,164 @@
+/**
+ * Low-overhead time source for heartbeat timestamps.
+ *
+ * @author Connor Imes
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <errno.h>
+#include <inttypes.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "heartbeat-time.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define HB_HAVE_TSC
+#include <cpuid.h>
+__extension__ typedef unsigned __int128 hb_uint128;
+#endif
+
+#define ONE_BILLION 1000000000ULL
+
+/* Duration (ns) to measure the TSC frequency */
+#define HB_TSC_CALIBRATION_NS 10000000ULL
+
+static hb_clock_source clock_source = HB_CLOCK_MONOTONIC;
+
+#if defined(HB_HAVE_TSC)
+static int tsc_has_rdtscp;
+// TSC ticks are converted to ns with fixed point multiplication relative to a base
+static uint64_t tsc_base;
+static uint64_t tsc_base_ns;
+static uint64_t tsc_mult;
+#define HB_TSC_SHIFT 32
+#endif
+
+static uint64_t get_time_monotonic(void) {
+#if defined(_WIN32)
+  LARGE_INTEGER count;
+  LARGE_INTEGER freq;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  // avoid overflow in count * ONE_BILLION
+  return (count.QuadPart / freq.QuadPart) * ONE_BILLION + (count.QuadPart % freq.QuadPart) * ONE_BILLION / freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * ONE_BILLION + ts.tv_nsec;
+#endif
+}
+
+static uint64_t get_time_monotonic_raw(void) {
+#if defined(CLOCK_MONOTONIC_RAW)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return ts.tv_sec * ONE_BILLION + ts.tv_nsec;
+#else
+  return get_time_monotonic();
+#endif
+}
+
+#if defined(HB_HAVE_TSC)
+static inline uint64_t read_tsc(void) {
+  uint32_t lo, hi, aux;
+  if (tsc_has_rdtscp) {
+    // waits for prior instructions to execute
+    __asm__ __volatile__("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux));
+  } else {
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  }
+  (void) aux;
+  return ((uint64_t) hi << 32) | lo;
+}
+
+static int tsc_is_invariant(void) {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) {
+    return 0;
+  }
+  __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+  tsc_has_rdtscp = (edx >> 27) & 1;
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return (edx >> 8) & 1;
+}
+
+static int tsc_calibrate(void) {
+  uint64_t ns_start, ns_end, tsc_start, tsc_end;
+  if (!tsc_is_invariant()) {
+    return -1;
+  }
+  ns_start = get_time_monotonic_raw();
+  tsc_start = read_tsc();
+  do {
+    ns_end = get_time_monotonic_raw();
+    tsc_end = read_tsc();
+  } while (ns_end - ns_start < HB_TSC_CALIBRATION_NS);
+  if (tsc_end <= tsc_start) {
+    return -1;
+  }
+  tsc_mult = (uint64_t) ((((hb_uint128) (ns_end - ns_start)) << HB_TSC_SHIFT) / (tsc_end - tsc_start));
+  tsc_base = tsc_end;
+  tsc_base_ns = ns_end;
+  return 0;
+}
+
+static uint64_t get_time_tsc(void) {
+  uint64_t tsc = read_tsc();
+  // TSCs may be slightly out of sync between cores
+  if (tsc < tsc_base) {
+    return tsc_base_ns - (uint64_t) ((((hb_uint128) (tsc_base - tsc)) * tsc_mult) >> HB_TSC_SHIFT);
+  }
+  return tsc_base_ns + (uint64_t) ((((hb_uint128) (tsc - tsc_base)) * tsc_mult) >> HB_TSC_SHIFT);
+}
+#endif
+
+int hb_time_init(hb_clock_source source) {
+  switch (source) {
+  case HB_CLOCK_MONOTONIC:
+    break;
+  case HB_CLOCK_MONOTONIC_RAW:
+#if !defined(CLOCK_MONOTONIC_RAW)
+    source = HB_CLOCK_MONOTONIC;
+#endif
+    break;
+  case HB_CLOCK_TSC:
+#if defined(HB_HAVE_TSC)
+    if (tsc_calibrate()) {
+      source = HB_CLOCK_MONOTONIC_RAW;
+    }
+#else
+    source = HB_CLOCK_MONOTONIC_RAW;
+#endif
+#if !defined(CLOCK_MONOTONIC_RAW)
+    if (source == HB_CLOCK_MONOTONIC_RAW) {
+      source = HB_CLOCK_MONOTONIC;
+    }
+#endif
+    break;
+  default:
+    errno = EINVAL;
+    return -1;
+  }
+  clock_source = source;
+  return 0;
+}
+
+hb_clock_source hb_time_get_source(void) {
+  return clock_source;
+}
+
+uint64_t hb_time_now(void) {
+  switch (clock_source) {
+#if defined(HB_HAVE_TSC)
+  case HB_CLOCK_TSC:
+    return get_time_tsc();
+#endif
+  case HB_CLOCK_MONOTONIC_RAW:
+    return get_time_monotonic_raw();
+  default:
+    return get_time_monotonic();
+  }
+}
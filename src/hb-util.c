@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* Determine which heartbeat implementation to use */
 #if defined(HEARTBEAT_MODE_POW)
@@ -18,6 +19,14 @@
 #else
 #include "heartbeat.h"
 #endif
+#include "heartbeat-shm-reader.h"
+#include "hb-atomic.h"
+#include "hb-ewma.h"
+#include "hb-rates.h"
+#include "hb-stats.h"
+
+/* Attempts to copy a consistent snapshot before giving up */
+#define HB_SNAPSHOT_RETRIES 1024
 
 #if defined(HEARTBEAT_MODE_ACC)
 uint64_t hb_acc_get_window_size(const heartbeat_acc_context* hb) {
@@ -64,7 +73,7 @@ uint64_t hb_get_user_tag(const heartbeat_context* hb) {
     errno = EINVAL;
     return 0;
   }
-  return hb->window_buffer[hb->ws.read_index].user_tag;
+  return hb->window_buffer != NULL ? hb->window_buffer[hb->ws.read_index].user_tag : 0;
 }
 
 #if defined(HEARTBEAT_MODE_ACC)
@@ -140,11 +149,16 @@ double hb_acc_pow_get_global_perf(const heartbeat_acc_pow_context* hb) {
 #else
 double hb_get_global_perf(const heartbeat_context* hb) {
 #endif
+  const hb_mode_record* rec;
   if (hb == NULL) {
     errno = EINVAL;
     return 0.0;
   }
-  return hb->window_buffer[hb->ws.read_index].perf.global;
+  if (hb->window_buffer == NULL) {
+    return hb_rate(hb->wd.global, hb->td.global);
+  }
+  rec = &hb->window_buffer[hb->ws.read_index];
+  return hb_lazy_rates(hb) ? hb_rate(rec->wd.global, rec->td.global) : rec->perf.global;
 }
 
 #if defined(HEARTBEAT_MODE_ACC)
@@ -156,11 +170,16 @@ double hb_acc_pow_get_window_perf(const heartbeat_acc_pow_context* hb) {
 #else
 double hb_get_window_perf(const heartbeat_context* hb) {
 #endif
+  const hb_mode_record* rec;
   if (hb == NULL) {
     errno = EINVAL;
     return 0.0;
   }
-  return hb->window_buffer[hb->ws.read_index].perf.window;
+  if (hb->window_buffer == NULL) {
+    return 0.0;
+  }
+  rec = &hb->window_buffer[hb->ws.read_index];
+  return hb_lazy_rates(hb) ? hb_rate(rec->wd.window, rec->td.window) : rec->perf.window;
 }
 
 #if defined(HEARTBEAT_MODE_ACC)
@@ -172,9 +191,140 @@ double hb_acc_pow_get_instant_perf(const heartbeat_acc_pow_context* hb) {
 #else
 double hb_get_instant_perf(const heartbeat_context* hb) {
 #endif
+  const hb_mode_record* rec;
   if (hb == NULL) {
     errno = EINVAL;
     return 0.0;
   }
-  return hb->window_buffer[hb->ws.read_index].perf.instant;
+  if (hb->window_buffer == NULL) {
+    return 0.0;
+  }
+  if (hb->columns != NULL && !hb_lazy_rates(hb)) {
+    return hb->columns->perf_instant[hb->ws.read_index];
+  }
+  rec = &hb->window_buffer[hb->ws.read_index];
+  return hb_lazy_rates(hb) ? hb_rate(rec->work, rec->end_time - rec->start_time) : rec->perf.instant;
+}
+
+/*
+ * Copy the last record, which is consistent if no write began that hadn't
+ * already ended. The window buffer may not be at the context's own pointer,
+ * e.g., when the context is mapped by another process, in which case the
+ * read index isn't trusted either.
+ */
+static int copy_snapshot(const hb_mode_context* hb,
+                         const hb_mode_record* window_buffer,
+                         uint64_t window_size,
+                         hb_mode_record* snapshot) {
+  uint64_t seq_end;
+  uint64_t read_index;
+  unsigned int spins = 0;
+  unsigned int i;
+  for (i = 0; i < HB_SNAPSHOT_RETRIES; i++) {
+    seq_end = hb->seq_end;
+    hb_fence_acquire();
+    read_index = hb->ws.read_index;
+    if (read_index < window_size) {
+      memcpy(snapshot, &window_buffer[read_index], sizeof(*snapshot));
+    }
+    hb_fence_acquire();
+    if (hb->seq_begin == seq_end && read_index < window_size) {
+      if (hb_lazy_rates(hb)) {
+        hb_compute_rates(snapshot);
+      }
+      return 0;
+    }
+    hb_spin_wait(&spins);
+  }
+  errno = EAGAIN;
+  return -1;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_get_snapshot(const heartbeat_acc_context* hb, heartbeat_acc_record* snapshot) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_get_snapshot(const heartbeat_pow_context* hb, heartbeat_pow_record* snapshot) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_get_snapshot(const heartbeat_acc_pow_context* hb, heartbeat_acc_pow_record* snapshot) {
+#else
+int hb_get_snapshot(const heartbeat_context* hb, heartbeat_record* snapshot) {
+#endif
+  if (hb == NULL || snapshot == NULL || hb->window_buffer == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  return copy_snapshot(hb, hb->window_buffer, hb->ws.window_size, snapshot);
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_shm_read(const heartbeat_shm_reader* reader, heartbeat_acc_record* snapshot) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_shm_read(const heartbeat_shm_reader* reader, heartbeat_pow_record* snapshot) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_shm_read(const heartbeat_shm_reader* reader, heartbeat_acc_pow_record* snapshot) {
+#else
+int hb_shm_read(const heartbeat_shm_reader* reader, heartbeat_record* snapshot) {
+#endif
+  const heartbeat_shm_header* header;
+  if (reader == NULL || reader->header == NULL || snapshot == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  header = reader->header;
+  if (header->mode != HB_MODE_BIN ||
+      header->context_size != sizeof(hb_mode_context) ||
+      header->record_size != sizeof(hb_mode_record)) {
+    errno = EINVAL;
+    return -1;
+  }
+  return copy_snapshot((const hb_mode_context*) ((const char*) header + header->context_offset),
+                       (const hb_mode_record*) ((const char*) header + header->buffer_offset),
+                       header->window_size, snapshot);
+}
+
+/* Computed from the record's data, since its rates may be lazy */
+static double instant_perf(const void* rec) {
+  const hb_mode_record* r = rec;
+  return hb_rate(r->work, r->end_time - r->start_time);
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_get_window_perf_stats(const heartbeat_acc_context* hb, heartbeat_window_stats* stats, double* scratch) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_get_window_perf_stats(const heartbeat_pow_context* hb, heartbeat_window_stats* stats, double* scratch) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_get_window_perf_stats(const heartbeat_acc_pow_context* hb,
+                                     heartbeat_window_stats* stats,
+                                     double* scratch) {
+#else
+int hb_get_window_perf_stats(const heartbeat_context* hb, heartbeat_window_stats* stats, double* scratch) {
+#endif
+  if (hb == NULL || stats == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (hb->columns != NULL && !hb_lazy_rates(hb)) {
+    hb_stats_values(hb->columns->perf_instant, hb->ws.window_size, hb_window_first(hb), hb_window_records(hb), scratch,
+                    stats);
+  } else {
+    hb_stats_records(hb->window_buffer, sizeof(hb_mode_record), hb->ws.window_size, hb_window_first(hb),
+                     hb_window_records(hb), &instant_perf, scratch, stats);
+  }
+  return 0;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+double hb_acc_get_ewma_perf(const heartbeat_acc_context* hb, uint32_t index) {
+#elif defined(HEARTBEAT_MODE_POW)
+double hb_pow_get_ewma_perf(const heartbeat_pow_context* hb, uint32_t index) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+double hb_acc_pow_get_ewma_perf(const heartbeat_acc_pow_context* hb, uint32_t index) {
+#else
+double hb_get_ewma_perf(const heartbeat_context* hb, uint32_t index) {
+#endif
+  if (hb == NULL || hb->ws.ewma == NULL) {
+    errno = EINVAL;
+    return 0.0;
+  }
+  return hb_ewma_rate(hb->ws.ewma, hb->ws.ewma->work, index);
 }
@@ -0,0 +1,58 @@
+/**
+ * Private varint helpers for compressed binary logs.
+ * Values are stored as residuals from a prediction, zigzag-encoded so small
+ * negative residuals are small too, then as little-endian base-128 varints.
+ *
+ * @author Connor Imes
+ */
+#ifndef _HB_VARINT_H_
+#define _HB_VARINT_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/* Encoded size of a 64-bit value */
+#define HB_VARINT_MAX 10
+
+static inline unsigned char* hb_varint_put(unsigned char* pos, uint64_t val) {
+  while (val >= 0x80) {
+    *pos++ = (unsigned char) (val | 0x80);
+    val >>= 7;
+  }
+  *pos++ = (unsigned char) val;
+  return pos;
+}
+
+/*
+ * Returns the position after the value, or NULL if it's truncated or too long.
+ */
+static inline const unsigned char* hb_varint_get(const unsigned char* pos, const unsigned char* end,
+                                                 uint64_t* val) {
+  uint64_t v = 0;
+  unsigned int shift;
+  for (shift = 0; shift < 64 && pos < end; shift += 7) {
+    v |= (uint64_t) (*pos & 0x7f) << shift;
+    if (!(*pos++ & 0x80)) {
+      *val = v;
+      return pos;
+    }
+  }
+  return NULL;
+}
+
+/* Residuals wrap like the unsigned arithmetic that produced the values */
+static inline unsigned char* hb_varint_put_delta(unsigned char* pos, uint64_t val, uint64_t pred) {
+  uint64_t r = val - pred;
+  return hb_varint_put(pos, (r << 1) ^ (0 - (r >> 63)));
+}
+
+static inline const unsigned char* hb_varint_get_delta(const unsigned char* pos, const unsigned char* end,
+                                                       uint64_t* val, uint64_t pred) {
+  uint64_t z;
+  if ((pos = hb_varint_get(pos, end, &z)) != NULL) {
+    *val = pred + ((z >> 1) ^ (0 - (z & 1)));
+  }
+  return pos;
+}
+
+#endif
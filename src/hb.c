@@ -7,6 +7,8 @@
 #define _POSIX_C_SOURCE 1
 #include <errno.h>
 #include <inttypes.h>
+#include <math.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,54 +21,63 @@
 #include <unistd.h>
 #endif
 
-/* Determine which heartbeat implementation to use */
-#if defined(HEARTBEAT_MODE_ACC)
-#include "heartbeat-acc.h"
-#elif defined(HEARTBEAT_MODE_POW)
-#include "heartbeat-pow.h"
-#elif defined(HEARTBEAT_MODE_ACC_POW)
-#include "heartbeat-acc-pow.h"
-#else
-#include "heartbeat.h"
-#endif
+#include "hb-log-queue.h"
+#include "hb-atomic.h"
+#include "hb-ewma.h"
+#include "hb-format.h"
+#include "hb-histogram.h"
+#include "hb-log-sink.h"
+#include "hb-mode.h"
+#include "hb-rates.h"
+#include "hb-rollup.h"
 
 #define __STDC_FORMAT_MACROS
 
+#define HEARTBEAT_FLAGS_ALL (HEARTBEAT_FLAG_LOCK_FREE | HEARTBEAT_FLAG_SINGLE_WRITER | HEARTBEAT_FLAG_LAZY_RATES | \
+                             HEARTBEAT_FLAG_LOG_BINARY | HEARTBEAT_FLAG_LOG_COMPRESSED | \
+                             HEARTBEAT_FLAG_HISTOGRAM_WINDOW)
+
 static void init_udata(heartbeat_udata* data) {
   data->global = 0;
   data->window = 0;
 }
 
 #if defined(HEARTBEAT_MODE_ACC)
-int heartbeat_acc_init(heartbeat_acc_context* hb,
-                       uint64_t window_size,
-                       heartbeat_acc_record* window_buffer,
-                       int log_fd,
-                       heartbeat_acc_window_complete* hwc_callback) {
+int heartbeat_acc_init_flags(heartbeat_acc_context* hb,
+                             uint64_t window_size,
+                             heartbeat_acc_record* window_buffer,
+                             int log_fd,
+                             heartbeat_acc_window_complete* hwc_callback,
+                             uint32_t flags) {
   size_t record_size = sizeof(heartbeat_acc_record);
 #elif defined(HEARTBEAT_MODE_POW)
-int heartbeat_pow_init(heartbeat_pow_context* hb,
-                       uint64_t window_size,
-                       heartbeat_pow_record* window_buffer,
-                       int log_fd,
-                       heartbeat_pow_window_complete* hwc_callback) {
+int heartbeat_pow_init_flags(heartbeat_pow_context* hb,
+                             uint64_t window_size,
+                             heartbeat_pow_record* window_buffer,
+                             int log_fd,
+                             heartbeat_pow_window_complete* hwc_callback,
+                             uint32_t flags) {
   size_t record_size = sizeof(heartbeat_pow_record);
 #elif defined(HEARTBEAT_MODE_ACC_POW)
-int heartbeat_acc_pow_init(heartbeat_acc_pow_context* hb,
-                           uint64_t window_size,
-                           heartbeat_acc_pow_record* window_buffer,
-                           int log_fd,
-                           heartbeat_acc_pow_window_complete* hwc_callback) {
+int heartbeat_acc_pow_init_flags(heartbeat_acc_pow_context* hb,
+                                 uint64_t window_size,
+                                 heartbeat_acc_pow_record* window_buffer,
+                                 int log_fd,
+                                 heartbeat_acc_pow_window_complete* hwc_callback,
+                                 uint32_t flags) {
   size_t record_size = sizeof(heartbeat_acc_pow_record);
 #else
-int heartbeat_init(heartbeat_context* hb,
-                   uint64_t window_size,
-                   heartbeat_record* window_buffer,
-                   int log_fd,
-                   heartbeat_window_complete* hwc_callback) {
+int heartbeat_init_flags(heartbeat_context* hb,
+                         uint64_t window_size,
+                         heartbeat_record* window_buffer,
+                         int log_fd,
+                         heartbeat_window_complete* hwc_callback,
+                         uint32_t flags) {
   size_t record_size = sizeof(heartbeat_record);
 #endif
-  if (hb == NULL || window_buffer == NULL || window_size == 0) {
+  if (hb == NULL || (window_buffer == NULL) != (window_size == 0) || (flags & ~HEARTBEAT_FLAGS_ALL) ||
+      ((flags & HEARTBEAT_FLAG_LOCK_FREE) && (flags & HEARTBEAT_FLAG_SINGLE_WRITER)) ||
+      ((flags & HEARTBEAT_FLAG_LOG_COMPRESSED) && !(flags & HEARTBEAT_FLAG_LOG_BINARY))) {
     errno = EINVAL;
     return -1;
   }
@@ -75,11 +86,29 @@ int heartbeat_init(heartbeat_context* hb,
   hb->ws.read_index = 0;
   hb->ws.window_size = window_size;
   hb->ws.log_fd = log_fd;
+  hb->ws.flags = flags;
+  hb->ws.window_count = 0;
+  hb->ws.async_log = NULL;
+  hb->ws.log_sink = NULL;
+  hb->ws.histogram = NULL;
+  hb->ws.ewma = NULL;
+  hb->ws.rollup = NULL;
+  hb->ws.window_duration = 0;
+  hb->ws.first_index = 0;
+  hb->ws.window_len = 0;
+  hb->ws.deadline = 0;
+  hb->ws.log_format = HEARTBEAT_LOG_FORMAT_TEXT;
+  hb->ws.log_columns = 0;
   hb->window_buffer = window_buffer;
+  hb->columns = NULL;
   // cheap way to set initial values to 0 (necessary for managing window data)
-  memset(hb->window_buffer, 0, window_size * record_size);
+  if (window_buffer != NULL) {
+    memset(hb->window_buffer, 0, window_size * record_size);
+  }
   hb->counter = 0;
   hb->lock = 0;
+  hb->seq_begin = 0;
+  hb->seq_end = 0;
   hb->hwc_callback = hwc_callback;
   init_udata(&hb->td);
   init_udata(&hb->wd);
@@ -93,6 +122,194 @@ int heartbeat_init(heartbeat_context* hb,
   return 0;
 }
 
+#if defined(HEARTBEAT_MODE_ACC)
+int heartbeat_acc_init(heartbeat_acc_context* hb,
+                       uint64_t window_size,
+                       heartbeat_acc_record* window_buffer,
+                       int log_fd,
+                       heartbeat_acc_window_complete* hwc_callback) {
+  return heartbeat_acc_init_flags(hb, window_size, window_buffer, log_fd, hwc_callback, 0);
+}
+#elif defined(HEARTBEAT_MODE_POW)
+int heartbeat_pow_init(heartbeat_pow_context* hb,
+                       uint64_t window_size,
+                       heartbeat_pow_record* window_buffer,
+                       int log_fd,
+                       heartbeat_pow_window_complete* hwc_callback) {
+  return heartbeat_pow_init_flags(hb, window_size, window_buffer, log_fd, hwc_callback, 0);
+}
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int heartbeat_acc_pow_init(heartbeat_acc_pow_context* hb,
+                           uint64_t window_size,
+                           heartbeat_acc_pow_record* window_buffer,
+                           int log_fd,
+                           heartbeat_acc_pow_window_complete* hwc_callback) {
+  return heartbeat_acc_pow_init_flags(hb, window_size, window_buffer, log_fd, hwc_callback, 0);
+}
+#else
+int heartbeat_init(heartbeat_context* hb,
+                   uint64_t window_size,
+                   heartbeat_record* window_buffer,
+                   int log_fd,
+                   heartbeat_window_complete* hwc_callback) {
+  return heartbeat_init_flags(hb, window_size, window_buffer, log_fd, hwc_callback, 0);
+}
+#endif
+
+/* Text logs are formatted into a buffer, which is written when it might not fit another line */
+#define HB_LOG_BUFFER_SIZE 32768
+#if defined(HEARTBEAT_USE_ACC) && defined(HEARTBEAT_USE_POW)
+#define HB_LOG_FIELDS 25
+#elif defined(HEARTBEAT_USE_ACC)
+#define HB_LOG_FIELDS 18
+#elif defined(HEARTBEAT_USE_POW)
+#define HB_LOG_FIELDS 19
+#else
+#define HB_LOG_FIELDS 12
+#endif
+/* Space for a quoted JSON key and its separators */
+#define HB_LOG_KEY_MAX 24
+#define HB_LOG_LINE_MAX (HB_LOG_FIELDS * (HB_FORMAT_FIELD_MAX + HB_LOG_KEY_MAX) + 2)
+
+typedef struct hb_log_column {
+  const char* name;
+  size_t offset;
+  unsigned int width;
+  unsigned int is_double;
+  uint32_t mask;
+} hb_log_column;
+
+#define HB_LOG_U64(name, field, width, mask) { name, offsetof(hb_mode_record, field), width, 0, mask }
+#define HB_LOG_DBL(name, field, width, mask) { name, offsetof(hb_mode_record, field), width, 1, mask }
+
+/* Log columns, in text log order */
+static const hb_log_column log_columns[HB_LOG_FIELDS] = {
+  HB_LOG_U64("HB", id, 6, HEARTBEAT_LOG_COL_ID),
+  HB_LOG_U64("Tag", user_tag, 6, HEARTBEAT_LOG_COL_TAG),
+
+  HB_LOG_U64("Global_Work", wd.global, 11, HEARTBEAT_LOG_COL_GLOBAL_WORK),
+  HB_LOG_U64("Window_Work", wd.window, 11, HEARTBEAT_LOG_COL_WINDOW_WORK),
+  HB_LOG_U64("Work", work, 11, HEARTBEAT_LOG_COL_WORK),
+
+  HB_LOG_U64("Global_Time", td.global, 15, HEARTBEAT_LOG_COL_GLOBAL_TIME),
+  HB_LOG_U64("Window_Time", td.window, 15, HEARTBEAT_LOG_COL_WINDOW_TIME),
+  HB_LOG_U64("Start_Time", start_time, 20, HEARTBEAT_LOG_COL_START_TIME),
+  HB_LOG_U64("End_Time", end_time, 20, HEARTBEAT_LOG_COL_END_TIME),
+
+  HB_LOG_DBL("Global_Perf", perf.global, 15, HEARTBEAT_LOG_COL_GLOBAL_PERF),
+  HB_LOG_DBL("Window_Perf", perf.window, 15, HEARTBEAT_LOG_COL_WINDOW_PERF),
+  HB_LOG_DBL("Instant_Perf", perf.instant, 15, HEARTBEAT_LOG_COL_INSTANT_PERF),
+#if defined(HEARTBEAT_USE_ACC)
+
+  HB_LOG_U64("Global_Acc", ad.global, 11, HEARTBEAT_LOG_COL_GLOBAL_ACC),
+  HB_LOG_U64("Window_Acc", ad.window, 11, HEARTBEAT_LOG_COL_WINDOW_ACC),
+  HB_LOG_U64("Acc", accuracy, 11, HEARTBEAT_LOG_COL_ACC),
+
+  HB_LOG_DBL("Global_Acc_Rate", acc.global, 16, HEARTBEAT_LOG_COL_GLOBAL_ACC_RATE),
+  HB_LOG_DBL("Window_Acc_Rate", acc.window, 16, HEARTBEAT_LOG_COL_WINDOW_ACC_RATE),
+  HB_LOG_DBL("Instant_Acc_Rate", acc.instant, 16, HEARTBEAT_LOG_COL_INSTANT_ACC_RATE),
+#endif
+#if defined(HEARTBEAT_USE_POW)
+
+  HB_LOG_U64("Global_Energy", ed.global, 15, HEARTBEAT_LOG_COL_GLOBAL_ENERGY),
+  HB_LOG_U64("Window_Energy", ed.window, 15, HEARTBEAT_LOG_COL_WINDOW_ENERGY),
+  HB_LOG_U64("Start_Energy", start_energy, 15, HEARTBEAT_LOG_COL_START_ENERGY),
+  HB_LOG_U64("End_Energy", end_energy, 15, HEARTBEAT_LOG_COL_END_ENERGY),
+
+  HB_LOG_DBL("Global_Pwr", pwr.global, 15, HEARTBEAT_LOG_COL_GLOBAL_PWR),
+  HB_LOG_DBL("Window_Pwr", pwr.window, 15, HEARTBEAT_LOG_COL_WINDOW_PWR),
+  HB_LOG_DBL("Instant_Pwr", pwr.instant, 15, HEARTBEAT_LOG_COL_INSTANT_PWR),
+#endif
+};
+
+/*
+ * A columns value of 0 selects all columns.
+ */
+static uint32_t log_columns_mask(uint32_t columns) {
+  return columns == 0 ? HEARTBEAT_LOG_COL_ALL : columns;
+}
+
+/*
+ * Format a log line with the same columns as the header.
+ * Text columns are padded, CSV and JSON Lines values are not. JSON has no
+ * representation for non-finite values, so they're logged as null.
+ */
+static char* format_record(char* pos, const hb_mode_record* rec, uint32_t format, uint32_t columns) {
+  const char* base = (const char*) rec;
+  const hb_log_column* col;
+  char sep = format == HEARTBEAT_LOG_FORMAT_TEXT ? ' ' : ',';
+  unsigned int width;
+  int first = 1;
+  uint64_t u;
+  double d;
+  size_t i;
+  columns = log_columns_mask(columns);
+  if (format == HEARTBEAT_LOG_FORMAT_JSONL) {
+    *pos++ = '{';
+  }
+  for (i = 0; i < HB_LOG_FIELDS; i++) {
+    col = &log_columns[i];
+    if (!(columns & col->mask)) {
+      continue;
+    }
+    if (!first) {
+      *pos++ = sep;
+    }
+    first = 0;
+    width = 0;
+    if (format == HEARTBEAT_LOG_FORMAT_TEXT) {
+      width = col->width;
+    } else if (format == HEARTBEAT_LOG_FORMAT_JSONL) {
+      *pos++ = '"';
+      pos = hb_format_str(pos, col->name, 0);
+      *pos++ = '"';
+      *pos++ = ':';
+    }
+    if (col->is_double) {
+      memcpy(&d, base + col->offset, sizeof(d));
+      if (format == HEARTBEAT_LOG_FORMAT_JSONL && !isfinite(d)) {
+        pos = hb_format_str(pos, "null", 0);
+      } else {
+        pos = hb_format_double(pos, d, width);
+      }
+    } else {
+      memcpy(&u, base + col->offset, sizeof(u));
+      pos = hb_format_u64(pos, u, width);
+    }
+  }
+  if (format == HEARTBEAT_LOG_FORMAT_JSONL) {
+    *pos++ = '}';
+  }
+  *pos++ = '\n';
+  return pos;
+}
+
+/*
+ * Format the log header line. JSON Lines logs don't have one.
+ */
+static char* format_header(char* pos, uint32_t format, uint32_t columns) {
+  char sep = format == HEARTBEAT_LOG_FORMAT_TEXT ? ' ' : ',';
+  int first = 1;
+  size_t i;
+  if (format == HEARTBEAT_LOG_FORMAT_JSONL) {
+    return pos;
+  }
+  columns = log_columns_mask(columns);
+  for (i = 0; i < HB_LOG_FIELDS; i++) {
+    if (!(columns & log_columns[i].mask)) {
+      continue;
+    }
+    if (!first) {
+      *pos++ = sep;
+    }
+    first = 0;
+    pos = hb_format_str(pos, log_columns[i].name,
+                        format == HEARTBEAT_LOG_FORMAT_TEXT ? log_columns[i].width : 0);
+  }
+  *pos++ = '\n';
+  return pos;
+}
+
 #if defined(HEARTBEAT_MODE_ACC)
 int hb_acc_log_header(int fd) {
 #elif defined(HEARTBEAT_MODE_POW)
@@ -102,48 +319,377 @@ int hb_acc_pow_log_header(int fd) {
 #else
 int hb_log_header(int fd) {
 #endif
-  int err_save;
-  FILE* log = fdopen(dup(fd), "w");
+  char buf[HB_LOG_LINE_MAX];
+  char* pos = format_header(buf, HEARTBEAT_LOG_FORMAT_TEXT, 0);
+  errno = hb_write_all(fd, buf, (size_t) (pos - buf));
+  return errno;
+}
 
-  if (log == NULL) {
+/*
+ * Whether the format is known and columns is 0 or has any of this heartbeat's columns.
+ */
+static int is_log_format(uint32_t format, uint32_t columns) {
+  uint32_t mode_columns = 0;
+  size_t i;
+  for (i = 0; i < HB_LOG_FIELDS; i++) {
+    mode_columns |= log_columns[i].mask;
+  }
+  return format <= HEARTBEAT_LOG_FORMAT_JSONL && (columns == 0 || (columns & mode_columns));
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_log_header_format(int fd, uint32_t format, uint32_t columns) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_log_header_format(int fd, uint32_t format, uint32_t columns) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_log_header_format(int fd, uint32_t format, uint32_t columns) {
+#else
+int hb_log_header_format(int fd, uint32_t format, uint32_t columns) {
+#endif
+  char buf[HB_LOG_LINE_MAX];
+  char* pos;
+  if (!is_log_format(format, columns)) {
+    errno = EINVAL;
     return errno;
   }
+  pos = format_header(buf, format, columns);
+  errno = hb_write_all(fd, buf, (size_t) (pos - buf));
+  return errno;
+}
 
-  errno = 0;
-  fprintf(log,
-          "%-6s %-6s"
-          " %-11s %-11s %-11s"
-          " %-15s %-15s %-20s %-20s"
-          " %-15s %-15s %-15s"
-#if defined(HEARTBEAT_USE_ACC)
-          " %-11s %-11s %-11s"
-          " %-16s %-16s %-16s"
+static void fill_bin_header(const hb_mode_context* hb, heartbeat_bin_header* header) {
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, HEARTBEAT_BIN_MAGIC, sizeof(header->magic));
+  header->byte_order = HEARTBEAT_BIN_BYTE_ORDER;
+  header->version = HEARTBEAT_BIN_VERSION;
+  header->mode = HB_MODE_BIN;
+  header->flags = hb->ws.flags & (HEARTBEAT_FLAG_LAZY_RATES | HEARTBEAT_FLAG_LOG_COMPRESSED);
+  header->record_size = sizeof(hb_mode_record);
+  header->window_size = hb->ws.window_size;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_log_bin_header(const heartbeat_acc_context* hb, int fd) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_log_bin_header(const heartbeat_pow_context* hb, int fd) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_log_bin_header(const heartbeat_acc_pow_context* hb, int fd) {
+#else
+int hb_log_bin_header(const heartbeat_context* hb, int fd) {
 #endif
-#if defined(HEARTBEAT_USE_POW)
-          " %-15s %-15s %-15s %-15s"
-          " %-15s %-15s %-15s"
-#endif
-          "\n",
-          "HB", "Tag",
-          "Global_Work", "Window_Work", "Work",
-          "Global_Time", "Window_Time", "Start_Time", "End_Time",
-          "Global_Perf", "Window_Perf", "Instant_Perf"
+  heartbeat_bin_header header;
+  if (hb == NULL) {
+    errno = EINVAL;
+    return errno;
+  }
+  fill_bin_header(hb, &header);
+  errno = hb_write_all(fd, &header, sizeof(header));
+  return errno;
+}
+
+/* Records per compressed block when encoding into a log buffer */
+#define HB_LOG_BLOCK_RECORDS \
+  ((HB_LOG_BUFFER_SIZE - HEARTBEAT_LOG_BLOCK_MAX(0, sizeof(hb_mode_record))) / \
+   (HEARTBEAT_LOG_BLOCK_MAX(1, sizeof(hb_mode_record)) - HEARTBEAT_LOG_BLOCK_MAX(0, sizeof(hb_mode_record))))
+
+/*
+ * Encode a compressed block into a buffer that's large enough for it.
+ */
+static void encode_block(const hb_mode_record* records, uint64_t count, void* buf, size_t len, size_t* block_len) {
+#if defined(HEARTBEAT_MODE_ACC)
+  hb_acc_log_encode_block(records, count, buf, len, block_len);
+#elif defined(HEARTBEAT_MODE_POW)
+  hb_pow_log_encode_block(records, count, buf, len, block_len);
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+  hb_acc_pow_log_encode_block(records, count, buf, len, block_len);
+#else
+  hb_log_encode_block(records, count, buf, len, block_len);
+#endif
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_log_bin_window_buffer(const heartbeat_acc_context* hb, int fd) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_log_bin_window_buffer(const heartbeat_pow_context* hb, int fd) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_log_bin_window_buffer(const heartbeat_acc_pow_context* hb, int fd) {
+#else
+int hb_log_bin_window_buffer(const heartbeat_context* hb, int fd) {
+#endif
+  unsigned char buf[HB_LOG_BUFFER_SIZE];
+  size_t len;
+  uint64_t count;
+  uint64_t i;
+  int err = 0;
+  if (hb == NULL) {
+    errno = EINVAL;
+    return errno;
+  }
+  if (!(hb->ws.flags & HEARTBEAT_FLAG_LOG_COMPRESSED)) {
+    errno = hb_write_all(fd, hb->window_buffer, hb->ws.buffer_index * sizeof(hb_mode_record));
+    return errno;
+  }
+  // large windows are split into blocks that fit in the buffer
+  for (i = 0; i < hb->ws.buffer_index && !err; i += count) {
+    count = hb->ws.buffer_index - i < HB_LOG_BLOCK_RECORDS ? hb->ws.buffer_index - i : HB_LOG_BLOCK_RECORDS;
+    encode_block(&hb->window_buffer[i], count, buf, sizeof(buf), &len);
+    err = hb_write_all(fd, buf, len);
+  }
+  errno = err;
+  return errno;
+}
+
+/*
+ * Log the window buffer in the context's log format.
+ */
+static int log_window_buffer(const hb_mode_context* hb, int fd) {
+  if (hb->ws.flags & HEARTBEAT_FLAG_LOG_BINARY) {
+#if defined(HEARTBEAT_MODE_ACC)
+    return hb_acc_log_bin_window_buffer(hb, fd);
+#elif defined(HEARTBEAT_MODE_POW)
+    return hb_pow_log_bin_window_buffer(hb, fd);
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+    return hb_acc_pow_log_bin_window_buffer(hb, fd);
+#else
+    return hb_log_bin_window_buffer(hb, fd);
+#endif
+  }
+#if defined(HEARTBEAT_MODE_ACC)
+  return hb_acc_log_window_buffer(hb, fd);
+#elif defined(HEARTBEAT_MODE_POW)
+  return hb_pow_log_window_buffer(hb, fd);
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+  return hb_acc_pow_log_window_buffer(hb, fd);
+#else
+  return hb_log_window_buffer(hb, fd);
+#endif
+}
+
+/*
+ * Log the header to a sink, with its header function if it has one.
+ * Sinks that only take records don't get a header.
+ */
+static int sink_log_header(const hb_mode_context* hb, hb_log_sink* sink) {
+  hb_log_sink_write* write_header = sink->header != NULL ? sink->header : sink->write;
+  heartbeat_bin_header header;
+  char buf[HB_LOG_LINE_MAX];
+  char* pos;
+  if (write_header == NULL) {
+    errno = 0;
+  } else if (hb->ws.flags & HEARTBEAT_FLAG_LOG_BINARY) {
+    fill_bin_header(hb, &header);
+    errno = write_header(sink, &header, sizeof(header)) ? errno : 0;
+  } else {
+    pos = format_header(buf, hb->ws.log_format, hb->ws.log_columns);
+    errno = pos > buf && write_header(sink, buf, (size_t) (pos - buf)) ? errno : 0;
+  }
+  return errno;
+}
+
+/*
+ * Log the window buffer to a sink. Text is formatted into the sink's buffer,
+ * so the window is written all at once.
+ */
+static int sink_log_window_buffer(const hb_mode_context* hb, hb_log_sink* sink) {
+  const hb_mode_record* rec;
+  hb_mode_record lazy;
+  char* buf = sink->buf;
+  size_t len = 0;
+  uint64_t i;
+  int err = 0;
+  if (sink->records != NULL &&
+      sink->records(sink, hb->window_buffer, hb->ws.buffer_index, sizeof(hb_mode_record))) {
+    err = errno;
+  }
+  if (sink->write == NULL || hb->ws.buffer_index == 0) {
+    errno = err;
+    return errno;
+  }
+  if (hb->ws.flags & HEARTBEAT_FLAG_LOG_COMPRESSED) {
+    len = HEARTBEAT_LOG_BLOCK_MAX(hb->ws.buffer_index, sizeof(hb_mode_record));
+    if ((buf = hb_log_sink_reserve(sink, len)) == NULL) {
+      errno = err ? err : errno;
+      return errno;
+    }
+    encode_block(hb->window_buffer, hb->ws.buffer_index, buf, len, &len);
+    if (sink->write(sink, buf, len) && !err) {
+      err = errno;
+    }
+    errno = err;
+    return errno;
+  }
+  if (hb->ws.flags & HEARTBEAT_FLAG_LOG_BINARY) {
+    if (sink->write(sink, hb->window_buffer, hb->ws.buffer_index * sizeof(hb_mode_record)) && !err) {
+      err = errno;
+    }
+    errno = err;
+    return errno;
+  }
+  for (i = 0; i < hb->ws.buffer_index; i++) {
+    if (sink->buf_size - len < HB_LOG_LINE_MAX && (buf = hb_log_sink_reserve(sink, len + HB_LOG_LINE_MAX)) == NULL) {
+      errno = err ? err : errno;
+      return errno;
+    }
+    rec = &hb->window_buffer[i];
+    if (hb_lazy_rates(hb)) {
+      memcpy(&lazy, rec, sizeof(lazy));
+      hb_compute_rates(&lazy);
+      rec = &lazy;
+    }
+    len = (size_t) (format_record(buf + len, rec, hb->ws.log_format, hb->ws.log_columns) - buf);
+  }
+  if (sink->write(sink, buf, len) && !err) {
+    err = errno;
+  }
+  errno = err;
+  return errno;
+}
+
+/*
+ * Log the window buffer to the context's sink, or its log file descriptor.
+ */
+static int ctx_log_window_buffer(const hb_mode_context* hb) {
+  if (hb->ws.log_sink != NULL) {
+    return sink_log_window_buffer(hb, hb->ws.log_sink);
+  }
+  return log_window_buffer(hb, hb->ws.log_fd);
+}
+
+static int has_log(const hb_mode_context* hb) {
+  return hb->ws.log_sink != NULL || hb->ws.log_fd > 0;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_set_log_sink(heartbeat_acc_context* hb, hb_log_sink* sink) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_set_log_sink(heartbeat_pow_context* hb, hb_log_sink* sink) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_set_log_sink(heartbeat_acc_pow_context* hb, hb_log_sink* sink) {
+#else
+int hb_set_log_sink(heartbeat_context* hb, hb_log_sink* sink) {
+#endif
+  if (hb == NULL || (sink != NULL && sink->write == NULL && sink->records == NULL) || hb->ws.async_log != NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  hb->ws.log_sink = sink;
+  return 0;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_set_histogram(heartbeat_acc_context* hb, hb_histogram* histogram) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_set_histogram(heartbeat_pow_context* hb, hb_histogram* histogram) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_set_histogram(heartbeat_acc_pow_context* hb, hb_histogram* histogram) {
+#else
+int hb_set_histogram(heartbeat_context* hb, hb_histogram* histogram) {
+#endif
+  if (hb == NULL || (histogram != NULL && histogram->counts == NULL)) {
+    errno = EINVAL;
+    return -1;
+  }
+  hb->ws.histogram = histogram;
+  return 0;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_set_ewma(heartbeat_acc_context* hb, hb_ewma* ewma) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_set_ewma(heartbeat_pow_context* hb, hb_ewma* ewma) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_set_ewma(heartbeat_acc_pow_context* hb, hb_ewma* ewma) {
+#else
+int hb_set_ewma(heartbeat_context* hb, hb_ewma* ewma) {
+#endif
+  if (hb == NULL || (ewma != NULL && ewma->count == 0)) {
+    errno = EINVAL;
+    return -1;
+  }
+  hb->ws.ewma = ewma;
+  return 0;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_set_rollup(heartbeat_acc_context* hb, hb_rollup* rollup) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_set_rollup(heartbeat_pow_context* hb, hb_rollup* rollup) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_set_rollup(heartbeat_acc_pow_context* hb, hb_rollup* rollup) {
+#else
+int hb_set_rollup(heartbeat_context* hb, hb_rollup* rollup) {
+#endif
+  if (hb == NULL || (rollup != NULL && rollup->count == 0)) {
+    errno = EINVAL;
+    return -1;
+  }
+  hb->ws.rollup = rollup;
+  return 0;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_set_window_duration(heartbeat_acc_context* hb, uint64_t duration) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_set_window_duration(heartbeat_pow_context* hb, uint64_t duration) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_set_window_duration(heartbeat_acc_pow_context* hb, uint64_t duration) {
+#else
+int hb_set_window_duration(heartbeat_context* hb, uint64_t duration) {
+#endif
+  if (hb == NULL || hb->window_buffer == NULL || (hb->ws.flags & HEARTBEAT_FLAG_LOCK_FREE)) {
+    errno = EINVAL;
+    return -1;
+  }
+  // the window starts empty, with the next heartbeat
+  hb->ws.window_duration = duration;
+  hb->ws.first_index = hb->ws.buffer_index;
+  hb->ws.window_len = 0;
+  hb->ws.deadline = 0;
+  return 0;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_set_log_format(heartbeat_acc_context* hb, uint32_t format, uint32_t columns) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_set_log_format(heartbeat_pow_context* hb, uint32_t format, uint32_t columns) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_set_log_format(heartbeat_acc_pow_context* hb, uint32_t format, uint32_t columns) {
+#else
+int hb_set_log_format(heartbeat_context* hb, uint32_t format, uint32_t columns) {
+#endif
+  if (hb == NULL || !is_log_format(format, columns) || hb->ws.async_log != NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  hb->ws.log_format = format;
+  hb->ws.log_columns = columns;
+  return 0;
+}
+
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_set_columns(heartbeat_acc_context* hb, heartbeat_acc_columns* columns) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_set_columns(heartbeat_pow_context* hb, heartbeat_pow_columns* columns) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_set_columns(heartbeat_acc_pow_context* hb, heartbeat_acc_pow_columns* columns) {
+#else
+int hb_set_columns(heartbeat_context* hb, heartbeat_columns* columns) {
+#endif
+  if (hb == NULL || (columns != NULL &&
+      (columns->id == NULL || columns->user_tag == NULL || columns->work == NULL || columns->start_time == NULL ||
+       columns->end_time == NULL || columns->perf_instant == NULL
 #if defined(HEARTBEAT_USE_ACC)
-          ,
-          "Global_Acc", "Window_Acc", "Acc",
-          "Global_Acc_Rate", "Window_Acc_Rate", "Instant_Acc_Rate"
+       || columns->accuracy == NULL || columns->acc_instant == NULL
 #endif
 #if defined(HEARTBEAT_USE_POW)
-          ,
-          "Global_Energy", "Window_Energy", "Start_Energy", "End_Energy",
-          "Global_Pwr", "Window_Pwr", "Instant_Pwr"
-#endif
-  );
-  err_save = errno;
-  fclose(log);
-  // preserve first error
-  errno = err_save ? err_save : errno;
-  return errno;
+       || columns->start_energy == NULL || columns->end_energy == NULL || columns->pwr_instant == NULL
+#endif
+      ))) {
+    errno = EINVAL;
+    return -1;
+  }
+  hb->columns = columns;
+  return 0;
 }
 
 #if defined(HEARTBEAT_MODE_ACC)
@@ -155,19 +701,29 @@ int hb_acc_pow_ctx_log_header(const heartbeat_acc_pow_context* hb) {
 #else
 int hb_ctx_log_header(const heartbeat_context* hb) {
 #endif
+  char buf[HB_LOG_LINE_MAX];
+  char* pos;
   if (hb == NULL) {
     errno = EINVAL;
     return errno;
   }
+  if (hb->ws.log_sink != NULL) {
+    return sink_log_header(hb, hb->ws.log_sink);
+  }
+  if (hb->ws.flags & HEARTBEAT_FLAG_LOG_BINARY) {
 #if defined(HEARTBEAT_MODE_ACC)
-  return hb_acc_log_header(hb->ws.log_fd);
+    return hb_acc_log_bin_header(hb, hb->ws.log_fd);
 #elif defined(HEARTBEAT_MODE_POW)
-  return hb_pow_log_header(hb->ws.log_fd);
+    return hb_pow_log_bin_header(hb, hb->ws.log_fd);
 #elif defined(HEARTBEAT_MODE_ACC_POW)
-  return hb_acc_pow_log_header(hb->ws.log_fd);
+    return hb_acc_pow_log_bin_header(hb, hb->ws.log_fd);
 #else
-  return hb_log_header(hb->ws.log_fd);
+    return hb_log_bin_header(hb, hb->ws.log_fd);
 #endif
+  }
+  pos = format_header(buf, hb->ws.log_format, hb->ws.log_columns);
+  errno = hb_write_all(hb->ws.log_fd, buf, (size_t) (pos - buf));
+  return errno;
 }
 
 #if defined(HEARTBEAT_MODE_ACC)
@@ -184,72 +740,30 @@ int hb_log_window_buffer(const heartbeat_context* hb, int fd) {
     return errno;
   }
 
-  int err_save;
+  char buf[HB_LOG_BUFFER_SIZE];
+  char* pos = buf;
+  const hb_mode_record* rec;
+  hb_mode_record lazy;
   uint64_t i;
-  FILE* log = fdopen(dup(fd), "w");
+  int err = 0;
 
-  if (log == NULL) {
-    return errno;
+  for (i = 0; i < hb->ws.buffer_index && !err; i++) {
+    rec = &hb->window_buffer[i];
+    if (hb_lazy_rates(hb)) {
+      memcpy(&lazy, rec, sizeof(lazy));
+      hb_compute_rates(&lazy);
+      rec = &lazy;
+    }
+    if (pos - buf > HB_LOG_BUFFER_SIZE - HB_LOG_LINE_MAX) {
+      err = hb_write_all(fd, buf, (size_t) (pos - buf));
+      pos = buf;
+    }
+    pos = format_record(pos, rec, hb->ws.log_format, hb->ws.log_columns);
   }
-
-  errno = 0;
-  for (i = 0; i < hb->ws.buffer_index && !errno; i++) {
-    fprintf(log,
-            "%-6"PRIu64" %-6"PRIu64
-            " %-11"PRIu64" %-11"PRIu64" %-11"PRIu64
-            " %-15"PRIu64" %-15"PRIu64" %-20"PRIu64" %-20"PRIu64
-            " %-15.6f %-15.6f %-15.6f"
-#if defined(HEARTBEAT_USE_ACC)
-            " %-11"PRIu64" %-11"PRIu64" %-11"PRIu64
-            " %-16.6f %-16.6f %-16.6f"
-#endif
-#if defined(HEARTBEAT_USE_POW)
-            " %-15"PRIu64" %-15"PRIu64" %-15"PRIu64" %-15"PRIu64
-            " %-15.6f %-15.6f %-15.6f"
-#endif
-            "\n",
-            hb->window_buffer[i].id,
-            hb->window_buffer[i].user_tag,
-
-            hb->window_buffer[i].wd.global,
-            hb->window_buffer[i].wd.window,
-            hb->window_buffer[i].work,
-
-            hb->window_buffer[i].td.global,
-            hb->window_buffer[i].td.window,
-            hb->window_buffer[i].start_time,
-            hb->window_buffer[i].end_time,
-
-            hb->window_buffer[i].perf.global,
-            hb->window_buffer[i].perf.window,
-            hb->window_buffer[i].perf.instant
-#if defined(HEARTBEAT_USE_ACC)
-            ,
-            hb->window_buffer[i].ad.global,
-            hb->window_buffer[i].ad.window,
-            hb->window_buffer[i].accuracy,
-
-            hb->window_buffer[i].acc.global,
-            hb->window_buffer[i].acc.window,
-            hb->window_buffer[i].acc.instant
-#endif
-#if defined(HEARTBEAT_USE_POW)
-            ,
-            hb->window_buffer[i].ed.global,
-            hb->window_buffer[i].ed.window,
-            hb->window_buffer[i].start_energy,
-            hb->window_buffer[i].end_energy,
-
-            hb->window_buffer[i].pwr.global,
-            hb->window_buffer[i].pwr.window,
-            hb->window_buffer[i].pwr.instant
-#endif
-    );
-  }
-  err_save = errno;
-  fclose(log);
-  // preserve first error
-  errno = err_save ? err_save : errno;
+  if (!err && pos > buf) {
+    err = hb_write_all(fd, buf, (size_t) (pos - buf));
+  }
+  errno = err;
   return errno;
 }
 
@@ -266,145 +780,517 @@ int hb_ctx_log_window_buffer(const heartbeat_context* hb) {
     errno = EINVAL;
     return errno;
   }
+  return ctx_log_window_buffer(hb);
+}
+
+/*
+ * Log a window that was copied out of the context's window buffer.
+ */
+static int async_log_format(const void* ctx, const void* records, uint64_t count, int fd) {
+  hb_mode_context view;
+  memset(&view, 0, sizeof(view));
+  // flags, the sink, and the format are constant while logging asynchronously, so are safe to read
+  view.ws.flags = ((const hb_mode_context*) ctx)->ws.flags;
+  view.ws.log_fd = fd;
+  view.ws.log_sink = ((const hb_mode_context*) ctx)->ws.log_sink;
+  view.ws.log_format = ((const hb_mode_context*) ctx)->ws.log_format;
+  view.ws.log_columns = ((const hb_mode_context*) ctx)->ws.log_columns;
+  view.ws.buffer_index = count;
+  view.window_buffer = (hb_mode_record*) records;
+  return ctx_log_window_buffer(&view);
+}
+
 #if defined(HEARTBEAT_MODE_ACC)
-  return hb_acc_log_window_buffer(hb, hb->ws.log_fd);
+int hb_acc_async_log_init(heartbeat_acc_context* hb, uint32_t queue_len) {
 #elif defined(HEARTBEAT_MODE_POW)
-  return hb_pow_log_window_buffer(hb, hb->ws.log_fd);
+int hb_pow_async_log_init(heartbeat_pow_context* hb, uint32_t queue_len) {
 #elif defined(HEARTBEAT_MODE_ACC_POW)
-  return hb_acc_pow_log_window_buffer(hb, hb->ws.log_fd);
+int hb_acc_pow_async_log_init(heartbeat_acc_pow_context* hb, uint32_t queue_len) {
 #else
-  return hb_log_window_buffer(hb, hb->ws.log_fd);
+int hb_async_log_init(heartbeat_context* hb, uint32_t queue_len) {
 #endif
+  if (hb == NULL || hb->window_buffer == NULL || queue_len == 0 || hb->ws.async_log != NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  hb->ws.async_log = hb_log_queue_create(hb, &async_log_format, hb->ws.log_fd, sizeof(hb_mode_record),
+                                         hb->ws.window_size, queue_len);
+  return hb->ws.async_log == NULL ? -1 : 0;
 }
 
-#define ONE_MILLION 1000000.0
-#define ONE_BILLION 1000000000.0
+#if defined(HEARTBEAT_MODE_ACC)
+int hb_acc_async_log_finish(heartbeat_acc_context* hb) {
+#elif defined(HEARTBEAT_MODE_POW)
+int hb_pow_async_log_finish(heartbeat_pow_context* hb) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+int hb_acc_pow_async_log_finish(heartbeat_acc_pow_context* hb) {
+#else
+int hb_async_log_finish(heartbeat_context* hb) {
+#endif
+  struct hb_log_queue* lq;
+  if (hb == NULL || hb->ws.async_log == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  lq = hb->ws.async_log;
+  hb->ws.async_log = NULL;
+  return hb_log_queue_destroy(lq);
+}
 
 #if defined(HEARTBEAT_MODE_ACC)
-void heartbeat_acc(heartbeat_acc_context* hb,
-                   uint64_t user_tag,
-                   uint64_t work,
-                   uint64_t start_time,
-                   uint64_t end_time,
-                   uint64_t accuracy) {
-  heartbeat_acc_record* old_record;
+int hb_acc_async_log_get_stats(const heartbeat_acc_context* hb, heartbeat_async_log_stats* stats) {
 #elif defined(HEARTBEAT_MODE_POW)
-void heartbeat_pow(heartbeat_pow_context* hb,
-                   uint64_t user_tag,
-                   uint64_t work,
-                   uint64_t start_time,
-                   uint64_t end_time,
-                   uint64_t start_energy,
-                   uint64_t end_energy) {
-  heartbeat_pow_record* old_record;
+int hb_pow_async_log_get_stats(const heartbeat_pow_context* hb, heartbeat_async_log_stats* stats) {
 #elif defined(HEARTBEAT_MODE_ACC_POW)
-void heartbeat_acc_pow(heartbeat_acc_pow_context* hb,
-                       uint64_t user_tag,
-                       uint64_t work,
-                       uint64_t start_time,
-                       uint64_t end_time,
-                       uint64_t accuracy,
-                       uint64_t start_energy,
-                       uint64_t end_energy) {
-  heartbeat_acc_pow_record* old_record;
+int hb_acc_pow_async_log_get_stats(const heartbeat_acc_pow_context* hb, heartbeat_async_log_stats* stats) {
 #else
-void heartbeat(heartbeat_context* hb,
-               uint64_t user_tag,
-               uint64_t work,
-               uint64_t start_time,
-               uint64_t end_time) {
-  heartbeat_record* old_record;
+int hb_async_log_get_stats(const heartbeat_context* hb, heartbeat_async_log_stats* stats) {
 #endif
-  if (hb == NULL || hb->window_buffer == NULL) {
+  if (hb == NULL || stats == NULL || hb->ws.async_log == NULL) {
     errno = EINVAL;
+    return -1;
+  }
+  hb_log_queue_get_stats(hb->ws.async_log, stats);
+  return 0;
+}
+
+/*
+ * Cumulative data is updated by a single writer (under the lock), or with
+ * atomic additions in lock-free mode.
+ */
+static uint64_t add_global(heartbeat_udata* data, uint64_t delta, int lock_free) {
+  if (lock_free) {
+    return hb_add_fetch_u64(&data->global, delta);
+  }
+  data->global += delta;
+  return data->global;
+}
+
+/*
+ * Copy a record's raw data, and its instant rates unless they're lazy, to the columns.
+ */
+static void fill_columns(hb_mode_columns* cols, uint64_t i, const hb_mode_record* rec, int lazy) {
+  cols->id[i] = rec->id;
+  cols->user_tag[i] = rec->user_tag;
+  cols->work[i] = rec->work;
+  cols->start_time[i] = rec->start_time;
+  cols->end_time[i] = rec->end_time;
+#if defined(HEARTBEAT_USE_ACC)
+  cols->accuracy[i] = rec->accuracy;
+#endif
+#if defined(HEARTBEAT_USE_POW)
+  cols->start_energy[i] = rec->start_energy;
+  cols->end_energy[i] = rec->end_energy;
+#endif
+  if (lazy) {
     return;
   }
+  cols->perf_instant[i] = rec->perf.instant;
+#if defined(HEARTBEAT_USE_ACC)
+  cols->acc_instant[i] = rec->acc.instant;
+#endif
+#if defined(HEARTBEAT_USE_POW)
+  cols->pwr_instant[i] = rec->pwr.instant;
+#endif
+}
 
-#if defined(_WIN32)
-  // long guaranteed to be 32 bits on Windows
-  while (InterlockedExchange((long*) &hb->lock, 1)) {
-#else
-  while (__sync_lock_test_and_set(&hb->lock, 1)) {
+/*
+ * Compute the columns' lazy instant rates for the records in the window, from
+ * the columns alone.
+ */
+static void compute_column_rates(const hb_mode_context* hb) {
+  hb_mode_columns* cols = hb->columns;
+  uint64_t first = hb_window_first(hb);
+  uint64_t n = hb_window_records(hb);
+  uint64_t i;
+  uint64_t j;
+  for (i = 0; i < n; i++) {
+    j = (first + i) % hb->ws.window_size;
+    cols->perf_instant[j] = hb_rate(cols->work[j], cols->end_time[j] - cols->start_time[j]);
+#if defined(HEARTBEAT_USE_ACC)
+    cols->acc_instant[j] = hb_rate(cols->accuracy[j], cols->end_time[j] - cols->start_time[j]);
+#endif
+#if defined(HEARTBEAT_USE_POW)
+    cols->pwr_instant[j] = hb_power(cols->end_energy[j] - cols->start_energy[j],
+                                    cols->end_time[j] - cols->start_time[j]);
 #endif
-    while (hb->lock);
   }
+}
 
-  // if we haven't yet reached window_size heartbeats, the log values are 0
-  old_record = &hb->window_buffer[hb->ws.buffer_index];
+/*
+ * Update the histogram, moving averages, and rollups, which don't need the window buffer.
+ */
+static void update_summaries(hb_mode_context* hb, const hb_mode_input* in, int lock_free) {
+  uint64_t accuracy = 0;
+  uint64_t energy = 0;
+  if (hb->ws.histogram != NULL) {
+    if (lock_free) {
+      hb_histogram_record_atomic(hb->ws.histogram, in->end_time - in->start_time);
+    } else {
+      hb_histogram_record(hb->ws.histogram, in->end_time - in->start_time);
+    }
+  }
+#if defined(HEARTBEAT_USE_ACC)
+  accuracy = in->accuracy;
+#endif
+#if defined(HEARTBEAT_USE_POW)
+  energy = in->end_energy - in->start_energy;
+#endif
+  if (hb->ws.ewma != NULL) {
+    hb_ewma_update(hb->ws.ewma, in->start_time, in->end_time, in->work, accuracy, energy, lock_free);
+  }
+  if (hb->ws.rollup != NULL) {
+    hb_rollup_update(hb->ws.rollup, in->start_time, in->end_time, in->work, accuracy, energy);
+  }
+}
+
+/*
+ * Without a window buffer, only cumulative data and summaries are maintained.
+ */
+static void update_windowless(hb_mode_context* hb, const hb_mode_input* in, int lock_free) {
+  update_summaries(hb, in, lock_free);
+  add_global(&hb->td, in->end_time - in->start_time, lock_free);
+  add_global(&hb->wd, in->work, lock_free);
+#if defined(HEARTBEAT_USE_ACC)
+  add_global(&hb->ad, in->accuracy, lock_free);
+#endif
+#if defined(HEARTBEAT_USE_POW)
+  add_global(&hb->ed, in->end_energy - in->start_energy, lock_free);
+#endif
+}
 
-  hb->window_buffer[hb->ws.buffer_index].id = hb->counter;
-  hb->window_buffer[hb->ws.buffer_index].user_tag = user_tag;
+/*
+ * Populate a window buffer record and update the context's cumulative data.
+ * Window values are relative to the base's global data: the record itself,
+ * which still holds the data from window_size heartbeats ago, or the data
+ * before a time-based window.
+ * Rates are left for readers to compute in lazy mode.
+ */
+static void fill_record(hb_mode_context* hb, hb_mode_record* rec, const hb_mode_record* base, uint64_t id,
+                        const hb_mode_input* in, int lock_free) {
+  heartbeat_udata td;
+  heartbeat_udata wd;
+  rec->id = id;
+  rec->user_tag = in->user_tag;
+  update_summaries(hb, in, lock_free);
 
   // time and work
-  int64_t delta_time = end_time - start_time;
-  hb->td.global += delta_time;
-  hb->td.window = hb->td.global - old_record->td.global;
-  hb->wd.global += work;
-  hb->wd.window = hb->wd.global - old_record->wd.global;
-  hb->window_buffer[hb->ws.buffer_index].work = work;
-  memcpy(&hb->window_buffer[hb->ws.buffer_index].wd, &hb->wd, sizeof(heartbeat_udata));
-  hb->window_buffer[hb->ws.buffer_index].start_time = start_time;
-  hb->window_buffer[hb->ws.buffer_index].end_time = end_time;
-  memcpy(&hb->window_buffer[hb->ws.buffer_index].td, &hb->td, sizeof(heartbeat_udata));
-  double total_seconds = ((double) hb->td.global) / ONE_BILLION;
-  double window_seconds = ((double) hb->td.window) / ONE_BILLION;
-  double instant_seconds = ((double) delta_time) / ONE_BILLION;
-  hb->window_buffer[hb->ws.buffer_index].perf.global = ((double) hb->wd.global) / total_seconds;
-  hb->window_buffer[hb->ws.buffer_index].perf.window = ((double) hb->wd.window) / window_seconds;
-  hb->window_buffer[hb->ws.buffer_index].perf.instant = ((double) work) / instant_seconds;
+  int64_t delta_time = in->end_time - in->start_time;
+  td.global = add_global(&hb->td, delta_time, lock_free);
+  td.window = td.global - base->td.global;
+  hb->td.window = td.window;
+  wd.global = add_global(&hb->wd, in->work, lock_free);
+  wd.window = wd.global - base->wd.global;
+  hb->wd.window = wd.window;
+  rec->work = in->work;
+  memcpy(&rec->wd, &wd, sizeof(heartbeat_udata));
+  rec->start_time = in->start_time;
+  rec->end_time = in->end_time;
+  memcpy(&rec->td, &td, sizeof(heartbeat_udata));
 
 #if defined(HEARTBEAT_USE_ACC)
   // accuracy
-  hb->ad.global += accuracy;
-  hb->ad.window = hb->ad.global - old_record->ad.global;
-  hb->window_buffer[hb->ws.buffer_index].accuracy = accuracy;
-  memcpy(&hb->window_buffer[hb->ws.buffer_index].ad, &hb->ad, sizeof(heartbeat_udata));
-  hb->window_buffer[hb->ws.buffer_index].acc.global = ((double) hb->ad.global) / total_seconds;
-  hb->window_buffer[hb->ws.buffer_index].acc.window = ((double) hb->ad.window) / window_seconds;
-  hb->window_buffer[hb->ws.buffer_index].acc.instant = ((double) accuracy) / instant_seconds;
+  heartbeat_udata ad;
+  ad.global = add_global(&hb->ad, in->accuracy, lock_free);
+  ad.window = ad.global - base->ad.global;
+  hb->ad.window = ad.window;
+  rec->accuracy = in->accuracy;
+  memcpy(&rec->ad, &ad, sizeof(heartbeat_udata));
 #endif
 
 #if defined(HEARTBEAT_USE_POW)
   // energy
-  int64_t delta_energy = end_energy - start_energy;
-  hb->ed.global += delta_energy;
-  hb->ed.window = hb->ed.global - old_record->ed.global;
-  hb->window_buffer[hb->ws.buffer_index].start_energy = start_energy;
-  hb->window_buffer[hb->ws.buffer_index].end_energy = end_energy;
-  memcpy(&hb->window_buffer[hb->ws.buffer_index].ed, &hb->ed, sizeof(heartbeat_udata));
-  hb->window_buffer[hb->ws.buffer_index].pwr.global = ((double) hb->ed.global) / total_seconds / ONE_MILLION;
-  hb->window_buffer[hb->ws.buffer_index].pwr.window = ((double) hb->ed.window) / window_seconds / ONE_MILLION;
-  hb->window_buffer[hb->ws.buffer_index].pwr.instant = ((double) delta_energy) / instant_seconds / ONE_MILLION;
+  heartbeat_udata ed;
+  int64_t delta_energy = in->end_energy - in->start_energy;
+  ed.global = add_global(&hb->ed, delta_energy, lock_free);
+  ed.window = ed.global - base->ed.global;
+  hb->ed.window = ed.window;
+  rec->start_energy = in->start_energy;
+  rec->end_energy = in->end_energy;
+  memcpy(&rec->ed, &ed, sizeof(heartbeat_udata));
 #endif
 
+  if (!hb_lazy_rates(hb)) {
+    hb_compute_rates(rec);
+  }
+  if (hb->columns != NULL) {
+    fill_columns(hb->columns, (uint64_t) (rec - hb->window_buffer), rec, hb_lazy_rates(hb));
+  }
+}
+
+/*
+ * Log the full window buffer.
+ */
+static void log_window(hb_mode_context* hb) {
+  if (has_log(hb) && hb->ws.async_log != NULL) {
+    hb_log_queue_enqueue(hb->ws.async_log, hb->window_buffer, hb->ws.buffer_index);
+  } else if (has_log(hb)) {
+    if (ctx_log_window_buffer(hb)) {
+      perror("Failed to log heartbeat record data");
+    }
+  }
+}
+
+/*
+ * Issue the callback, with rates computed in lazy mode for the records in the
+ * window, which may be fewer than the window buffer holds.
+ * A per-window histogram is reset after the callback reads it.
+ */
+static void notify_window(hb_mode_context* hb) {
+  uint64_t first = hb_window_first(hb);
+  uint64_t n = hb_window_records(hb);
+  uint64_t i;
+  uint64_t j;
+  if (hb->hwc_callback != NULL) {
+    if (hb_lazy_rates(hb)) {
+      for (i = 0; i < n; i++) {
+        j = (first + i) % hb->ws.window_size;
+        hb_compute_rates(&hb->window_buffer[j]);
+      }
+    }
+    (*hb->hwc_callback)(hb);
+  }
+  if (hb->ws.histogram != NULL && (hb->ws.flags & HEARTBEAT_FLAG_HISTOGRAM_WINDOW)) {
+    hb_histogram_reset(hb->ws.histogram);
+  }
+}
+
+/*
+ * In lazy mode, the columns' instant rates are only computed for the completed
+ * window, rather than by each heartbeat.
+ */
+static void complete_window(hb_mode_context* hb) {
+  if (hb->columns != NULL && hb_lazy_rates(hb)) {
+    compute_column_rates(hb);
+  }
+  log_window(hb);
+  notify_window(hb);
+}
+
+/*
+ * Evict records from the front of a time-based window that ended at least
+ * window_duration before the new heartbeat, or that it's about to overwrite,
+ * and get the global data from before the window.
+ */
+static void evict_expired(hb_mode_context* hb, const hb_mode_input* in, hb_mode_record* base) {
+  const hb_mode_record* first;
+  while (hb->ws.window_len > 0) {
+    first = &hb->window_buffer[hb->ws.first_index];
+    if (hb->ws.window_len < hb->ws.window_size && first->end_time + hb->ws.window_duration > in->end_time) {
+      break;
+    }
+    hb->ws.first_index = (hb->ws.first_index + 1) % hb->ws.window_size;
+    hb->ws.window_len--;
+  }
+  if (hb->ws.window_len == 0) {
+    hb->ws.first_index = hb->ws.buffer_index;
+    base->td.global = hb->td.global;
+    base->wd.global = hb->wd.global;
+#if defined(HEARTBEAT_USE_ACC)
+    base->ad.global = hb->ad.global;
+#endif
+#if defined(HEARTBEAT_USE_POW)
+    base->ed.global = hb->ed.global;
+#endif
+    return;
+  }
+  first = &hb->window_buffer[hb->ws.first_index];
+  base->td.global = first->td.global - (first->end_time - first->start_time);
+  base->wd.global = first->wd.global - first->work;
+#if defined(HEARTBEAT_USE_ACC)
+  base->ad.global = first->ad.global - first->accuracy;
+#endif
+#if defined(HEARTBEAT_USE_POW)
+  base->ed.global = first->ed.global - (first->end_energy - first->start_energy);
+#endif
+}
+
+/*
+ * Time-based windows issue the callback each window_duration of end time,
+ * skipping periods without heartbeats.
+ */
+static void check_deadline(hb_mode_context* hb, uint64_t end_time) {
+  if (hb->ws.deadline == 0) {
+    hb->ws.deadline = end_time + hb->ws.window_duration;
+  } else if (end_time >= hb->ws.deadline) {
+    notify_window(hb);
+    hb->ws.deadline += ((end_time - hb->ws.deadline) / hb->ws.window_duration + 1) * hb->ws.window_duration;
+  }
+}
+
+static void issue_serialized(hb_mode_context* hb, const hb_mode_input* in) {
+  hb_mode_record* rec;
+  hb_mode_record base;
+  if (hb->window_buffer == NULL) {
+    hb->counter++;
+    update_windowless(hb, in, 0);
+    return;
+  }
+  rec = &hb->window_buffer[hb->ws.buffer_index];
+  hb->seq_begin++;
+  hb_fence_release();
+  if (hb->ws.window_duration > 0) {
+    evict_expired(hb, in, &base);
+    fill_record(hb, rec, &base, hb->counter, in, 0);
+    hb->ws.window_len++;
+  } else {
+    // if we haven't yet reached window_size heartbeats, the log values are 0
+    fill_record(hb, rec, rec, hb->counter, in, 0);
+  }
+
   // update context state
   hb->counter++;
   hb->ws.read_index = hb->ws.buffer_index;
+  hb_fence_release();
+  hb->seq_end++;
   hb->ws.buffer_index++;
   // check circular buffer, issue callback if full
-  if (hb->ws.buffer_index % hb->ws.window_size == 0) {
-    if (hb->ws.log_fd > 0) {
+  if (hb->ws.window_duration > 0) {
+    // the full buffer is still logged, but the callback is on a time cadence
+    if (hb->ws.buffer_index == hb->ws.window_size) {
+      log_window(hb);
+      hb->ws.buffer_index = 0;
+      hb->ws.window_count++;
+    }
+    check_deadline(hb, in->end_time);
+  } else if (hb->ws.buffer_index % hb->ws.window_size == 0) {
+    complete_window(hb);
+    hb->ws.buffer_index = 0;
+    hb->ws.window_count++;
+  }
+}
+
+/*
+ * Producers publish out of order, so the read index only moves to a newer
+ * record than the one it refers to. Otherwise, that record's producer, which
+ * may still be writing it, moves the read index itself.
+ */
+static void publish_read_index(hb_mode_context* hb, uint64_t seq, uint64_t index) {
+  uint64_t cur;
+  do {
+    cur = hb->ws.read_index;
+    if (cur == index || hb->window_buffer[cur].id > seq) {
+      return;
+    }
+  } while (hb_cas_u64((volatile uint64_t*) &hb->ws.read_index, cur, index) != cur);
+}
+
+/*
+ * The heartbeat counter is the sequence used to reserve slots, and
+ * ws.buffer_index counts the records published in the current window.
+ * Whoever publishes the last record of a window completes it; producers that
+ * reserved slots in the next window wait until then, since they would
+ * otherwise overwrite records that are being logged.
+ */
+static void issue_lock_free(hb_mode_context* hb, uint64_t seq, const hb_mode_input* in) {
+  uint64_t window;
+  uint64_t index;
+  unsigned int spins = 0;
+
+  if (hb->window_buffer == NULL) {
+    update_windowless(hb, in, 1);
+    return;
+  }
+  window = seq / hb->ws.window_size;
+  index = seq % hb->ws.window_size;
+
+  while (hb->ws.window_count != window) {
+    hb_spin_wait(&spins);
+  }
+  hb_fence_acquire();
+
+  hb_fetch_add_u64(&hb->seq_begin, 1);
+  fill_record(hb, &hb->window_buffer[index], &hb->window_buffer[index], seq, in, 1);
+  publish_read_index(hb, seq, index);
+  hb_fetch_add_u64(&hb->seq_end, 1);
+  if (hb_add_fetch_u64(&hb->ws.buffer_index, 1) == hb->ws.window_size) {
+    complete_window(hb);
+    hb->ws.buffer_index = 0;
+    hb_fence_release();
+    hb->ws.window_count++;
+  }
+}
+
+static void issue(hb_mode_context* hb, const hb_mode_input* in, uint64_t count) {
+  uint64_t seq;
+  uint64_t i;
+  if (hb == NULL || (in == NULL && count > 0)) {
+    errno = EINVAL;
+    return;
+  }
+  if (hb->ws.flags & HEARTBEAT_FLAG_LOCK_FREE) {
+    // reserve consecutive slots for the whole batch
+    seq = hb_fetch_add_u64(&hb->counter, count);
+    for (i = 0; i < count; i++) {
+      issue_lock_free(hb, seq + i, &in[i]);
+    }
+  } else if (hb->ws.flags & HEARTBEAT_FLAG_SINGLE_WRITER) {
+    for (i = 0; i < count; i++) {
+      issue_serialized(hb, &in[i]);
+    }
+  } else {
+    hb_spin_lock(&hb->lock);
+    for (i = 0; i < count; i++) {
+      issue_serialized(hb, &in[i]);
+    }
+    hb_spin_unlock(&hb->lock);
+  }
+}
+
 #if defined(HEARTBEAT_MODE_ACC)
-      if (hb_acc_log_window_buffer(hb, hb->ws.log_fd)) {
+void heartbeat_acc(heartbeat_acc_context* hb,
+                   uint64_t user_tag,
+                   uint64_t work,
+                   uint64_t start_time,
+                   uint64_t end_time,
+                   uint64_t accuracy) {
+  hb_mode_input in = { user_tag, work, start_time, end_time, accuracy };
 #elif defined(HEARTBEAT_MODE_POW)
-      if (hb_pow_log_window_buffer(hb, hb->ws.log_fd)) {
+void heartbeat_pow(heartbeat_pow_context* hb,
+                   uint64_t user_tag,
+                   uint64_t work,
+                   uint64_t start_time,
+                   uint64_t end_time,
+                   uint64_t start_energy,
+                   uint64_t end_energy) {
+  hb_mode_input in = { user_tag, work, start_time, end_time, start_energy, end_energy };
 #elif defined(HEARTBEAT_MODE_ACC_POW)
-      if (hb_acc_pow_log_window_buffer(hb, hb->ws.log_fd)) {
+void heartbeat_acc_pow(heartbeat_acc_pow_context* hb,
+                       uint64_t user_tag,
+                       uint64_t work,
+                       uint64_t start_time,
+                       uint64_t end_time,
+                       uint64_t accuracy,
+                       uint64_t start_energy,
+                       uint64_t end_energy) {
+  hb_mode_input in = { user_tag, work, start_time, end_time, accuracy, start_energy, end_energy };
 #else
-      if (hb_log_window_buffer(hb, hb->ws.log_fd)) {
+void heartbeat(heartbeat_context* hb,
+               uint64_t user_tag,
+               uint64_t work,
+               uint64_t start_time,
+               uint64_t end_time) {
+  hb_mode_input in = { user_tag, work, start_time, end_time };
 #endif
-        perror("Failed to log heartbeat record data");
-      }
-    }
-    if (hb->hwc_callback != NULL) {
-      (*hb->hwc_callback)(hb);
-    }
-    hb->ws.buffer_index = 0;
-  }
+  issue(hb, &in, 1);
+}
 
-#if defined(_WIN32)
-  InterlockedExchange((long*) &hb->lock, 0);
+#if defined(HEARTBEAT_MODE_ACC)
+void heartbeat_acc_batch(heartbeat_acc_context* hb,
+                         const heartbeat_acc_input* inputs,
+                         uint64_t count) {
+#elif defined(HEARTBEAT_MODE_POW)
+void heartbeat_pow_batch(heartbeat_pow_context* hb,
+                         const heartbeat_pow_input* inputs,
+                         uint64_t count) {
+#elif defined(HEARTBEAT_MODE_ACC_POW)
+void heartbeat_acc_pow_batch(heartbeat_acc_pow_context* hb,
+                             const heartbeat_acc_pow_input* inputs,
+                             uint64_t count) {
 #else
-  __sync_lock_release(&hb->lock);
+void heartbeat_batch(heartbeat_context* hb,
+                     const heartbeat_input* inputs,
+                     uint64_t count) {
 #endif
+  issue(hb, inputs, count);
 }
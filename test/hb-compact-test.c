@@ -0,0 +1,196 @@
+/**
+ * Compact heartbeat tests.
+ */
+// force assertions
+#undef NDEBUG
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <heartbeats-simple.h>
+
+#define WINDOW_SIZE 4
+#define HEARTBEATS 10
+
+static heartbeat_acc_pow_record windows[HEARTBEATS];
+static uint64_t windows_completed = 0;
+static uint64_t records_completed = 0;
+
+static void window_complete(const heartbeat_acc_pow_compact_context* cc) {
+  uint64_t n = hb_acc_pow_compact_get_window_records(cc);
+  assert(hb_acc_pow_compact_get_records(cc, 0, &windows[records_completed], n) == 0);
+  windows_completed++;
+  records_completed += n;
+}
+
+static void test_bad_arguments(void) {
+  heartbeat_compact_context cc;
+  heartbeat_compact_record buf[2];
+  heartbeat_record rec;
+  errno = 0;
+  assert(heartbeat_compact_init(NULL, 2, buf, -1, NULL) != 0);
+  assert(errno == EINVAL);
+  assert(heartbeat_compact_init(&cc, 0, buf, -1, NULL) != 0);
+  assert(heartbeat_compact_init(&cc, 2, NULL, -1, NULL) != 0);
+  assert(heartbeat_compact_init(&cc, 2, buf, -1, NULL) == 0);
+  heartbeat_compact(&cc, 0, 1, 0, 10);
+  errno = 0;
+  assert(hb_compact_get_records(&cc, 0, &rec, 2) != 0);
+  assert(errno == EINVAL);
+  assert(hb_compact_get_records(&cc, 2, &rec, 0) != 0);
+  assert(hb_compact_get_records(&cc, 0, NULL, 1) != 0);
+  assert(hb_compact_get_records(&cc, 1, &rec, 0) == 0);
+  assert(hb_compact_get_snapshot(&cc, NULL) != 0);
+  assert(hb_compact_get_snapshot(NULL, &rec) != 0);
+  errno = 0;
+  assert(hb_compact_get_window_records(NULL) == 0);
+  assert(errno == EINVAL);
+}
+
+static void test_reconstruct(void) {
+  heartbeat_acc_pow_compact_context cc;
+  heartbeat_acc_pow_compact_record buf[WINDOW_SIZE];
+  heartbeat_acc_pow_context hb;
+  heartbeat_acc_pow_record full[HEARTBEATS];
+  heartbeat_acc_pow_record snapshot;
+  heartbeat_acc_pow_record expected;
+  uint64_t base[4] = { 0 };
+  uint64_t time = 1000000000000ULL;
+  uint64_t energy = 5000000000000ULL;
+  uint64_t i;
+  assert(heartbeat_acc_pow_compact_init(&cc, WINDOW_SIZE, buf, -1, window_complete) == 0);
+  assert(heartbeat_acc_pow_init(&hb, HEARTBEATS, full, -1, NULL) == 0);
+  for (i = 0; i < HEARTBEATS; i++) {
+    uint64_t start_time = time + i * 7;
+    uint64_t end_time = start_time + 1000 + i * 100;
+    uint64_t start_energy = energy + i * 3;
+    uint64_t end_energy = start_energy + 20 + i;
+    heartbeat_acc_pow_compact(&cc, i, i + 1, start_time, end_time, 2 * i, start_energy, end_energy);
+    heartbeat_acc_pow(&hb, i, i + 1, start_time, end_time, 2 * i, start_energy, end_energy);
+    time = end_time;
+    energy = end_energy;
+  }
+  assert(windows_completed == HEARTBEATS / WINDOW_SIZE);
+  assert(hb_acc_pow_compact_get_window_records(&cc) == HEARTBEATS % WINDOW_SIZE);
+  assert(hb_acc_pow_compact_get_records(&cc, 0, &windows[records_completed], HEARTBEATS % WINDOW_SIZE) == 0);
+
+  // everything but window data matches a regular context, which has sliding windows
+  for (i = 0; i < HEARTBEATS; i++) {
+    const heartbeat_acc_pow_record* r = &windows[i];
+    const heartbeat_acc_pow_record* e = &full[i];
+    if (i % WINDOW_SIZE == 0 && i > 0) {
+      base[0] = full[i - 1].wd.global;
+      base[1] = full[i - 1].td.global;
+      base[2] = full[i - 1].ad.global;
+      base[3] = full[i - 1].ed.global;
+    }
+    assert(r->id == e->id);
+    assert(r->user_tag == e->user_tag);
+    assert(r->work == e->work);
+    assert(r->start_time == e->start_time);
+    assert(r->end_time == e->end_time);
+    assert(r->accuracy == e->accuracy);
+    assert(r->start_energy == e->start_energy);
+    assert(r->end_energy == e->end_energy);
+    assert(r->wd.global == e->wd.global);
+    assert(r->td.global == e->td.global);
+    assert(r->ad.global == e->ad.global);
+    assert(r->ed.global == e->ed.global);
+    assert(r->wd.window == e->wd.global - base[0]);
+    assert(r->td.window == e->td.global - base[1]);
+    assert(r->ad.window == e->ad.global - base[2]);
+    assert(r->ed.window == e->ed.global - base[3]);
+    assert(r->perf.instant == e->perf.instant);
+    assert(r->perf.global == e->perf.global);
+    assert(r->acc.instant == e->acc.instant);
+    assert(r->pwr.instant == e->pwr.instant);
+    assert(r->pwr.global == e->pwr.global);
+  }
+
+  assert(hb_acc_pow_compact_get_snapshot(&cc, &snapshot) == 0);
+  memcpy(&expected, &windows[HEARTBEATS - 1], sizeof(expected));
+  assert(memcmp(&snapshot, &expected, sizeof(snapshot)) == 0);
+}
+
+static void test_range(void) {
+  heartbeat_pow_compact_context cc;
+  heartbeat_pow_compact_record buf[WINDOW_SIZE];
+  heartbeat_pow_record rec;
+  assert(heartbeat_pow_compact_init(&cc, WINDOW_SIZE, buf, -1, NULL) == 0);
+  heartbeat_pow_compact(&cc, 0, 1, 100, 200, 1000, 1100);
+  // values that don't fit aren't stored, but complete the window and are still counted
+  errno = 0;
+  heartbeat_pow_compact(&cc, 1, 1ULL << 32, 200, 300, 1100, 1200);
+  assert(errno == ERANGE);
+  assert(hb_pow_compact_get_window_records(&cc) == 0);
+  heartbeat_pow_compact(&cc, 1, 1, 200, 200 + (1ULL << 32), 1100, 1200);
+  heartbeat_pow_compact(&cc, 1, 1, 200, 300, 1100, 1100 + (1ULL << 32));
+  heartbeat_pow_compact(&cc, 1, 1, 300, 200, 1100, 1200);
+  assert(hb_pow_compact_get_rejected(&cc) == 4);
+  assert(hb_pow_compact_get_window_records(&cc) == 0);
+  assert(hb_pow_compact_get_snapshot(&cc, &rec) == 0);
+  assert(rec.id == 4);
+  assert(rec.wd.global == (1ULL << 32) + 4);
+  assert(rec.td.global == (1ULL << 32) + 200);
+  assert(rec.ed.global == (1ULL << 32) + 400);
+
+  // the next window begins after them
+  heartbeat_pow_compact(&cc, 1, 1, 300, 400, 1200, 1300);
+  assert(hb_pow_compact_get_window_records(&cc) == 1);
+  assert(hb_pow_compact_get_records(&cc, 0, &rec, 1) == 0);
+  assert(rec.id == 5);
+  assert(rec.wd.global == (1ULL << 32) + 5);
+  assert(rec.wd.window == 1);
+  assert(rec.td.global == (1ULL << 32) + 300);
+  assert(rec.td.window == 100);
+
+  // gaps that don't fit complete the window early
+  heartbeat_pow_compact(&cc, 2, 1, 400 + (1ULL << 32), 500 + (1ULL << 32), 1300, 1400);
+  assert(hb_pow_compact_get_window_records(&cc) == 1);
+  heartbeat_pow_compact(&cc, 3, 1, 600 + (1ULL << 32), 700 + (1ULL << 32), 1000, 1100);
+  assert(hb_pow_compact_get_window_records(&cc) == 1);
+  assert(hb_pow_compact_get_records(&cc, 0, &rec, 1) == 0);
+  assert(rec.id == 7);
+  assert(rec.start_time == 600 + (1ULL << 32));
+  assert(rec.start_energy == 1000);
+  assert(rec.ed.global == (1ULL << 32) + 700);
+  assert(rec.ed.window == 100);
+  assert(rec.wd.window == 1);
+  assert(hb_pow_compact_get_rejected(&cc) == 4);
+}
+
+static void test_log(void) {
+  heartbeat_compact_context cc;
+  heartbeat_compact_record buf[50];
+  char data[65536];
+  FILE* f = tmpfile();
+  size_t len;
+  size_t i;
+  uint64_t j;
+  int lines = 0;
+  assert(f != NULL);
+  assert(heartbeat_compact_init(&cc, 50, buf, fileno(f), NULL) == 0);
+  for (j = 0; j < 50; j++) {
+    heartbeat_compact(&cc, j, 1, j * 10, j * 10 + 5);
+  }
+  rewind(f);
+  len = fread(data, 1, sizeof(data), f);
+  assert(len > 0);
+  for (i = 0; i < len; i++) {
+    lines += data[i] == '\n';
+  }
+  assert(lines == 50);
+  fclose(f);
+}
+
+int main(void) {
+  test_bad_arguments();
+  test_reconstruct();
+  test_range();
+  test_log();
+  return 0;
+}
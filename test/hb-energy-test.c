@@ -0,0 +1,143 @@
+/**
+ * Energy provider tests, using fake sysfs directory trees.
+ */
+// force assertions
+#undef NDEBUG
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <heartbeats-simple.h>
+
+static char root[64];
+
+static void make_dir(const char* name) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%s", root, name);
+  assert(mkdir(path, 0700) == 0);
+}
+
+static void write_file(const char* name, uint64_t val) {
+  char path[256];
+  FILE* f;
+  snprintf(path, sizeof(path), "%s/%s", root, name);
+  f = fopen(path, "w");
+  assert(f);
+  fprintf(f, "%"PRIu64"\n", val);
+  fclose(f);
+}
+
+static void remove_tree(void) {
+  char cmd[128];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+  assert(system(cmd) == 0);
+}
+
+static void make_root(void) {
+  strcpy(root, "/tmp/hb-energy-test-XXXXXX");
+  assert(mkdtemp(root));
+}
+
+static void test_powercap(void) {
+  hb_energy_provider ep;
+  uint64_t energy;
+  make_root();
+  make_dir("intel-rapl:0");
+  write_file("intel-rapl:0/energy_uj", 1000);
+  write_file("intel-rapl:0/max_energy_range_uj", 10000);
+  // subzones are included in their parent, so must be ignored
+  make_dir("intel-rapl:0:0");
+  write_file("intel-rapl:0:0/energy_uj", 500);
+  write_file("intel-rapl:0:0/max_energy_range_uj", 10000);
+  make_dir("intel-rapl:1");
+  write_file("intel-rapl:1/energy_uj", 0);
+  write_file("intel-rapl:1/max_energy_range_uj", 10000);
+
+  assert(hb_energy_powercap_init(&ep, root) == 0);
+  assert(hb_energy_read(&ep, &energy) == 0);
+  assert(energy == 0);
+
+  write_file("intel-rapl:0/energy_uj", 1500);
+  write_file("intel-rapl:0:0/energy_uj", 900);
+  write_file("intel-rapl:1/energy_uj", 100);
+  assert(hb_energy_read(&ep, &energy) == 0);
+  assert(energy == 600);
+
+  // overflow
+  write_file("intel-rapl:0/energy_uj", 500);
+  assert(hb_energy_read(&ep, &energy) == 0);
+  assert(energy == 600 + 9000);
+
+  assert(hb_energy_finish(&ep) == 0);
+  remove_tree();
+}
+
+static void test_hwmon(void) {
+  hb_energy_provider ep;
+  uint64_t energy;
+  make_root();
+  make_dir("hwmon0");
+  write_file("hwmon0/energy1_input", 100);
+  write_file("hwmon0/temp1_input", 40000);
+  make_dir("hwmon1");
+  write_file("hwmon1/energy2_input", 200);
+
+  assert(hb_energy_hwmon_init(&ep, root) == 0);
+  write_file("hwmon0/energy1_input", 150);
+  write_file("hwmon0/temp1_input", 50000);
+  write_file("hwmon1/energy2_input", 300);
+  assert(hb_energy_read(&ep, &energy) == 0);
+  assert(energy == 150);
+
+  assert(hb_energy_finish(&ep) == 0);
+  remove_tree();
+}
+
+static void test_power_supply(void) {
+  hb_energy_provider ep;
+  uint64_t energy;
+  make_root();
+  make_dir("AC");
+  make_dir("BAT0");
+  write_file("BAT0/energy_now", 50000000);
+
+  assert(hb_energy_power_supply_init(&ep, root) == 0);
+  write_file("BAT0/energy_now", 49999990);
+  assert(hb_energy_read(&ep, &energy) == 0);
+  assert(energy == 10 * 3600);
+  // charging doesn't count
+  write_file("BAT0/energy_now", 50000000);
+  assert(hb_energy_read(&ep, &energy) == 0);
+  assert(energy == 10 * 3600);
+
+  assert(hb_energy_finish(&ep) == 0);
+  remove_tree();
+}
+
+static void test_bad_arguments(void) {
+  hb_energy_provider ep;
+  uint64_t energy;
+  make_root();
+  assert(hb_energy_powercap_init(NULL, root));
+  assert(errno == EINVAL);
+  assert(hb_energy_powercap_init(&ep, root));
+  assert(errno == ENOENT);
+  assert(hb_energy_hwmon_init(&ep, "/nonexistent"));
+  assert(hb_energy_read(NULL, &energy));
+  assert(hb_energy_finish(NULL));
+  remove_tree();
+}
+
+int main(void) {
+  test_powercap();
+  test_hwmon();
+  test_power_supply();
+  test_bad_arguments();
+  return 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * Moving average tests.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <heartbeats-simple.h>
+
+#define MS 1000000ULL
+
+static int near(double value, double expected) {
+  double diff = value > expected ? value - expected : expected - value;
+  return diff <= expected * 0.001;
+}
+
+static void test_bad_arguments(void) {
+  const uint64_t tc[HB_EWMA_MAX + 1] = { 1, 2, 3, 4, 5 };
+  const uint64_t zero[2] = { 1, 0 };
+  hb_ewma ewma;
+  heartbeat_pow_context hb;
+  heartbeat_pow_record rec;
+  errno = 0;
+  assert(hb_ewma_init(&ewma, tc, 0) != 0);
+  assert(errno == EINVAL);
+  assert(hb_ewma_init(&ewma, tc, HB_EWMA_MAX + 1) != 0);
+  assert(hb_ewma_init(&ewma, zero, 2) != 0);
+  assert(hb_ewma_init(&ewma, NULL, 1) != 0);
+  assert(hb_ewma_init(NULL, tc, 1) != 0);
+  assert(hb_ewma_init(&ewma, tc, HB_EWMA_MAX) == 0);
+
+  // a window needs both a size and a buffer
+  assert(heartbeat_pow_init(&hb, 0, &rec, -1, NULL) != 0);
+  assert(heartbeat_pow_init(&hb, 1, NULL, -1, NULL) != 0);
+  assert(heartbeat_pow_init(&hb, 0, NULL, -1, NULL) == 0);
+  errno = 0;
+  assert(hb_pow_get_ewma_perf(&hb, 0) == 0);
+  assert(errno == EINVAL);
+  assert(hb_pow_set_ewma(NULL, &ewma) != 0);
+  assert(hb_pow_set_ewma(&hb, &ewma) == 0);
+  errno = 0;
+  assert(hb_pow_get_ewma_power(&hb, HB_EWMA_MAX) == 0);
+  assert(errno == EINVAL);
+}
+
+/*
+ * 10 ms heartbeats, back to back, with the given work and 10 mJ each (1 W).
+ */
+static uint64_t issue(heartbeat_pow_context* hb, uint64_t t, uint64_t count, uint64_t work) {
+  uint64_t i;
+  for (i = 0; i < count; i++, t += 10 * MS) {
+    heartbeat_pow(hb, i, work, t, t + 10 * MS, t / 1000, (t + 10 * MS) / 1000);
+  }
+  return t;
+}
+
+static void test_windowless(uint32_t flags) {
+  const uint64_t tc[3] = { 100 * MS, 1000 * MS, 60000 * MS };
+  heartbeat_pow_context hb;
+  heartbeat_pow_record snapshot;
+  hb_ewma ewma;
+  uint64_t t;
+  uint32_t i;
+  assert(heartbeat_pow_init_flags(&hb, 0, NULL, -1, NULL, flags) == 0);
+  assert(hb_ewma_init(&ewma, tc, 3) == 0);
+  assert(hb_pow_set_ewma(&hb, &ewma) == 0);
+  assert(hb_pow_get_ewma_perf(&hb, 0) == 0);
+
+  // a steady rate is the same for every time constant
+  t = issue(&hb, 1000 * MS, 100, 1);
+  for (i = 0; i < 3; i++) {
+    assert(near(hb_pow_get_ewma_perf(&hb, i), 100.0));
+    assert(near(hb_pow_get_ewma_power(&hb, i), 1.0));
+  }
+  assert(hb_pow_get_global_work(&hb) == 100);
+  assert(near(hb_pow_get_global_perf(&hb), 100.0));
+  assert(near(hb_pow_get_global_power(&hb), 1.0));
+  assert(hb_pow_get_window_perf(&hb) == 0);
+  assert(hb_pow_get_instant_power(&hb) == 0);
+  errno = 0;
+  assert(hb_pow_get_snapshot(&hb, &snapshot) != 0);
+  assert(errno == EINVAL);
+
+  // shorter time constants follow a new rate sooner
+  issue(&hb, t, 100, 2);
+  assert(near(hb_pow_get_ewma_perf(&hb, 0), 200.0));
+  assert(hb_pow_get_ewma_perf(&hb, 1) > hb_pow_get_ewma_perf(&hb, 2));
+  assert(hb_pow_get_ewma_perf(&hb, 2) > 100.0);
+  assert(near(hb_pow_get_ewma_power(&hb, 2), 1.0));
+}
+
+static void test_window(void) {
+  const uint64_t tc[1] = { 1000 * MS };
+  heartbeat_pow_container hc;
+  hb_ewma ewma;
+  assert(heartbeat_pow_container_init_context(&hc, 20, -1, NULL) == 0);
+  assert(hb_ewma_init(&ewma, tc, 1) == 0);
+  assert(hb_pow_set_ewma(&hc.hb, &ewma) == 0);
+  issue(&hc.hb, 0, 50, 3);
+  assert(near(hb_pow_get_ewma_perf(&hc.hb, 0), hb_pow_get_window_perf(&hc.hb)));
+  heartbeat_pow_container_finish(&hc);
+}
+
+int main(void) {
+  test_bad_arguments();
+  test_windowless(0);
+  test_windowless(HEARTBEAT_FLAG_LOCK_FREE);
+  test_windowless(HEARTBEAT_FLAG_SINGLE_WRITER | HEARTBEAT_FLAG_LAZY_RATES);
+  test_window();
+  return 0;
+}
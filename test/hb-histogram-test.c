@@ -0,0 +1,131 @@
+/**
+ * Histogram tests.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <heartbeats-simple.h>
+
+#define PRECISION 7
+
+static uint64_t counts_a[HB_HISTOGRAM_LEN(PRECISION)];
+static uint64_t counts_b[HB_HISTOGRAM_LEN(PRECISION)];
+static uint64_t counts_c[HB_HISTOGRAM_LEN(4)];
+
+/* Within the relative error of the precision */
+static int near(uint64_t value, uint64_t expected, uint32_t precision) {
+  uint64_t diff = value > expected ? value - expected : expected - value;
+  return diff <= (expected >> precision) + 1;
+}
+
+static void test_bad_arguments(void) {
+  hb_histogram h;
+  errno = 0;
+  assert(hb_histogram_init(&h, HB_HISTOGRAM_PRECISION_MAX + 1, counts_a, HB_HISTOGRAM_LEN(PRECISION)) != 0);
+  assert(errno == EINVAL);
+  assert(hb_histogram_init(&h, PRECISION, counts_a, HB_HISTOGRAM_LEN(PRECISION) - 1) != 0);
+  assert(hb_histogram_init(&h, PRECISION, NULL, HB_HISTOGRAM_LEN(PRECISION)) != 0);
+  assert(hb_histogram_init(NULL, PRECISION, counts_a, HB_HISTOGRAM_LEN(PRECISION)) != 0);
+  assert(hb_histogram_record(NULL, 1) != 0);
+  assert(hb_histogram_merge(&h, NULL) != 0);
+  assert(hb_histogram_init(&h, PRECISION, counts_a, HB_HISTOGRAM_LEN(PRECISION)) == 0);
+  errno = 0;
+  assert(hb_histogram_get_percentile(&h, 100.1) == 0);
+  assert(errno == EINVAL);
+  assert(hb_histogram_get_percentile(&h, 50) == 0);
+}
+
+static void test_percentiles(void) {
+  hb_histogram h;
+  uint64_t i;
+  assert(hb_histogram_init(&h, PRECISION, counts_a, HB_HISTOGRAM_LEN(PRECISION)) == 0);
+  // 1..100000 us, in ns
+  for (i = 1; i <= 100000; i++) {
+    assert(hb_histogram_record(&h, i * 1000) == 0);
+  }
+  assert(h.count == 100000);
+  assert(hb_histogram_get_percentile(&h, 0) == 1000);
+  assert(hb_histogram_get_percentile(&h, 100) == 100000000);
+  assert(near(hb_histogram_get_percentile(&h, 50), 50000000, PRECISION));
+  assert(near(hb_histogram_get_percentile(&h, 99), 99000000, PRECISION));
+  assert(near(hb_histogram_get_percentile(&h, 99.9), 99900000, PRECISION));
+
+  // small values are exact, and the full range is supported
+  assert(hb_histogram_reset(&h) == 0);
+  assert(hb_histogram_get_percentile(&h, 50) == 0);
+  for (i = 0; i < 100; i++) {
+    assert(hb_histogram_record(&h, i) == 0);
+  }
+  assert(hb_histogram_get_percentile(&h, 50) == 49);
+  assert(hb_histogram_record(&h, UINT64_MAX) == 0);
+  assert(hb_histogram_get_percentile(&h, 100) == UINT64_MAX);
+}
+
+static void test_merge(void) {
+  hb_histogram a;
+  hb_histogram b;
+  hb_histogram c;
+  uint64_t i;
+  assert(hb_histogram_init(&a, PRECISION, counts_a, HB_HISTOGRAM_LEN(PRECISION)) == 0);
+  assert(hb_histogram_init(&b, PRECISION, counts_b, HB_HISTOGRAM_LEN(PRECISION)) == 0);
+  assert(hb_histogram_init(&c, 4, counts_c, HB_HISTOGRAM_LEN(4)) == 0);
+  for (i = 0; i < 1000; i++) {
+    assert(hb_histogram_record(&a, 1000 + i) == 0);
+    assert(hb_histogram_record(&b, 5000 + i) == 0);
+  }
+  assert(hb_histogram_merge(&a, &b) == 0);
+  assert(a.count == 2000);
+  assert(a.min == 1000);
+  assert(a.max == 5999);
+  assert(near(hb_histogram_get_percentile(&a, 25), 1500, PRECISION));
+  assert(near(hb_histogram_get_percentile(&a, 75), 5500, PRECISION));
+
+  // into a lower precision
+  assert(hb_histogram_merge(&c, &a) == 0);
+  assert(c.count == 2000);
+  assert(c.max == 5999);
+  assert(near(hb_histogram_get_percentile(&c, 75), 5500, 4));
+}
+
+static void test_context(void) {
+  heartbeat_container hc;
+  hb_histogram h;
+  uint64_t ws = 10;
+  uint64_t i;
+  assert(heartbeat_container_init(&hc, ws) == 0);
+  assert(heartbeat_init_flags(&hc.hb, ws, hc.window_buffer, -1, NULL, HEARTBEAT_FLAG_HISTOGRAM_WINDOW) == 0);
+  assert(hb_histogram_init(&h, PRECISION, counts_a, HB_HISTOGRAM_LEN(PRECISION)) == 0);
+  assert(hb_set_histogram(NULL, &h) != 0);
+  assert(hb_set_histogram(&hc.hb, &h) == 0);
+  // durations of 1..15 us; the first window is reset when it completes
+  for (i = 1; i <= 15; i++) {
+    heartbeat(&hc.hb, i, 1, 0, i * 1000);
+  }
+  assert(h.count == 5);
+  assert(h.min == 11000);
+  assert(h.max == 15000);
+
+  // lock-free producers record with atomic updates
+  assert(heartbeat_init_flags(&hc.hb, ws, hc.window_buffer, -1, NULL, HEARTBEAT_FLAG_LOCK_FREE) == 0);
+  assert(hb_set_histogram(&hc.hb, &h) == 0);
+  assert(hb_histogram_reset(&h) == 0);
+  for (i = 1; i <= 15; i++) {
+    heartbeat(&hc.hb, i, 1, 0, i * 1000);
+  }
+  assert(h.count == 15);
+  assert(hb_histogram_get_percentile(&h, 0) == 1000);
+  assert(hb_histogram_get_percentile(&h, 100) == 15000);
+  heartbeat_container_finish(&hc);
+}
+
+int main(void) {
+  test_bad_arguments();
+  test_percentiles();
+  test_merge();
+  test_context();
+  return 0;
+}
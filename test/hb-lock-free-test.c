@@ -0,0 +1,131 @@
+/**
+ * Lock-free mode tests with concurrent producers.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <heartbeats-simple.h>
+
+#define THREADS 8
+#define WINDOW_SIZE 64
+#define HEARTBEATS_PER_THREAD 20000
+#define BATCH_SIZE 7
+
+static heartbeat_context hb;
+static heartbeat_record window_buffer[WINDOW_SIZE];
+static volatile int producers_done = 0;
+static uint64_t windows_completed = 0;
+
+/* Each heartbeat's work and duration are derived from its tag, so torn records can be detected */
+static uint64_t tag_work(uint64_t tag) {
+  return tag % 7 + 1;
+}
+
+static void check_record(const heartbeat_record* rec) {
+  assert(rec->work == tag_work(rec->user_tag));
+  assert(rec->end_time - rec->start_time == 10 * rec->work);
+  assert(rec->wd.global >= rec->work);
+  assert(rec->td.global >= rec->end_time - rec->start_time);
+}
+
+/* Runs while other producers wait, so the window is stable */
+static void window_complete(const heartbeat_context* ctx) {
+  uint64_t window = ctx->window_buffer[0].id / WINDOW_SIZE;
+  uint64_t i;
+  for (i = 0; i < WINDOW_SIZE; i++) {
+    assert(ctx->window_buffer[i].id == window * WINDOW_SIZE + i);
+    check_record(&ctx->window_buffer[i]);
+  }
+  assert(window == windows_completed);
+  windows_completed++;
+}
+
+static void fill_input(heartbeat_input* in, uint64_t tag) {
+  in->user_tag = tag;
+  in->work = tag_work(tag);
+  in->start_time = tag * 100;
+  in->end_time = in->start_time + 10 * in->work;
+}
+
+static void* produce(void* arg) {
+  uint64_t first = (uint64_t) (uintptr_t) arg * HEARTBEATS_PER_THREAD;
+  heartbeat_input batch[BATCH_SIZE];
+  heartbeat_input in;
+  uint64_t i = 0;
+  uint64_t n;
+  // alternate between single heartbeats and batches
+  while (i < HEARTBEATS_PER_THREAD) {
+    if ((i / BATCH_SIZE) % 2 == 0) {
+      fill_input(&in, first + i);
+      heartbeat(&hb, in.user_tag, in.work, in.start_time, in.end_time);
+      i++;
+    } else {
+      for (n = 0; n < BATCH_SIZE && i + n < HEARTBEATS_PER_THREAD; n++) {
+        fill_input(&batch[n], first + i + n);
+      }
+      heartbeat_batch(&hb, batch, n);
+      i += n;
+    }
+  }
+  return NULL;
+}
+
+static void* read_snapshots(void* arg) {
+  heartbeat_record snapshot;
+  uint64_t last_id = 0;
+  uint64_t reads = 0;
+  (void) arg;
+  while (!producers_done) {
+    if (hb_get_snapshot(&hb, &snapshot) != 0) {
+      assert(errno == EAGAIN);
+      continue;
+    }
+    check_record(&snapshot);
+    // the last record never goes back to an older heartbeat
+    assert(snapshot.id >= last_id);
+    last_id = snapshot.id;
+    reads++;
+  }
+  return (void*) (uintptr_t) reads;
+}
+
+int main(void) {
+  pthread_t producers[THREADS];
+  pthread_t reader;
+  uint64_t total = (uint64_t) THREADS * HEARTBEATS_PER_THREAD;
+  uint64_t work = 0;
+  uint64_t time = 0;
+  uint64_t i;
+
+  assert(heartbeat_init_flags(&hb, WINDOW_SIZE, window_buffer, -1, &window_complete, HEARTBEAT_FLAG_LOCK_FREE) == 0);
+  // the first heartbeat makes every snapshot valid
+  heartbeat(&hb, 0, tag_work(0), 0, 10 * tag_work(0));
+  assert(pthread_create(&reader, NULL, &read_snapshots, NULL) == 0);
+  for (i = 0; i < THREADS; i++) {
+    assert(pthread_create(&producers[i], NULL, &produce, (void*) (uintptr_t) i) == 0);
+  }
+  for (i = 0; i < THREADS; i++) {
+    assert(pthread_join(producers[i], NULL) == 0);
+  }
+  producers_done = 1;
+  assert(pthread_join(reader, NULL) == 0);
+
+  // tag 0 was issued twice
+  for (i = 0; i < total; i++) {
+    work += tag_work(i);
+    time += 10 * tag_work(i);
+  }
+  work += tag_work(0);
+  time += 10 * tag_work(0);
+  assert(hb.counter == total + 1);
+  assert(hb_get_global_work(&hb) == work);
+  assert(hb_get_global_time(&hb) == time);
+  assert(windows_completed == (total + 1) / WINDOW_SIZE);
+  assert(hb.ws.buffer_index == (total + 1) % WINDOW_SIZE);
+  return 0;
+}
@@ -0,0 +1,431 @@
+/**
+ * Log sink tests.
+ */
+// force assertions
+#undef NDEBUG
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#include <heartbeats-simple.h>
+
+static const uint64_t window_size = 4;
+
+typedef struct records_seen {
+  uint64_t windows;
+  uint64_t records;
+  uint64_t last_id;
+} records_seen;
+
+static int count_records(const void* records, uint64_t count, size_t record_size, void* arg) {
+  records_seen* seen = arg;
+  assert(record_size == sizeof(heartbeat_record));
+  seen->windows++;
+  seen->records += count;
+  seen->last_id = ((const heartbeat_record*) records)[count - 1].id;
+  return 0;
+}
+
+static void issue(heartbeat_context* hb, uint64_t n) {
+  uint64_t i;
+  for (i = 0; i < n; i++) {
+    heartbeat(hb, i, 1, i * 1000, (i + 1) * 1000);
+  }
+}
+
+static void read_file(FILE* f, char* buf, size_t len) {
+  size_t n;
+  fflush(f);
+  rewind(f);
+  n = fread(buf, 1, len - 1, f);
+  buf[n] = '\0';
+}
+
+/**
+ * Test that a memory sink gets the same text as the log file descriptor
+ */
+static void test_memory(void) {
+#if !defined(_WIN32)
+  char buf[8192];
+  const void* data;
+  size_t len;
+  hb_log_sink sink;
+  heartbeat_context hb;
+  heartbeat_context hb_fd;
+  heartbeat_record* window_buffer = malloc(window_size * sizeof(heartbeat_record));
+  heartbeat_record* window_buffer_fd = malloc(window_size * sizeof(heartbeat_record));
+  FILE* log = tmpfile();
+  assert(window_buffer);
+  assert(window_buffer_fd);
+  assert(log);
+  assert(hb_log_sink_memory_init(&sink) == 0);
+  assert(heartbeat_init(&hb, window_size, window_buffer, -1, NULL) == 0);
+  assert(heartbeat_init(&hb_fd, window_size, window_buffer_fd, fileno(log), NULL) == 0);
+  assert(hb_set_log_sink(&hb, &sink) == 0);
+  assert(hb_ctx_log_header(&hb) == 0);
+  assert(hb_ctx_log_header(&hb_fd) == 0);
+  issue(&hb, 3 * window_size + 1);
+  issue(&hb_fd, 3 * window_size + 1);
+  assert(hb_ctx_log_window_buffer(&hb) == 0);
+  assert(hb_ctx_log_window_buffer(&hb_fd) == 0);
+
+  read_file(log, buf, sizeof(buf));
+  assert(hb_log_sink_memory_get(&sink, &data, &len) == 0);
+  assert(len == strlen(buf));
+  assert(memcmp(data, buf, len) == 0);
+  assert(hb_log_sink_memory_reset(&sink) == 0);
+  assert(hb_log_sink_memory_get(&sink, &data, &len) == 0);
+  assert(len == 0);
+
+  assert(hb_log_sink_finish(&sink) == 0);
+  fclose(log);
+  free(window_buffer_fd);
+  free(window_buffer);
+#endif
+}
+
+/**
+ * Test that a callback sink gets each completed window, but no header
+ */
+static void test_callback(void) {
+  records_seen seen = { 0, 0, 0 };
+  hb_log_sink sink;
+  heartbeat_context hb;
+  heartbeat_record* window_buffer = malloc(window_size * sizeof(heartbeat_record));
+  assert(window_buffer);
+  assert(hb_log_sink_callback_init(&sink, &count_records, &seen) == 0);
+  assert(heartbeat_init(&hb, window_size, window_buffer, -1, NULL) == 0);
+  assert(hb_set_log_sink(&hb, &sink) == 0);
+  assert(hb_ctx_log_header(&hb) == 0);
+  issue(&hb, 2 * window_size + 1);
+  assert(seen.windows == 2);
+  assert(seen.records == 2 * window_size);
+  assert(seen.last_id == 2 * window_size - 1);
+  assert(hb_log_sink_finish(&sink) == 0);
+  free(window_buffer);
+}
+
+/**
+ * Test that a fan-out sink forwards binary data and records to its sinks
+ */
+static void test_fanout(void) {
+  records_seen seen = { 0, 0, 0 };
+  const heartbeat_bin_header* header;
+  const heartbeat_record* records;
+  const void* data;
+  size_t len;
+  uint64_t i;
+  hb_log_sink mem;
+  hb_log_sink cb;
+  hb_log_sink fanout;
+  hb_log_sink* sinks[2];
+  heartbeat_context hb;
+  heartbeat_record* window_buffer = malloc(window_size * sizeof(heartbeat_record));
+  assert(window_buffer);
+  assert(hb_log_sink_memory_init(&mem) == 0);
+  assert(hb_log_sink_callback_init(&cb, &count_records, &seen) == 0);
+  sinks[0] = &mem;
+  sinks[1] = &cb;
+  assert(hb_log_sink_fanout_init(&fanout, sinks, 2) == 0);
+  assert(heartbeat_init_flags(&hb, window_size, window_buffer, -1, NULL, HEARTBEAT_FLAG_LOG_BINARY) == 0);
+  assert(hb_set_log_sink(&hb, &fanout) == 0);
+  assert(hb_ctx_log_header(&hb) == 0);
+  issue(&hb, 2 * window_size);
+  assert(seen.windows == 2);
+
+  assert(hb_log_sink_memory_get(&mem, &data, &len) == 0);
+  assert(len == sizeof(heartbeat_bin_header) + 2 * window_size * sizeof(heartbeat_record));
+  header = data;
+  assert(memcmp(header->magic, HEARTBEAT_BIN_MAGIC, sizeof(header->magic)) == 0);
+  assert(header->mode == HEARTBEAT_BIN_MODE_HB);
+  assert(header->record_size == sizeof(heartbeat_record));
+  records = (const heartbeat_record*) (header + 1);
+  for (i = 0; i < 2 * window_size; i++) {
+    assert(records[i].id == i);
+  }
+
+  assert(hb_log_sink_finish(&fanout) == 0);
+  assert(hb_log_sink_finish(&cb) == 0);
+  assert(hb_log_sink_finish(&mem) == 0);
+  free(window_buffer);
+}
+
+/**
+ * Test that an io_uring sink writes the same data as a memory sink, in order,
+ * whether it uses io_uring or falls back to write()
+ */
+static void test_uring(void) {
+#if !defined(_WIN32)
+  const char prefix[] = "prefix\n";
+  char buf[65536];
+  const void* data;
+  size_t len;
+  hb_log_sink mem;
+  hb_log_sink uring;
+  hb_log_sink fanout;
+  hb_log_sink* sinks[2];
+  heartbeat_context hb;
+  heartbeat_record* window_buffer = malloc(window_size * sizeof(heartbeat_record));
+  FILE* log = tmpfile();
+  assert(window_buffer);
+  assert(log);
+  fputs(prefix, log);
+  fflush(log);
+  // small buffers, so some windows are written synchronously
+  assert(hb_log_sink_uring_init(&uring, fileno(log), 2, 512) == 0);
+  assert(hb_log_sink_uring_active(&uring) >= 0);
+  assert(hb_log_sink_memory_init(&mem) == 0);
+  sinks[0] = &uring;
+  sinks[1] = &mem;
+  assert(hb_log_sink_fanout_init(&fanout, sinks, 2) == 0);
+  assert(heartbeat_init(&hb, window_size, window_buffer, -1, NULL) == 0);
+  assert(hb_set_log_sink(&hb, &fanout) == 0);
+  assert(hb_ctx_log_header(&hb) == 0);
+  issue(&hb, 40 * window_size);
+  assert(hb_log_sink_finish(&fanout) == 0);
+  assert(hb_log_sink_finish(&uring) == 0);
+  // the file position follows the data
+  assert(write(fileno(log), "end\n", 4) == 4);
+
+  read_file(log, buf, sizeof(buf));
+  assert(hb_log_sink_memory_get(&mem, &data, &len) == 0);
+  assert(strlen(buf) == strlen(prefix) + len + 4);
+  assert(strncmp(buf, prefix, strlen(prefix)) == 0);
+  assert(memcmp(buf + strlen(prefix), data, len) == 0);
+  assert(strcmp(buf + strlen(prefix) + len, "end\n") == 0);
+
+  errno = 0;
+  assert(hb_log_sink_uring_active(&mem) < 0);
+  assert(errno == EINVAL);
+  assert(hb_log_sink_finish(&mem) == 0);
+  fclose(log);
+  free(window_buffer);
+#endif
+}
+
+static size_t read_path(const char* path, char* buf, size_t len) {
+  FILE* f = fopen(path, "rb");
+  size_t n = 0;
+  if (f != NULL) {
+    n = fread(buf, 1, len - 1, f);
+    fclose(f);
+  }
+  buf[n] = '\0';
+  return n;
+}
+
+/**
+ * Test that a rotating sink starts segments at window boundaries with the
+ * header, and keeps only the last segments
+ */
+static void test_rotate(void) {
+#if !defined(_WIN32)
+  char pattern[] = "/tmp/hb-rotate-XXXXXX";
+  char path[64];
+  char buf[8192];
+  char header[1024];
+  char* line;
+  size_t header_len;
+  uint64_t segments;
+  uint64_t expected_id = 0;
+  uint64_t id;
+  uint64_t i;
+  hb_log_sink sink;
+  hb_log_sink mem;
+  heartbeat_context hb;
+  heartbeat_record* window_buffer = malloc(window_size * sizeof(heartbeat_record));
+  const void* data;
+  size_t len;
+  int fd = mkstemp(pattern);
+  assert(window_buffer);
+  assert(fd >= 0);
+  close(fd);
+  unlink(pattern);
+  assert(strlen(pattern) + 8 < sizeof(path));
+
+  // the header alone, for comparison
+  assert(hb_log_sink_memory_init(&mem) == 0);
+  assert(heartbeat_init(&hb, window_size, window_buffer, -1, NULL) == 0);
+  assert(hb_set_log_sink(&hb, &mem) == 0);
+  assert(hb_ctx_log_header(&hb) == 0);
+  assert(hb_log_sink_memory_get(&mem, &data, &len) == 0);
+  assert(len < sizeof(header));
+  memcpy(header, data, len);
+  header[len] = '\0';
+  header_len = len;
+  assert(hb_log_sink_finish(&mem) == 0);
+
+  snprintf(path, sizeof(path), "%s-%%u", pattern);
+  errno = 0;
+  assert(hb_log_sink_rotate_init(&sink, "/tmp/no-conversion", 4096, 0) != 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(hb_log_sink_rotate_init(&sink, "/tmp/%u-%s", 4096, 0) != 0);
+  assert(errno == EINVAL);
+  // room for the header and a couple of windows per segment
+  assert(hb_log_sink_rotate_init(&sink, path, header_len + 2 * window_size * 200, 3) == 0);
+  assert(heartbeat_init(&hb, window_size, window_buffer, -1, NULL) == 0);
+  assert(hb_set_log_sink(&hb, &sink) == 0);
+  assert(hb_ctx_log_header(&hb) == 0);
+  issue(&hb, 20 * window_size);
+  assert(hb_log_sink_finish(&sink) == 0);
+
+  // only the last 3 segments remain
+  for (i = 0, segments = 0; i < 64; i++) {
+    snprintf(path, sizeof(path), "%s-%"PRIu64, pattern, i);
+    if ((len = read_path(path, buf, sizeof(buf))) == 0) {
+      assert(segments == 0 || segments == 3);
+      continue;
+    }
+    assert(i >= 3);
+    segments++;
+    unlink(path);
+    // each segment begins with the header and has whole windows, which continue from the last segment
+    assert(len > header_len);
+    assert(strncmp(buf, header, header_len) == 0);
+    if (expected_id == 0) {
+      expected_id = strtoull(buf + header_len, NULL, 10);
+    }
+    for (line = buf + header_len; *line != '\0'; line = strchr(line, '\n') + 1) {
+      id = strtoull(line, NULL, 10);
+      assert(id == expected_id);
+      expected_id++;
+    }
+    assert(expected_id % window_size == 0);
+  }
+  assert(segments == 3);
+  assert(expected_id == 20 * window_size);
+  free(window_buffer);
+#endif
+}
+
+#if !defined(_WIN32)
+static void write_path(const char* path, const char* data) {
+  FILE* f = fopen(path, "w");
+  assert(f);
+  fputs(data, f);
+  fclose(f);
+}
+#endif
+
+/**
+ * Test that a rotating sink removes segments left by an earlier series, but
+ * not other files
+ */
+static void test_rotate_restart(void) {
+#if !defined(_WIN32)
+  char dir[] = "/tmp/hb-rotate-restart-XXXXXX";
+  char pattern[64];
+  char path[64];
+  char buf[8192];
+  const char* others[] = { "seg-01.log", "seg-.log", "seg-1.log.bak", "seg-1x.log", "other-1.log",
+                           "seg-99999999999999999999.log" };
+  hb_log_sink sink;
+  heartbeat_context hb;
+  heartbeat_record window_buffer[4];
+  uint64_t i;
+  assert(mkdtemp(dir));
+  snprintf(pattern, sizeof(pattern), "%s/seg-%%u.log", dir);
+  errno = 0;
+  assert(hb_log_sink_rotate_init(&sink, "/tmp/%u/seg.log", 4096, 0) != 0);
+  assert(errno == EINVAL);
+
+  // an earlier run's segments, and files that only look like them
+  for (i = 0; i < 10; i++) {
+    snprintf(path, sizeof(path), "%s/seg-%"PRIu64".log", dir, i);
+    write_path(path, "stale\n");
+  }
+  for (i = 0; i < sizeof(others) / sizeof(others[0]); i++) {
+    snprintf(path, sizeof(path), "%s/%s", dir, others[i]);
+    write_path(path, "other\n");
+  }
+
+  assert(hb_log_sink_rotate_init(&sink, pattern, 4096, 3) == 0);
+  assert(heartbeat_init(&hb, 4, window_buffer, -1, NULL) == 0);
+  assert(hb_set_log_sink(&hb, &sink) == 0);
+  issue(&hb, 4);
+  assert(hb_log_sink_finish(&sink) == 0);
+
+  // the series continues after the earlier one, which is pruned to max_files
+  snprintf(path, sizeof(path), "%s/seg-10.log", dir);
+  assert(read_path(path, buf, sizeof(buf)) > 0);
+  assert(strstr(buf, "stale") == NULL);
+  assert(unlink(path) == 0);
+  for (i = 8; i < 10; i++) {
+    snprintf(path, sizeof(path), "%s/seg-%"PRIu64".log", dir, i);
+    assert(read_path(path, buf, sizeof(buf)) > 0);
+    assert(strstr(buf, "stale") != NULL);
+    assert(unlink(path) == 0);
+  }
+  for (i = 0; i < 8; i++) {
+    snprintf(path, sizeof(path), "%s/seg-%"PRIu64".log", dir, i);
+    errno = 0;
+    assert(unlink(path) != 0);
+    assert(errno == ENOENT);
+  }
+  for (i = 0; i < sizeof(others) / sizeof(others[0]); i++) {
+    snprintf(path, sizeof(path), "%s/%s", dir, others[i]);
+    assert(read_path(path, buf, sizeof(buf)) > 0);
+    assert(unlink(path) == 0);
+  }
+  assert(rmdir(dir) == 0);
+#endif
+}
+
+static void test_bad_arguments(void) {
+  hb_log_sink sink;
+  hb_log_sink* sinks[1] = { NULL };
+  heartbeat_context hb;
+  heartbeat_record window_buffer[1];
+  errno = 0;
+  assert(hb_log_sink_fd_init(NULL, 1) != 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(hb_log_sink_fd_init(&sink, -1) != 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(hb_log_sink_callback_init(&sink, NULL, NULL) != 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(hb_log_sink_fanout_init(&sink, sinks, 1) != 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(hb_log_sink_uring_init(&sink, 1, UINT32_MAX, SIZE_MAX / 2) != 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(hb_log_sink_finish(NULL) != 0);
+  assert(errno == EINVAL);
+
+  assert(hb_log_sink_fd_init(&sink, 1) == 0);
+  errno = 0;
+  assert(hb_log_sink_memory_reset(&sink) != 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(hb_set_log_sink(NULL, &sink) != 0);
+  assert(errno == EINVAL);
+  assert(hb_log_sink_finish(&sink) == 0);
+
+  memset(&sink, 0, sizeof(sink));
+  assert(heartbeat_init(&hb, 1, window_buffer, -1, NULL) == 0);
+  errno = 0;
+  assert(hb_set_log_sink(&hb, &sink) != 0);
+  assert(errno == EINVAL);
+}
+
+int main(void) {
+  test_memory();
+  test_callback();
+  test_fanout();
+  test_uring();
+  test_rotate();
+  test_rotate_restart();
+  test_bad_arguments();
+  return 0;
+}
@@ -0,0 +1,136 @@
+/**
+ * Rollup tests.
+ */
+// force assertions
+#undef NDEBUG
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <errno.h>
+#include <float.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <heartbeats-simple.h>
+
+static const uint64_t resolutions[3] = { 1000, 10000, 60000 };
+static const uint64_t lens[3] = { 4, 3, 2 };
+
+static int equal_dbl(double a, double b) {
+  double diff = a > b ? a - b : b - a;
+  return diff <= b * DBL_EPSILON * 4;
+}
+
+static void test_bad_arguments(void) {
+  const uint64_t uneven[2] = { 1000, 1500 };
+  const uint64_t zero[2] = { 4, 0 };
+  hb_rollup_interval intervals[9];
+  hb_rollup r;
+  heartbeat_context hb;
+  errno = 0;
+  assert(hb_rollup_init(NULL, resolutions, lens, 3, intervals, 9, -1) != 0);
+  assert(errno == EINVAL);
+  assert(hb_rollup_init(&r, NULL, lens, 3, intervals, 9, -1) != 0);
+  assert(hb_rollup_init(&r, resolutions, NULL, 3, intervals, 9, -1) != 0);
+  assert(hb_rollup_init(&r, resolutions, lens, 3, NULL, 9, -1) != 0);
+  assert(hb_rollup_init(&r, resolutions, lens, 0, intervals, 9, -1) != 0);
+  assert(hb_rollup_init(&r, resolutions, lens, HB_ROLLUP_LEVELS_MAX + 1, intervals, 9, -1) != 0);
+  assert(hb_rollup_init(&r, resolutions, lens, 3, intervals, 8, -1) != 0);
+  assert(hb_rollup_init(&r, uneven, lens, 2, intervals, 9, -1) != 0);
+  assert(hb_rollup_init(&r, resolutions, zero, 2, intervals, 9, -1) != 0);
+  assert(hb_rollup_init(&r, resolutions, lens, 3, intervals, 9, -1) == 0);
+
+  errno = 0;
+  assert(hb_rollup_get_intervals(&r, 3, intervals, 1) == 0);
+  assert(errno == EINVAL);
+  assert(hb_rollup_get_intervals(&r, 0, NULL, 1) == 0);
+  assert(hb_rollup_get_current(&r, 3, intervals) != 0);
+  assert(hb_rollup_get_current(NULL, 0, intervals) != 0);
+  assert(hb_rollup_get_intervals(&r, 0, intervals, 1) == 0);
+
+  assert(heartbeat_init(&hb, 0, NULL, -1, NULL) == 0);
+  assert(hb_set_rollup(NULL, &r) != 0);
+  assert(hb_set_rollup(&hb, &r) == 0);
+  assert(hb_set_rollup(&hb, NULL) == 0);
+}
+
+static void test_cascade(void) {
+  hb_rollup_interval intervals[9];
+  hb_rollup_interval out[4];
+  hb_rollup r;
+  heartbeat_pow_context hb;
+  char data[16384];
+  size_t len;
+  size_t i;
+  uint64_t j;
+  int lines = 0;
+  FILE* f = tmpfile();
+  assert(f != NULL);
+  assert(hb_rollup_init(&r, resolutions, lens, 3, intervals, 9, fileno(f)) == 0);
+  assert(hb_rollup_log_header(fileno(f)) == 0);
+  // rollups don't need a window buffer
+  assert(heartbeat_pow_init(&hb, 0, NULL, -1, NULL) == 0);
+  assert(hb_pow_set_rollup(&hb, &r) == 0);
+
+  // heartbeats every 100 ns, so 10 in each interval of the finest level, except the first
+  for (j = 0; j < 250; j++) {
+    heartbeat_pow(&hb, j, 1, j * 100, (j + 1) * 100, j * 5, (j + 1) * 5);
+  }
+
+  // 25 intervals completed, and only the last 4 are kept
+  assert(hb_rollup_get_intervals(&r, 0, out, 4) == 4);
+  for (j = 0; j < 4; j++) {
+    assert(out[j].start_time == (21 + j) * 1000);
+    assert(out[j].count == 10);
+    assert(out[j].work == 10);
+    assert(out[j].time == 1000);
+    assert(out[j].energy == 50);
+    assert(equal_dbl(out[j].min_perf, 10000000.0));
+    assert(equal_dbl(out[j].max_perf, 10000000.0));
+    assert(equal_dbl(out[j].max_pwr, 50.0));
+  }
+  assert(hb_rollup_get_intervals(&r, 0, out, 2) == 2);
+  assert(out[0].start_time == 23000);
+  assert(hb_rollup_get_current(&r, 0, out) == 0);
+  assert(out[0].start_time == 25000);
+  assert(out[0].count == 1);
+
+  // coarser levels only get completed intervals
+  assert(hb_rollup_get_intervals(&r, 1, out, 4) == 2);
+  assert(out[0].start_time == 0);
+  assert(out[0].count == 99);
+  assert(out[1].start_time == 10000);
+  assert(out[1].count == 100);
+  assert(out[1].energy == 500);
+  assert(hb_rollup_get_current(&r, 1, out) == 0);
+  assert(out[0].start_time == 20000);
+  assert(out[0].count == 50);
+  assert(hb_rollup_get_intervals(&r, 2, out, 4) == 0);
+  assert(hb_rollup_get_current(&r, 2, out) == 0);
+  assert(out[0].start_time == 0);
+  assert(out[0].count == 199);
+
+  // a late heartbeat is added to the interval in progress, and its perf extends the range
+  heartbeat_pow(&hb, 250, 1, 300, 500, 0, 0);
+  assert(hb_rollup_get_current(&r, 0, out) == 0);
+  assert(out[0].start_time == 25000);
+  assert(out[0].count == 2);
+  assert(equal_dbl(out[0].min_perf, 5000000.0));
+  assert(equal_dbl(out[0].min_pwr, 0.0));
+  assert(equal_dbl(out[0].max_pwr, 50.0));
+
+  // the header and each completed interval
+  rewind(f);
+  len = fread(data, 1, sizeof(data), f);
+  for (i = 0; i < len; i++) {
+    lines += data[i] == '\n';
+  }
+  assert(lines == 1 + 25 + 2);
+  fclose(f);
+}
+
+int main(void) {
+  test_bad_arguments();
+  test_cascade();
+  return 0;
+}
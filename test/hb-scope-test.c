@@ -0,0 +1,127 @@
+/**
+ * Scoped heartbeat tests. hb-acc-pow covers hb, hb-acc, and hb-pow due to
+ * shared code.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <heartbeats-simple.h>
+
+static const uint64_t window_size = 20;
+
+static unsigned int energy_reads = 0;
+
+// a custom provider that consumes 1 J per read
+static int fake_read(hb_energy_provider* ep, uint64_t* energy) {
+  (void) ep;
+  *energy = 1000000 * energy_reads++;
+  return 0;
+}
+
+static int fake_read_fail(hb_energy_provider* ep, uint64_t* energy) {
+  (void) ep;
+  (void) energy;
+  errno = EIO;
+  return -1;
+}
+
+/**
+ * Just tests that the functions are all there.
+ */
+static void test_hb_scope(void) {
+  heartbeat_context hb;
+  heartbeat_scope hs;
+  heartbeat_record* window_buffer = malloc(window_size * sizeof(heartbeat_record));
+  assert(window_buffer);
+  assert(heartbeat_init(&hb, window_size, window_buffer, -1, NULL) == 0);
+  assert(heartbeat_scope_init(&hs, &hb) == 0);
+  assert(hb_begin(&hs) == 0);
+  assert(hb_end(&hs, 0, 1) == 0);
+  free(window_buffer);
+}
+
+static void test_hb_acc_scope(void) {
+  heartbeat_acc_context hb;
+  heartbeat_acc_scope hs;
+  heartbeat_acc_record* window_buffer = malloc(window_size * sizeof(heartbeat_acc_record));
+  assert(window_buffer);
+  assert(heartbeat_acc_init(&hb, window_size, window_buffer, -1, NULL) == 0);
+  assert(heartbeat_acc_scope_init(&hs, &hb) == 0);
+  assert(hb_acc_begin(&hs) == 0);
+  assert(hb_acc_end(&hs, 0, 1, 1) == 0);
+  free(window_buffer);
+}
+
+static void test_hb_pow_scope(void) {
+  heartbeat_pow_context hb;
+  heartbeat_pow_scope hs;
+  hb_energy_provider ep = { &fake_read, NULL, NULL };
+  heartbeat_pow_record* window_buffer = malloc(window_size * sizeof(heartbeat_pow_record));
+  assert(window_buffer);
+  assert(heartbeat_pow_init(&hb, window_size, window_buffer, -1, NULL) == 0);
+  assert(heartbeat_pow_scope_init(&hs, &hb, &ep) == 0);
+  assert(hb_pow_begin(&hs) == 0);
+  assert(hb_pow_end(&hs, 0, 1) == 0);
+  free(window_buffer);
+}
+
+/**
+ * Test that readings are taken and reused properly.
+ */
+static void test_hb_acc_pow_scope(void) {
+  heartbeat_acc_pow_context hb;
+  heartbeat_acc_pow_scope hs;
+  hb_energy_provider ep = { &fake_read, NULL, NULL };
+  hb_energy_provider ep_fail = { &fake_read_fail, NULL, NULL };
+  heartbeat_acc_pow_record* window_buffer = malloc(window_size * sizeof(heartbeat_acc_pow_record));
+  assert(window_buffer);
+  assert(heartbeat_acc_pow_init(&hb, window_size, window_buffer, -1, NULL) == 0);
+  energy_reads = 0;
+  assert(heartbeat_acc_pow_scope_init(&hs, &hb, &ep) == 0);
+  assert(energy_reads == 1);
+
+  // back-to-back heartbeats reuse the end readings
+  assert(hb_acc_pow_end(&hs, 1, 1, 1) == 0);
+  assert(hb_acc_pow_end(&hs, 2, 1, 1) == 0);
+  assert(energy_reads == 3);
+  assert(hb.counter == 2);
+  assert(window_buffer[0].end_time == window_buffer[1].start_time);
+  assert(window_buffer[0].end_time >= window_buffer[0].start_time);
+  assert(window_buffer[0].end_energy == window_buffer[1].start_energy);
+  assert(hb_acc_pow_get_global_energy(&hb) == 2000000);
+  assert(hb_acc_pow_get_global_accuracy(&hb) == 2);
+
+  // beginning again takes new readings
+  assert(hb_acc_pow_begin(&hs) == 0);
+  assert(hb_acc_pow_end(&hs, 3, 1, 1) == 0);
+  assert(energy_reads == 5);
+  assert(window_buffer[2].start_energy == window_buffer[1].end_energy + 1000000);
+
+  // failed readings don't register heartbeats
+  hs.ep = &ep_fail;
+  assert(hb_acc_pow_end(&hs, 4, 1, 1));
+  assert(errno == EIO);
+  assert(hb.counter == 3);
+  assert(heartbeat_acc_pow_scope_init(&hs, &hb, &ep_fail));
+
+  // bad arguments
+  assert(heartbeat_acc_pow_scope_init(NULL, &hb, &ep));
+  assert(heartbeat_acc_pow_scope_init(&hs, NULL, &ep));
+  assert(heartbeat_acc_pow_scope_init(&hs, &hb, NULL));
+  assert(hb_acc_pow_begin(NULL));
+  assert(hb_acc_pow_end(NULL, 0, 1, 1));
+  assert(errno == EINVAL);
+  free(window_buffer);
+}
+
+int main(void) {
+  test_hb_scope();
+  test_hb_acc_scope();
+  test_hb_pow_scope();
+  test_hb_acc_pow_scope();
+  return 0;
+}
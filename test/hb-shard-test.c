@@ -0,0 +1,124 @@
+/**
+ * Sharded heartbeat tests. hb-acc-pow covers hb, hb-acc, and hb-pow due to
+ * shared code.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <float.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <heartbeats-simple.h>
+
+static const uint64_t window_size = 20;
+static const uint32_t num_shards = 4;
+
+static double abs_dbl(double a) {
+  return a >= 0 ? a : -a;
+}
+
+static int equal_dbl(double a, double b) {
+  return abs_dbl(a - b) < DBL_EPSILON;
+}
+
+/**
+ * Just tests that the functions are all there.
+ */
+static void test_hb_shard(void) {
+  heartbeat_shard_context hs;
+  heartbeat_record merged;
+  assert(heartbeat_shard_init(&hs, num_shards, window_size, -1, NULL, 0) == 0);
+  heartbeat(hb_shard_get_context(&hs, 0), 0, 1, 0, 1000000000);
+  assert(hb_shard_merge(&hs, &merged) == 0);
+  heartbeat_shard_finish(&hs);
+}
+
+static void test_hb_acc_shard(void) {
+  heartbeat_acc_shard_context hs;
+  heartbeat_acc_record merged;
+  assert(heartbeat_acc_shard_init(&hs, num_shards, window_size, -1, NULL, 0) == 0);
+  heartbeat_acc(hb_acc_shard_get_context(&hs, 0), 0, 1, 0, 1000000000, 1);
+  assert(hb_acc_shard_merge(&hs, &merged) == 0);
+  heartbeat_acc_shard_finish(&hs);
+}
+
+static void test_hb_pow_shard(void) {
+  heartbeat_pow_shard_context hs;
+  heartbeat_pow_record merged;
+  assert(heartbeat_pow_shard_init(&hs, num_shards, window_size, -1, NULL, 0) == 0);
+  heartbeat_pow(hb_pow_shard_get_context(&hs, 0), 0, 1, 0, 1000000000, 0, 1000000);
+  assert(hb_pow_shard_merge(&hs, &merged) == 0);
+  heartbeat_pow_shard_finish(&hs);
+}
+
+/**
+ * Test that shards are independent and merged properly.
+ */
+static void test_hb_acc_pow_shard(void) {
+  heartbeat_acc_pow_shard_context hs;
+  heartbeat_acc_pow_context* hb;
+  heartbeat_acc_pow_record merged;
+  uint32_t i;
+  assert(heartbeat_acc_pow_shard_init(&hs, num_shards, window_size, -1, NULL, 0) == 0);
+  assert(hb_acc_pow_shard_merge(&hs, &merged) == 0);
+  assert(merged.id == 0);
+
+  // shard i does i + 1 work per second at 1 W, and shard 0 stays idle
+  for (i = 1; i < num_shards; i++) {
+    hb = hb_acc_pow_shard_get_context(&hs, i);
+    assert(hb != NULL);
+    assert(hb->ws.flags & HEARTBEAT_FLAG_SINGLE_WRITER);
+    heartbeat_acc_pow(hb, i, i + 1, 0, 1000000000, 1, 0, 1000000);
+    heartbeat_acc_pow(hb, i, i + 1, 1000000000, 2000000000, 1, 1000000, 2000000);
+  }
+  assert(hb_acc_pow_shard_merge(&hs, &merged) == 0);
+  assert(merged.id == 2 * (num_shards - 1));
+  assert(merged.start_time == 1000000000);
+  assert(merged.end_time == 2000000000);
+  assert(merged.work == 2 + 3 + 4);
+  assert(merged.wd.global == 2 * (2 + 3 + 4));
+  assert(merged.td.global == 2 * 1000000000ULL * (num_shards - 1));
+  assert(equal_dbl(merged.perf.global, 2 + 3 + 4));
+  assert(equal_dbl(merged.perf.instant, 2 + 3 + 4));
+  assert(merged.ad.global == 2 * (num_shards - 1));
+  assert(equal_dbl(merged.acc.global, num_shards - 1));
+  assert(merged.ed.global == 2 * 1000000ULL * (num_shards - 1));
+  assert(equal_dbl(merged.pwr.global, 1.0));
+  assert(equal_dbl(merged.pwr.window, 1.0));
+  assert(equal_dbl(merged.pwr.instant, 1.0));
+
+  // bad arguments
+  assert(hb_acc_pow_shard_get_context(&hs, num_shards) == NULL);
+  assert(hb_acc_pow_shard_merge(NULL, &merged));
+  assert(hb_acc_pow_shard_merge(&hs, NULL));
+  assert(heartbeat_acc_pow_shard_init(&hs, 0, window_size, -1, NULL, 0));
+  assert(heartbeat_acc_pow_shard_init(&hs, num_shards, window_size, -1, NULL, HEARTBEAT_FLAG_LOCK_FREE));
+  assert(errno == EINVAL);
+  heartbeat_acc_pow_shard_finish(&hs);
+}
+
+static void test_buffer_padding(void) {
+  heartbeat_pow_shard_context hs;
+  uintptr_t end;
+  uintptr_t next;
+  uint32_t i;
+  // an odd window size, so buffers don't end on a cache line boundary
+  assert(heartbeat_pow_shard_init(&hs, num_shards, 3, -1, NULL, 0) == 0);
+  for (i = 0; i + 1 < num_shards; i++) {
+    end = (uintptr_t) (hb_pow_shard_get_context(&hs, i)->window_buffer + 3) - 1;
+    next = (uintptr_t) hb_pow_shard_get_context(&hs, i + 1)->window_buffer;
+    assert(end / HEARTBEAT_CACHE_LINE_SIZE < next / HEARTBEAT_CACHE_LINE_SIZE);
+  }
+  heartbeat_pow_shard_finish(&hs);
+}
+
+int main(void) {
+  test_hb_shard();
+  test_hb_acc_shard();
+  test_hb_pow_shard();
+  test_hb_acc_pow_shard();
+  test_buffer_padding();
+  return 0;
+}
@@ -0,0 +1,225 @@
+/**
+ * Shared-memory heartbeat tests. hb-acc-pow covers hb, hb-acc, and hb-pow due
+ * to shared code.
+ */
+// force assertions
+#undef NDEBUG
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <heartbeats-simple.h>
+
+static const uint64_t window_size = 4;
+
+/**
+ * Just tests that the functions are all there.
+ */
+static void test_functions_exist(const char* name) {
+  heartbeat_shm_context hs;
+  heartbeat_acc_shm_context hs_acc;
+  heartbeat_pow_shm_context hs_pow;
+  heartbeat_shm_reader reader;
+  heartbeat_record rec;
+  heartbeat_acc_record rec_acc;
+  heartbeat_pow_record rec_pow;
+  heartbeat_acc_pow_record rec_acc_pow;
+  assert(heartbeat_shm_init(&hs, name, window_size, -1, NULL, 0) == 0);
+  heartbeat(hs.hb, 0, 1, 0, 1000);
+  assert(hb_shm_reader_open(&reader, name) == 0);
+  assert(reader.header->mode == HEARTBEAT_BIN_MODE_HB);
+  assert(hb_shm_read(&reader, &rec) == 0);
+  assert(rec.work == 1);
+  // the mode must match
+  errno = 0;
+  assert(hb_acc_shm_read(&reader, &rec_acc));
+  assert(errno == EINVAL);
+  assert(hb_pow_shm_read(&reader, &rec_pow));
+  assert(hb_acc_pow_shm_read(&reader, &rec_acc_pow));
+  assert(hb_shm_reader_close(&reader) == 0);
+  heartbeat_shm_finish(&hs);
+
+  assert(heartbeat_acc_shm_init(&hs_acc, name, window_size, -1, NULL, 0) == 0);
+  heartbeat_acc_shm_finish(&hs_acc);
+  assert(heartbeat_pow_shm_init(&hs_pow, name, window_size, -1, NULL, 0) == 0);
+  heartbeat_pow_shm_finish(&hs_pow);
+}
+
+static void test_bad_arguments(const char* name) {
+  heartbeat_acc_pow_shm_context hs;
+  heartbeat_shm_reader reader;
+  heartbeat_acc_pow_record rec;
+  char long_name[HEARTBEAT_SHM_NAME_MAX + 1];
+  assert(heartbeat_acc_pow_shm_init(NULL, name, window_size, -1, NULL, 0));
+  assert(heartbeat_acc_pow_shm_init(&hs, NULL, window_size, -1, NULL, 0));
+  assert(heartbeat_acc_pow_shm_init(&hs, name, 0, -1, NULL, 0));
+  errno = 0;
+  assert(heartbeat_acc_pow_shm_init(&hs, name, window_size, -1, NULL, 0x80000000));
+  assert(errno == EINVAL);
+  // a failed init doesn't leave a region behind
+  assert(hb_shm_reader_open(&reader, name));
+  assert(errno == ENOENT);
+  memset(long_name, 'a', sizeof(long_name));
+  long_name[0] = '/';
+  long_name[sizeof(long_name) - 1] = '\0';
+  assert(heartbeat_acc_pow_shm_init(&hs, long_name, window_size, -1, NULL, 0));
+  assert(errno == ENAMETOOLONG);
+  assert(hb_shm_reader_open(NULL, name));
+  assert(hb_shm_reader_open(&reader, NULL));
+  assert(hb_shm_reader_close(NULL));
+  assert(hb_acc_pow_shm_read(NULL, &rec));
+  heartbeat_acc_pow_shm_finish(NULL);
+}
+
+/**
+ * Test that readers see the same records as the writer.
+ */
+static void test_read(const char* name, uint32_t flags) {
+  heartbeat_acc_pow_shm_context hs;
+  heartbeat_shm_reader reader;
+  heartbeat_acc_pow_record rec;
+  heartbeat_acc_pow_record expected;
+  uint64_t i;
+  assert(heartbeat_acc_pow_shm_init(&hs, name, window_size, -1, NULL, flags) == 0);
+  assert(hb_shm_reader_open(&reader, name) == 0);
+  assert(reader.header->mode == HEARTBEAT_BIN_MODE_ACC_POW);
+  assert(reader.header->window_size == window_size);
+  assert(reader.header->pid == (int64_t) getpid());
+
+  for (i = 0; i < 3 * window_size + 1; i++) {
+    heartbeat_acc_pow(hs.hb, i, i + 1, i * 1000, (i + 1) * 1000, 2, i * 10, (i + 1) * 10);
+    assert(hb_acc_pow_shm_read(&reader, &rec) == 0);
+    assert(hb_acc_pow_get_snapshot(hs.hb, &expected) == 0);
+    assert(memcmp(&rec, &expected, sizeof(rec)) == 0);
+    assert(rec.id == i);
+    assert(rec.wd.global == (i + 1) * (i + 2) / 2);
+    assert(rec.perf.instant == 1000000.0 * (i + 1));
+  }
+
+  heartbeat_acc_pow_shm_finish(&hs);
+  // the reader keeps its mapping after the region is unlinked
+  assert(hb_acc_pow_shm_read(&reader, &rec) == 0);
+  assert(rec.id == 3 * window_size);
+  assert(hb_shm_reader_close(&reader) == 0);
+  assert(hb_shm_reader_close(&reader));
+  assert(hb_shm_reader_open(&reader, name));
+  assert(errno == ENOENT);
+}
+
+/**
+ * Test that a file that isn't a region is rejected.
+ */
+static void test_not_region(const char* path) {
+  heartbeat_shm_reader reader;
+  FILE* f = fopen(path, "w");
+  assert(f);
+  fprintf(f, "%0*d", (int) sizeof(heartbeat_shm_header), 0);
+  fclose(f);
+  errno = 0;
+  assert(hb_shm_reader_open(&reader, path));
+  assert(errno == EPROTO);
+  f = fopen(path, "w");
+  assert(f);
+  fclose(f);
+  errno = 0;
+  assert(hb_shm_reader_open(&reader, path));
+  assert(errno == EAGAIN);
+  assert(unlink(path) == 0);
+}
+
+/**
+ * Test that a region is only replaced if its writer no longer exists.
+ */
+static void test_replace(const char* name, const char* path) {
+  heartbeat_acc_pow_shm_context hs;
+  heartbeat_acc_pow_shm_context hs2;
+  heartbeat_shm_reader reader;
+  FILE* f;
+  pid_t pid;
+  int status;
+  // a live writer's region is kept
+  assert(heartbeat_acc_pow_shm_init(&hs, name, window_size, -1, NULL, 0) == 0);
+  errno = 0;
+  assert(heartbeat_acc_pow_shm_init(&hs2, name, window_size, -1, NULL, 0));
+  assert(errno == EEXIST);
+  assert(hb_shm_reader_open(&reader, name) == 0);
+  assert(reader.header->pid == (int64_t) getpid());
+  assert(hb_shm_reader_close(&reader) == 0);
+  heartbeat_acc_pow_shm_finish(&hs);
+
+  // a writer that exits without cleaning up leaves a stale region
+  pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    _exit(heartbeat_acc_pow_shm_init(&hs, name, window_size, -1, NULL, 0) != 0);
+  }
+  assert(waitpid(pid, &status, 0) == pid);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  assert(hb_shm_reader_open(&reader, name) == 0);
+  assert(reader.header->pid == (int64_t) pid);
+  assert(hb_shm_reader_close(&reader) == 0);
+  assert(heartbeat_acc_pow_shm_init(&hs, name, window_size, -1, NULL, 0) == 0);
+  assert(hb_shm_reader_open(&reader, name) == 0);
+  assert(reader.header->pid == (int64_t) getpid());
+  assert(hb_shm_reader_close(&reader) == 0);
+  heartbeat_acc_pow_shm_finish(&hs);
+
+  // files that aren't regions are kept
+  f = fopen(path, "w");
+  assert(f);
+  fclose(f);
+  errno = 0;
+  assert(heartbeat_acc_pow_shm_init(&hs, path, window_size, -1, NULL, 0));
+  assert(errno == EEXIST);
+  assert(unlink(path) == 0);
+}
+
+/**
+ * Test that registered regions have unique, discoverable names.
+ */
+static void test_register(void) {
+  heartbeat_acc_pow_shm_context hs1;
+  heartbeat_acc_pow_shm_context hs2;
+  heartbeat_shm_reader reader;
+  char prefix[64];
+  snprintf(prefix, sizeof(prefix), HEARTBEAT_SHM_REGISTRY_PREFIX"%ld-", (long) getpid());
+  assert(heartbeat_acc_pow_shm_register(NULL, window_size, -1, NULL, 0));
+  assert(heartbeat_acc_pow_shm_register(&hs1, window_size, -1, NULL, 0) == 0);
+  assert(heartbeat_acc_pow_shm_register(&hs2, window_size, -1, NULL, 0) == 0);
+  assert(strncmp(hs1.region.name, prefix, strlen(prefix)) == 0);
+  assert(strncmp(hs2.region.name, prefix, strlen(prefix)) == 0);
+  assert(strcmp(hs1.region.name, hs2.region.name) != 0);
+  assert(hb_shm_reader_open(&reader, hs2.region.name) == 0);
+  assert(hb_shm_reader_close(&reader) == 0);
+  heartbeat_acc_pow_shm_finish(&hs1);
+  heartbeat_acc_pow_shm_finish(&hs2);
+}
+
+int main(void) {
+  char shm_name[64];
+  char dir[] = "/tmp/hb-shm-test-XXXXXX";
+  char path[64];
+  snprintf(shm_name, sizeof(shm_name), "/hb-shm-test-%ld", (long) getpid());
+  assert(mkdtemp(dir));
+  snprintf(path, sizeof(path), "%s/region", dir);
+
+  test_functions_exist(shm_name);
+  test_bad_arguments(shm_name);
+  test_read(shm_name, 0);
+  test_read(shm_name, HEARTBEAT_FLAG_LAZY_RATES);
+  test_read(shm_name, HEARTBEAT_FLAG_LOCK_FREE);
+  // memory-mapped files work the same way
+  test_read(path, 0);
+  test_not_region(path);
+  test_replace(shm_name, path);
+  test_register();
+
+  assert(rmdir(dir) == 0);
+  return 0;
+}
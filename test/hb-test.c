@@ -3,10 +3,14 @@
  */
 // force assertions
 #undef NDEBUG
+#define _POSIX_C_SOURCE 1
 #include <assert.h>
+#include <errno.h>
 #include <float.h>
 #include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <heartbeats-simple.h>
 
@@ -25,9 +29,12 @@ static const uint64_t window_size = 20;
  */
 static void test_hb(void) {
   heartbeat_context hb;
+  heartbeat_input input = { 1, 1, 1000000000, 2000000000 };
+  heartbeat_record snapshot;
   heartbeat_record* window_buffer = malloc(window_size * sizeof(heartbeat_record));
   heartbeat_init(&hb, window_size, window_buffer, -1, NULL);
   heartbeat(&hb, 0, 1, 0, 1000000000);
+  heartbeat_batch(&hb, &input, 1);
   hb_log_header(1);
   hb_log_window_buffer(&hb, 1);
 
@@ -41,6 +48,7 @@ static void test_hb(void) {
   hb_get_global_perf(&hb);
   hb_get_window_perf(&hb);
   hb_get_instant_perf(&hb);
+  hb_get_snapshot(&hb, &snapshot);
 
   free(window_buffer);
 }
@@ -50,9 +58,12 @@ static void test_hb(void) {
  */
 static void test_hb_acc(void) {
   heartbeat_acc_context hb;
+  heartbeat_acc_input input = { 1, 1, 1000000000, 2000000000, 1 };
+  heartbeat_acc_record snapshot;
   heartbeat_acc_record* window_buffer = malloc(window_size * sizeof(heartbeat_acc_record));
   heartbeat_acc_init(&hb, window_size, window_buffer, -1, NULL);
   heartbeat_acc(&hb, 0, 1, 0, 1000000000, 1);
+  heartbeat_acc_batch(&hb, &input, 1);
   hb_acc_log_header(1);
   hb_acc_log_window_buffer(&hb, 1);
 
@@ -71,6 +82,7 @@ static void test_hb_acc(void) {
   hb_acc_get_global_accuracy_rate(&hb);
   hb_acc_get_window_accuracy_rate(&hb);
   hb_acc_get_instant_accuracy_rate(&hb);
+  hb_acc_get_snapshot(&hb, &snapshot);
 
   free(window_buffer);
 }
@@ -80,9 +92,12 @@ static void test_hb_acc(void) {
  */
 static void test_hb_pow(void) {
   heartbeat_pow_context hb;
+  heartbeat_pow_input input = { 1, 1, 1000000000, 2000000000, 1000000, 2000000 };
+  heartbeat_pow_record snapshot;
   heartbeat_pow_record* window_buffer = malloc(window_size * sizeof(heartbeat_pow_record));
   heartbeat_pow_init(&hb, window_size, window_buffer, -1, NULL);
   heartbeat_pow(&hb, 0, 1, 0, 1000000000, 0, 1000000);
+  heartbeat_pow_batch(&hb, &input, 1);
   hb_pow_log_header(1);
   hb_pow_log_window_buffer(&hb, 1);
 
@@ -101,6 +116,7 @@ static void test_hb_pow(void) {
   hb_pow_get_global_power(&hb);
   hb_pow_get_window_power(&hb);
   hb_pow_get_instant_power(&hb);
+  hb_pow_get_snapshot(&hb, &snapshot);
 
   free(window_buffer);
 }
@@ -300,11 +316,771 @@ static void test_bad_arguments(void) {
   free(window_buffer);
 }
 
+/**
+ * Test that lock-free ingestion produces the same records as locked ingestion
+ */
+static void test_lock_free(void) {
+  uint64_t ws = 4;
+  uint64_t i;
+  heartbeat_acc_pow_context hb;
+  heartbeat_acc_pow_context hb_lf;
+  heartbeat_acc_pow_record* window_buffer = malloc(ws * sizeof(heartbeat_acc_pow_record));
+  heartbeat_acc_pow_record* window_buffer_lf = malloc(ws * sizeof(heartbeat_acc_pow_record));
+  assert(window_buffer);
+  assert(window_buffer_lf);
+  assert(heartbeat_acc_pow_init(&hb, ws, window_buffer, -1, NULL) == 0);
+  assert(heartbeat_acc_pow_init_flags(&hb_lf, ws, window_buffer_lf, -1, &callback, HEARTBEAT_FLAG_LOCK_FREE) == 0);
+  received_cb = 0;
+
+  // cross two window boundaries
+  for (i = 0; i < 2 * ws + 1; i++) {
+    heartbeat_acc_pow(&hb, i, i + 1, i * 1000, (i + 1) * 1000, 2, i * 10, (i + 1) * 10);
+    heartbeat_acc_pow(&hb_lf, i, i + 1, i * 1000, (i + 1) * 1000, 2, i * 10, (i + 1) * 10);
+  }
+  assert(received_cb == 2);
+  assert(hb_lf.ws.buffer_index == 1);
+  assert(memcmp(window_buffer, window_buffer_lf, ws * sizeof(heartbeat_acc_pow_record)) == 0);
+  assert(hb_acc_pow_get_user_tag(&hb_lf) == 2 * ws);
+  assert(hb_acc_pow_get_global_work(&hb_lf) == hb_acc_pow_get_global_work(&hb));
+  assert(hb_acc_pow_get_window_work(&hb_lf) == hb_acc_pow_get_window_work(&hb));
+  assert(hb_acc_pow_get_window_energy(&hb_lf) == hb_acc_pow_get_window_energy(&hb));
+  assert(equal_dbl(hb_acc_pow_get_window_perf(&hb_lf), hb_acc_pow_get_window_perf(&hb)));
+
+  // unknown flags
+  assert(heartbeat_acc_pow_init_flags(&hb_lf, ws, window_buffer_lf, -1, NULL, 0x80000000));
+
+  free(window_buffer_lf);
+  free(window_buffer);
+}
+
+/**
+ * Test that a snapshot matches the getters
+ */
+static void test_snapshot(void) {
+  uint64_t ws = 2;
+  uint64_t i;
+  heartbeat_acc_pow_context hb;
+  heartbeat_acc_pow_record snapshot;
+  heartbeat_acc_pow_record* window_buffer = malloc(ws * sizeof(heartbeat_acc_pow_record));
+  assert(window_buffer);
+  assert(heartbeat_acc_pow_init(&hb, ws, window_buffer, -1, NULL) == 0);
+  for (i = 0; i < 3; i++) {
+    heartbeat_acc_pow(&hb, i + 10, 2, i * 1000000000, (i + 1) * 1000000000, 1, i * 1000000, (i + 1) * 1000000);
+    assert(hb_acc_pow_get_snapshot(&hb, &snapshot) == 0);
+    assert(snapshot.id == i);
+    assert(snapshot.user_tag == hb_acc_pow_get_user_tag(&hb));
+    assert(snapshot.td.global == hb_acc_pow_get_global_time(&hb));
+    assert(snapshot.td.window == hb_acc_pow_get_window_time(&hb));
+    assert(snapshot.wd.global == hb_acc_pow_get_global_work(&hb));
+    assert(snapshot.wd.window == hb_acc_pow_get_window_work(&hb));
+    assert(equal_dbl(snapshot.perf.global, hb_acc_pow_get_global_perf(&hb)));
+    assert(equal_dbl(snapshot.perf.window, hb_acc_pow_get_window_perf(&hb)));
+    assert(equal_dbl(snapshot.perf.instant, hb_acc_pow_get_instant_perf(&hb)));
+    assert(snapshot.ad.global == hb_acc_pow_get_global_accuracy(&hb));
+    assert(equal_dbl(snapshot.acc.instant, hb_acc_pow_get_instant_accuracy_rate(&hb)));
+    assert(snapshot.ed.window == hb_acc_pow_get_window_energy(&hb));
+    assert(equal_dbl(snapshot.pwr.instant, hb_acc_pow_get_instant_power(&hb)));
+  }
+  assert(hb.seq_begin == hb.seq_end);
+
+  // bad arguments
+  assert(hb_acc_pow_get_snapshot(NULL, &snapshot));
+  assert(hb_acc_pow_get_snapshot(&hb, NULL));
+
+  free(window_buffer);
+}
+
+/**
+ * Test that a batch produces the same records as individual heartbeats,
+ * including when it crosses window boundaries
+ */
+static void test_batch(void) {
+  uint64_t ws = 3;
+  uint64_t i;
+  heartbeat_acc_pow_input inputs[8];
+  heartbeat_acc_pow_context hb;
+  heartbeat_acc_pow_context hb_batch;
+  heartbeat_acc_pow_record* window_buffer = malloc(ws * sizeof(heartbeat_acc_pow_record));
+  heartbeat_acc_pow_record* window_buffer_batch = malloc(ws * sizeof(heartbeat_acc_pow_record));
+  assert(window_buffer);
+  assert(window_buffer_batch);
+  assert(heartbeat_acc_pow_init(&hb, ws, window_buffer, -1, NULL) == 0);
+  assert(heartbeat_acc_pow_init(&hb_batch, ws, window_buffer_batch, -1, &callback) == 0);
+  received_cb = 0;
+
+  for (i = 0; i < 8; i++) {
+    inputs[i].user_tag = i;
+    inputs[i].work = i + 1;
+    inputs[i].start_time = i * 1000;
+    inputs[i].end_time = (i + 1) * 1000;
+    inputs[i].accuracy = 2;
+    inputs[i].start_energy = i * 10;
+    inputs[i].end_energy = (i + 1) * 10;
+    heartbeat_acc_pow(&hb, inputs[i].user_tag, inputs[i].work, inputs[i].start_time, inputs[i].end_time,
+                      inputs[i].accuracy, inputs[i].start_energy, inputs[i].end_energy);
+  }
+  heartbeat_acc_pow_batch(&hb_batch, inputs, 8);
+  assert(received_cb == 2);
+  assert(hb_batch.counter == 8);
+  assert(hb_batch.ws.buffer_index == 2);
+  assert(memcmp(window_buffer, window_buffer_batch, ws * sizeof(heartbeat_acc_pow_record)) == 0);
+  assert(hb_acc_pow_get_global_work(&hb_batch) == hb_acc_pow_get_global_work(&hb));
+  assert(hb_acc_pow_get_window_energy(&hb_batch) == hb_acc_pow_get_window_energy(&hb));
+
+  // lock-free batches reserve all of their slots at once
+  assert(heartbeat_acc_pow_init_flags(&hb_batch, ws, window_buffer_batch, -1, NULL, HEARTBEAT_FLAG_LOCK_FREE) == 0);
+  heartbeat_acc_pow_batch(&hb_batch, inputs, 8);
+  assert(hb_batch.counter == 8);
+  assert(memcmp(window_buffer, window_buffer_batch, ws * sizeof(heartbeat_acc_pow_record)) == 0);
+
+  // empty and bad batches
+  heartbeat_acc_pow_batch(&hb_batch, NULL, 0);
+  assert(hb_batch.counter == 8);
+  errno = 0;
+  heartbeat_acc_pow_batch(&hb_batch, NULL, 1);
+  assert(errno == EINVAL);
+  errno = 0;
+  heartbeat_acc_pow_batch(NULL, inputs, 1);
+  assert(errno == EINVAL);
+
+  free(window_buffer_batch);
+  free(window_buffer);
+}
+
+static double lazy_cb_perf = 0;
+static void lazy_callback(const heartbeat_acc_pow_context* hb) {
+  lazy_cb_perf = hb->window_buffer[0].perf.instant;
+}
+
+/**
+ * Test that lazy rates match eagerly computed rates
+ */
+static void test_lazy_rates(void) {
+  uint64_t ws = 4;
+  uint64_t i;
+  heartbeat_acc_pow_context hb;
+  heartbeat_acc_pow_context hb_lazy;
+  heartbeat_acc_pow_record snapshot;
+  heartbeat_acc_pow_record snapshot_lazy;
+  heartbeat_acc_pow_record* window_buffer = malloc(ws * sizeof(heartbeat_acc_pow_record));
+  heartbeat_acc_pow_record* window_buffer_lazy = malloc(ws * sizeof(heartbeat_acc_pow_record));
+  assert(window_buffer);
+  assert(window_buffer_lazy);
+  assert(heartbeat_acc_pow_init(&hb, ws, window_buffer, -1, NULL) == 0);
+  assert(heartbeat_acc_pow_init_flags(&hb_lazy, ws, window_buffer_lazy, -1, &lazy_callback,
+                                      HEARTBEAT_FLAG_LAZY_RATES) == 0);
+
+  for (i = 0; i < ws + 1; i++) {
+    heartbeat_acc_pow(&hb, i, i + 1, i * 1000, (i + 2) * 1000, 2, i * 10, (i + 3) * 10);
+    heartbeat_acc_pow(&hb_lazy, i, i + 1, i * 1000, (i + 2) * 1000, 2, i * 10, (i + 3) * 10);
+  }
+  // rates were computed for the callback: 1 work in 2 us
+  assert(equal_dbl(lazy_cb_perf, 500000.0));
+
+  assert(equal_dbl(hb_acc_pow_get_global_perf(&hb_lazy), hb_acc_pow_get_global_perf(&hb)));
+  assert(equal_dbl(hb_acc_pow_get_window_perf(&hb_lazy), hb_acc_pow_get_window_perf(&hb)));
+  assert(equal_dbl(hb_acc_pow_get_instant_perf(&hb_lazy), hb_acc_pow_get_instant_perf(&hb)));
+  assert(equal_dbl(hb_acc_pow_get_global_accuracy_rate(&hb_lazy), hb_acc_pow_get_global_accuracy_rate(&hb)));
+  assert(equal_dbl(hb_acc_pow_get_window_accuracy_rate(&hb_lazy), hb_acc_pow_get_window_accuracy_rate(&hb)));
+  assert(equal_dbl(hb_acc_pow_get_instant_accuracy_rate(&hb_lazy), hb_acc_pow_get_instant_accuracy_rate(&hb)));
+  assert(equal_dbl(hb_acc_pow_get_global_power(&hb_lazy), hb_acc_pow_get_global_power(&hb)));
+  assert(equal_dbl(hb_acc_pow_get_window_power(&hb_lazy), hb_acc_pow_get_window_power(&hb)));
+  assert(equal_dbl(hb_acc_pow_get_instant_power(&hb_lazy), hb_acc_pow_get_instant_power(&hb)));
+  assert(hb_acc_pow_get_snapshot(&hb, &snapshot) == 0);
+  assert(hb_acc_pow_get_snapshot(&hb_lazy, &snapshot_lazy) == 0);
+  assert(memcmp(&snapshot, &snapshot_lazy, sizeof(snapshot)) == 0);
+
+  free(window_buffer_lazy);
+  free(window_buffer);
+}
+
+static void read_file(FILE* f, char* buf, size_t len) {
+  size_t n;
+  fflush(f);
+  rewind(f);
+  n = fread(buf, 1, len - 1, f);
+  buf[n] = '\0';
+}
+
+/**
+ * Test that asynchronous logging writes the same data as synchronous logging
+ */
+static void test_async_log(void) {
+#if !defined(_WIN32)
+  uint64_t ws = 2;
+  uint64_t i;
+  char buf[8192];
+  char buf_async[8192];
+  heartbeat_async_log_stats stats;
+  heartbeat_acc_pow_context hb;
+  heartbeat_acc_pow_context hb_async;
+  heartbeat_acc_pow_record* window_buffer = malloc(ws * sizeof(heartbeat_acc_pow_record));
+  heartbeat_acc_pow_record* window_buffer_async = malloc(ws * sizeof(heartbeat_acc_pow_record));
+  FILE* log = tmpfile();
+  FILE* log_async = tmpfile();
+  assert(window_buffer);
+  assert(window_buffer_async);
+  assert(log);
+  assert(log_async);
+  assert(heartbeat_acc_pow_init(&hb, ws, window_buffer, fileno(log), NULL) == 0);
+  assert(heartbeat_acc_pow_init(&hb_async, ws, window_buffer_async, fileno(log_async), NULL) == 0);
+  assert(hb_acc_pow_async_log_get_stats(&hb_async, &stats));
+  assert(hb_acc_pow_async_log_init(&hb_async, 0));
+  assert(hb_acc_pow_async_log_init(&hb_async, 1) == 0);
+  assert(hb_acc_pow_async_log_init(&hb_async, 1));
+
+  for (i = 0; i < 5 * ws + 1; i++) {
+    heartbeat_acc_pow(&hb, i, i + 1, i * 1000, (i + 1) * 1000, 2, i * 10, (i + 1) * 10);
+    heartbeat_acc_pow(&hb_async, i, i + 1, i * 1000, (i + 1) * 1000, 2, i * 10, (i + 1) * 10);
+  }
+  assert(hb_acc_pow_async_log_get_stats(&hb_async, &stats) == 0);
+  assert(stats.windows_queued == 5);
+  assert(stats.queue_len == 1);
+  assert(stats.max_depth == 1);
+  assert(hb_acc_pow_async_log_finish(&hb_async) == 0);
+  assert(hb_acc_pow_async_log_finish(&hb_async));
+  // the remaining data is logged after the queue
+  assert(hb_acc_pow_ctx_log_window_buffer(&hb) == 0);
+  assert(hb_acc_pow_ctx_log_window_buffer(&hb_async) == 0);
+
+  read_file(log, buf, sizeof(buf));
+  read_file(log_async, buf_async, sizeof(buf_async));
+  assert(strlen(buf) > 0);
+  assert(strcmp(buf, buf_async) == 0);
+
+  fclose(log_async);
+  fclose(log);
+  free(window_buffer_async);
+  free(window_buffer);
+#endif
+}
+
+/**
+ * Test that the binary log contains a header and the raw records of each window
+ */
+static void test_bin_log(void) {
+#if !defined(_WIN32)
+  uint64_t ws = 2;
+  uint64_t i;
+  heartbeat_bin_header header;
+  heartbeat_acc_pow_record records[5];
+  heartbeat_acc_pow_context hb;
+  heartbeat_acc_pow_record* window_buffer = malloc(ws * sizeof(heartbeat_acc_pow_record));
+  FILE* log = tmpfile();
+  assert(window_buffer);
+  assert(log);
+  assert(heartbeat_acc_pow_init_flags(&hb, ws, window_buffer, fileno(log), NULL,
+                                      HEARTBEAT_FLAG_LOG_BINARY | HEARTBEAT_FLAG_LAZY_RATES) == 0);
+  assert(hb_acc_pow_ctx_log_header(&hb) == 0);
+  for (i = 0; i < 2 * ws + 1; i++) {
+    heartbeat_acc_pow(&hb, i, i + 1, i * 1000, (i + 1) * 1000, 2, i * 10, (i + 1) * 10);
+  }
+  assert(hb_acc_pow_ctx_log_window_buffer(&hb) == 0);
+
+  fflush(log);
+  rewind(log);
+  assert(fread(&header, sizeof(header), 1, log) == 1);
+  assert(memcmp(header.magic, HEARTBEAT_BIN_MAGIC, sizeof(header.magic)) == 0);
+  assert(header.byte_order == HEARTBEAT_BIN_BYTE_ORDER);
+  assert(header.version == HEARTBEAT_BIN_VERSION);
+  assert(header.mode == HEARTBEAT_BIN_MODE_ACC_POW);
+  assert(header.flags == HEARTBEAT_FLAG_LAZY_RATES);
+  assert(header.record_size == sizeof(heartbeat_acc_pow_record));
+  assert(header.window_size == ws);
+  assert(fread(records, sizeof(heartbeat_acc_pow_record), 5, log) == 5);
+  assert(fgetc(log) == EOF);
+  for (i = 0; i < 5; i++) {
+    assert(records[i].id == i);
+    assert(records[i].user_tag == i);
+    assert(records[i].start_energy == i * 10);
+  }
+  // the last record is still in the window buffer
+  assert(memcmp(&records[4], &window_buffer[0], sizeof(heartbeat_acc_pow_record)) == 0);
+
+  fclose(log);
+  free(window_buffer);
+#endif
+}
+
+/**
+ * Test that logged values are formatted like printf, including values that
+ * are near rounding ties or out of the usual range
+ */
+static void test_log_format(void) {
+#if !defined(_WIN32)
+  const double values[] = {
+    0.0, 1.0, 0.5, 0.0000005, 0.0000015, 0.0000025, 1.2345675, 2.5e-7, 999999.9999995, 123456789.123456789,
+    4503599627.3704995, 9007199254.740993, 1e15, 1e300, DBL_MAX, DBL_MIN, -0.0, -1.5, 1.0 / 3.0, 2.0 / 3.0
+  };
+  const size_t n = sizeof(values) / sizeof(values[0]);
+  char buf[16384];
+  char expected[16384];
+  size_t len = 0;
+  size_t i;
+  heartbeat_pow_context hb;
+  heartbeat_pow_record* window_buffer = calloc(n, sizeof(heartbeat_pow_record));
+  FILE* log = tmpfile();
+  assert(window_buffer);
+  assert(log);
+  // init clears the window buffer
+  assert(heartbeat_pow_init(&hb, n, window_buffer, fileno(log), NULL) == 0);
+  for (i = 0; i < n; i++) {
+    window_buffer[i].id = i;
+    window_buffer[i].user_tag = UINT64_MAX - i;
+    window_buffer[i].start_time = (uint64_t) 1 << (i * 3);
+    window_buffer[i].perf.global = values[i];
+    window_buffer[i].perf.window = values[n - i - 1];
+    window_buffer[i].perf.instant = values[i] / 7.0;
+    window_buffer[i].pwr.global = values[i] * 1000.0;
+    len += (size_t) snprintf(expected + len, sizeof(expected) - len,
+                             "%-6"PRIu64" %-6"PRIu64
+                             " %-11"PRIu64" %-11"PRIu64" %-11"PRIu64
+                             " %-15"PRIu64" %-15"PRIu64" %-20"PRIu64" %-20"PRIu64
+                             " %-15.6f %-15.6f %-15.6f"
+                             " %-15"PRIu64" %-15"PRIu64" %-15"PRIu64" %-15"PRIu64
+                             " %-15.6f %-15.6f %-15.6f"
+                             "\n",
+                             window_buffer[i].id, window_buffer[i].user_tag,
+                             (uint64_t) 0, (uint64_t) 0, (uint64_t) 0,
+                             (uint64_t) 0, (uint64_t) 0, window_buffer[i].start_time, (uint64_t) 0,
+                             window_buffer[i].perf.global, window_buffer[i].perf.window, window_buffer[i].perf.instant,
+                             (uint64_t) 0, (uint64_t) 0, (uint64_t) 0, (uint64_t) 0,
+                             window_buffer[i].pwr.global, 0.0, 0.0);
+    assert(len < sizeof(expected));
+  }
+  hb.ws.buffer_index = n;
+  assert(hb_pow_ctx_log_window_buffer(&hb) == 0);
+  read_file(log, buf, sizeof(buf));
+  assert(strcmp(buf, expected) == 0);
+
+  fclose(log);
+  free(window_buffer);
+#endif
+}
+
+/**
+ * Test CSV and JSON Lines logs with a subset of columns
+ */
+static void test_log_projection(void) {
+#if !defined(_WIN32)
+  const uint32_t columns = HEARTBEAT_LOG_COL_ID | HEARTBEAT_LOG_COL_END_TIME | HEARTBEAT_LOG_COL_INSTANT_PERF |
+                           HEARTBEAT_LOG_COL_INSTANT_PWR;
+  char buf[1024];
+  heartbeat_pow_context hb;
+  heartbeat_pow_record window_buffer[2];
+  FILE* log = tmpfile();
+  FILE* log_json = tmpfile();
+  FILE* log_other = tmpfile();
+  assert(log);
+  assert(log_json);
+  assert(log_other);
+
+  assert(heartbeat_pow_init(&hb, 2, window_buffer, fileno(log), NULL) == 0);
+  assert(hb_pow_set_log_format(&hb, HEARTBEAT_LOG_FORMAT_CSV, columns) == 0);
+  assert(hb_pow_ctx_log_header(&hb) == 0);
+  heartbeat_pow(&hb, 7, 1, 1000000000, 2000000000, 0, 2000000);
+  heartbeat_pow(&hb, 8, 1, 2000000000, 2500000000, 2000000, 3000000);
+  read_file(log, buf, sizeof(buf));
+  assert(strcmp(buf, "HB,End_Time,Instant_Perf,Instant_Pwr\n"
+                     "0,2000000000,1.000000,2.000000\n"
+                     "1,2500000000,2.000000,2.000000\n") == 0);
+
+  assert(heartbeat_pow_init(&hb, 2, window_buffer, fileno(log_json), NULL) == 0);
+  assert(hb_pow_set_log_format(&hb, HEARTBEAT_LOG_FORMAT_JSONL, HEARTBEAT_LOG_COL_ID | HEARTBEAT_LOG_COL_TAG |
+                                                                HEARTBEAT_LOG_COL_INSTANT_PERF) == 0);
+  assert(hb_pow_ctx_log_header(&hb) == 0);
+  // no time elapsed, so the rate isn't finite
+  heartbeat_pow(&hb, 7, 1, 1000, 1000, 0, 0);
+  assert(hb_pow_ctx_log_window_buffer(&hb) == 0);
+  read_file(log_json, buf, sizeof(buf));
+  assert(strcmp(buf, "{\"HB\":0,\"Tag\":7,\"Instant_Perf\":null}\n") == 0);
+
+  // a header that matches the records logged to another file
+  assert(hb_pow_set_log_format(&hb, HEARTBEAT_LOG_FORMAT_CSV, columns) == 0);
+  assert(hb_pow_log_header_format(fileno(log_other), HEARTBEAT_LOG_FORMAT_CSV, columns) == 0);
+  assert(hb_pow_log_window_buffer(&hb, fileno(log_other)) == 0);
+  assert(hb_pow_log_header_format(fileno(log_other), HEARTBEAT_LOG_FORMAT_JSONL, 0) == 0);
+  read_file(log_other, buf, sizeof(buf));
+  // the rates aren't finite, and their text depends on the platform
+  assert(strncmp(buf, "HB,End_Time,Instant_Perf,Instant_Pwr\n0,1000,", 44) == 0);
+  assert(strchr(buf + 44, '\n') == buf + strlen(buf) - 1);
+
+  errno = 0;
+  assert(hb_pow_set_log_format(&hb, HEARTBEAT_LOG_FORMAT_JSONL + 1, 0) != 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(hb_pow_set_log_format(&hb, HEARTBEAT_LOG_FORMAT_CSV, HEARTBEAT_LOG_COL_ACC) != 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(hb_pow_set_log_format(NULL, HEARTBEAT_LOG_FORMAT_CSV, 0) != 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(hb_pow_log_header_format(fileno(log_other), HEARTBEAT_LOG_FORMAT_JSONL + 1, 0) != 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(hb_pow_log_header_format(fileno(log_other), HEARTBEAT_LOG_FORMAT_CSV, HEARTBEAT_LOG_COL_ACC) != 0);
+  assert(errno == EINVAL);
+
+  fclose(log_other);
+  fclose(log_json);
+  fclose(log);
+#endif
+}
+
+/**
+ * Test that compressed logs decode to the same records as raw binary logs
+ */
+static void test_compressed_log(void) {
+#if !defined(_WIN32)
+  uint64_t ws = 3;
+  uint64_t n = 3 * ws + 2;
+  uint64_t i;
+  uint64_t count;
+  uint64_t total = 0;
+  size_t len;
+  size_t block_len;
+  size_t pos;
+  heartbeat_bin_header header;
+  heartbeat_acc_pow_record raw[16];
+  heartbeat_acc_pow_record decoded[16];
+  unsigned char data[4096];
+  heartbeat_acc_pow_context hb;
+  heartbeat_acc_pow_context hb_raw;
+  heartbeat_acc_pow_record* window_buffer = malloc(ws * sizeof(heartbeat_acc_pow_record));
+  heartbeat_acc_pow_record* window_buffer_raw = malloc(ws * sizeof(heartbeat_acc_pow_record));
+  FILE* log = tmpfile();
+  FILE* log_raw = tmpfile();
+  assert(window_buffer);
+  assert(window_buffer_raw);
+  assert(log);
+  assert(log_raw);
+  errno = 0;
+  assert(heartbeat_acc_pow_init_flags(&hb, ws, window_buffer, fileno(log), NULL, HEARTBEAT_FLAG_LOG_COMPRESSED) != 0);
+  assert(errno == EINVAL);
+  assert(heartbeat_acc_pow_init_flags(&hb, ws, window_buffer, fileno(log), NULL,
+                                      HEARTBEAT_FLAG_LOG_BINARY | HEARTBEAT_FLAG_LOG_COMPRESSED) == 0);
+  assert(heartbeat_acc_pow_init_flags(&hb_raw, ws, window_buffer_raw, fileno(log_raw), NULL,
+                                      HEARTBEAT_FLAG_LOG_BINARY) == 0);
+  assert(hb_acc_pow_ctx_log_header(&hb) == 0);
+  for (i = 0; i < n; i++) {
+    // irregular values, including a large jump in time and energy
+    heartbeat_acc_pow(&hb, i * 3, i % 4, 1000 + i * 997 + (i == 5 ? UINT32_MAX : 0), 1000 + (i + 1) * 997, i,
+                      i * 50000, i * 50000 + (i * 7919) % 1000);
+    heartbeat_acc_pow(&hb_raw, i * 3, i % 4, 1000 + i * 997 + (i == 5 ? UINT32_MAX : 0), 1000 + (i + 1) * 997, i,
+                      i * 50000, i * 50000 + (i * 7919) % 1000);
+  }
+  assert(hb_acc_pow_ctx_log_window_buffer(&hb) == 0);
+  assert(hb_acc_pow_ctx_log_window_buffer(&hb_raw) == 0);
+
+  fflush(log_raw);
+  rewind(log_raw);
+  assert(fread(raw, sizeof(heartbeat_acc_pow_record), n, log_raw) == n);
+  fflush(log);
+  rewind(log);
+  assert(fread(&header, sizeof(header), 1, log) == 1);
+  assert(header.flags == HEARTBEAT_FLAG_LOG_COMPRESSED);
+  len = fread(data, 1, sizeof(data), log);
+  assert(len > 0 && len < n * sizeof(heartbeat_acc_pow_record) / 4);
+  for (pos = 0; pos < len; pos += block_len) {
+    // a partial block needs more data
+    errno = 0;
+    assert(hb_acc_pow_log_decode_block(data + pos, 1, decoded, 16, &count, &block_len) != 0);
+    assert(errno == EAGAIN);
+    assert(hb_acc_pow_log_decode_block(data + pos, len - pos, decoded + total, 16 - total, &count, &block_len) == 0);
+    assert(count <= ws);
+    total += count;
+  }
+  assert(total == n);
+  assert(memcmp(raw, decoded, n * sizeof(heartbeat_acc_pow_record)) == 0);
+
+  errno = 0;
+  assert(hb_acc_pow_log_decode_block(data, len, decoded, 1, &count, &block_len) != 0);
+  assert(errno == ENOBUFS);
+  errno = 0;
+  assert(hb_acc_pow_log_encode_block(raw, n, data, HEARTBEAT_LOG_BLOCK_MAX(n, sizeof(raw[0])) - 1, &len) != 0);
+  assert(errno == EINVAL);
+
+  fclose(log_raw);
+  fclose(log);
+  free(window_buffer_raw);
+  free(window_buffer);
+#endif
+}
+
+/**
+ * Test that columns match the window buffer, including with lazy rates
+ */
+static void test_columns(void) {
+  uint64_t ws = 4;
+  uint64_t i;
+  heartbeat_acc_pow_container hc;
+  heartbeat_acc_pow_container hc_lazy;
+  heartbeat_acc_pow_columns bad;
+  const heartbeat_acc_pow_record* rec;
+
+  assert(heartbeat_acc_pow_container_init_columns(&hc, ws, -1, NULL) == 0);
+  assert(heartbeat_acc_pow_container_init(&hc_lazy, ws) == 0);
+  assert(heartbeat_acc_pow_init_flags(&hc_lazy.hb, ws, hc_lazy.window_buffer, -1, &lazy_callback,
+                                      HEARTBEAT_FLAG_LAZY_RATES) == 0);
+  memset(&bad, 0, sizeof(bad));
+  errno = 0;
+  assert(hb_acc_pow_set_columns(&hc.hb, &bad) != 0);
+  assert(errno == EINVAL);
+  assert(hb_acc_pow_set_columns(NULL, NULL) != 0);
+
+  for (i = 0; i < ws + 2; i++) {
+    heartbeat_acc_pow(&hc.hb, i, i + 1, i * 1000, (i + 2) * 1000, 3, i * 10, (i + 3) * 10);
+  }
+  for (i = 0; i < ws; i++) {
+    rec = &hc.window_buffer[i];
+    assert(hc.columns.id[i] == rec->id);
+    assert(hc.columns.user_tag[i] == rec->user_tag);
+    assert(hc.columns.work[i] == rec->work);
+    assert(hc.columns.start_time[i] == rec->start_time);
+    assert(hc.columns.end_time[i] == rec->end_time);
+    assert(hc.columns.accuracy[i] == rec->accuracy);
+    assert(hc.columns.start_energy[i] == rec->start_energy);
+    assert(hc.columns.end_energy[i] == rec->end_energy);
+    assert(equal_dbl(hc.columns.perf_instant[i], rec->perf.instant));
+    assert(equal_dbl(hc.columns.acc_instant[i], rec->acc.instant));
+    assert(equal_dbl(hc.columns.pwr_instant[i], rec->pwr.instant));
+  }
+
+  // lazy instant rates are computed for the columns when the window completes; reuse hc's columns
+  assert(hb_acc_pow_set_columns(&hc_lazy.hb, &hc_lazy.columns) != 0);
+  hc_lazy.columns = hc.columns;
+  memset(&hc.columns, 0, sizeof(hc.columns));
+  assert(hb_acc_pow_set_columns(&hc.hb, NULL) == 0);
+  assert(hb_acc_pow_set_columns(&hc_lazy.hb, &hc_lazy.columns) == 0);
+  for (i = 0; i < ws; i++) {
+    hc_lazy.columns.perf_instant[i] = -1.0;
+  }
+  for (i = 0; i < ws - 1; i++) {
+    heartbeat_acc_pow(&hc_lazy.hb, i, i + 1, i * 1000, (i + 2) * 1000, 3, i * 10, (i + 3) * 10);
+    assert(hc_lazy.columns.work[i] == i + 1);
+    assert(equal_dbl(hc_lazy.columns.perf_instant[i], -1.0));
+  }
+  // getters compute lazy rates from the records until then
+  assert(equal_dbl(hb_acc_pow_get_instant_perf(&hc_lazy.hb), (double) (ws - 1) * 500000.0));
+  assert(equal_dbl(hb_acc_pow_get_instant_accuracy_rate(&hc_lazy.hb), 1500000.0));
+  assert(equal_dbl(hb_acc_pow_get_instant_power(&hc_lazy.hb), 15.0));
+  heartbeat_acc_pow(&hc_lazy.hb, ws - 1, ws, (ws - 1) * 1000, (ws + 1) * 1000, 3, (ws - 1) * 10, (ws + 2) * 10);
+  for (i = 0; i < ws; i++) {
+    // i + 1 work, 3 accuracy, and 30 uJ in 2 us
+    assert(equal_dbl(hc_lazy.columns.perf_instant[i], (double) (i + 1) * 500000.0));
+    assert(equal_dbl(hc_lazy.columns.acc_instant[i], 1500000.0));
+    assert(equal_dbl(hc_lazy.columns.pwr_instant[i], 15.0));
+  }
+  assert(equal_dbl(lazy_cb_perf, 500000.0));
+
+  heartbeat_acc_pow_container_finish(&hc_lazy);
+  heartbeat_acc_pow_container_finish(&hc);
+  assert(hc_lazy.columns.id == NULL);
+}
+
+static int compare_dbl(const void* a, const void* b) {
+  double x = *(const double*) a;
+  double y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Test window statistics against a simple computation, from records and from columns
+ */
+static void test_window_stats(void) {
+  uint64_t ws = 37;
+  uint64_t i;
+  double sum = 0;
+  double sq_dev = 0;
+  double mean;
+  double sorted[37];
+  double scratch[37];
+  heartbeat_acc_pow_container hc;
+  heartbeat_acc_pow_container hc_cols;
+  heartbeat_window_stats stats;
+  heartbeat_window_stats cols_stats;
+
+  assert(heartbeat_acc_pow_container_init(&hc, ws) == 0);
+  assert(heartbeat_acc_pow_init_flags(&hc.hb, ws, hc.window_buffer, -1, NULL, HEARTBEAT_FLAG_LAZY_RATES) == 0);
+  assert(heartbeat_acc_pow_container_init_columns(&hc_cols, ws, -1, NULL) == 0);
+  assert(hb_acc_pow_get_window_perf_stats(&hc.hb, &stats, scratch) == 0);
+  assert(stats.count == 0);
+  assert(hb_acc_pow_get_window_perf_stats(&hc_cols.hb, &stats, scratch) == 0);
+  assert(stats.count == 0);
+  errno = 0;
+  assert(hb_acc_pow_get_window_perf_stats(&hc.hb, NULL, scratch) != 0);
+  assert(errno == EINVAL);
+  assert(hb_acc_pow_get_window_power_stats(NULL, &stats, scratch) != 0);
+
+  // a partial window, including a heartbeat over no time
+  heartbeat_acc_pow(&hc.hb, 0, 1, 0, 0, 1, 0, 0);
+  heartbeat_acc_pow(&hc_cols.hb, 0, 1, 0, 0, 1, 0, 0);
+  for (i = 1; i < 10; i++) {
+    heartbeat_acc_pow(&hc.hb, i, i, i * 1000, (i + 1) * 1000, 2, 0, 5);
+    heartbeat_acc_pow(&hc_cols.hb, i, i, i * 1000, (i + 1) * 1000, 2, 0, 5);
+  }
+  assert(hb_acc_pow_get_window_perf_stats(&hc.hb, &stats, scratch) == 0);
+  assert(stats.count == 9);
+  assert(equal_dbl(stats.min, 1000000.0));
+  assert(equal_dbl(stats.max, 9000000.0));
+  assert(equal_dbl(stats.mean, 5000000.0));
+  assert(equal_dbl(stats.p50, 5000000.0));
+  assert(equal_dbl(stats.p90, 9000000.0));
+  assert(hb_acc_pow_get_window_perf_stats(&hc_cols.hb, &cols_stats, scratch) == 0);
+  assert(memcmp(&stats, &cols_stats, sizeof(stats)) == 0);
+  // without scratch, there are no percentiles
+  assert(hb_acc_pow_get_window_perf_stats(&hc.hb, &stats, NULL) == 0);
+  assert(stats.count == 9);
+  assert(equal_dbl(stats.mean, 5000000.0));
+  assert(stats.p50 == 0);
+  assert(hb_acc_pow_get_window_perf_stats(&hc_cols.hb, &cols_stats, NULL) == 0);
+  assert(memcmp(&stats, &cols_stats, sizeof(stats)) == 0);
+  assert(hb_acc_pow_get_window_accuracy_rate_stats(&hc.hb, &stats, scratch) == 0);
+  assert(equal_dbl(stats.min, 2000000.0));
+  assert(equal_dbl(stats.variance, 0.0));
+  assert(hb_acc_pow_get_window_accuracy_rate_stats(&hc_cols.hb, &stats, scratch) == 0);
+  assert(equal_dbl(stats.min, 2000000.0));
+  assert(hb_acc_pow_get_window_power_stats(&hc.hb, &stats, scratch) == 0);
+  assert(equal_dbl(stats.max, 5.0));
+  assert(hb_acc_pow_get_window_power_stats(&hc_cols.hb, &stats, scratch) == 0);
+  assert(equal_dbl(stats.max, 5.0));
+
+  // wrap the window with an uneven number of records for the vector kernels
+  for (i = 10; i < 2 * ws + 3; i++) {
+    heartbeat_acc_pow(&hc.hb, i, (i * 7919) % 101, i * 1000, (i + 1) * 1000, 2, 0, 5);
+    heartbeat_acc_pow(&hc_cols.hb, i, (i * 7919) % 101, i * 1000, (i + 1) * 1000, 2, 0, 5);
+  }
+  for (i = 0; i < ws; i++) {
+    sorted[i] = hc.window_buffer[i].work * 1000000.0;
+    sum += sorted[i];
+  }
+  mean = sum / (double) ws;
+  for (i = 0; i < ws; i++) {
+    sq_dev += (sorted[i] - mean) * (sorted[i] - mean);
+  }
+  qsort(sorted, ws, sizeof(double), &compare_dbl);
+  assert(hb_acc_pow_get_window_perf_stats(&hc.hb, &stats, scratch) == 0);
+  assert(stats.count == ws);
+  assert(abs_dbl(stats.mean - mean) < 1e-6 * mean);
+  assert(abs_dbl(stats.variance - sq_dev / (double) ws) < 1e-6 * stats.variance);
+  // nearest ranks 19, 34, and 37 of 37
+  assert(stats.min == sorted[0]);
+  assert(stats.p50 == sorted[18]);
+  assert(stats.p90 == sorted[33]);
+  assert(stats.p99 == sorted[36]);
+  assert(stats.max == sorted[36]);
+  assert(hb_acc_pow_get_window_perf_stats(&hc_cols.hb, &cols_stats, scratch) == 0);
+  assert(cols_stats.count == ws);
+  assert(abs_dbl(cols_stats.mean - mean) < 1e-6 * mean);
+  assert(abs_dbl(cols_stats.variance - stats.variance) < 1e-6 * stats.variance);
+  assert(cols_stats.p50 == stats.p50 && cols_stats.p90 == stats.p90 && cols_stats.p99 == stats.p99);
+
+  heartbeat_acc_pow_container_finish(&hc_cols);
+  heartbeat_acc_pow_container_finish(&hc);
+}
+
+static uint64_t time_cb_count = 0;
+static uint64_t time_cb_work = 0;
+static void time_callback(const heartbeat_acc_pow_context* hb) {
+  time_cb_count++;
+  time_cb_work = hb_acc_pow_get_window_work(hb);
+}
+
+static void test_time_window(void) {
+  heartbeat_acc_pow_container hc;
+  heartbeat_acc_pow_context small;
+  heartbeat_acc_pow_record small_buffer[4];
+  heartbeat_window_stats stats;
+  uint64_t i;
+
+  assert(heartbeat_acc_pow_container_init(&hc, 16) == 0);
+  assert(heartbeat_acc_pow_init(&hc.hb, 16, hc.window_buffer, -1, time_callback) == 0);
+  errno = 0;
+  assert(hb_acc_pow_set_window_duration(NULL, 1000) != 0);
+  assert(errno == EINVAL);
+  assert(heartbeat_acc_pow_init_flags(&small, 4, small_buffer, -1, NULL, HEARTBEAT_FLAG_LOCK_FREE) == 0);
+  assert(hb_acc_pow_set_window_duration(&small, 1000) != 0);
+  assert(heartbeat_acc_pow_init(&small, 0, NULL, -1, NULL) == 0);
+  assert(hb_acc_pow_set_window_duration(&small, 1000) != 0);
+  assert(hb_acc_pow_set_window_duration(&hc.hb, 1000) == 0);
+
+  // heartbeats every 100 ns, so the window holds the last 10
+  for (i = 0; i < 35; i++) {
+    heartbeat_acc_pow(&hc.hb, i, 1, i * 100, (i + 1) * 100, 2, i * 10, (i + 1) * 10);
+    assert(hb_acc_pow_get_window_work(&hc.hb) == (i < 10 ? i + 1 : 10));
+  }
+  assert(hb_acc_pow_get_window_time(&hc.hb) == 1000);
+  assert(abs_dbl(hb_acc_pow_get_window_perf(&hc.hb) - 10000000.0) < 1e-6);
+  assert(abs_dbl(hb_acc_pow_get_window_power(&hc.hb) - 100.0) < 1e-9);
+  assert(hb_acc_pow_get_window_perf_stats(&hc.hb, &stats, NULL) == 0);
+  assert(stats.count == 10);
+  // the callback is issued at 1100, 2100, and 3100 ns
+  assert(time_cb_count == 3);
+  assert(time_cb_work == 10);
+
+  // after a gap, the window only holds the new heartbeat and the missed periods are skipped
+  heartbeat_acc_pow(&hc.hb, 35, 3, 9900, 10000, 2, 350, 360);
+  assert(time_cb_count == 4);
+  assert(time_cb_work == 3);
+  assert(hb_acc_pow_get_window_time(&hc.hb) == 100);
+  heartbeat_acc_pow(&hc.hb, 36, 1, 10000, 10099, 2, 360, 370);
+  assert(time_cb_count == 4);
+  heartbeat_acc_pow(&hc.hb, 37, 1, 10099, 10100, 2, 370, 380);
+  assert(time_cb_count == 5);
+  heartbeat_acc_pow_container_finish(&hc);
+
+  // the window is limited by the window buffer
+  assert(heartbeat_acc_pow_init(&small, 4, small_buffer, -1, NULL) == 0);
+  assert(hb_acc_pow_set_window_duration(&small, 1000000) == 0);
+  for (i = 0; i < 10; i++) {
+    heartbeat_acc_pow(&small, i, i, i * 100, (i + 1) * 100, 2, 0, 0);
+  }
+  assert(hb_acc_pow_get_window_work(&small) == 6 + 7 + 8 + 9);
+  assert(hb_acc_pow_get_window_time(&small) == 400);
+
+  // and count-based again without a duration
+  assert(hb_acc_pow_set_window_duration(&small, 0) == 0);
+  heartbeat_acc_pow(&small, 10, 10, 1000, 1100, 2, 0, 0);
+  assert(hb_acc_pow_get_window_work(&small) == 7 + 8 + 9 + 10);
+
+  // lazy rates are only computed for records in the window, not the whole buffer
+  assert(heartbeat_acc_pow_container_init(&hc, 16) == 0);
+  assert(heartbeat_acc_pow_init_flags(&hc.hb, 16, hc.window_buffer, -1, time_callback,
+                                      HEARTBEAT_FLAG_LAZY_RATES) == 0);
+  for (i = 0; i < 16; i++) {
+    hc.window_buffer[i].perf.instant = -1.0;
+  }
+  assert(hb_acc_pow_set_window_duration(&hc.hb, 300) == 0);
+  time_cb_count = 0;
+  for (i = 0; i < 12; i++) {
+    heartbeat_acc_pow(&hc.hb, i, 1, i * 100, (i + 1) * 100, 2, 0, 0);
+  }
+  assert(time_cb_count == 3);
+  assert(equal_dbl(hc.window_buffer[11].perf.instant, -1.0));
+  assert(equal_dbl(hc.window_buffer[9].perf.instant, 10000000.0));
+  for (i = 12; i < 16; i++) {
+    assert(equal_dbl(hc.window_buffer[i].perf.instant, -1.0));
+  }
+  heartbeat_acc_pow_container_finish(&hc);
+}
+
 static void test_hb_acc_pow(void) {
   test_functions_exist();
   test_two_hb();
   test_callback();
   test_bad_arguments();
+  test_lock_free();
+  test_snapshot();
+  test_batch();
+  test_lazy_rates();
+  test_async_log();
+  test_bin_log();
+  test_log_format();
+  test_log_projection();
+  test_compressed_log();
+  test_columns();
+  test_window_stats();
+  test_time_window();
 }
 
 int main(void) {
@@ -0,0 +1,49 @@
+/**
+ * Time source tests.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include <heartbeats-simple.h>
+
+static void test_source(hb_clock_source source) {
+  uint64_t start;
+  uint64_t end;
+  assert(hb_time_init(source) == 0);
+  start = hb_time_now();
+  do {
+    end = hb_time_now();
+  } while (end - start < 1000000);
+  assert(end >= start);
+}
+
+static void test_tsc(void) {
+  uint64_t start;
+  uint64_t end;
+  assert(hb_time_init(HB_CLOCK_TSC) == 0);
+  if (hb_time_get_source() != HB_CLOCK_TSC) {
+    // not invariant or not supported
+    return;
+  }
+  // the TSC is calibrated against the raw monotonic clock
+  start = hb_time_now();
+  assert(hb_time_init(HB_CLOCK_MONOTONIC_RAW) == 0);
+  end = hb_time_now();
+  assert(end + 1000000 >= start);
+  assert(end - start < 1000000000);
+}
+
+int main(void) {
+  assert(hb_time_get_source() == HB_CLOCK_MONOTONIC);
+  assert(hb_time_now() > 0);
+  test_source(HB_CLOCK_MONOTONIC);
+  test_source(HB_CLOCK_MONOTONIC_RAW);
+  test_source(HB_CLOCK_TSC);
+  test_tsc();
+  assert(hb_time_init((hb_clock_source) 100));
+  assert(errno == EINVAL);
+  return 0;
+}
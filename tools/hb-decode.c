@@ -0,0 +1,298 @@
+/**
+ * Convert a binary heartbeat log, raw or compressed, to the text log format.
+ *
+ * Usage: hb-decode [FILE]
+ * Reads from stdin if FILE is not specified, and writes to stdout.
+ *
+ * @author Connor Imes
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "heartbeats-simple.h"
+
+/* Maximum number of records to decode at once */
+#define HB_DECODE_CHUNK 4096
+
+#define HB_BIN_BYTE_ORDER_SWAPPED 0x04030201
+
+static uint16_t swap16(uint16_t v) {
+  return (uint16_t) ((v >> 8) | (v << 8));
+}
+
+static uint32_t swap32(uint32_t v) {
+  return ((v >> 24) & 0xff) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+}
+
+static uint64_t swap64(uint64_t v) {
+  return ((uint64_t) swap32((uint32_t) v) << 32) | swap32((uint32_t) (v >> 32));
+}
+
+static size_t record_size(uint16_t mode) {
+  switch (mode) {
+  case HEARTBEAT_BIN_MODE_HB:
+    return sizeof(heartbeat_record);
+  case HEARTBEAT_BIN_MODE_ACC:
+    return sizeof(heartbeat_acc_record);
+  case HEARTBEAT_BIN_MODE_POW:
+    return sizeof(heartbeat_pow_record);
+  case HEARTBEAT_BIN_MODE_ACC_POW:
+    return sizeof(heartbeat_acc_pow_record);
+  default:
+    return 0;
+  }
+}
+
+static int read_header(FILE* in, heartbeat_bin_header* header, int* swap) {
+  if (fread(header, sizeof(*header), 1, in) != 1) {
+    fprintf(stderr, "hb-decode: failed to read header\n");
+    return -1;
+  }
+  if (memcmp(header->magic, HEARTBEAT_BIN_MAGIC, sizeof(header->magic))) {
+    fprintf(stderr, "hb-decode: not a binary heartbeat log\n");
+    return -1;
+  }
+  *swap = header->byte_order == HB_BIN_BYTE_ORDER_SWAPPED;
+  if (*swap) {
+    header->version = swap16(header->version);
+    header->mode = swap16(header->mode);
+    header->flags = swap32(header->flags);
+    header->record_size = swap32(header->record_size);
+    header->window_size = swap64(header->window_size);
+  } else if (header->byte_order != HEARTBEAT_BIN_BYTE_ORDER) {
+    fprintf(stderr, "hb-decode: unknown byte order\n");
+    return -1;
+  }
+  if (header->version != HEARTBEAT_BIN_VERSION) {
+    fprintf(stderr, "hb-decode: unsupported version: %"PRIu16"\n", header->version);
+    return -1;
+  }
+  if (record_size(header->mode) == 0 || header->record_size != record_size(header->mode)) {
+    fprintf(stderr, "hb-decode: unsupported mode: %"PRIu16", record size: %"PRIu32"\n",
+            header->mode, header->record_size);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Log records in the text format, using a context view of the records.
+ */
+static int log_records(const heartbeat_bin_header* header, void* records, uint64_t count, int fd) {
+  switch (header->mode) {
+  case HEARTBEAT_BIN_MODE_HB: {
+    heartbeat_context view;
+    memset(&view, 0, sizeof(view));
+    view.ws.flags = header->flags;
+    view.ws.buffer_index = count;
+    view.window_buffer = records;
+    return hb_log_window_buffer(&view, fd);
+  }
+  case HEARTBEAT_BIN_MODE_ACC: {
+    heartbeat_acc_context view;
+    memset(&view, 0, sizeof(view));
+    view.ws.flags = header->flags;
+    view.ws.buffer_index = count;
+    view.window_buffer = records;
+    return hb_acc_log_window_buffer(&view, fd);
+  }
+  case HEARTBEAT_BIN_MODE_POW: {
+    heartbeat_pow_context view;
+    memset(&view, 0, sizeof(view));
+    view.ws.flags = header->flags;
+    view.ws.buffer_index = count;
+    view.window_buffer = records;
+    return hb_pow_log_window_buffer(&view, fd);
+  }
+  default: {
+    heartbeat_acc_pow_context view;
+    memset(&view, 0, sizeof(view));
+    view.ws.flags = header->flags;
+    view.ws.buffer_index = count;
+    view.window_buffer = records;
+    return hb_acc_pow_log_window_buffer(&view, fd);
+  }
+  }
+}
+
+static int log_header(const heartbeat_bin_header* header, int fd) {
+  switch (header->mode) {
+  case HEARTBEAT_BIN_MODE_HB:
+    return hb_log_header(fd);
+  case HEARTBEAT_BIN_MODE_ACC:
+    return hb_acc_log_header(fd);
+  case HEARTBEAT_BIN_MODE_POW:
+    return hb_pow_log_header(fd);
+  default:
+    return hb_acc_pow_log_header(fd);
+  }
+}
+
+static int decode_block(const heartbeat_bin_header* header, const void* data, size_t len, void* records,
+                        uint64_t max_records, uint64_t* count, size_t* block_len) {
+  switch (header->mode) {
+  case HEARTBEAT_BIN_MODE_HB:
+    return hb_log_decode_block(data, len, records, max_records, count, block_len);
+  case HEARTBEAT_BIN_MODE_ACC:
+    return hb_acc_log_decode_block(data, len, records, max_records, count, block_len);
+  case HEARTBEAT_BIN_MODE_POW:
+    return hb_pow_log_decode_block(data, len, records, max_records, count, block_len);
+  default:
+    return hb_acc_pow_log_decode_block(data, len, records, max_records, count, block_len);
+  }
+}
+
+/*
+ * Decode compressed blocks, growing the buffers for blocks that don't fit.
+ */
+static int decode_compressed(FILE* in, const heartbeat_bin_header* header, int fd) {
+  unsigned char* data = NULL;
+  void* records = NULL;
+  void* tmp;
+  size_t data_size = HB_DECODE_CHUNK * header->record_size;
+  size_t data_len = 0;
+  size_t pos = 0;
+  size_t block_len;
+  uint64_t max_records = HB_DECODE_CHUNK;
+  uint64_t count;
+  int eof = 0;
+  int ret = -1;
+  if ((data = malloc(data_size)) == NULL || (records = malloc(max_records * header->record_size)) == NULL) {
+    perror("hb-decode: malloc");
+    goto out;
+  }
+  for (;;) {
+    if (pos < data_len &&
+        !decode_block(header, data + pos, data_len - pos, records, max_records, &count, &block_len)) {
+      if (log_records(header, records, count, fd)) {
+        perror("hb-decode: failed to write records");
+        goto out;
+      }
+      pos += block_len;
+      continue;
+    }
+    if (pos < data_len && errno == ENOBUFS) {
+      if ((tmp = realloc(records, 2 * max_records * header->record_size)) == NULL) {
+        perror("hb-decode: realloc");
+        goto out;
+      }
+      records = tmp;
+      max_records *= 2;
+      continue;
+    }
+    if (pos < data_len && errno != EAGAIN) {
+      fprintf(stderr, "hb-decode: invalid compressed block\n");
+      goto out;
+    }
+    if (eof) {
+      if (pos < data_len) {
+        fprintf(stderr, "hb-decode: truncated compressed block\n");
+        goto out;
+      }
+      break;
+    }
+    // keep the partial block, and make room to read the rest of it
+    memmove(data, data + pos, data_len - pos);
+    data_len -= pos;
+    pos = 0;
+    if (data_len == data_size) {
+      if ((tmp = realloc(data, 2 * data_size)) == NULL) {
+        perror("hb-decode: realloc");
+        goto out;
+      }
+      data = tmp;
+      data_size *= 2;
+    }
+    data_len += fread(data + data_len, 1, data_size - data_len, in);
+    if (data_len < data_size) {
+      if (ferror(in)) {
+        fprintf(stderr, "hb-decode: failed to read records\n");
+        goto out;
+      }
+      eof = 1;
+    }
+  }
+  ret = 0;
+out:
+  free(records);
+  free(data);
+  return ret;
+}
+
+static int decode(FILE* in, int fd) {
+  heartbeat_bin_header header;
+  uint64_t* records;
+  size_t words;
+  size_t len;
+  size_t count;
+  size_t i;
+  int swap;
+  int ret = 0;
+  if (read_header(in, &header, &swap)) {
+    return -1;
+  }
+  if (header.flags & HEARTBEAT_FLAG_LOG_COMPRESSED) {
+    if (log_header(&header, fd)) {
+      perror("hb-decode: failed to write header");
+      return -1;
+    }
+    return decode_compressed(in, &header, fd);
+  }
+  // records only contain 64-bit fields
+  words = header.record_size / sizeof(uint64_t);
+  if ((records = malloc(HB_DECODE_CHUNK * header.record_size)) == NULL) {
+    perror("hb-decode: malloc");
+    return -1;
+  }
+  if (log_header(&header, fd)) {
+    perror("hb-decode: failed to write header");
+    free(records);
+    return -1;
+  }
+  // read bytes rather than whole records, so a trailing partial record is noticed
+  while ((len = fread(records, 1, HB_DECODE_CHUNK * header.record_size, in)) > 0) {
+    count = len / header.record_size;
+    if (swap) {
+      for (i = 0; i < count * words; i++) {
+        records[i] = swap64(records[i]);
+      }
+    }
+    if (log_records(&header, records, count, fd)) {
+      perror("hb-decode: failed to write records");
+      ret = -1;
+      break;
+    }
+    if (len % header.record_size != 0 && !ferror(in)) {
+      fprintf(stderr, "hb-decode: truncated record\n");
+      ret = -1;
+      break;
+    }
+  }
+  if (ret == 0 && ferror(in)) {
+    fprintf(stderr, "hb-decode: failed to read records\n");
+    ret = -1;
+  }
+  free(records);
+  return ret;
+}
+
+int main(int argc, char** argv) {
+  FILE* in = stdin;
+  int ret;
+  if (argc > 2 || (argc == 2 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")))) {
+    fprintf(stderr, "Usage: %s [FILE]\n", argv[0]);
+    fprintf(stderr, "Convert a binary heartbeat log to text. Reads from stdin if FILE is not specified.\n");
+    return argc > 2 ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+  if (argc == 2 && (in = fopen(argv[1], "rb")) == NULL) {
+    perror(argv[1]);
+    return EXIT_FAILURE;
+  }
+  ret = decode(in, 1);
+  if (in != stdin) {
+    fclose(in);
+  }
+  return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
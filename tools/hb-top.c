@@ -0,0 +1,314 @@
+/**
+ * Live monitor for processes with registered heartbeat regions (see
+ * heartbeat_shm_register()).
+ * Regions are only read through read-only mappings, so monitoring doesn't cost
+ * the instrumented processes anything.
+ *
+ * Usage: hb-top [-d SECONDS] [-n COUNT] [-b] [-p DIR]
+ *
+ * @author Connor Imes
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include "heartbeats-simple.h"
+
+#define HB_TOP_DEFAULT_DIR "/dev/shm"
+#define HB_TOP_COMM_MAX 32
+
+typedef struct hb_top_region {
+  char path[HEARTBEAT_SHM_NAME_MAX];
+  char comm[HB_TOP_COMM_MAX];
+  heartbeat_shm_reader reader;
+  int seen;
+} hb_top_region;
+
+/* Values for one row, where a NaN is not applicable to the heartbeat variant */
+typedef struct hb_top_row {
+  uint64_t count;
+  double perf_global;
+  double perf_window;
+  double perf_instant;
+  double acc_window;
+  double pwr_window;
+} hb_top_row;
+
+static hb_top_region* regions = NULL;
+static size_t num_regions = 0;
+static size_t max_regions = 0;
+
+static void usage(const char* name) {
+  fprintf(stderr, "Usage: %s [-d SECONDS] [-n COUNT] [-b] [-p DIR]\n", name);
+  fprintf(stderr, "Show heartbeats for processes with registered heartbeat regions.\n");
+  fprintf(stderr, "  -d SECONDS  Refresh interval (default: 1)\n");
+  fprintf(stderr, "  -n COUNT    Number of refreshes, or 0 to refresh until interrupted (default: 0)\n");
+  fprintf(stderr, "  -b          Batch mode: don't clear the screen between refreshes\n");
+  fprintf(stderr, "  -p DIR      Directory of registered regions (default: %s)\n", HB_TOP_DEFAULT_DIR);
+}
+
+static void read_comm(int64_t pid, char* comm, size_t len) {
+  char path[64];
+  FILE* f;
+  snprintf(path, sizeof(path), "/proc/%"PRId64"/comm", pid);
+  comm[0] = '\0';
+  if ((f = fopen(path, "r")) != NULL) {
+    if (fgets(comm, (int) len, f) != NULL) {
+      comm[strcspn(comm, "\n")] = '\0';
+    }
+    fclose(f);
+  }
+  if (comm[0] == '\0') {
+    snprintf(comm, len, "?");
+  }
+}
+
+static int pid_is_alive(int64_t pid) {
+  return kill((pid_t) pid, 0) == 0 || errno == EPERM;
+}
+
+static hb_top_region* find_region(const char* path) {
+  size_t i;
+  for (i = 0; i < num_regions; i++) {
+    if (strcmp(regions[i].path, path) == 0) {
+      return &regions[i];
+    }
+  }
+  return NULL;
+}
+
+static void add_region(const char* path) {
+  hb_top_region* tmp;
+  hb_top_region* region;
+  if (num_regions == max_regions) {
+    max_regions = max_regions == 0 ? 16 : 2 * max_regions;
+    if ((tmp = realloc(regions, max_regions * sizeof(hb_top_region))) == NULL) {
+      max_regions = num_regions;
+      return;
+    }
+    regions = tmp;
+  }
+  region = &regions[num_regions];
+  // regions that are still being initialized are found on the next refresh
+  if (hb_shm_reader_open(&region->reader, path)) {
+    return;
+  }
+  snprintf(region->path, sizeof(region->path), "%s", path);
+  read_comm(region->reader.header->pid, region->comm, sizeof(region->comm));
+  region->seen = 1;
+  num_regions++;
+}
+
+static int compare_regions(const void* a, const void* b) {
+  const hb_top_region* ra = a;
+  const hb_top_region* rb = b;
+  if (ra->reader.header->pid != rb->reader.header->pid) {
+    return ra->reader.header->pid < rb->reader.header->pid ? -1 : 1;
+  }
+  return strcmp(ra->path, rb->path);
+}
+
+/*
+ * Attach to new regions and detach from regions that were unlinked.
+ */
+static int scan(const char* dir_name) {
+  const char* prefix = HEARTBEAT_SHM_REGISTRY_PREFIX + 1;
+  char path[HEARTBEAT_SHM_NAME_MAX];
+  struct dirent* entry;
+  hb_top_region* region;
+  DIR* dir;
+  size_t i;
+  size_t j;
+  if ((dir = opendir(dir_name)) == NULL) {
+    return -1;
+  }
+  for (i = 0; i < num_regions; i++) {
+    regions[i].seen = 0;
+  }
+  while ((entry = readdir(dir)) != NULL) {
+    if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0 ||
+        (size_t) snprintf(path, sizeof(path), "%s/%s", dir_name, entry->d_name) >= sizeof(path)) {
+      continue;
+    }
+    if ((region = find_region(path)) != NULL) {
+      region->seen = 1;
+    } else {
+      add_region(path);
+    }
+  }
+  closedir(dir);
+  for (i = 0, j = 0; i < num_regions; i++) {
+    if (regions[i].seen) {
+      regions[j++] = regions[i];
+    } else {
+      hb_shm_reader_close(&regions[i].reader);
+    }
+  }
+  num_regions = j;
+  qsort(regions, num_regions, sizeof(hb_top_region), &compare_regions);
+  return 0;
+}
+
+static int read_row(const heartbeat_shm_reader* reader, hb_top_row* row) {
+  heartbeat_record rec;
+  heartbeat_acc_record rec_acc;
+  heartbeat_pow_record rec_pow;
+  heartbeat_acc_pow_record rec_acc_pow;
+  uint64_t td_global;
+  row->acc_window = NAN;
+  row->pwr_window = NAN;
+  switch (reader->header->mode) {
+  case HEARTBEAT_BIN_MODE_HB:
+    if (hb_shm_read(reader, &rec)) {
+      return -1;
+    }
+    row->count = rec.id + 1;
+    td_global = rec.td.global;
+    row->perf_global = rec.perf.global;
+    row->perf_window = rec.perf.window;
+    row->perf_instant = rec.perf.instant;
+    break;
+  case HEARTBEAT_BIN_MODE_ACC:
+    if (hb_acc_shm_read(reader, &rec_acc)) {
+      return -1;
+    }
+    row->count = rec_acc.id + 1;
+    td_global = rec_acc.td.global;
+    row->perf_global = rec_acc.perf.global;
+    row->perf_window = rec_acc.perf.window;
+    row->perf_instant = rec_acc.perf.instant;
+    row->acc_window = rec_acc.acc.window;
+    break;
+  case HEARTBEAT_BIN_MODE_POW:
+    if (hb_pow_shm_read(reader, &rec_pow)) {
+      return -1;
+    }
+    row->count = rec_pow.id + 1;
+    td_global = rec_pow.td.global;
+    row->perf_global = rec_pow.perf.global;
+    row->perf_window = rec_pow.perf.window;
+    row->perf_instant = rec_pow.perf.instant;
+    row->pwr_window = rec_pow.pwr.window;
+    break;
+  case HEARTBEAT_BIN_MODE_ACC_POW:
+    if (hb_acc_pow_shm_read(reader, &rec_acc_pow)) {
+      return -1;
+    }
+    row->count = rec_acc_pow.id + 1;
+    td_global = rec_acc_pow.td.global;
+    row->perf_global = rec_acc_pow.perf.global;
+    row->perf_window = rec_acc_pow.perf.window;
+    row->perf_instant = rec_acc_pow.perf.instant;
+    row->acc_window = rec_acc_pow.acc.window;
+    row->pwr_window = rec_acc_pow.pwr.window;
+    break;
+  default:
+    return -1;
+  }
+  if (td_global == 0) {
+    // no heartbeats yet
+    row->count = 0;
+    row->perf_global = NAN;
+    row->perf_window = NAN;
+    row->perf_instant = NAN;
+    row->acc_window = NAN;
+    row->pwr_window = NAN;
+  }
+  return 0;
+}
+
+static void print_value(double val) {
+  if (isnan(val)) {
+    printf(" %14s", "-");
+  } else {
+    printf(" %14.3f", val);
+  }
+}
+
+static void print_regions(int clear) {
+  hb_top_row row;
+  size_t i;
+  if (clear) {
+    printf("\033[H\033[2J");
+  }
+  printf("%-8s %-16s %-24s %12s %14s %14s %14s %14s %14s\n",
+         "PID", "COMMAND", "REGION", "HEARTBEATS", "GLOBAL_PERF", "WINDOW_PERF", "INSTANT_PERF", "WINDOW_ACC",
+         "WINDOW_POWER");
+  for (i = 0; i < num_regions; i++) {
+    if (!pid_is_alive(regions[i].reader.header->pid) || read_row(&regions[i].reader, &row)) {
+      continue;
+    }
+    printf("%-8"PRId64" %-16s %-24s %12"PRIu64,
+           regions[i].reader.header->pid, regions[i].comm, strrchr(regions[i].path, '/') + 1, row.count);
+    print_value(row.perf_global);
+    print_value(row.perf_window);
+    print_value(row.perf_instant);
+    print_value(row.acc_window);
+    print_value(row.pwr_window);
+    printf("\n");
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+  const char* dir = HB_TOP_DEFAULT_DIR;
+  struct timespec interval;
+  double delay = 1.0;
+  unsigned long count = 0;
+  unsigned long i;
+  int batch = 0;
+  int c;
+  while ((c = getopt(argc, argv, "d:n:bp:h")) != -1) {
+    switch (c) {
+    case 'd':
+      delay = strtod(optarg, NULL);
+      break;
+    case 'n':
+      count = strtoul(optarg, NULL, 0);
+      break;
+    case 'b':
+      batch = 1;
+      break;
+    case 'p':
+      dir = optarg;
+      break;
+    case 'h':
+      usage(argv[0]);
+      return EXIT_SUCCESS;
+    default:
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (optind < argc || !(delay > 0)) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  interval.tv_sec = (time_t) delay;
+  interval.tv_nsec = (long) ((delay - (double) interval.tv_sec) * 1000000000.0);
+
+  for (i = 0; count == 0 || i < count; i++) {
+    if (i > 0) {
+      nanosleep(&interval, NULL);
+    }
+    if (scan(dir)) {
+      perror(dir);
+      return EXIT_FAILURE;
+    }
+    print_regions(!batch);
+  }
+
+  for (i = 0; i < num_regions; i++) {
+    hb_shm_reader_close(&regions[i].reader);
+  }
+  free(regions);
+  return EXIT_SUCCESS;
+}